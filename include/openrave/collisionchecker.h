@@ -48,6 +48,13 @@ enum CollisionOptions
     CO_IgnoreCallbacks = 0x100 ///< if set, then will not use the registered collision callbacks.
 };
 
+/// \brief which checks \ref CollisionCheckerBase::CheckCollisionBatch runs, also used as the per-configuration result bitmask
+enum CollisionBatchFlags
+{
+    CBF_Env = 1, ///< collision of the body with the environment, same as CollisionCheckerBase::CheckCollision(KinBodyConstPtr)
+    CBF_Self = 2, ///< self-collision of the body, same as CollisionCheckerBase::CheckStandaloneSelfCollision(KinBodyConstPtr)
+};
+
 /// \brief action to perform whenever a collision is detected between objects
 enum CollisionAction
 {
@@ -146,6 +153,19 @@ public:
 
 typedef CollisionReport COLLISIONREPORT RAVE_DEPRECATED;
 
+/// \brief closest hit of one ray, \see CollisionCheckerBase::CheckCollisionRays
+class OPENRAVE_API RayCollisionResult
+{
+public:
+    RayCollisionResult() : fDistance(0) {
+    }
+
+    KinBody::LinkConstPtr plink; ///< the link that was hit, empty if the ray did not hit anything
+    Vector pos; ///< where the ray hit the link
+    Vector norm; ///< normal of the surface at pos
+    dReal fDistance; ///< distance from RAY::pos to pos
+};
+
 /** \brief <b>[interface]</b> Responsible for all collision checking queries of the environment. <b>If not specified, method is not multi-thread safe.</b> See \ref arch_collisionchecker.
     \ingroup interfaces
  */
@@ -190,6 +210,14 @@ public:
     /// \biref Gets the geometry group that a body is currently using
     virtual const std::string& GetBodyGeometryGroup(KinBodyConstPtr pbody) const OPENRAVE_DUMMY_IMPLEMENTATION;
 
+    /// \brief returns true if the collision queries of this checker can be called from several threads at the same time.
+    ///
+    /// The environment then runs the CheckCollision and CheckStandaloneSelfCollision queries under a shared lock of \ref EnvironmentBase::GetStateMutex
+    /// instead of the environment mutex. The checker has to protect any internal data it updates during a query.
+    virtual bool IsReentrant() const {
+        return false;
+    }
+
     /// \brief initialize the checker with the current environment and gather all current bodies in the environment and put them in its collision space
     virtual bool InitEnvironment() = 0;
 
@@ -290,6 +318,48 @@ public:
     /// \param[out] report [optional] collision report to be filled with data about the collision.
     virtual bool CheckStandaloneSelfCollision(KinBody::LinkConstPtr plink, CollisionReportPtr report = CollisionReportPtr()) = 0;
 
+    /// \brief Checks many configurations of a body in one call.
+    ///
+    /// Equivalent to calling KinBody::SetDOFValues followed by \ref CheckCollision and \ref CheckStandaloneSelfCollision for every configuration, except that checkers can share the setup of the queries across configurations. The values are set with KinBody::CLA_Nothing, so the configurations should already be inside the joint limits. The state of the body is restored before returning. Attached bodies are respected. If CO_ActiveDOFs is set, will only check affected links of the body.
+    /// \param pbody the body whose configurations are checked
+    /// \param pconfigs numconfigs configurations stored one after another, each of them ordered by dofindices
+    /// \param numconfigs number of configurations in pconfigs
+    /// \param dofindices the dof indices of every configuration. If empty, every configuration holds all the dofs of the body
+    /// \param[out] vresults resized to numconfigs. Each entry is the bitmask of \ref CollisionBatchFlags that were in collision for that configuration, 0 if the configuration is free.
+    /// \param checkflags bitmask of \ref CollisionBatchFlags to check
+    /// \param[out] report [optional] collision report filled with the collision of the first colliding configuration
+    /// \return the number of configurations that are in collision
+    virtual int CheckCollisionBatch(KinBodyConstPtr pbody, const dReal* pconfigs, int numconfigs, const std::vector<int>& dofindices, std::vector<uint8_t>& vresults, int checkflags=CBF_Env|CBF_Self, CollisionReportPtr report = CollisionReportPtr());
+
+    /// \brief Checks if the body collides anywhere on the straight line from q0 to q1 in configuration space.
+    ///
+    /// The default implementation discretizes the segment with KinBody::GetDOFResolutions and checks the configurations in order, checkers that support continuous queries can validate the whole segment without a fixed discretization. The values are set with KinBody::CLA_Nothing and the state of the body is restored before returning. Attached bodies are respected.
+    /// \param pbody the body that moves
+    /// \param q0 start configuration ordered by dofindices
+    /// \param q1 end configuration ordered by dofindices
+    /// \param dofindices the dof indices of q0 and q1. If empty, q0 and q1 hold all the dofs of the body
+    /// \param checkflags bitmask of \ref CollisionBatchFlags to check
+    /// \param[out] pfContactTime [optional] if in collision, set to the first time in [0,1] along the segment that was found in collision
+    /// \param[out] report [optional] collision report filled with the first collision found along the segment
+    /// \return true if in collision somewhere along the segment
+    virtual bool CheckContinuousCollision(KinBodyConstPtr pbody, const std::vector<dReal>& q0, const std::vector<dReal>& q1, const std::vector<int>& dofindices, int checkflags=CBF_Env|CBF_Self, dReal* pfContactTime=NULL, CollisionReportPtr report = CollisionReportPtr());
+
+    /// \brief Checks many rays in one call.
+    ///
+    /// Equivalent to calling \ref CheckCollision(const RAY&, CollisionReportPtr) for every ray, or \ref CheckCollision(const RAY&, KinBodyConstPtr, CollisionReportPtr) if pbody is set. As for the single ray queries, the length of RAY::dir is the maximum distance that is checked. The default implementation splits the rays across threads if the checker is reentrant (see \ref IsReentrant) and checks them one at a time otherwise, checkers can cull the geometries for many rays at once.
+    /// \param vrays the rays to check
+    /// \param pbody [optional] if set, only checks the rays against this body. Otherwise checks against all the enabled bodies of the environment.
+    /// \param[out] vresults resized to the number of rays. Each entry holds the closest hit of that ray.
+    /// \return the number of rays that hit something
+    virtual int CheckCollisionRays(const std::vector<RAY>& vrays, KinBodyConstPtr pbody, std::vector<RayCollisionResult>& vresults);
+
+    /// \brief Returns a lower bound of the distance between the body and the static bodies of the environment.
+    ///
+    /// Static bodies are the bodies that are not robots and whose links are all static, see \ref KinBody::IsStatic. Bodies attached to pbody are ignored, and the links of the bodies attached to pbody are part of the query. The default implementation computes the exact distance to every static body with CO_Distance, checkers can answer from a precomputed distance field instead, which returns a smaller but still safe value.
+    /// \param pbody the body whose enabled links are measured
+    /// \return 0 if the body is in collision with a static body, 1e20 if there are no static bodies
+    virtual dReal ComputeStaticClearance(KinBodyConstPtr pbody);
+
     /// \deprecated (13/04/09)
     virtual bool CheckSelfCollision(KinBodyConstPtr pbody, CollisionReportPtr report = CollisionReportPtr()) RAVE_DEPRECATED
     {
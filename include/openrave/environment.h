@@ -44,6 +44,9 @@ using defer_lock_t     = ::std::defer_lock_t;
 using try_to_lock_t    = ::std::try_to_lock_t;
 #endif // OPENRAVE_ENVIRONMENT_RECURSIVE_LOCK
 
+/// \brief readers/writer mutex of the environment state, see \ref EnvironmentBase::GetStateMutex
+using EnvironmentStateMutex = ::boost::shared_mutex;
+
 /// \brief used when adding interfaces to the environment
 enum InterfaceAddMode
 {
@@ -231,6 +234,18 @@ public:
     /// See \ref arch_simulation for more about the simulation thread.
     virtual bool IsSimulationRunning() const = 0;
 
+    /// \brief Sets the number of threads that step the read-only sensors in \ref StepSimulation. <b>[multi-thread safe]</b>
+    ///
+    /// The sensors whose \ref SensorBase::IsSimulationStepReadOnly returns true are stepped concurrently after the physics, the bodies, the modules and all other sensors.
+    /// StepSimulation returns once all of them are done, and since every sensor only writes its own data, the sensor data is the same as when stepping them one at a time.
+    /// The sensors are stepped concurrently only if the current collision checker is reentrant (\ref CollisionCheckerBase::IsReentrant), otherwise they are stepped one at a time.
+    /// Sensor data callbacks can then be called from the threads of the environment.
+    /// \param numthreads the number of threads including the thread calling StepSimulation. 1 (the default) steps all the sensors on the calling thread, <= 0 uses the number of hardware threads.
+    virtual void SetSimulationSensorThreads(int numthreads) = 0;
+
+    /// \brief Returns the number of threads that step the read-only sensors, \see SetSimulationSensorThreads
+    virtual int GetSimulationSensorThreads() const = 0;
+
     /// \brief Return simulation time since the start of the environment (in microseconds). <b>[multi-thread safe]</b>
     ///
     /// See \ref arch_simulation for more about the simulation thread.
@@ -658,6 +673,18 @@ public:
     /// is locked, the user is guaranteed that nnothing will change in the environment.
     virtual EnvironmentMutex& GetMutex() const = 0;
 
+    /// \brief Return the readers/writer mutex of the environment state used by concurrent read-only collision queries.
+    ///
+    /// When the current collision checker is reentrant (\ref CollisionCheckerBase::IsReentrant), the const collision queries of the
+    /// environment lock this mutex shared instead of locking \ref GetMutex, so queries from several threads can run at the same time.
+    /// The environment locks it exclusively when adding or removing bodies and when changing the collision checker, and the
+    /// bodies lock it exclusively when their transforms, joint values, enable states or grabbed bodies change (see \ref EnvironmentStateExclusiveLock).
+    /// Threads that modify other body properties while other threads are running such queries should also lock it exclusively.
+    virtual EnvironmentStateMutex& GetStateMutex() const = 0;
+
+    /// \brief returns true if the collision queries run under a shared lock of \ref GetStateMutex, which is the case when the current collision checker is reentrant.
+    virtual bool IsConcurrentCollisionQueryEnabled() const = 0;
+
     /// \name 3D plotting methods.
     /// \anchor env_plotting
     //@{
@@ -877,6 +904,11 @@ public:
         /// \param vInputToBodyInfoMapping maps indices into rEnvInfo["bodies"] into indices of _vBodyInfos: rEnvInfo["bodies"][i] -> _vBodyInfos[vInputToBodyInfoMapping[i]]. This forces certain _vBodyInfos to get updated with specific input. Use -1 for no mapping
         void DeserializeJSONWithMapping(const rapidjson::Value& rEnvInfo, dReal fUnitScale, int options, const std::vector<int>& vInputToBodyInfoMapping);
 
+        /// \brief same as above, except the body infos are decoded on up to numThreads threads.
+        ///
+        /// The resulting _vBodyInfos is the same as when decoding one body at a time.
+        void DeserializeJSONWithMapping(const rapidjson::Value& rEnvInfo, dReal fUnitScale, int options, const std::vector<int>& vInputToBodyInfoMapping, int numThreads);
+
         std::string _description;   ///< environment description
         std::vector<std::string> _keywords;  ///< some string values for describinging the environment
         Vector _gravity = Vector(0,0,-9.797930195020351);  ///< gravity and gravity direction of the environment
@@ -918,6 +950,37 @@ public:
     /// \param updateMode one of UFIM_X
     virtual void UpdateFromInfo(const EnvironmentBaseInfo& info, std::vector<KinBodyPtr>& vCreatedBodies, std::vector<KinBodyPtr>& vModifiedBodies, std::vector<KinBodyPtr>& vRemovedBodies, UpdateFromInfoMode updateMode) = 0;
 
+    /// \brief keeps track of what a mirrored environment received from \ref ExtractDelta. A default constructed stamp makes the next delta carry every body.
+    class OPENRAVE_API DeltaStamp
+    {
+public:
+        struct BodyStamp
+        {
+            KinBodyWeakPtr pbody; ///< to detect bodies that were removed and added again with the same id
+            int updateStamp = 0; ///< \see KinBody::GetUpdateStamp
+            uint32_t structureRevision = 0; ///< \see KinBody::GetStructureRevision
+            std::string grabbedHash; ///< concatenated KinBody::GrabbedInfo::GetGrabbedInfoHash of the grabbed bodies
+        };
+
+        void Reset() {
+            _mapBodyStamps.clear();
+        }
+
+        std::map<std::string, BodyStamp> _mapBodyStamps; ///< indexed by body id
+    };
+
+    /// \brief writes the changes since stamp as a compact binary delta that \ref ApplyDelta of another environment can apply, then updates stamp to the current state.
+    ///
+    /// Bodies that are new or whose structure revision changed are written as full infos. The other bodies only carry their dof values, transform and link enable states when their update stamp changed, and their grabbed infos when those changed. Bodies without an id cannot be tracked and are skipped.
+    /// \param odelta binary stream to write into
+    /// \param stamp[in,out] what the receiver already has
+    virtual void ExtractDelta(std::ostream& odelta, DeltaStamp& stamp);
+
+    /// \brief applies a delta written by \ref ExtractDelta. The bodies are matched by id.
+    ///
+    /// \return false if the delta is malformed, in which case the environment could be partially updated
+    virtual bool ApplyDelta(std::istream& idelta);
+
     int _revision = 0;  ///< environment current revision
     std::string _description;   ///< environment description
     std::vector<std::string> _keywords;  ///< some string values for describinging the environment
@@ -937,6 +1000,44 @@ private:
     int __nUniqueId;         ///< \see RaveGetEnvironmentId
 };
 
+/// \brief Exclusive lock of \ref EnvironmentBase::GetStateMutex taken while the state of the bodies changes.
+///
+/// Only locks the mutex when the environment runs concurrent collision queries (\ref EnvironmentBase::IsConcurrentCollisionQueryEnabled) or bAlways is set.
+/// The locks of one thread nest, so the state changes made while the mutex is already locked by the thread (for example moving the grabbed bodies) do not lock it again.
+/// \throw openrave_exception with ORE_InvalidState if the thread is running a concurrent collision query, since the lock would never be acquired.
+class OPENRAVE_API EnvironmentStateExclusiveLock
+{
+public:
+    EnvironmentStateExclusiveLock(const EnvironmentBase& env, bool bAlways=false);
+    ~EnvironmentStateExclusiveLock();
+
+    void lock();
+    void unlock();
+
+private:
+    const EnvironmentBase& _env;
+    bool _bAlways;
+    bool _bLocked; ///< true if this instance locked the mutex
+};
+
+/// \brief Shared lock of \ref EnvironmentBase::GetStateMutex taken by concurrent collision queries.
+///
+/// Does not lock the mutex if the thread already holds it shared or exclusively (\ref EnvironmentStateExclusiveLock), so queries called from inside
+/// state changes or collision callbacks do not deadlock.
+class OPENRAVE_API EnvironmentStateSharedLock
+{
+public:
+    EnvironmentStateSharedLock(EnvironmentStateMutex& mutex, defer_lock_t);
+    ~EnvironmentStateSharedLock();
+
+    void lock();
+    void unlock();
+
+private:
+    EnvironmentStateMutex& _mutex;
+    bool _bLocked; ///< true if this instance locked the mutex
+};
+
 } // end namespace OpenRAVE
 
 #endif
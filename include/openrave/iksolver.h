@@ -282,6 +282,27 @@ public:
      */
     virtual bool SolveAll(const IkParameterization& param, const std::vector<dReal>& vFreeParameters, int filteroptions, std::vector<IkReturnPtr>& ikreturns);
 
+    /** \brief Return a joint configuration for each of many end effector transforms.
+
+        Equivalent to calling \ref Solve(const IkParameterization&, const std::vector<dReal>&, int, IkReturnPtr) for every parameterization. Solvers can save the robot state, enumerate the free parameters and set up the filters once for all of them.
+        \param[in] vparams the poses the end effector has to achieve in the manipulator base's coordinate system.
+        \param[in] q0 Return solutions nearest to the given configuration q0 in terms of the joint distance. If q0 is empty, returns the first solution found for every pose
+        \param[in] filteroptions A bitmask of \ref IkFilterOptions values controlling what is checked for each ik solution.
+        \param[out] vikreturns resized to the number of poses. vikreturns[i] is always set and holds the output of vparams[i], its action is IKRA_Success if a solution was found.
+        \return the number of poses that have a solution
+     */
+    virtual int SolveBatch(const std::vector<IkParameterization>& vparams, const std::vector<dReal>& q0, int filteroptions, std::vector<IkReturnPtr>& vikreturns);
+
+    /** \brief Return all joint configurations for each of many end effector transforms.
+
+        Equivalent to calling \ref SolveAll(const IkParameterization&, int, std::vector<IkReturnPtr>&) for every parameterization, see \ref SolveBatch.
+        \param[in] vparams the poses the end effector has to achieve in the manipulator base's coordinate system.
+        \param[in] filteroptions A bitmask of \ref IkFilterOptions values controlling what is checked for each ik solution.
+        \param[out] vvikreturns resized to the number of poses. vvikreturns[i] holds all the solutions of vparams[i].
+        \return the number of poses that have at least one solution
+     */
+    virtual int SolveAllBatch(const std::vector<IkParameterization>& vparams, int filteroptions, std::vector< std::vector<IkReturnPtr> >& vvikreturns);
+
     /// \brief returns true if the solver supports a particular ik parameterization as input.
     virtual bool Supports(IkParameterizationType iktype) const OPENRAVE_DUMMY_IMPLEMENTATION;
 
@@ -299,6 +320,9 @@ public:
      */
     virtual IkReturnAction CallFilters(const IkParameterization& param, IkReturnPtr ikreturn=IkReturnPtr(), int32_t minpriority=IKSP_MinPriority, int32_t maxpriority=IKSP_MaxPriority) OPENRAVE_DUMMY_IMPLEMENTATION;
 
+    /// \brief returns true if custom filters or finish callbacks are registered. They are not copied when the solver is cloned.
+    bool HasRegisteredCallbacks() const;
+
     /// \brief returns the kinematics structure hash this ik solver is encoded to. Checked with \ref RobotBase::Manipulator::GetKinematicsStructureHash()
     virtual const std::string& GetKinematicsStructureHash() const OPENRAVE_DUMMY_IMPLEMENTATION;
     
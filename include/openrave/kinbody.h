@@ -224,6 +224,36 @@ public:
 
 typedef boost::shared_ptr<KinematicsGenerator> KinematicsGeneratorPtr;
 
+/// \brief Returns the built-in forward kinematics generator, use with KinBody::SetKinematicsGenerator.
+///
+/// If all the moving joints of a body are single-axis revolute/prismatic joints without mimic equations or closed loops, generates an unrolled forward kinematics routine with the joint axes and constant offsets precomputed.
+/// Bodies with exactly the same joint offsets and axes share one routine. For other bodies no functions are generated, so KinBody uses its generic forward kinematics.
+OPENRAVE_API KinematicsGeneratorPtr GetUnrolledKinematicsGenerator();
+
+/// \brief sphere approximation of the geometries of every link of a body, used to answer collision queries before calling the collision checker.
+///
+/// All spheres are in the frame of their link and Vector::w is the radius.
+class OPENRAVE_API LinkSphereTree
+{
+public:
+    struct LinkSpheres
+    {
+        Vector vroot; ///< encloses all the outer spheres. If the radius is negative, the link has no geometries.
+        std::vector<Vector> vouter; ///< union covers all the geometries of the link, a point outside of all of them is outside of the link
+        std::vector<Vector> vinner; ///< every sphere is inside of a solid geometry (box, sphere, cylinder) of the link, can be empty
+    };
+
+    std::string kinematicsGeometryHash; ///< KinBody::GetKinematicsGeometryHash of the body the tree was built for
+    std::vector<LinkSpheres> vlinks; ///< indexed by link index
+};
+
+typedef boost::shared_ptr<LinkSphereTree const> LinkSphereTreeConstPtr;
+
+/// \brief Returns the sphere approximation of the current geometries of the links of body.
+///
+/// The trees are cached per the exact geometries of the links, so bodies loaded from the same model share one tree.
+OPENRAVE_API LinkSphereTreeConstPtr GetLinkSphereTree(const KinBody& body);
+
 
 /// \brief checks if link is enabled from vector of link enable state mask
 /// intended to be used on return value of GetLinkEnableStatesMasks()
@@ -981,6 +1011,8 @@ public:
         int Compare(const LinkInfo& rhs, int linkCompareOptions, dReal fUnitScale, dReal fEpsilon) const;
 
         /// \brief converts the unit scale of the link properties and geometries
+        ///
+        /// The geometry infos are replaced by scaled copies, so infos shared with other links are not modified.
         void ConvertUnitScale(dReal fUnitScale);
 
         inline const std::string& GetId() const {
@@ -2928,6 +2960,9 @@ private:
     /// \return true if any link of the KinBody is enabled
     bool IsEnabled() const;
 
+    /// \return true if the KinBody has links and all of them are static, see \ref Link::IsStatic
+    bool IsStatic() const;
+
     /// \brief Sets all the links as visible or not visible.
     ///
     /// \return true if changed
@@ -3284,6 +3319,31 @@ private:
         return _nUpdateStampId;
     }
 
+    /// \brief Return the update stamp at which GetChangedLinksMasks was computed.
+    ///
+    /// When SetDOFValues is called with a subset of the dofs, only the links downstream of those dofs are recomputed.
+    /// If GetUpdateStamp() equals this stamp, then going from stamp GetChangedLinksBaseUpdateStamp() to the current stamp only moved the links in GetChangedLinksMasks.
+    /// Every recomputed link increments the stamp, so the two stamps can differ by more than one.
+    /// Otherwise any link could have changed.
+    inline int GetChangedLinksUpdateStamp() const {
+        return _nChangedLinksUpdateStamp;
+    }
+
+    /// \brief Return the update stamp the body had before the partial SetDOFValues that computed GetChangedLinksMasks. \see GetChangedLinksUpdateStamp
+    inline int GetChangedLinksBaseUpdateStamp() const {
+        return _nChangedLinksBaseUpdateStamp;
+    }
+
+    /// \brief Return the bit masks of the links moved by the last partial SetDOFValues, use with IsLinkStateBitEnabled. \see GetChangedLinksUpdateStamp
+    inline const std::vector<uint64_t>& GetChangedLinksMasks() const {
+        return _vChangedLinksMasks;
+    }
+
+    /// \brief Return a revision that increments every time the body changes in a way other than its link transforms, link enable states, grabbed bodies or active dofs. For example when geometries change.
+    inline uint32_t GetStructureRevision() const {
+        return _nStructureRevision;
+    }
+
     /// \brief Increments the unique id that indicates the number of transformation state changes of any link. Used to check if robot state has changed.
     void IncrementUpdateStamp(const int inc=1) {
         _nUpdateStampId += inc;
@@ -3532,6 +3592,11 @@ private:
     /// \brief Associate the kinbody's current kinematics geometry hash with a forward kinematics generator
     virtual void SetKinematicsGenerator(KinematicsGeneratorPtr pGenerator);
 
+    /// \brief returns the kinematics functions generated for the current kinematics, empty if the generic forward kinematics is used
+    inline const KinematicsFunctionsPtr& GetKinematicsFunctions() const {
+        return _pCurrentKinematicsFunctions;
+    }
+
     /// \brief gets the associated file entries
     inline const boost::shared_ptr<rapidjson::Document>& GetAssociatedFileEntries() const {
         return _prAssociatedFileEntries;
@@ -3583,6 +3648,21 @@ protected:
     /// recomputes the hashes if geometry changed.
     virtual void _PostprocessChangedParameters(uint32_t parameters);
 
+    /// \brief clamps the values of one joint to its limits depending on checklimits. Writes joint.GetDOF() values to pclampedvalues, which can be the same as pvalues.
+    void _ClampJointValuesToLimits(const Joint& joint, const dReal* pvalues, dReal* pclampedvalues, uint32_t checklimits) const;
+
+    /// \brief fills _vJointsToUpdateCache with the joints that have to be recomputed when only dofindices change.
+    ///
+    /// \return false if all the links have to be recomputed
+    bool _ComputeJointsToUpdate(const std::vector<int>& dofindices);
+
+    /// \brief tests the non-adjacent link pairs that CheckStandaloneSelfCollision would check with the spheres of GetLinkSphereTree.
+    ///
+    /// \param adjacentoptions passed to GetNonAdjacentLinks
+    /// \param bAllowColliding if false, never returns -1 and stops at the first pair that is not clearly free
+    /// \return 1 if all pairs are clearly free, -1 if a pair is clearly colliding, 0 if the collision checker has to decide
+    int _PrecheckSelfCollisionWithSpheres(int adjacentoptions, bool bAllowColliding) const;
+
     /// \brief Return true if two bodies should be considered as one during collision (ie one is grabbing the other)
     bool _IsAttached(const KinBody &body, std::set<KinBodyConstPtr>& setChecked) const;
 
@@ -3667,7 +3747,13 @@ protected:
     mutable std::vector< boost::array<dReal, 3> > _vPassiveJointValuesCache;
     mutable std::vector< boost::array<dReal, 3> > _vPassiveJointAccelerationsCache;
     mutable std::vector<uint8_t> _vLinksVisitedCache;
+    std::vector<uint8_t> _vJointsToUpdateCache; ///< indexed by joint index (passive joints come after the active joints), \see _ComputeJointsToUpdate
+    std::vector<uint8_t> _vLinksMovedCache;
     mutable std::vector<dReal> _vTempMimicValues, _vTempMimicValues2, _vTempMimicValues3;
+    mutable LinkSphereTreeConstPtr _pLinkSphereTreeCache; ///< \see _PrecheckSelfCollisionWithSpheres
+    mutable std::vector<dReal> _vLinkSpheresWorldCache; ///< outer spheres of the links in world coordinates, 4 arrays (x, y, z, radius) per link. \see _PrecheckSelfCollisionWithSpheres
+    mutable std::vector<size_t> _vLinkSpheresWorldOffsetsCache; ///< offset of each link in _vLinkSpheresWorldCache
+    mutable std::vector<uint8_t> _vLinkSpheresWorldComputedCache; ///< 1 if the spheres of the link are in _vLinkSpheresWorldCache for the current call
 
 
     ConfigurationSpecification _spec;
@@ -3678,6 +3764,10 @@ protected:
 
     int _environmentBodyIndex; ///< \see GetEnvironmentBodyIndex
     mutable int _nUpdateStampId; ///< \see GetUpdateStamp
+    int _nChangedLinksUpdateStamp; ///< \see GetChangedLinksUpdateStamp
+    int _nChangedLinksBaseUpdateStamp; ///< \see GetChangedLinksBaseUpdateStamp
+    uint32_t _nStructureRevision = 0; ///< \see GetStructureRevision
+    std::vector<uint64_t> _vChangedLinksMasks; ///< \see GetChangedLinksMasks
     uint32_t _nParametersChanged; ///< set of parameters that changed and need callbacks
     ManageDataPtr _pManageData;
     uint32_t _nHierarchyComputed; ///< 2 if the joint heirarchy and other cached information is computed. 1 if the hierarchy information is computing
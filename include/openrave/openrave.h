@@ -321,6 +321,7 @@ enum CloningOptions {
     Clone_Modules = 0x0020, ///< if specified, will clone the modules attached to the environment
     Clone_PassOnMissingBodyReferences=0x00008000, ///< if specified, then will not throw an exception if a body reference is missing in the environment. For example, the grabbed body in GrabbedInfo
     Clone_IgnoreGrabbedBodies = 0x00010000, ///< if specified, then will not clone _vGrabbedBodies when cloning a KinBody/Robot.
+    Clone_ShareGeometries = 0x00020000, ///< if specified, the extra geometry groups of the cloned links (LinkInfo::_mapExtraGeometries) point to the GeometryInfo objects of the source instead of deep copies of them. The group lists themselves are still copied, so adding, removing or setting group geometries only affects the clone, and LinkInfo::ConvertUnitScale scales copies of the infos. The active geometries of the links and their meshes are always copied. Clone_All includes it, pass Clone_All&~Clone_ShareGeometries to deep copy the groups too.
     Clone_All = 0xffffffff,
 };
 
@@ -40,6 +40,7 @@ enum ConstraintFilterOptions
     CFO_FromPathSampling=0x00080000, ///< if set, will use \ref NSO_FromPathSampling for the _neighstatefn
     CFO_FromPathShortcutting=0x00100000, ///< if set, will use \ref NSO_FromPathShortcutting for the _neighstatefn
     CFO_FromTrajectorySmoother=0x00200000, ///< if set, will use \ref NSO_FromTrajectorySmoother for the _neighstatefn
+    CFO_CheckInBisectionOrder=0x00400000, ///< if set, the interpolated configurations of a segment are checked starting from the midpoint and then recursively bisecting the sub-segments instead of going from start to end. Segments usually collide somewhere in the middle, so this finds invalid segments with fewer checks. Used for both linearly and quadratically interpolated segments. The states are queued in blocks, so a block is checked as soon as it is full. The returned code and ConstraintFilterReturn describe the first invalid state found, which is not necessarily the earliest invalid state of the segment, and ConstraintFilterReturn::_configurations is cut at that state.
     CFO_FinalValuesNotReached=0x40000000, ///< if set, then the final values of the interpolation have not been reached, although a close interpolation has been computed. This happens when manipulator constraints are used.
     CFO_StateSettingError=0x80000000, ///< error when the state setting function (or neighbor function) breaks
     CFO_RecommendedOptions = 0x0000ffff, ///< recommended options that all plugins should use by default
@@ -733,11 +733,13 @@ typedef boost::shared_ptr<WorkspaceTrajectoryParameters const> WorkspaceTrajecto
 class OPENRAVE_API RRTParameters : public PlannerBase::PlannerParameters
 {
 public:
-    RRTParameters() : _minimumgoalpaths(1), _bProcessing(false) {
+    RRTParameters() : _minimumgoalpaths(1), _nNearestNeighborType(0), _bProcessing(false) {
         _vXMLParameters.push_back("minimumgoalpaths");
+        _vXMLParameters.push_back("nearestneighbortype");
     }
 
     size_t _minimumgoalpaths; ///< minimum number of goals to connect to before exiting. the goal with the shortest path is returned.
+    int _nNearestNeighborType; ///< the nearest neighbor search of the rrt trees. if 0, then traverse the cover tree with _distmetricfn. if 1, then scan all the nodes with a vectorized weighted euclidean distance using the robot active dof weights, only use when _distmetricfn is the default weighted euclidean metric (SimpleDistanceMetric). Planners fall back to 0 if the active dofs have circular joints or affine dofs.
 
 protected:
     bool _bProcessing;
@@ -747,6 +749,7 @@ protected:
             return false;
         }
         O << "<minimumgoalpaths>" << _minimumgoalpaths << "</minimumgoalpaths>" << std::endl;
+        O << "<nearestneighbortype>" << _nNearestNeighborType << "</nearestneighbortype>" << std::endl;
         if( !(options & 1) ) {
             O << _sExtraParameters << std::endl;
         }
@@ -764,7 +767,7 @@ protected:
         case PE_Ignore: return PE_Ignore;
         }
 
-        _bProcessing = name=="minimumgoalpaths";
+        _bProcessing = name=="minimumgoalpaths" || name=="nearestneighbortype";
         return _bProcessing ? PE_Support : PE_Pass;
     }
 
@@ -774,6 +777,9 @@ protected:
             if( name == "minimumgoalpaths") {
                 _ss >> _minimumgoalpaths;
             }
+            else if( name == "nearestneighbortype") {
+                _ss >> _nNearestNeighborType;
+            }
             else {
                 RAVELOG_WARN(str(boost::format("unknown tag %s\n")%name));
             }
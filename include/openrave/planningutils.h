@@ -479,9 +479,30 @@ protected:
     virtual int _SetAndCheckState(PlannerBase::PlannerParametersConstPtr params, const std::vector<dReal>& vdofvalues, const std::vector<dReal>& vdofvelocities, const std::vector<dReal>& vdofaccels, int options, ConstraintFilterReturnPtr filterreturn);
     virtual void _PrintOnFailure(const std::string& prefix);
 
+    /// \brief sets the state and records it so that it is checked later by _CheckQueuedStates. Used when checking in \ref CFO_CheckInBisectionOrder.
+    ///
+    /// \param numfilled the number of configurations added to filterreturn->_configurations for this state
+    virtual int _SetAndQueueState(PlannerBase::PlannerParametersConstPtr params, const std::vector<dReal>& vdofvalues, const std::vector<dReal>& vdofvelocities, dReal fTime, int numfilled, ConstraintFilterReturnPtr filterreturn);
+
+    /// \brief checks the queued states starting from the middle one and recursively bisecting, and clears the queue. Returns at the first invalid state found.
+    ///
+    /// The states before the invalid one are not checked, so it is not necessarily the earliest invalid state of the queue. If filterreturn is set, it describes the invalid state that was found and its configurations are cut at that state.
+    /// If all states are valid, the last queued state is set again since the caller continues from it.
+    virtual int _CheckQueuedStates(PlannerBase::PlannerParametersConstPtr params, const std::vector<dReal>& vdofaccels, int options, ConstraintFilterReturnPtr filterreturn);
+
+    /// \brief a state recorded by _SetAndQueueState
+    struct QueuedState
+    {
+        dReal fTime; ///< time of the state in the segment
+        size_t numFilledConfigurations; ///< size of filterreturn->_configurationtimes once this state has been added
+    };
+
     PlannerBase::PlannerParametersWeakConstPtr _parameters;
     std::vector<dReal> _vtempconfig, _vtempvelconfig, dQ, _vtempveldelta, _vtempacceldelta, _vtempaccelconfig, _vtempjerkconfig, _vperturbedvalues, _vcoeff2, _vcoeff1, _vprevtempconfig, _vprevtempvelconfig, _vprevtempaccelconfig, _vtempconfig2, _vdiffconfig, _vdiffvelconfig, _vdiffaccelconfig, _vstepconfig; ///< in configuration space
     std::vector<dReal> _vrawroots, _vrawcoeffs;
+    std::vector<dReal> _vqueuedconfigs, _vqueuedvelconfigs; ///< values and velocities of the states recorded by _SetAndQueueState, one after another
+    std::vector<QueuedState> _vqueuedstates;
+    std::vector< std::pair<int, int> > _vbisectionranges; ///< cache for _CheckQueuedStates
     std::vector<std::vector<dReal> > _valldofscoeffs, _valldofscriticalpoints, _valldofscriticalvalues;
     CollisionReportPtr _report;
     std::list<KinBodyPtr> _listCheckBodies;
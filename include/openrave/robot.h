@@ -311,6 +311,22 @@ public:
         bool FindIKSolutions(const IkParameterization& param, int filteroptions, std::vector<IkReturnPtr>& vikreturns) const;
         bool FindIKSolutions(const IkParameterization& param, const std::vector<dReal>& vFreeParameters, int filteroptions, std::vector<IkReturnPtr>& vikreturns) const;
 
+        /// \brief Find a close solution to the current robot's joint values for each of many end effector transforms.
+        ///
+        /// Equivalent to calling FindIKSolution for every transform, except the ik solver can share its setup across all of them, see \ref IkSolverBase::SolveBatch.
+        /// \param vparams The transformations of the end-effector in the global coord system
+        /// \param[in] filteroptions A bitmask of \ref IkFilterOptions values controlling what is checked for each ik solution.
+        /// \param[out] vikreturns resized to the number of transforms, vikreturns[i] holds the output of vparams[i]
+        /// \param numthreads If > 1, the transforms are split across this many threads, each solving with the manipulator of its own clone of the environment. If <= 0, uses the number of hardware threads. The transforms are solved on the calling thread if the ik solver has registered filters or finish callbacks since they are not cloned.
+        /// \return the number of transforms that have a solution
+        int FindIKSolutionBatch(const std::vector<IkParameterization>& vparams, int filteroptions, std::vector<IkReturnPtr>& vikreturns, int numthreads=1) const;
+
+        /// \brief Find all the IK solutions for each of many end effector transforms, see \ref FindIKSolutionBatch
+        ///
+        /// \param[out] vvikreturns resized to the number of transforms, vvikreturns[i] holds all the solutions of vparams[i]
+        /// \return the number of transforms that have at least one solution
+        int FindIKSolutionsBatch(const std::vector<IkParameterization>& vparams, int filteroptions, std::vector< std::vector<IkReturnPtr> >& vvikreturns, int numthreads=1) const;
+
         /** \brief returns the parameterization of a given IK type for the current manipulator position.
 
             Ideally pluging the returned ik parameterization into FindIkSolution should return the a manipulator configuration
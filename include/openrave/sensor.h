@@ -571,6 +571,13 @@ public:
     /// Only valid if this sensor is simulation based. A sensor hooked up to a real device can ignore this call
     virtual bool SimulationStep(dReal fTimeElapsed) OPENRAVE_DUMMY_IMPLEMENTATION;
 
+    /// \brief returns true if \ref SimulationStep only reads the environment and writes the data of this sensor.
+    ///
+    /// Such sensors do not move bodies, change the collision checker options, or lock the environment mutex, so the environment can step them concurrently with other read-only sensors, see \ref EnvironmentBase::SetSimulationSensorThreads.
+    virtual bool IsSimulationStepReadOnly() const {
+        return false;
+    }
+
     /// \brief Returns the sensor geometry. This method is thread safe.
     ///
     /// \param type the requested sensor type to create. A sensor can support many types. If type is ST_Invalid, then returns any structure that represents the geometry.
@@ -115,6 +115,16 @@ public:
      */
     virtual void SamplePoints(std::vector<dReal>& data, const std::vector<dReal>& times, const ConfigurationSpecification& spec) const;
 
+    /** \brief bulk samples the trajectory given an array of increasing times into a caller-provided buffer using the trajectory's specification.
+
+        Because the times are increasing, implementations can walk the waypoints in a single pass. Times that are not increasing are still sampled correctly, but slower.
+        The default implementation calls \ref Sample for every time.
+        \param pdata[out] the sampled points, has to hold numtimes*GetConfigurationSpecification().GetDOF() values
+        \param ptimes[in] the times to sample
+        \param numtimes[in] the number of times to sample
+     */
+    virtual void SamplePoints(dReal* pdata, const dReal* ptimes, size_t numtimes) const;
+
     /** \brief bulk samples the trajectory evenly given a delta time using the trajectory's specification.
 
         \param data[out] the sampled points depending on the times
@@ -163,7 +163,6 @@ public:
 
         _pgeom.reset(new BaseFlashLidar3DGeom());
         _pdata.reset(new LaserSensorData());
-        _report.reset(new CollisionReport());
 
         _bRenderData = false;
         _bRenderGeometry = true;
@@ -227,7 +226,6 @@ public:
 
             RAY r;
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(CO_Distance);
             Transform t;
 
             {
@@ -240,6 +238,8 @@ public:
                 r.pos = t.trans;
                 _pdata->positions.at(0) = t.trans;
 
+                _vrays.resize(_pgeom->width*_pgeom->height);
+                _vraydirs.resize(_vrays.size());
                 for(int w = 0; w < _pgeom->width; ++w) {
                     for(int h = 0; h < _pgeom->height; ++h) {
                         Vector vdir;
@@ -250,29 +250,30 @@ public:
                         r.dir = _pgeom->max_range*vdir;
 
                         int index = w*_pgeom->height+h;
-
-                        if( GetEnv()->CheckCollision(r, _report)) {
-                            _pdata->ranges[index] = vdir*_report->minDistance;
-                            _pdata->intensity[index] = 1;
-                            // store the colliding bodies
-                            KinBody::LinkConstPtr plink = !!_report->plink1 ? _report->plink1 : _report->plink2;
-                            if( !!plink ) {
-                                _databodyids[index] = plink->GetParent()->GetEnvironmentBodyIndex();
-                            }
-                        }
-                        else {
-                            _databodyids[index] = 0;
-                            _pdata->ranges[index] = vdir*_pgeom->max_range;
-                            _pdata->intensity[index] = 0;
-                        }
+                        _vrays[index] = r;
+                        _vraydirs[index] = vdir;
                     }
                 }
 
-                _report->Reset();
+                // check all the pixels at once so that the checker can share the culling between neighboring rays
+                GetEnv()->GetCollisionChecker()->CheckCollisionRays(_vrays, KinBodyConstPtr(), _vrayresults);
+                for(size_t index = 0; index < _vrays.size(); ++index) {
+                    const Vector& vdir = _vraydirs[index];
+                    const RayCollisionResult& result = _vrayresults[index];
+                    if( !!result.plink ) {
+                        _pdata->ranges[index] = vdir*result.fDistance;
+                        _pdata->intensity[index] = 1;
+                        // store the colliding bodies
+                        _databodyids[index] = result.plink->GetParent()->GetEnvironmentBodyIndex();
+                    }
+                    else {
+                        _databodyids[index] = 0;
+                        _pdata->ranges[index] = vdir*_pgeom->max_range;
+                        _pdata->intensity[index] = 0;
+                    }
+                }
             }
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(0);
-
             if( _bRenderData ) {
                 // If can render, check if some time passed before last update
                 list<GraphHandlePtr> listhandles;
@@ -320,6 +321,11 @@ public:
         return true;
     }
 
+    /// the rays only read the bodies, and the results are written to the data of the sensor
+    virtual bool IsSimulationStepReadOnly() const {
+        return true;
+    }
+
     virtual SensorGeometryConstPtr GetSensorGeometry(SensorType type)
     {
         if(( type == ST_Invalid) ||( type == ST_Laser) ) {
@@ -445,7 +451,9 @@ protected:
     boost::shared_ptr<BaseFlashLidar3DGeom> _pgeom;
     boost::shared_ptr<LaserSensorData> _pdata;
     vector<int> _databodyids;     ///< if non 0, for each point in _data, specifies the body that was hit
-    CollisionReportPtr _report;
+    std::vector<RAY> _vrays; ///< cache of the rays of one scan, indexed like the ranges
+    std::vector<Vector> _vraydirs; ///< cache of the unit direction of each ray of one scan
+    std::vector<RayCollisionResult> _vrayresults; ///< cache
     // more geom stuff
     RaveVector<float> _vColor;
     dReal _iKK[4];     // inverse of KK
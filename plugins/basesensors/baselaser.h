@@ -168,7 +168,6 @@ public:
         _pgeom->max_range = 100;
         _fTimeToScan = 0;
         _vColor = RaveVector<float>(0.5f,0.5f,1,1);
-        _report.reset(new CollisionReport());
         _bPower = false;
         _bRenderData = false;
         _bRenderGeometry = true;
@@ -224,7 +223,6 @@ public:
             Vector rotaxis(0,0,1);
             RAY r;
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(CO_Distance);
             Transform t;
 
             {
@@ -234,6 +232,8 @@ public:
                 _pdata->__stamp = GetEnv()->GetSimulationTime();
                 t = GetLaserPlaneTransform();
                 _pdata->positions.at(0) = t.trans;
+                _vrays.resize(0);
+                _vraydirs.resize(0);
                 size_t index = 0;
                 for(dReal frotangle = _pgeom->min_angle[0]; frotangle <= _pgeom->max_angle[0]; frotangle += _pgeom->resolution[0], ++index) {
                     if( index >= _pdata->ranges.size() ) {
@@ -242,15 +242,20 @@ public:
                     Vector vdir(t.rotate(quatRotate(quatFromAxisAngle(rotaxis, (dReal)frotangle),Vector(1,0,0))));
                     r.pos = t.trans+_pgeom->min_range*vdir;
                     r.dir = (_pgeom->max_range-_pgeom->min_range)*vdir;
+                    _vrays.push_back(r);
+                    _vraydirs.push_back(vdir);
+                }
 
-                    if( GetEnv()->CheckCollision(r, _report)) {
-                        _pdata->ranges[index] = vdir*(_report->minDistance+_pgeom->min_range);
+                // check the whole scan at once so that the checker can share the culling between neighboring rays
+                GetEnv()->GetCollisionChecker()->CheckCollisionRays(_vrays, KinBodyConstPtr(), _vrayresults);
+                for(index = 0; index < _vrays.size(); ++index) {
+                    const Vector& vdir = _vraydirs[index];
+                    const RayCollisionResult& result = _vrayresults[index];
+                    if( !!result.plink ) {
+                        _pdata->ranges[index] = vdir*(result.fDistance+_pgeom->min_range);
                         _pdata->intensity[index] = 1;
                         // store the colliding bodies
-                        KinBody::LinkConstPtr plink = !!_report->plink1 ? _report->plink1 : _report->plink2;
-                        if( !!plink ) {
-                            _databodyids[index] = plink->GetParent()->GetEnvironmentBodyIndex();
-                        }
+                        _databodyids[index] = result.plink->GetParent()->GetEnvironmentBodyIndex();
                     }
                     else {
                         _databodyids[index] = 0;
@@ -260,8 +265,6 @@ public:
                 }
             }
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(0);
-
             if( _bRenderData ) {
                 // If can render, check if some time passed before last update
                 list<GraphHandlePtr> listhandles;
@@ -303,13 +306,16 @@ public:
             else {
                 _listGraphicsHandles.clear();
             }
-
-            _report->Reset();
         }
 
         return true;
     }
 
+    /// the rays only read the bodies, and the results are written to the data of the sensor
+    virtual bool IsSimulationStepReadOnly() const {
+        return true;
+    }
+
     virtual SensorGeometryConstPtr GetSensorGeometry(SensorType type)
     {
         if( type == ST_Invalid || type == ST_Laser ) {
@@ -455,7 +461,9 @@ protected:
     boost::shared_ptr<LaserGeomData> _pgeom;
     boost::shared_ptr<LaserSensorData> _pdata;
     vector<int> _databodyids;     ///< if non 0, for each point in _data, specifies the body that was hit
-    CollisionReportPtr _report;
+    std::vector<RAY> _vrays; ///< cache of the rays of one scan
+    std::vector<Vector> _vraydirs; ///< cache of the unit direction of each ray of one scan
+    std::vector<RayCollisionResult> _vrayresults; ///< cache
 
     // more geom stuff
     RaveVector<float> _vColor;
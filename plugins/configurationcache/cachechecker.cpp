@@ -47,9 +47,13 @@ public:
         RegisterCommand("UpdateFreeConfigurations",boost::bind(&CacheCollisionChecker::_UpdateFreeConfigurationsCommand,this,_1,_2),
                         "remove all free nodes that overlap with this body. [bodyname]");
         RegisterCommand("SaveCache",boost::bind(&CacheCollisionChecker::_SaveCacheCommand,this,_1,_2),
-                        "save self collision cache");
+                        "save self collision cache to the database directory, keyed by the robot kinematics geometry hash");
         RegisterCommand("LoadCache",boost::bind(&CacheCollisionChecker::_LoadCacheCommand,this,_1,_2),
-                        "load self collision cache");
+                        "load self collision cache saved for the same robot kinematics geometry, configurations colliding with changed bodies are invalidated. returns the number of known configurations");
+        RegisterCommand("ShareSelfCache",boost::bind(&CacheCollisionChecker::_ShareSelfCacheCommand,this,_1,_2),
+                        "share the self collision cache with all clones of this checker so that they can query and extend it concurrently. new configurations are visible to the others once publishbatchsize of them are queued or publishdelay seconds passed. [publishbatchsize publishdelay]");
+        RegisterCommand("GetSharedSelfCacheStatistics",boost::bind(&CacheCollisionChecker::_GetSharedSelfCacheStatisticsCommand,this,_1,_2),
+                        "get the statistics of the shared self collision cache: sharedcachehits, sharedcachenodes, numpending. fails if the self collision cache is not shared");
         RegisterCommand("GetCacheTimes",boost::bind(&CacheCollisionChecker::_GetCacheTimesCommand,this,_1,_2),
                         "get the cache times: insert, query, collision checking, load");
         std::string collisionname="ode";
@@ -63,6 +67,7 @@ public:
         _selfcachedcollisionchecks=0;
         _selfcachedcollisionhits=0;
         _selfcachedfreehits = 0;
+        _sharedselfcachedhits = 0;
 
         __cachehash.resize(0);
 
@@ -144,6 +149,7 @@ public:
             _pintchecker->DestroyEnvironment();
         }
         _handleRobotDOFChange.reset();
+        _DetachSharedSelfCache();
         _probot.reset();
     }
 
@@ -177,6 +183,11 @@ public:
         _selfcachedcollisionhits=clone->_selfcachedcollisionhits;
         _selfcachedfreehits = clone->_selfcachedfreehits;
 
+        // clones share the learned self collision configurations instead of rebuilding them
+        if( !!clone->_psharedselfcache && !!_probot ) {
+            _AttachSharedSelfCache(clone->_psharedselfcache);
+        }
+
     }
 
     virtual bool InitKinBody(KinBodyPtr pbody) {
@@ -351,6 +362,17 @@ public:
                 _size = _selfcache->GetNumKnownNodes();
             }
         }
+        if( ret == -1 && !!_psharedselfcache ) {
+            // configurations learned by the other clones
+            _stime = utils::GetMilliTime();
+            _psharedselfcache->PublishIfDue();
+            _selfcache->GetDOFValues(_dofvals);
+            ret = _selfcache->CheckCollision(*_psharedselfcache, _dofvals, robotlink, collidinglink, closestdist);
+            if( ret != -1 ) {
+                ++_sharedselfcachedhits;
+            }
+            _selfquerytime += utils::GetMilliTime()-_stime;
+        }
         if( ret == 1 ) {
             ++_selfcachedcollisionhits;
             // in collision
@@ -378,6 +400,9 @@ public:
         _stime = utils::GetMilliTime();
         _selfcache->GetDOFValues(_dofvals);
         _selfcache->InsertConfiguration(_dofvals, !col ? CollisionReportPtr() : report, closestdist);
+        if( !!_psharedselfcache ) {
+            _selfcache->InsertConfiguration(*_psharedselfcache, _dofvals, !col ? CollisionReportPtr() : report);
+        }
         _selfintime += utils::GetMilliTime()-_stime;
 
         return col;
@@ -414,10 +439,11 @@ protected:
         std::string fulldirname = RaveFindDatabaseFile(("selfcache."+GetCacheHash()));
         if (fulldirname != "" && _selfcache->GetNumKnownNodes() == 0) {
             _stime = utils::GetMilliTime();
-            _selfcache->LoadCache(GetCacheHash(), GetEnv());
-            _loadtime = utils::GetMilliTime()-_stime;
-            _size = _selfcache->GetNumKnownNodes();
-            RAVELOG_VERBOSE_FORMAT("Loaded %d configurations in %d ms from %s", _size%_loadtime%fulldirname);
+            if( _selfcache->LoadCache(GetCacheHash(), GetEnv()) ) {
+                _loadtime = utils::GetMilliTime()-_stime;
+                _size = _selfcache->GetNumKnownNodes();
+                RAVELOG_VERBOSE_FORMAT("Loaded %d configurations in %d ms from %s", _size%_loadtime%fulldirname);
+            }
 
             __cachehash = "";
         }
@@ -576,16 +602,71 @@ protected:
         return true;
     }
 
-    virtual bool _SaveCacheCommand(std::ostream& sout, std::istream& sinput)
+    virtual bool _ShareSelfCacheCommand(std::ostream& sout, std::istream& sinput)
     {
-        _selfcache->SaveCache(GetCacheHash());
+        if( !GetRobot() ) {
+            return false;
+        }
+        int publishbatchsize = 0;
+        dReal publishdelay = 0.05;
+        sinput >> publishbatchsize >> publishdelay;
+        if( publishbatchsize <= 0 ) {
+            publishbatchsize = 64;
+        }
+        _AttachSharedSelfCache(_selfcache->CreateSharedTree(publishbatchsize, publishdelay));
         return true;
     }
 
+    virtual bool _GetSharedSelfCacheStatisticsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        if( !_psharedselfcache ) {
+            return false;
+        }
+        sout << _sharedselfcachedhits << " " << _psharedselfcache->GetTree()->GetNumNodes() << " " << _psharedselfcache->GetNumPendingConfigurations();
+        return true;
+    }
+
+    void _AttachSharedSelfCache(SharedCacheTreePtr psharedselfcache)
+    {
+        _psharedselfcache = psharedselfcache;
+        _sharedselfcachedhits = 0;
+        // the shared configurations are only valid for the grabbed bodies at the time of sharing
+        _handleSharedSelfCacheGrabbedChange = _probot->RegisterChangeCallback(KinBody::Prop_RobotGrabbed, boost::bind(&CacheCollisionChecker::_UpdateSharedSelfCacheGrabbed, this));
+    }
+
+    void _UpdateSharedSelfCacheGrabbed()
+    {
+        // cannot destroy the callback handle while it is being called
+        if( !!_psharedselfcache ) {
+            // the queued configurations were checked with the old grabbed bodies
+            _psharedselfcache->Publish();
+        }
+        _psharedselfcache.reset();
+    }
+
+    void _DetachSharedSelfCache()
+    {
+        if( !!_psharedselfcache ) {
+            // make the configurations this checker queued visible to the others
+            _psharedselfcache->Publish();
+        }
+        _psharedselfcache.reset();
+        _handleSharedSelfCacheGrabbedChange.reset();
+    }
+
+    virtual bool _SaveCacheCommand(std::ostream& sout, std::istream& sinput)
+    {
+        return _selfcache->SaveCache(GetCacheHash());
+    }
+
 
     virtual bool _LoadCacheCommand(std::ostream& sout, std::istream& sinput)
     {
-        _selfcache->LoadCache(GetCacheHash(), GetEnv());
+        if( !_selfcache->LoadCache(GetCacheHash(), GetEnv()) ) {
+            return false;
+        }
+        _size = _selfcache->GetNumKnownNodes();
+        sout << _size;
         return true;
     }
 
@@ -601,10 +682,10 @@ protected:
         return _probot;
     }
 
-    /// \brief generate a string to be used to save/load selfcollision cache. hash considers: robot, grabbed bodies, parameters for the cache, and DOF
+    /// \brief generate a string to be used to save/load selfcollision cache. hash considers: robot kinematics geometry, grabbed bodies, parameters for the cache, and DOF
     std::string GetCacheHash()
     {
-        _robothash = GetRobot()->GetRobotStructureHash();
+        _robothash = GetRobot()->GetKinematicsGeometryHash();
 
         _vGrabbedBodies.resize(0);
         GetRobot()->GetGrabbed(_vGrabbedBodies);
@@ -678,6 +759,7 @@ protected:
     std::vector<int> _dofindices;
     ConfigurationCachePtr _cache;
     ConfigurationCachePtr _selfcache;
+    SharedCacheTreePtr _psharedselfcache; ///< if set, self collision cache shared with the clones of this checker
     CollisionCheckerBasePtr _pintchecker;
     std::string _strRobotName; ///< the robot name to track
     std::string __cachehash;
@@ -686,11 +768,13 @@ protected:
     int _numdofs;
     int _cachedcollisionchecks, _cachedcollisionhits, _cachedfreehits, _size;
     int _selfcachedcollisionchecks, _selfcachedcollisionhits, _selfcachedfreehits;
+    int _sharedselfcachedhits; ///< self collision queries answered by the shared cache
     uint64_t _stime, _ftime, _intime, _querytime, _loadtime, _savetime, _rawtime, _resettime, _selfintime, _selfquerytime, _selfrawtime;
     stringstream _ss;
     ostringstream _oss;
 
     UserDataPtr _handleRobotDOFChange;
+    UserDataPtr _handleSharedSelfCacheGrabbedChange;
 };
 
 CollisionCheckerBasePtr CreateCacheCollisionChecker(EnvironmentBasePtr penv, std::istream& sinput)
@@ -14,6 +14,8 @@
 /// \author Alejandro Perez & Rosen Diankov
 #include "configurationcachetree.h"
 #include <sstream>
+#include <cstdio>
+#include <iomanip>
 #include <boost/lexical_cast.hpp>
 
 #include <boost/multi_array.hpp>
@@ -28,6 +30,34 @@ inline dReal Sqr(dReal x) {
     return x*x;
 }
 
+static const uint32_t CACHETREE_FILE_MAGIC = 0x43544f52; ///< "ROTC" in little endian
+static const uint32_t CACHETREE_FILE_VERSION = 2; ///< version 1 files had no header and are ignored
+
+/// \brief reads size bytes from the file, returns false if the file is truncated
+inline bool _ReadCacheData(FILE* pfile, void* pdata, size_t size)
+{
+    return size == 0 || fread(pdata, size, 1, pfile) == 1;
+}
+
+inline bool _ReadCacheString(FILE* pfile, std::string& s)
+{
+    int length = 0;
+    if( !_ReadCacheData(pfile, &length, sizeof(length)) || length < 0 || length > (1<<20) ) {
+        return false;
+    }
+    s.resize(length);
+    return _ReadCacheData(pfile, &s[0], length);
+}
+
+inline void _WriteCacheString(FILE* pfile, const std::string& s)
+{
+    int length = s.size();
+    fwrite(&length, sizeof(length), 1, pfile);
+    if( length > 0 ) {
+        fwrite(s.c_str(), length, 1, pfile);
+    }
+}
+
 CacheTreeNode::CacheTreeNode(const std::vector<dReal>& cs, Vector* plinkspheres)
 {
     std::copy(cs.begin(), cs.end(), _pcstate);
@@ -38,6 +68,8 @@ CacheTreeNode::CacheTreeNode(const std::vector<dReal>& cs, Vector* plinkspheres)
 //    _approxnn.second = std::numeric_limits<float>::infinity();
     _conftype = CNT_Unknown;
     _robotlinkindex = -1;
+    _collidinglinkindex = -1;
+    _collidingbodyindex = -1;
     _level = 0;
     _hasselfchild = 0;
     _usenn = 1;
@@ -50,6 +82,8 @@ CacheTreeNode::CacheTreeNode(const dReal* pstate, int dof, Vector* plinkspheres)
     _plinkspheres = plinkspheres;
     _conftype = CNT_Unknown;
     _robotlinkindex = -1;
+    _collidinglinkindex = -1;
+    _collidingbodyindex = -1;
     _level = 0;
     _hasselfchild = 0;
     _usenn = 1;
@@ -62,12 +96,16 @@ void CacheTreeNode::SetCollisionInfo(CollisionReportPtr report)
         _collidinglinktrans = report->plink1->GetTransform();
         _robotlinkindex = report->plink1->GetIndex();
         _collidinglink = report->plink2;
+        _collidinglinkindex = !report->plink2 ? -1 : report->plink2->GetIndex();
+        _collidingbodyindex = -1;
         _conftype = CNT_Collision;
     }
     else {
         _conftype = CNT_Free;
         _collidinglink.reset();
         _robotlinkindex = 0;
+        _collidinglinkindex = -1;
+        _collidingbodyindex = -1;
     }
 }
 
@@ -112,6 +150,7 @@ CacheTree::CacheTree(int statedof)
     _fulldirname.resize(0);
     _mapNodeIndices.clear();
     _collidingbodyname.resize(0);
+    _vcollidingbodynames.resize(0);
 
     _statedof=statedof;
     _weights.resize(_statedof, 1.0);
@@ -152,6 +191,7 @@ void CacheTree::Reset()
     _fulldirname.resize(0);
     _mapNodeIndices.clear();
     _collidingbodyname.resize(0);
+    _vcollidingbodynames.resize(0);
 
     // make sure all children are deleted
     for(size_t ilevel = 0; ilevel < _vsetLevelNodes.size(); ++ilevel) {
@@ -207,11 +247,13 @@ CacheTreeNodePtr CacheTree::_CloneCacheTreeNode(CacheTreeNodeConstPtr refnode)
     clonenode->id = s_CacheTreeId++;
 #endif
     clonenode->_conftype = refnode->_conftype;
-    clonenode->_hitcount = refnode->_hitcount;
+    clonenode->_hitcount = refnode->_hitcount.load();
     if( clonenode->IsInCollision() ) {
         clonenode->_collidinglink = refnode->_collidinglink;
         clonenode->_collidinglinktrans = refnode->_collidinglinktrans;
         clonenode->_robotlinkindex = refnode->_robotlinkindex;
+        clonenode->_collidinglinkindex = refnode->_collidinglinkindex;
+        clonenode->_collidingbodyindex = refnode->_collidingbodyindex;
     }
 
     return clonenode;
@@ -274,6 +316,13 @@ void CacheTree::SetBase(dReal base)
     }
 }
 
+/// \brief per-thread level buffers for the nearest neighbor queries, so that several threads can query the same tree
+static std::pair< std::vector< std::pair<CacheTreeNodePtr, dReal> >, std::vector< std::pair<CacheTreeNodePtr, dReal> > >& _GetQueryScratch()
+{
+    static thread_local std::pair< std::vector< std::pair<CacheTreeNodePtr, dReal> >, std::vector< std::pair<CacheTreeNodePtr, dReal> > > s_scratch;
+    return s_scratch;
+}
+
 std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::vector<dReal>& vquerystate, dReal distancebound, ConfigurationNodeType conftype) const
 {
     if( _numnodes == 0 ) {
@@ -284,22 +333,24 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
     dReal bestdist2 = std::numeric_limits<dReal>::infinity();
     OPENRAVE_ASSERT_OP(vquerystate.size(),==,_weights.size());
     const dReal* pquerystate = &vquerystate[0];
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& vCurrentLevelNodes = _GetQueryScratch().first;
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& vNextLevelNodes = _GetQueryScratch().second;
 
     dReal distancebound2 = Sqr(distancebound);
     int currentlevel = _maxlevel; // where the root node is
     // traverse all levels gathering up the children at each level
     dReal fLevelBound2 = Sqr(_fMaxLevelBound);
-    _vCurrentLevelNodes.resize(1);
-    _vCurrentLevelNodes[0].first = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
-    _vCurrentLevelNodes[0].second = _ComputeDistance2(pquerystate, _vCurrentLevelNodes[0].first->GetConfigurationState());
-    if( (conftype == CNT_Any || _vCurrentLevelNodes[0].first->GetType() == conftype) && _vCurrentLevelNodes[0].first->_usenn ) {
-        pbestnode = _vCurrentLevelNodes[0].first;
-        bestdist2 = _vCurrentLevelNodes[0].second;
-    }
-    while(_vCurrentLevelNodes.size() > 0 ) {
-        _vNextLevelNodes.resize(0);
+    vCurrentLevelNodes.resize(1);
+    vCurrentLevelNodes[0].first = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
+    vCurrentLevelNodes[0].second = _ComputeDistance2(pquerystate, vCurrentLevelNodes[0].first->GetConfigurationState());
+    if( (conftype == CNT_Any || vCurrentLevelNodes[0].first->GetType() == conftype) && vCurrentLevelNodes[0].first->_usenn ) {
+        pbestnode = vCurrentLevelNodes[0].first;
+        bestdist2 = vCurrentLevelNodes[0].second;
+    }
+    while(vCurrentLevelNodes.size() > 0 ) {
+        vNextLevelNodes.resize(0);
         dReal minchilddist2 = std::numeric_limits<dReal>::infinity();
-        FOREACH(itcurrentnode, _vCurrentLevelNodes) {
+        FOREACH(itcurrentnode, vCurrentLevelNodes) {
             // only take the children whose distances are within the bound
             FOREACHC(itchild, itcurrentnode->first->_vchildren) {
                 dReal curdist2 = _ComputeDistance2(pquerystate, (*itchild)->GetConfigurationState());
@@ -313,22 +364,22 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
                         }
                     }
                 }
-                _vNextLevelNodes.emplace_back(*itchild,  curdist2);
+                vNextLevelNodes.emplace_back(*itchild,  curdist2);
                 if( minchilddist2 > curdist2 ) {
                     minchilddist2 = curdist2;
                 }
             }
         }
 
-        _vCurrentLevelNodes.resize(0);
+        vCurrentLevelNodes.resize(0);
         // have to compute dist < RaveSqrt(minchilddist2) + fLevelBound
         // dist2 < m2 + 2mL + L2
 
         dReal ftestbound2 = 4*minchilddist2*fLevelBound2;
-        FOREACH(itnode, _vNextLevelNodes) {
+        FOREACH(itnode, vNextLevelNodes) {
             dReal f = itnode->second - minchilddist2 - fLevelBound2;
             if( f <= 0 || Sqr(f) <= ftestbound2 ) {
-                _vCurrentLevelNodes.push_back(*itnode);
+                vCurrentLevelNodes.push_back(*itnode);
             }
         }
         currentlevel -= 1;
@@ -353,6 +404,8 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
     OPENRAVE_ASSERT_OP(vquerystate.size(),==,_weights.size());
     // first localmax is distance from this node to the root
     const dReal* pquerystate = &vquerystate[0];
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& vCurrentLevelNodes = _GetQueryScratch().first;
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& vNextLevelNodes = _GetQueryScratch().second;
 
     dReal collisionthresh2 = Sqr(collisionthresh), freespacethresh2 = Sqr(freespacethresh);
     // traverse all levels gathering up the children at each level
@@ -364,7 +417,7 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
         if( proot->_usenn ) {
             ConfigurationNodeType cntype = proot->GetType();
             if( cntype == CNT_Collision && curdist2 <= collisionthresh2 ) {
-                proot->_hitcount++;
+                proot->IncreaseHitCount();
                 return make_pair(proot,RaveSqrt(curdist2));
             }
             else if( cntype == CNT_Free && curdist2 <= freespacethresh2 ) {
@@ -372,15 +425,15 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
                 bestnode = make_pair(proot,RaveSqrt(curdist2));
             }
         }
-        _vCurrentLevelNodes.resize(1);
-        _vCurrentLevelNodes[0].first = proot;
-        _vCurrentLevelNodes[0].second = curdist2;
+        vCurrentLevelNodes.resize(1);
+        vCurrentLevelNodes[0].first = proot;
+        vCurrentLevelNodes[0].second = curdist2;
     }
-    dReal pruneradius2 = Sqr(_maxdistance); // the radius to prune all _vCurrentLevelNodes when going through them. Equivalent to min(query,children) + levelbound from the previous iteration
-    while(_vCurrentLevelNodes.size() > 0 ) {
-        _vNextLevelNodes.resize(0);
+    dReal pruneradius2 = Sqr(_maxdistance); // the radius to prune all vCurrentLevelNodes when going through them. Equivalent to min(query,children) + levelbound from the previous iteration
+    while(vCurrentLevelNodes.size() > 0 ) {
+        vNextLevelNodes.resize(0);
         dReal minchilddist=_maxdistance;
-        FOREACH(itcurrentnode, _vCurrentLevelNodes) {
+        FOREACH(itcurrentnode, vCurrentLevelNodes) {
             if( itcurrentnode->second > pruneradius2 ) {
                 continue;
             }
@@ -391,7 +444,7 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
                 if( (*itchild)->_usenn ) {
                     ConfigurationNodeType cntype = (*itchild)->GetType();
                     if( cntype == CNT_Collision && curdist2 <= collisionthresh2 ) {
-                        (*itchild)->_hitcount++;
+                        (*itchild)->IncreaseHitCount();
                         return make_pair(*itchild, RaveSqrt(curdist2));
                     }
                     else if( cntype == CNT_Free && curdist2 <= freespacethresh2 ) {
@@ -402,7 +455,7 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
                     }
                 }
                 if( curdist2 < comparedist2 ) {
-                    _vNextLevelNodes.emplace_back(*itchild,  curdist2);
+                    vNextLevelNodes.emplace_back(*itchild,  curdist2);
                     if( Sqr(minchilddist) > curdist2 ) {
                         minchilddist = RaveSqrt(curdist2);
                         comparedist2 = Sqr(minchilddist + fLevelBound);
@@ -411,7 +464,7 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
             }
         }
 
-        _vCurrentLevelNodes.swap(_vNextLevelNodes);
+        vCurrentLevelNodes.swap(vNextLevelNodes);
         pruneradius2 = Sqr(minchilddist + fLevelBound);
         currentlevel -= 1;
         fLevelBound *= _fBaseInv;
@@ -428,7 +481,53 @@ int CacheTree::InsertNode(const std::vector<dReal>& cs, CollisionReportPtr repor
 {
 
     OPENRAVE_ASSERT_OP(cs.size(),==,_weights.size());
-    CacheTreeNodePtr nodein = _CreateCacheTreeNode(cs, report);
+    return _InsertNode(_CreateCacheTreeNode(cs, report), fMinSeparationDist);
+}
+
+int CacheTree::InsertCollisionNode(const std::vector<dReal>& cs, int robotlinkindex, const std::string& collidingbodyname, int collidinglinkindex, dReal fMinSeparationDist)
+{
+    OPENRAVE_ASSERT_OP(cs.size(),==,_weights.size());
+    CacheTreeNodePtr nodein = _CreateCacheTreeNode(cs, CollisionReportPtr());
+    nodein->_conftype = CNT_Collision;
+    nodein->_robotlinkindex = robotlinkindex;
+    nodein->_collidinglinkindex = collidinglinkindex;
+    nodein->_collidingbodyindex = _GetCollidingBodyIndex(collidingbodyname);
+    return _InsertNode(nodein, fMinSeparationDist);
+}
+
+void CacheTree::DetachCollidingLinks()
+{
+    FOREACH(itlevelnodes, _vsetLevelNodes) {
+        FOREACH(itnode, *itlevelnodes) {
+            CacheTreeNodePtr pnode = *itnode;
+            if( !!pnode->_collidinglink ) {
+                KinBodyPtr pbody = pnode->_collidinglink->GetParent(true);
+                pnode->_collidingbodyindex = _GetCollidingBodyIndex(!pbody ? std::string() : pbody->GetName());
+                pnode->_collidinglink.reset();
+            }
+        }
+    }
+}
+
+const std::string& CacheTree::GetCollidingBodyName(CacheTreeNodeConstPtr node) const
+{
+    OPENRAVE_ASSERT_OP(node->_collidingbodyindex,<,(int)_vcollidingbodynames.size());
+    return _vcollidingbodynames.at(node->_collidingbodyindex);
+}
+
+int CacheTree::_GetCollidingBodyIndex(const std::string& bodyname)
+{
+    std::vector<std::string>::iterator itname = std::find(_vcollidingbodynames.begin(), _vcollidingbodynames.end(), bodyname);
+    if( itname != _vcollidingbodynames.end() ) {
+        return itname - _vcollidingbodynames.begin();
+    }
+    _vcollidingbodynames.push_back(bodyname);
+    return _vcollidingbodynames.size()-1;
+}
+
+int CacheTree::_InsertNode(CacheTreeNodePtr nodein, dReal fMinSeparationDist)
+{
+    const dReal* cs = nodein->GetConfigurationState();
     // if there is no root, make this the root, otherwise call the lowlevel  insert
     if( _numnodes == 0 ) {
         // no root
@@ -440,7 +539,7 @@ int CacheTree::InsertNode(const std::vector<dReal>& cs, CollisionReportPtr repor
 
     _vCurrentLevelNodes.resize(1);
     _vCurrentLevelNodes[0].first = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
-    _vCurrentLevelNodes[0].second = _ComputeDistance2(_vCurrentLevelNodes[0].first->GetConfigurationState(), &cs[0]);
+    _vCurrentLevelNodes[0].second = _ComputeDistance2(_vCurrentLevelNodes[0].first->GetConfigurationState(), cs);
     int nParentFound = _Insert(nodein, _vCurrentLevelNodes, _maxlevel, Sqr(_fMaxLevelBound), Sqr(fMinSeparationDist));
     if( nParentFound != 1 ) {
         _DeleteCacheTreeNode(nodein);
@@ -786,28 +885,50 @@ int CacheTree::RemoveCollisionConfigurations()
     return nremoved;
 }
 
-int CacheTree::SaveCache(std::string filename)
+int CacheTree::SaveCache(const std::string& filename, const std::string& cachekey, const std::string& envhash)
 {
     //std::lock_guard<std::mutex> lock(_mutexpool);
     _mapNodeIndices.clear();
     int index=0;
     int knownnodes=0;
+    std::vector<KinBodyConstPtr> vcollidingbodies;
+    std::map<KinBodyConstPtr, int> mapBodyIndices;
     FOREACH(itlevelnodes, _vsetLevelNodes) {
         FOREACH(itnode, *itlevelnodes) {
             if( (*itnode)->_conftype != CNT_Unknown) {
                 knownnodes++;
             }
             _mapNodeIndices[*itnode] = index++;
+            if( (*itnode)->_conftype == CNT_Collision && !!(*itnode)->_collidinglink ) {
+                KinBodyConstPtr pbody = (*itnode)->_collidinglink->GetParent();
+                if( mapBodyIndices.insert(std::make_pair(pbody, (int)vcollidingbodies.size())).second ) {
+                    vcollidingbodies.push_back(pbody);
+                }
+            }
         }
     }
 
-    _numnodes = knownnodes;
+    // unknown nodes are still part of the tree structure, so have to save all of them
+    int numnodes = index;
     _fulldirname = RaveFindDatabaseFile(std::string("selfcache.")+filename,false);
 
-    RAVELOG_DEBUG_FORMAT("Writing cache to %s, size=%d", _fulldirname%_numnodes);
-    
-    FILE* pfile;
-    pfile = fopen(_fulldirname.c_str(),"wb");
+    RAVELOG_DEBUG_FORMAT("Writing cache to %s, size=%d/%d", _fulldirname%knownnodes%numnodes);
+
+    // write to a temporary file first so that other processes never read a partially written cache
+    std::string tempfilename = _fulldirname + ".tmp";
+    FILE* pfile = fopen(tempfilename.c_str(),"wb");
+    if( !pfile ) {
+        RAVELOG_WARN_FORMAT("failed to open %s for writing cache", tempfilename);
+        return 0;
+    }
+
+    uint32_t magic = CACHETREE_FILE_MAGIC, version = CACHETREE_FILE_VERSION;
+    uint8_t realsize = sizeof(dReal);
+    fwrite(&magic, sizeof(magic), 1, pfile);
+    fwrite(&version, sizeof(version), 1, pfile);
+    fwrite(&realsize, sizeof(realsize), 1, pfile);
+    _WriteCacheString(pfile, cachekey);
+    _WriteCacheString(pfile, envhash);
 
     fwrite(&_statedof, sizeof(_statedof), 1, pfile);
     fwrite(&_weights[0], sizeof(_weights[0])*_weights.size(), 1, pfile);
@@ -818,132 +939,199 @@ int CacheTree::SaveCache(std::string filename)
     fwrite(&_maxdistance, sizeof(_maxdistance), 1, pfile);
     fwrite(&_maxlevel, sizeof(_maxlevel), 1, pfile);
     fwrite(&_minlevel, sizeof(_minlevel), 1, pfile);
-    fwrite(&_numnodes, sizeof(_numnodes), 1, pfile);
+    fwrite(&numnodes, sizeof(numnodes), 1, pfile);
     fwrite(&_fMaxLevelBound, sizeof(_fMaxLevelBound), 1, pfile);
 
+    // every colliding body is written once, nodes reference it by index
+    int numbodies = vcollidingbodies.size();
+    fwrite(&numbodies, sizeof(numbodies), 1, pfile);
+    FOREACHC(itbody, vcollidingbodies) {
+        _WriteCacheString(pfile, (*itbody)->GetName());
+        _WriteCacheString(pfile, (*itbody)->GetKinematicsGeometryHash());
+    }
+
     FOREACH(itlevelnodes, _vsetLevelNodes) {
         FOREACH(itnode, *itlevelnodes) {
             _newnode = *itnode;
-            // TODO save only configuration != CNT_Unknown without losing the validity of the tree
-            if (true) { //_newnode->_conftype != CNT_Unknown) {
-                fwrite(&_newnode->_level, sizeof(_newnode->_level), 1, pfile);
-                fwrite(_newnode->GetConfigurationState(), sizeof(dReal)*_statedof, 1, pfile);
-                fwrite(&_newnode->_conftype, sizeof(_newnode->_conftype), 1, pfile);
-
-                if (_newnode->_conftype == CNT_Collision ) {
-                    // note, this assumes the colliding body name never changes across environments, which is a false assumption
-                    _collidingbodyname = _newnode->GetCollidingLink()->GetParent()->GetName();
-                    int namelength = _collidingbodyname.size();
-                    fwrite(&namelength, sizeof(namelength), 1, pfile);
-                    fwrite(_collidingbodyname.c_str(), _collidingbodyname.size(), 1, pfile);
-                    int linkindex = _newnode->GetCollidingLink()->GetIndex();
-                    fwrite(&linkindex, sizeof(linkindex), 1, pfile);
-                    fwrite(&_newnode->_robotlinkindex, sizeof(_newnode->_robotlinkindex), 1, pfile);
+            fwrite(&_newnode->_level, sizeof(_newnode->_level), 1, pfile);
+            fwrite(_newnode->GetConfigurationState(), sizeof(dReal)*_statedof, 1, pfile);
+            fwrite(&_newnode->_conftype, sizeof(_newnode->_conftype), 1, pfile);
+
+            if (_newnode->_conftype == CNT_Collision ) {
+                int bodyindex = -1, linkindex = -1;
+                if( !!_newnode->_collidinglink ) {
+                    bodyindex = mapBodyIndices[_newnode->_collidinglink->GetParent()];
+                    linkindex = _newnode->_collidinglink->GetIndex();
                 }
+                fwrite(&bodyindex, sizeof(bodyindex), 1, pfile);
+                fwrite(&linkindex, sizeof(linkindex), 1, pfile);
+                fwrite(&_newnode->_robotlinkindex, sizeof(_newnode->_robotlinkindex), 1, pfile);
+            }
 
-                fwrite(&_newnode->_hasselfchild, sizeof(_newnode->_hasselfchild), 1, pfile);
-                fwrite(&_newnode->_usenn, sizeof(_newnode->_usenn), 1, pfile);
-                int numchildren = _newnode->_vchildren.size();
-                fwrite(&numchildren, sizeof(numchildren), 1, pfile);
+            fwrite(&_newnode->_hasselfchild, sizeof(_newnode->_hasselfchild), 1, pfile);
+            fwrite(&_newnode->_usenn, sizeof(_newnode->_usenn), 1, pfile);
+            int numchildren = _newnode->_vchildren.size();
+            fwrite(&numchildren, sizeof(numchildren), 1, pfile);
 
-                FOREACHC(itchild, (*itnode)->_vchildren) {
-                    int cindex = _mapNodeIndices[*itchild];
-                    fwrite(&cindex, sizeof(cindex), 1, pfile);
-                }
+            FOREACHC(itchild, (*itnode)->_vchildren) {
+                int cindex = _mapNodeIndices[*itchild];
+                fwrite(&cindex, sizeof(cindex), 1, pfile);
             }
         }
     }
 
-    fclose(pfile);
-
+    _newnode = NULL;
+    _mapNodeIndices.clear();
+    bool bsuccess = !ferror(pfile);
+    bsuccess = fclose(pfile) == 0 && bsuccess;
+    if( !bsuccess || std::rename(tempfilename.c_str(), _fulldirname.c_str()) != 0 ) {
+        RAVELOG_WARN_FORMAT("failed to write cache to %s", _fulldirname);
+        std::remove(tempfilename.c_str());
+        return 0;
+    }
     return 1;
 }
 
-int CacheTree::LoadCache(std::string filename, EnvironmentBasePtr penv)
+int CacheTree::LoadCache(const std::string& filename, EnvironmentBasePtr penv, RobotBaseConstPtr probot, const std::string& cachekey, const std::string& envhash, bool bkeepenvnodes)
 {
     //std::lock_guard<std::mutex> lock(_mutexpool);
     _fulldirname = RaveFindDatabaseFile(std::string("selfcache.")+filename,false);
 
     FILE* pfile = fopen(_fulldirname.c_str(),"rb");
-    size_t outs;
-
     if (!pfile) {
         return 0;
     }
 
-    Reset();
-    outs = fread(&_statedof, sizeof(_statedof), 1, pfile);
+    // validate the header before touching the tree
+    uint32_t magic = 0, version = 0;
+    uint8_t realsize = 0;
+    int statedof = 0;
+    std::string savedcachekey, savedenvhash;
+    if( !_ReadCacheData(pfile, &magic, sizeof(magic)) || magic != CACHETREE_FILE_MAGIC || !_ReadCacheData(pfile, &version, sizeof(version)) || version != CACHETREE_FILE_VERSION || !_ReadCacheData(pfile, &realsize, sizeof(realsize)) || realsize != sizeof(dReal) ) {
+        RAVELOG_INFO_FORMAT("cache %s has an unsupported format, ignoring", _fulldirname);
+        fclose(pfile);
+        return 0;
+    }
+    if( !_ReadCacheString(pfile, savedcachekey) || savedcachekey != cachekey || !_ReadCacheString(pfile, savedenvhash) || !_ReadCacheData(pfile, &statedof, sizeof(statedof)) || statedof != _statedof ) {
+        RAVELOG_INFO_FORMAT("cache %s was saved for a different robot, ignoring", _fulldirname);
+        fclose(pfile);
+        return 0;
+    }
+    bool benvchanged = !bkeepenvnodes && savedenvhash != envhash;
 
+    Reset();
+    _fulldirname = RaveFindDatabaseFile(std::string("selfcache.")+filename,false);
     _weights.resize(_statedof,1.0);
     _curconf.resize(_statedof,1.0);
-    outs = fread(&_weights[0], sizeof(_weights[0])*_weights.size(), 1, pfile);
-
-    outs = fread(&_base, sizeof(_base), 1, pfile);
-    outs = fread(&_fBaseInv, sizeof(_fBaseInv), 1, pfile);
-    outs = fread(&_fBaseInv2, sizeof(_fBaseInv2), 1, pfile);
-    outs = fread(&_fBaseChildMult, sizeof(_fBaseChildMult), 1, pfile);
-    outs = fread(&_maxdistance, sizeof(_maxdistance), 1, pfile);
-    outs = fread(&_maxlevel, sizeof(_maxlevel), 1, pfile);
-    outs = fread(&_minlevel, sizeof(_minlevel), 1, pfile);
-    outs = fread(&_numnodes, sizeof(_numnodes), 1, pfile);
-    outs = fread(&_fMaxLevelBound, sizeof(_fMaxLevelBound), 1, pfile);
-
-    int maxenclevel = max(_EncodeLevel(_maxlevel), _EncodeLevel(_minlevel));
-    _vsetLevelNodes.resize(maxenclevel+1);
 
-    _vnodes.resize(_numnodes);
-    _dummycs.resize(_statedof, 0);
+    int numnodes = 0, numbodies = 0;
+    bool bsuccess = _ReadCacheData(pfile, &_weights[0], sizeof(_weights[0])*_weights.size());
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_base, sizeof(_base));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_fBaseInv, sizeof(_fBaseInv));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_fBaseInv2, sizeof(_fBaseInv2));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_fBaseChildMult, sizeof(_fBaseChildMult));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_maxdistance, sizeof(_maxdistance));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_maxlevel, sizeof(_maxlevel));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_minlevel, sizeof(_minlevel));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &numnodes, sizeof(numnodes)) && numnodes >= 0;
+    bsuccess = bsuccess && _ReadCacheData(pfile, &_fMaxLevelBound, sizeof(_fMaxLevelBound));
+    bsuccess = bsuccess && _ReadCacheData(pfile, &numbodies, sizeof(numbodies)) && numbodies >= 0;
+
+    // resolve the colliding bodies, stale bodies are left empty so that their collision configurations are invalidated
+    std::vector<KinBodyPtr> vcollidingbodies;
+    for(int ibody = 0; bsuccess && ibody < numbodies; ++ibody) {
+        std::string bodyhash;
+        bsuccess = _ReadCacheString(pfile, _collidingbodyname) && _ReadCacheString(pfile, bodyhash);
+        _pcollidingbody = penv->GetKinBody(_collidingbodyname);
+        if( !_pcollidingbody ) {
+            RAVELOG_DEBUG_FORMAT("loading cache expected colliding body %s, but none found", _collidingbodyname);
+        }
+        else if( _pcollidingbody->GetKinematicsGeometryHash() != bodyhash ) {
+            RAVELOG_DEBUG_FORMAT("colliding body %s changed since the cache was saved", _collidingbodyname);
+            _pcollidingbody.reset();
+        }
+        else if( benvchanged && _pcollidingbody != probot && !probot->IsGrabbing(*_pcollidingbody) ) {
+            _pcollidingbody.reset();
+        }
+        vcollidingbodies.push_back(_pcollidingbody);
+    }
+    _pcollidingbody.reset();
 
-    for(int i = 0; i < _numnodes; ++i) {
-        _vnodes[i] = _CreateCacheTreeNode(_dummycs, CollisionReportPtr());
+    int maxenclevel = max(_EncodeLevel(_maxlevel), _EncodeLevel(_minlevel));
+    if( bsuccess ) {
+        _vsetLevelNodes.resize(maxenclevel+1);
+        _dummycs.resize(_statedof, 0);
+        _vnodes.resize(numnodes);
+        for(int i = 0; i < numnodes; ++i) {
+            _vnodes[i] = _CreateCacheTreeNode(_dummycs, CollisionReportPtr());
+        }
     }
 
-    for (int inode = 0; inode < _numnodes; ++inode)
+    int inode = 0, numinvalidated = 0;
+    for (; bsuccess && inode < numnodes; ++inode)
     {
-        _newnode = _vnodes.at(inode);
-        outs = fread(&_newnode->_level, sizeof(_newnode->_level), 1, pfile);
-        outs = fread(_newnode->_pcstate, sizeof(dReal)*_statedof, 1, pfile);
-        outs = fread(&_newnode->_conftype, sizeof(_newnode->_conftype), 1, pfile);
-
-        if( _newnode->_conftype == CNT_Collision ) {
-            int namelength;
-            outs = fread(&namelength, sizeof(namelength), 1, pfile);
-            _collidingbodyname.resize(namelength);
-            outs = fread(&_collidingbodyname[0], namelength, 1, pfile);
-            int collidinglinkindex;
-            outs = fread(&collidinglinkindex, sizeof(collidinglinkindex), 1, pfile);
-            _pcollidingbody = penv->GetKinBody(_collidingbodyname);
-            if( !_pcollidingbody ) {
-                RAVELOG_WARN_FORMAT("loading cache expected colliding body %s, but none found", _collidingbodyname);
+        _newnode = _vnodes[inode];
+        bsuccess = _ReadCacheData(pfile, &_newnode->_level, sizeof(_newnode->_level)) && _EncodeLevel(_newnode->_level) <= maxenclevel;
+        bsuccess = bsuccess && _ReadCacheData(pfile, _newnode->_pcstate, sizeof(dReal)*_statedof);
+        bsuccess = bsuccess && _ReadCacheData(pfile, &_newnode->_conftype, sizeof(_newnode->_conftype));
+
+        if( bsuccess && _newnode->_conftype == CNT_Collision ) {
+            int bodyindex = -1, collidinglinkindex = -1;
+            bsuccess = _ReadCacheData(pfile, &bodyindex, sizeof(bodyindex)) && _ReadCacheData(pfile, &collidinglinkindex, sizeof(collidinglinkindex));
+            bsuccess = bsuccess && _ReadCacheData(pfile, &_newnode->_robotlinkindex, sizeof(_newnode->_robotlinkindex));
+            if( bodyindex >= 0 && bodyindex < (int)vcollidingbodies.size() && !!vcollidingbodies[bodyindex] && collidinglinkindex >= 0 && collidinglinkindex < (int)vcollidingbodies[bodyindex]->GetLinks().size() ) {
+                _newnode->_collidinglink = vcollidingbodies[bodyindex]->GetLinks()[collidinglinkindex];
+                _newnode->_collidinglinkindex = collidinglinkindex;
             }
             else {
-                _newnode->_collidinglink = _pcollidingbody->GetLinks().at(collidinglinkindex);
+                _newnode->_conftype = CNT_Unknown;
+                _newnode->_robotlinkindex = -1;
+                ++numinvalidated;
             }
-            outs = fread(&_newnode->_robotlinkindex, sizeof(_newnode->_robotlinkindex), 1, pfile);
         }
-
-        outs = fread(&_newnode->_hasselfchild, sizeof(_newnode->_hasselfchild), 1, pfile);
-        outs = fread(&_newnode->_usenn, sizeof(_newnode->_usenn), 1, pfile);
-        int numchildren;
-        outs = fread(&numchildren, sizeof(numchildren), 1, pfile);
-        _newnode->_vchildren.resize(numchildren);
-
-        // create the copies of the children and insert them
-        for(int i = 0; i < numchildren; ++i) {
-            int childid;
-            outs = fread(&childid, sizeof(childid), 1, pfile);
-            _newnode->_vchildren[i] = _vnodes.at(childid);
+        else if( benvchanged && _newnode->_conftype == CNT_Free ) {
+            _newnode->_conftype = CNT_Unknown;
+            ++numinvalidated;
         }
 
+        int numchildren = 0;
+        bsuccess = bsuccess && _ReadCacheData(pfile, &_newnode->_hasselfchild, sizeof(_newnode->_hasselfchild));
+        bsuccess = bsuccess && _ReadCacheData(pfile, &_newnode->_usenn, sizeof(_newnode->_usenn));
+        bsuccess = bsuccess && _ReadCacheData(pfile, &numchildren, sizeof(numchildren)) && numchildren >= 0 && numchildren <= numnodes;
+        if( bsuccess ) {
+            _newnode->_vchildren.resize(numchildren);
+            for(int i = 0; bsuccess && i < numchildren; ++i) {
+                int childid = -1;
+                bsuccess = _ReadCacheData(pfile, &childid, sizeof(childid)) && childid >= 0 && childid < numnodes;
+                if( bsuccess ) {
+                    _newnode->_vchildren[i] = _vnodes[childid];
+                }
+            }
+        }
+        if( !bsuccess ) {
+            break;
+        }
         _vsetLevelNodes.at(_EncodeLevel(_newnode->_level)).insert(_newnode);
     }
-
+    _newnode = NULL;
     fclose(pfile);
 
-    _vnodes.resize(0);
+    if( !bsuccess ) {
+        RAVELOG_WARN_FORMAT("cache %s is corrupted, ignoring", _fulldirname);
+        // nodes that were not inserted into the tree yet are not destroyed by Reset
+        for(; inode < (int)_vnodes.size(); ++inode) {
+            _DeleteCacheTreeNode(_vnodes[inode]);
+        }
+        _vnodes.resize(0);
+        Reset();
+        return 0;
+    }
 
-    int numloaded = GetNumKnownNodes();
-    OPENRAVE_ASSERT_OP(numloaded,==,_numnodes);
+    _vnodes.resize(0);
+    _numnodes = numnodes;
+    if( numinvalidated > 0 ) {
+        RAVELOG_DEBUG_FORMAT("invalidated %d/%d stale configurations when loading cache %s", numinvalidated%numnodes%_fulldirname);
+    }
     return 1;
 }
 
@@ -1122,6 +1310,145 @@ bool CacheTree::Validate()
     return true;
 }
 
+void CacheTree::CopyFrom(const CacheTree& r)
+{
+    // the pool is allocated in Reset with the node size for _statedof
+    _statedof = r._statedof;
+    Reset();
+    _weights = r._weights;
+    _curconf.resize(_statedof, 1.0);
+    _maxdistance = r._maxdistance;
+    _base = r._base;
+    _fBaseInv = r._fBaseInv;
+    _fBaseInv2 = r._fBaseInv2;
+    _fBaseChildMult = r._fBaseChildMult;
+    _maxlevel = r._maxlevel;
+    _minlevel = r._minlevel;
+    _fMaxLevelBound = r._fMaxLevelBound;
+    _vcollidingbodynames = r._vcollidingbodynames;
+
+    std::map<CacheTreeNodeConstPtr, CacheTreeNodePtr> mapClonedNodes;
+    _vsetLevelNodes.resize(r._vsetLevelNodes.size());
+    for(size_t ilevel = 0; ilevel < r._vsetLevelNodes.size(); ++ilevel) {
+        FOREACHC(itnode, r._vsetLevelNodes[ilevel]) {
+            CacheTreeNodePtr pclonenode = _CloneCacheTreeNode(*itnode);
+            pclonenode->_level = (*itnode)->_level;
+            pclonenode->_hasselfchild = (*itnode)->_hasselfchild;
+            pclonenode->_usenn = (*itnode)->_usenn;
+            mapClonedNodes[*itnode] = pclonenode;
+            _vsetLevelNodes[ilevel].insert(pclonenode);
+        }
+    }
+    FOREACHC(itclone, mapClonedNodes) {
+        itclone->second->_vchildren.resize(itclone->first->_vchildren.size());
+        for(size_t ichild = 0; ichild < itclone->first->_vchildren.size(); ++ichild) {
+            itclone->second->_vchildren[ichild] = mapClonedNodes[itclone->first->_vchildren[ichild]];
+        }
+    }
+    _numnodes = r._numnodes;
+}
+
+SharedCacheTree::SharedCacheTree(const CacheTree& tree, int publishbatchsize, dReal publishdelay)
+{
+    CacheTreePtr ptree(new CacheTree(1));
+    ptree->CopyFrom(tree);
+    // the tree is shared with other environments, so do not keep the links of this one
+    ptree->DetachCollidingLinks();
+    _ptree = ptree;
+    _statedof = ptree->GetWeights().size();
+    _publishbatchsize = publishbatchsize;
+    _publishdelay = publishdelay > 0 ? (uint64_t)(publishdelay*1000000) : 0;
+    _numpending = 0;
+    _firstpendingtime = 0;
+}
+
+void SharedCacheTree::InsertConfiguration(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist)
+{
+    OPENRAVE_ASSERT_OP((int)cs.size(),==,_statedof);
+    {
+        std::lock_guard<std::mutex> lock(_mutexPending);
+        _vpending.push_back(PendingConfiguration());
+        PendingConfiguration& pending = _vpending.back();
+        pending.cs = cs;
+        pending.bcollision = !!report;
+        pending.robotlinkindex = -1;
+        pending.collidinglinkindex = -1;
+        if( !!report ) {
+            if( !!report->plink1 ) {
+                pending.robotlinkindex = report->plink1->GetIndex();
+            }
+            if( !!report->plink2 ) {
+                KinBodyPtr pcollidingbody = report->plink2->GetParent(true);
+                if( !!pcollidingbody ) {
+                    pending.collidingbodyname = pcollidingbody->GetName();
+                    pending.collidinglinkindex = report->plink2->GetIndex();
+                }
+            }
+        }
+        pending.fMinSeparationDist = fMinSeparationDist;
+        if( _vpending.size() == 1 ) {
+            _firstpendingtime = utils::GetMicroTime();
+        }
+        _numpending = _vpending.size();
+    }
+    PublishIfDue();
+}
+
+void SharedCacheTree::PublishIfDue()
+{
+    int numpending = _numpending.load(std::memory_order_relaxed);
+    if( numpending == 0 ) {
+        return;
+    }
+    if( numpending < _publishbatchsize && utils::GetMicroTime() < _firstpendingtime.load(std::memory_order_relaxed) + _publishdelay ) {
+        return;
+    }
+    // if another thread is already publishing, the configurations will be merged by the next publish
+    std::unique_lock<std::mutex> lockpublish(_mutexPublish, std::try_to_lock);
+    if( lockpublish.owns_lock() ) {
+        _Publish();
+    }
+}
+
+void SharedCacheTree::Publish()
+{
+    std::lock_guard<std::mutex> lockpublish(_mutexPublish);
+    _Publish();
+}
+
+int SharedCacheTree::GetNumPendingConfigurations() const
+{
+    std::lock_guard<std::mutex> lock(_mutexPending);
+    return _vpending.size();
+}
+
+void SharedCacheTree::_Publish()
+{
+    std::vector<PendingConfiguration> vpending;
+    {
+        std::lock_guard<std::mutex> lock(_mutexPending);
+        vpending.swap(_vpending);
+        _numpending = 0;
+        _firstpendingtime = 0;
+    }
+    if( vpending.size() == 0 ) {
+        return;
+    }
+
+    // readers keep using the old tree while the new one is built
+    CacheTreePtr pnewtree(new CacheTree(_statedof));
+    pnewtree->CopyFrom(*GetTree());
+    FOREACHC(itpending, vpending) {
+        if( itpending->bcollision ) {
+            pnewtree->InsertCollisionNode(itpending->cs, itpending->robotlinkindex, itpending->collidingbodyname, itpending->collidinglinkindex, itpending->fMinSeparationDist);
+        }
+        else {
+            pnewtree->InsertNode(itpending->cs, CollisionReportPtr(), itpending->fMinSeparationDist);
+        }
+    }
+    boost::atomic_store(&_ptree, CacheTreeConstPtr(pnewtree));
+}
+
 ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates) : _cachetree(pstaterobot->GetDOF())
 {
     _userdatakey = std::string("configurationcache") + boost::lexical_cast<std::string>(this);
@@ -1331,6 +1658,56 @@ std::pair<std::vector<dReal>, dReal> ConfigurationCache::FindNearestNode(const s
     return make_pair(std::vector<dReal>(0), dReal(0));
 }
 
+SharedCacheTreePtr ConfigurationCache::CreateSharedTree(int publishbatchsize, dReal publishdelay) const
+{
+    return SharedCacheTreePtr(new SharedCacheTree(_cachetree, publishbatchsize, publishdelay));
+}
+
+int ConfigurationCache::CheckCollision(const SharedCacheTree& sharedtree, const std::vector<dReal>& conf, KinBody::LinkConstPtr& robotlink, KinBody::LinkConstPtr& collidinglink, dReal& closestdist) const
+{
+    // hold the tree until done with its nodes
+    CacheTreeConstPtr ptree = sharedtree.GetTree();
+    std::pair<CacheTreeNodeConstPtr, dReal> knn = ptree->FindNearestNode(conf, _collisionthresh, _freespacethresh);
+    if( !knn.first ) {
+        return -1;
+    }
+
+    closestdist = knn.second;
+    if( !knn.first->IsInCollision() ) {
+        return 0;
+    }
+
+    robotlink.reset();
+    if( knn.first->GetRobotLinkIndex() >= 0 && knn.first->GetRobotLinkIndex() < (int)_pstaterobot->GetLinks().size() ) {
+        robotlink = _pstaterobot->GetLinks()[knn.first->GetRobotLinkIndex()];
+    }
+
+    // the node could have been inserted from another environment, so find the link with the same body name and index in this one
+    collidinglink.reset();
+    if( knn.first->GetCollidingBodyIndex() >= 0 && knn.first->GetCollidingLinkIndex() >= 0 ) {
+        const std::string& collidingbodyname = ptree->GetCollidingBodyName(knn.first);
+        KinBodyPtr pbody = collidingbodyname == _pstaterobot->GetName() ? KinBodyPtr(_pstaterobot) : _penv->GetKinBody(collidingbodyname);
+        if( !!pbody && knn.first->GetCollidingLinkIndex() < (int)pbody->GetLinks().size() ) {
+            collidinglink = pbody->GetLinks()[knn.first->GetCollidingLinkIndex()];
+        }
+    }
+    return 1;
+}
+
+void ConfigurationCache::InsertConfiguration(SharedCacheTree& sharedtree, const std::vector<dReal>& conf, CollisionReportPtr report) const
+{
+    CollisionReportPtr preport;
+    if( !!report ) {
+        preport.reset(new CollisionReport());
+        preport->plink1 = report->plink1;
+        preport->plink2 = report->plink2;
+        if( !!preport->plink2 && preport->plink2->GetParent() == _pstaterobot ) {
+            std::swap(preport->plink1, preport->plink2);
+        }
+    }
+    sharedtree.InsertConfiguration(conf, preport, !report ? _freespacethresh*_insertiondistancemult : _collisionthresh*_insertiondistancemult);
+}
+
 int ConfigurationCache::CheckCollision(KinBody::LinkConstPtr& robotlink, KinBody::LinkConstPtr& collidinglink, dReal& closestdist)
 {
     std::vector<dReal> conf;
@@ -1349,6 +1726,43 @@ bool ConfigurationCache::Validate()
     return _cachetree.Validate();
 }
 
+std::string ConfigurationCache::GetCacheKey() const
+{
+    std::stringstream ss;
+    ss << _pstaterobot->GetKinematicsGeometryHash() << " " << _pstaterobot->GetDOF();
+    std::vector<KinBodyPtr> vgrabbedbodies;
+    _pstaterobot->GetGrabbed(vgrabbedbodies);
+    FOREACHC(itbody, vgrabbedbodies) {
+        ss << " " << (*itbody)->GetKinematicsGeometryHash();
+    }
+    return utils::GetMD5HashString(ss.str());
+}
+
+std::string ConfigurationCache::GetEnvironmentGeometryHash() const
+{
+    std::vector<KinBodyPtr> vbodies;
+    _penv->GetBodies(vbodies);
+    std::map<std::string, KinBodyPtr> mapbodies; // sorted by name so that the hash does not depend on the order bodies were added
+    FOREACHC(itbody, vbodies) {
+        if( *itbody != _pstaterobot && !_pstaterobot->IsGrabbing(**itbody) ) {
+            mapbodies[(*itbody)->GetName()] = *itbody;
+        }
+    }
+
+    std::stringstream ss;
+    ss << std::setprecision(std::numeric_limits<dReal>::digits10+1);
+    std::vector<Transform> vlinktransforms;
+    FOREACHC(itbody, mapbodies) {
+        ss << itbody->first << " " << itbody->second->GetKinematicsGeometryHash();
+        itbody->second->GetLinkTransformations(vlinktransforms);
+        FOREACHC(itlink, itbody->second->GetLinks()) {
+            ss << " " << (*itlink)->IsEnabled() << " " << vlinktransforms.at((*itlink)->GetIndex());
+        }
+        ss << std::endl;
+    }
+    return utils::GetMD5HashString(ss.str());
+}
+
 void ConfigurationCache::_UpdateUntrackedBody(KinBodyPtr pbody)
 {
     // body's state has changed, so remove collision space and invalidate free space.
@@ -17,6 +17,8 @@
 
 #include "openraveplugindefs.h"
 #include <deque>
+#include <atomic>
+#include <mutex>
 #include <boost/pool/pool.hpp>
 
 #define _(msgid) OpenRAVE::RaveGetLocalizedTextForDomain("openrave_plugins_configurationcache", msgid)
@@ -48,10 +50,15 @@ public:
 
     /// \brief returns the index of the colliding link
     inline int GetCollidingLinkIndex() const {
-        return _collidinglink->GetIndex();
+        return _collidinglinkindex;
     }
 
-    /// \brief returns the colliding link
+    /// \brief returns the index of the colliding body name in CacheTree::GetCollidingBodyName, -1 if the node holds the colliding link itself
+    inline int GetCollidingBodyIndex() const {
+        return _collidingbodyindex;
+    }
+
+    /// \brief returns the colliding link, empty if the tree does not store link pointers (see CacheTree::DetachCollidingLinks)
     inline KinBody::LinkConstPtr GetCollidingLink() const {
         return _collidinglink;
     }
@@ -100,8 +107,10 @@ public:
     }
 
     /// \brief function used to update the hitcount for this node, TODO use this information to prune cache when it gets too big/slow
-    inline int IncreaseHitCount(){
-        return _hitcount++;
+    ///
+    /// can be called from concurrent readers of a shared tree
+    inline int IncreaseHitCount() const {
+        return _hitcount.fetch_add(1, std::memory_order_relaxed);
     }
 
     // returns closest distance to a configuration of the opposite type seen so far
@@ -122,6 +131,8 @@ protected:
     KinBody::LinkConstPtr _collidinglink; ///< collidinglink in the collision report for this node
     Transform _collidinglinktrans; ///< the colliding link's transform. Valid if _conftype is CNT_Collision
     int _robotlinkindex; ///< the robot link index that is colliding with _collidinglink. Valid if _conftype is CNT_Collision
+    int _collidinglinkindex; ///< the index of the colliding link in its body. Valid if _conftype is CNT_Collision
+    int _collidingbodyindex; ///< if >= 0, index into CacheTree::_vcollidingbodynames of the colliding body and _collidinglink is empty
 
     // idea: keep k nearest neighbors and update k every now and then, k = (e + e/dim) * log(n+1) where n is the size of the tree?
     //std::map<int,std::vector<CacheTreeNodePtr> > _children; //maybe use a vector for each level somehow
@@ -131,7 +142,7 @@ protected:
     int16_t _level; ///< the level the node belongs to
     uint8_t _hasselfchild; ///< if 1, then _vchildren has contains a clone of this node in the level below it.
     uint8_t _usenn; ///< if 1, then use part of the nearest neighbor search, otherwise ignore
-    int _hitcount; /// number of cache hits
+    mutable std::atomic<int> _hitcount; /// number of cache hits
 
     // managed by pool
 #ifdef _DEBUG
@@ -194,6 +205,17 @@ public:
     /// \return 1 if point is inserted and parent found. 0 if no parent found and point is not inserted. -1 if parent found but point not inserted since it is close to fMinSeparationDist
     int InsertNode(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist);
 
+    /// \brief inserts a collision node that refers to the colliding link by body name and link index instead of a link pointer
+    ///
+    /// \return same as InsertNode
+    int InsertCollisionNode(const std::vector<dReal>& cs, int robotlinkindex, const std::string& collidingbodyname, int collidinglinkindex, dReal fMinSeparationDist);
+
+    /// \brief replaces the colliding link pointers of all nodes by body names and link indices, so that the tree does not reference any environment
+    void DetachCollidingLinks();
+
+    /// \brief returns the name of the colliding body of a node with GetCollidingBodyIndex() >= 0
+    const std::string& GetCollidingBodyName(CacheTreeNodeConstPtr node) const;
+
     /// \brief removes node from the tree
     ///
     /// \return true if node is removed
@@ -258,17 +280,38 @@ public:
     /// \brief returns the number of configurations in the tree that are not CNT_Unknown
     int GetNumKnownNodes();
 
-    /// \brief save cache to disk
-    int SaveCache(std::string filename);
+    /// \brief replaces the contents of this tree with a deep copy of r. The state dof is also copied.
+    void CopyFrom(const CacheTree& r);
+
+    /// \brief save cache to disk in a versioned binary format
+    ///
+    /// Every colliding body is stored once together with its kinematics geometry hash so that LoadCache can detect stale collision configurations.
+    /// \param cachekey identifies the robot the tree was built for, LoadCache ignores files with a different key
+    /// \param envhash hash of the environment geometry at the time of saving
+    /// \return 1 if the file was written
+    int SaveCache(const std::string& filename, const std::string& cachekey, const std::string& envhash);
 
     /// \brief load cache from disk
-    int LoadCache(std::string filename, EnvironmentBasePtr penv);
+    ///
+    /// Collision configurations whose colliding body is not in the environment anymore or has a different kinematics geometry hash are set to CNT_Unknown.
+    /// \param probot the robot the tree is built for. The robot and its grabbed bodies are not part of the environment geometry.
+    /// \param cachekey has to match the key the file was saved with
+    /// \param envhash the current environment geometry hash. If it differs from the saved one and bkeepenvnodes is false, then all free configurations and all collision configurations with environment bodies are set to CNT_Unknown.
+    /// \param bkeepenvnodes if true, configurations do not depend on the environment geometry (self collision cache)
+    /// \return 1 if the cache was loaded, 0 if no compatible file was found
+    int LoadCache(const std::string& filename, EnvironmentBasePtr penv, RobotBaseConstPtr probot, const std::string& cachekey, const std::string& envhash, bool bkeepenvnodes);
 
 private:
     /// \brief creates new node on the pool
     CacheTreeNodePtr _CreateCacheTreeNode(const std::vector<dReal>& cs, CollisionReportPtr report);
     CacheTreeNodePtr _CloneCacheTreeNode(CacheTreeNodeConstPtr refnode);
 
+    /// \brief inserts a node created on the pool, deletes it if it is not inserted
+    int _InsertNode(CacheTreeNodePtr nodein, dReal fMinSeparationDist);
+
+    /// \brief returns the index of the body name in _vcollidingbodynames, adds it if not there
+    int _GetCollidingBodyIndex(const std::string& bodyname);
+
     /// \brief deletes the node from the pool and calls its destructor.
     void _DeleteCacheTreeNode(CacheTreeNodePtr pnode);
 
@@ -323,6 +366,7 @@ private:
     KinBodyPtr _pcollidingbody;
 
     std::map<CacheTreeNodePtr, int> _mapNodeIndices;
+    std::vector<std::string> _vcollidingbodynames; ///< names of the colliding bodies of nodes without link pointers, indexed by CacheTreeNode::_collidingbodyindex
     std::vector< std::set<CacheTreeNodePtr> > _vsetLevelNodes; ///< _vsetLevelNodes[enc(level)][node] holds the indices of the children of "node" of a given the level. enc(level) maps (-inf,inf) into [0,inf) so it can be indexed by the vector. Every node has an entry in a map here. If the node doesn't hold any children, then it is at the leaf of the tree. _vsetLevelNodes.at(_EncodeLevel(_maxlevel)) is the root.
 
     OPENRAVE_SHARED_PTR<boost::pool<> > _poolNodes; ///< the dynamically growing memory pool of nodes. Since each node's size is determined during run-time, the pool constructor has to be called with the correct node size
@@ -336,7 +380,7 @@ private:
     int _numnodes; ///< the number of nodes in the current tree starting at the root at _vsetLevelNodes.at(_EncodeLevel(_maxlevel))
     dReal _fMaxLevelBound; ///< pow(_base, _maxlevel)
 
-    // cache cache
+    // cache cache, only used when modifying the tree. const queries use per-thread buffers.
     mutable std::vector< std::pair<CacheTreeNodePtr, dReal> > _vCurrentLevelNodes, _vNextLevelNodes;
     mutable std::vector< std::vector<CacheTreeNodePtr> > _vvCacheNodes;
 
@@ -345,6 +389,70 @@ private:
 };
 
 typedef OPENRAVE_SHARED_PTR<CacheTree> CacheTreePtr;
+typedef OPENRAVE_SHARED_PTR<CacheTree const> CacheTreeConstPtr;
+
+/// \brief a read-mostly cache tree that can be queried by many threads and environment clones at the same time
+///
+/// Readers get the currently published tree with GetTree and query it without locking. Inserted configurations are queued
+/// and merged in batches into a copy of the published tree, which then atomically replaces it (read-copy-update).
+/// Trees that readers still hold stay valid until they are released.
+/// The tree does not hold any link pointers, colliding links are stored by body name and link index so that every environment can map them to its own bodies.
+class SharedCacheTree
+{
+public:
+    /// \param tree the initial tree, is copied without its link pointers
+    /// \param publishbatchsize number of queued configurations that triggers a new tree to be published
+    /// \param publishdelay [s] queued configurations are published at the latest this long after the first of them was queued
+    SharedCacheTree(const CacheTree& tree, int publishbatchsize=64, dReal publishdelay=0.05);
+
+    /// \brief returns the currently published tree, lock-free
+    CacheTreeConstPtr GetTree() const {
+        return boost::atomic_load(&_ptree);
+    }
+
+    /// \brief queues a configuration to be inserted at the next publish. Never blocks on readers or on a publish in progress.
+    ///
+    /// \param report plink1 is the robot link and plink2 the colliding link. Only their body names and indices are stored, so it can be reused by the caller.
+    void InsertConfiguration(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist);
+
+    /// \brief publishes the queued configurations if the batch is full or the oldest one waited longer than the publish delay.
+    ///
+    /// Called at every query so configurations do not stay queued when their inserter stops inserting. Does not block if another thread is publishing.
+    void PublishIfDue();
+
+    /// \brief merges all queued configurations into a new tree and publishes it
+    void Publish();
+
+    /// \brief number of configurations that are queued, but not published yet
+    int GetNumPendingConfigurations() const;
+
+private:
+    struct PendingConfiguration
+    {
+        std::vector<dReal> cs;
+        bool bcollision;
+        int robotlinkindex;
+        std::string collidingbodyname; ///< empty if the colliding link is not known
+        int collidinglinkindex;
+        dReal fMinSeparationDist;
+    };
+
+    /// \brief merges the queued configurations, assumes _mutexPublish is locked
+    void _Publish();
+
+    CacheTreeConstPtr _ptree; ///< the published tree, is never modified. Has to be accessed with atomic_load/atomic_store.
+    int _statedof;
+    int _publishbatchsize;
+    uint64_t _publishdelay; ///< [us]
+
+    mutable std::mutex _mutexPending; ///< protects _vpending
+    std::vector<PendingConfiguration> _vpending;
+    std::atomic<int> _numpending; ///< size of _vpending, readable without locking
+    std::atomic<uint64_t> _firstpendingtime; ///< time the first configuration of _vpending was queued [us]
+    std::mutex _mutexPublish; ///< only one thread builds a new tree at a time
+};
+
+typedef OPENRAVE_SHARED_PTR<SharedCacheTree> SharedCacheTreePtr;
 
 /** Maintains an up-to-date cache tree synchronized to the openrave environment. Tracks bodies being added removed, states changing, etc.
    The state of cache consists of the active DOFs of the robot that is passed in at constructor time.
@@ -489,18 +597,38 @@ public:
         _cachetree.UpdateCollisionNodes(pbody);
     }
 
-    /// \brief saves the cache to disk
-    inline void SaveCache(std::string filename)
+    /// \brief saves the cache to disk keyed by the robot kinematics geometry hash and the environment geometry hash
+    inline bool SaveCache(const std::string& filename)
     {
-        _cachetree.SaveCache(filename);
+        return _cachetree.SaveCache(filename, GetCacheKey(), GetEnvironmentGeometryHash()) > 0;
     }
 
-    /// \brief loads cache from disk
-    inline void LoadCache(std::string filename, EnvironmentBasePtr penv)
+    /// \brief loads cache from disk, stale configurations are invalidated
+    ///
+    /// \return true if a cache compatible with the current robot was found
+    inline bool LoadCache(const std::string& filename, EnvironmentBasePtr penv)
     {
-        _cachetree.LoadCache(filename, penv);
+        return _cachetree.LoadCache(filename, penv, _pstaterobot, GetCacheKey(), GetEnvironmentGeometryHash(), !_envupdates) > 0;
     }
 
+    /// \brief creates a shared tree seeded with the configurations currently in the cache
+    SharedCacheTreePtr CreateSharedTree(int publishbatchsize=64, dReal publishdelay=0.05) const;
+
+    /// \brief determine if current configuration is within threshold of a collision in a tree shared between several caches
+    ///
+    /// Uses the thresholds of this cache. Can be called concurrently with other readers of the shared tree. Colliding links are mapped to the environment of this cache.
+    /// \return 1 if in collision, 0 if not in collision, -1 if unknown
+    int CheckCollision(const SharedCacheTree& sharedtree, const std::vector<dReal>& cs, KinBody::LinkConstPtr& robotlink, KinBody::LinkConstPtr& collidinglink, dReal& closestdist) const;
+
+    /// \brief queues the configuration for insertion into the shared tree with the insertion distance of this cache
+    void InsertConfiguration(SharedCacheTree& sharedtree, const std::vector<dReal>& conf, CollisionReportPtr report) const;
+
+    /// \brief returns a hash of the robot kinematics geometry and its grabbed bodies, used to validate saved caches
+    std::string GetCacheKey() const;
+
+    /// \brief returns a hash of the kinematics geometry and link transforms of all bodies except the robot and its grabbed bodies
+    std::string GetEnvironmentGeometryHash() const;
+
 private:
     /// \brief called when body has changed state.
     void _UpdateUntrackedBody(KinBodyPtr pbody);
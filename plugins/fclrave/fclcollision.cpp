@@ -2,6 +2,9 @@
 
 #include "fclcollision.h"
 
+#include <numeric>
+#include <thread>
+
 namespace fclrave {
 
 bool CompareGeometryPairContact(const CollisionReport::GeometryPairContact& pairContact1, const CollisionReport::GeometryPairContact& pairContact2)
@@ -113,6 +116,7 @@ FCLCollisionChecker::FCLCollisionChecker(OpenRAVE::EnvironmentBasePtr penv, std:
     _options = 0;
     // TODO : Should we put a more reasonable arbitrary value ?
     _numMaxContacts = std::numeric_limits<int>::max();
+    _fContinuousCollisionTolerance = 0.001;
     _nGetEnvManagerCacheClearCount = 100000;
     __description = ":Interface Author: Kenji Maillard\n\nFlexible Collision Library collision checker";
 
@@ -121,6 +125,10 @@ FCLCollisionChecker::FCLCollisionChecker(OpenRAVE::EnvironmentBasePtr penv, std:
     // TODO : Consider removing these which could be more harmful than anything else
     RegisterCommand("SetBroadphaseAlgorithm", boost::bind(&FCLCollisionChecker::SetBroadphaseAlgorithmCommand, this, _1, _2), "sets the broadphase algorithm (Naive, SaP, SSaP, IntervalTree, DynamicAABBTree, DynamicAABBTree_Array)");
     RegisterCommand("SetBVHRepresentation", boost::bind(&FCLCollisionChecker::_SetBVHRepresentation, this, _1, _2), "sets the Bouding Volume Hierarchy representation for meshes (AABB, OBB, OBBRSS, RSS, kIDS)");
+    RegisterCommand("SetContinuousCollisionTolerance", boost::bind(&FCLCollisionChecker::SetContinuousCollisionToleranceCommand, this, _1, _2), "sets the distance under which CheckContinuousCollision moves the links by this distance instead of advancing conservatively");
+    RegisterCommand("SetStaticDistanceField", boost::bind(&FCLCollisionChecker::SetStaticDistanceFieldCommand, this, _1, _2), "sets the voxel size and padding of the distance field of the static bodies used by ComputeStaticClearance, a voxel size of 0 removes the field");
+    RegisterCommand("GetGeometryBVHIds", boost::bind(&FCLCollisionChecker::GetGeometryBVHIdsCommand, this, _1, _2), "returns an id of the fcl collision geometry of every geometry of the body, bodies with the same meshes share the same BVH models [bodyname]");
+    RegisterCommand("PurgeSharedMeshBVHCache", boost::bind(&FCLCollisionChecker::PurgeSharedMeshBVHCacheCommand, this, _1, _2), "removes the BVH models that are not used anymore from the process-wide cache of the current representation, returns the number of models left");
 
     RAVELOG_VERBOSE_FORMAT("FCLCollisionChecker %s created in env %d", _userdatakey%penv->GetId());
 
@@ -169,6 +177,7 @@ FCLCollisionChecker::~FCLCollisionChecker() {
 void FCLCollisionChecker::Clone(InterfaceBaseConstPtr preference, int cloningoptions)
 {
     CollisionCheckerBase::Clone(preference, cloningoptions);
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     boost::shared_ptr<FCLCollisionChecker const> r = boost::dynamic_pointer_cast<FCLCollisionChecker const>(preference);
     // We don't clone Kinbody's specific geometry group
     _fclspace->SetGeometryGroup(r->GetGeometryGroup());
@@ -178,11 +187,18 @@ void FCLCollisionChecker::Clone(InterfaceBaseConstPtr preference, int cloningopt
     // We don't want to clone _bIsSelfCollisionChecker since a self collision checker can be created by cloning a environment collision checker
     _options = r->_options;
     _numMaxContacts = r->_numMaxContacts;
+    _fContinuousCollisionTolerance = r->_fContinuousCollisionTolerance;
+    // the field itself is rebuilt from the bodies of this environment
+    _pStaticDistanceField.reset();
+    if( !!r->_pStaticDistanceField ) {
+        _pStaticDistanceField.reset(new StaticDistanceField(r->_pStaticDistanceField->GetResolution(), r->_pStaticDistanceField->GetPadding()));
+    }
     RAVELOG_VERBOSE(str(boost::format("FCL User data cloning env %d into env %d") % r->GetEnv()->GetId() % GetEnv()->GetId()));
 }
 
 bool FCLCollisionChecker::SetCollisionOptions(int collision_options)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     _options = collision_options;
 
     if( _options & OpenRAVE::CO_RayAnyHit ) {
@@ -200,8 +216,70 @@ bool FCLCollisionChecker::SetBroadphaseAlgorithmCommand(ostream& sout, istream&
     return !!sinput;
 }
 
+bool FCLCollisionChecker::SetContinuousCollisionToleranceCommand(ostream& sout, istream& sinput)
+{
+    dReal ftolerance = 0;
+    sinput >> ftolerance;
+    if( !sinput || ftolerance <= 0 ) {
+        return false;
+    }
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    _fContinuousCollisionTolerance = ftolerance;
+    return true;
+}
+
+bool FCLCollisionChecker::SetStaticDistanceFieldCommand(ostream& sout, istream& sinput)
+{
+    dReal fresolution = 0, fpadding = 0;
+    sinput >> fresolution;
+    if( !sinput ) {
+        return false;
+    }
+    sinput >> fpadding;
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    if( fresolution <= 0 ) {
+        _pStaticDistanceField.reset();
+        return true;
+    }
+    _pStaticDistanceField.reset(new StaticDistanceField(fresolution, std::max(fpadding, dReal(0))));
+    return true;
+}
+
+bool FCLCollisionChecker::GetGeometryBVHIdsCommand(ostream& sout, istream& sinput)
+{
+    std::string bodyname;
+    sinput >> bodyname;
+    KinBodyPtr pbody = GetEnv()->GetKinBody(bodyname);
+    if( !pbody ) {
+        return false;
+    }
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    const FCLSpace::FCLKinBodyInfoPtr& pinfo = _fclspace->GetInfo(*pbody);
+    if( !pinfo ) {
+        return false;
+    }
+    bool bfirst = true;
+    FOREACHC(itlink, pinfo->vlinks) {
+        FOREACHC(itgeompair, (*itlink)->vgeoms) {
+            if( !bfirst ) {
+                sout << " ";
+            }
+            sout << (uint64_t)(*itgeompair).second->collisionGeometry().get();
+            bfirst = false;
+        }
+    }
+    return true;
+}
+
+bool FCLCollisionChecker::PurgeSharedMeshBVHCacheCommand(ostream& sout, istream& sinput)
+{
+    sout << _fclspace->PurgeSharedMeshBVHCache();
+    return true;
+}
+
 void FCLCollisionChecker::_SetBroadphaseAlgorithm(const std::string &algorithm)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if(_broadPhaseCollisionManagerAlgorithm == algorithm) {
         return;
     }
@@ -216,12 +294,14 @@ bool FCLCollisionChecker::_SetBVHRepresentation(ostream& sout, istream& sinput)
 {
     std::string type;
     sinput >> type;
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     _fclspace->SetBVHRepresentation(type);
     return !!sinput;
 }
 
 bool FCLCollisionChecker::InitEnvironment()
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     RAVELOG_VERBOSE(str(boost::format("FCL User data initializing %s in env %d") % _userdatakey % GetEnv()->GetId()));
     _bIsSelfCollisionChecker = false;
     _fclspace->SetIsSelfCollisionChecker(false);
@@ -235,22 +315,29 @@ bool FCLCollisionChecker::InitEnvironment()
 
 void FCLCollisionChecker::DestroyEnvironment()
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     RAVELOG_VERBOSE(str(boost::format("FCL User data destroying %s in env %d") % _userdatakey % GetEnv()->GetId()));
     _fclspace->DestroyEnvironment();
+    _rayMeshTrees.Clear();
 }
 
 bool FCLCollisionChecker::InitKinBody(OpenRAVE::KinBodyPtr pbody)
 {
     OpenRAVE::EnvironmentLock lock(GetEnv()->GetMutex());
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     FCLSpace::FCLKinBodyInfoPtr pinfo = _fclspace->GetInfo(*pbody);
     if( !pinfo || pinfo->GetBody() != pbody ) {
         pinfo = _fclspace->InitKinBody(pbody);
+        if( !!_pStaticDistanceField ) {
+            _pStaticDistanceField->Invalidate();
+        }
     }
     return !pinfo;
 }
 
 void FCLCollisionChecker::RemoveKinBody(OpenRAVE::KinBodyPtr pbody)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     const OpenRAVE::KinBody& body = *pbody;
 
     // remove body from all the managers
@@ -281,11 +368,16 @@ void FCLCollisionChecker::RemoveKinBody(OpenRAVE::KinBodyPtr pbody)
     if (numErased > 0) {
         RAVELOG_INFO_FORMAT("env=%s, erased %d element(s) from _envmanagers containing envBodyIndex=%d(\"%s\"), now %d remaining", GetEnv()->GetNameId()%numErased%envBodyIndex%body.GetName()%_envmanagers.size());
     }
+    if( !!_pStaticDistanceField ) {
+        _pStaticDistanceField->RemoveBody(body);
+        _pStaticDistanceField->Invalidate();
+    }
     _fclspace->RemoveUserData(pbody);
 }
 
 bool FCLCollisionChecker::CheckCollision(KinBodyConstPtr pbody1, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "Body/Env",_options,pbody1->IsRobot());
     // TODO : tailor this case when stuff become stable enough
     return CheckCollision(pbody1, std::vector<KinBodyConstPtr>(), std::vector<LinkConstPtr>(), report);
@@ -293,6 +385,7 @@ bool FCLCollisionChecker::CheckCollision(KinBodyConstPtr pbody1, CollisionReport
 
 bool FCLCollisionChecker::CheckCollision(KinBodyConstPtr pbody1, KinBodyConstPtr pbody2, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "Body/Body",_options,(pbody1->IsRobot() || pbody2->IsRobot()));
     if( !!report ) {
         report->Reset(_options);
@@ -337,6 +430,7 @@ bool FCLCollisionChecker::CheckCollision(KinBodyConstPtr pbody1, KinBodyConstPtr
 
 bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink,CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "Link/Env",_options,false);
     // TODO : tailor this case when stuff become stable enough
     return CheckCollision(plink, std::vector<KinBodyConstPtr>(), std::vector<LinkConstPtr>(), report);
@@ -344,6 +438,7 @@ bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink,CollisionReportPtr r
 
 bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink1, LinkConstPtr plink2, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "Link/Link",_options,false);
     if( !!report ) {
         report->Reset(_options);
@@ -394,6 +489,7 @@ bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink1, LinkConstPtr plink
 
 bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink, KinBodyConstPtr pbody,CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "Link/Body",_options,pbody->IsRobot());
 
     if( !!report ) {
@@ -441,6 +537,7 @@ bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink, KinBodyConstPtr pbo
 
 bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink, std::vector<KinBodyConstPtr> const &vbodyexcluded, std::vector<LinkConstPtr> const &vlinkexcluded, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if( !!report ) {
         report->Reset(_options);
     }
@@ -476,6 +573,7 @@ bool FCLCollisionChecker::CheckCollision(LinkConstPtr plink, std::vector<KinBody
 
 bool FCLCollisionChecker::CheckCollision(KinBodyConstPtr pbody, std::vector<KinBodyConstPtr> const &vbodyexcluded, std::vector<LinkConstPtr> const &vlinkexcluded, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if( !!report ) {
         report->Reset(_options);
     }
@@ -509,24 +607,44 @@ bool FCLCollisionChecker::CheckCollision(KinBodyConstPtr pbody, std::vector<KinB
 
 bool FCLCollisionChecker::CheckCollision(const RAY& ray, LinkConstPtr plink,CollisionReportPtr report)
 {
-    RAVELOG_WARN("fcl doesn't support Ray collisions\n");
-    return false; //TODO
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    if( !!report ) {
+        report->Reset(_options);
+    }
+    if( !plink->IsEnabled() ) {
+        return false;
+    }
+    _fclspace->Synchronize(*plink->GetParent());
+    FCLRayCaster rayCaster;
+    rayCaster.AddLink(*_fclspace->GetLinkInfo(*plink), _rayMeshTrees);
+    return _CheckRay(ray, rayCaster, report);
 }
 
 bool FCLCollisionChecker::CheckCollision(const RAY& ray, KinBodyConstPtr pbody, CollisionReportPtr report)
 {
-    RAVELOG_WARN("fcl doesn't support Ray collisions\n");
-    return false; //TODO
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    if( !!report ) {
+        report->Reset(_options);
+    }
+    FCLRayCaster rayCaster;
+    _AddRayBodies(pbody, rayCaster);
+    return _CheckRay(ray, rayCaster, report);
 }
 
 bool FCLCollisionChecker::CheckCollision(const RAY& ray, CollisionReportPtr report)
 {
-    RAVELOG_WARN("fcl doesn't support Ray collisions\n");
-    return false; //TODO
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    if( !!report ) {
+        report->Reset(_options);
+    }
+    FCLRayCaster rayCaster;
+    _AddRayBodies(KinBodyConstPtr(), rayCaster);
+    return _CheckRay(ray, rayCaster, report);
 }
 
 bool FCLCollisionChecker::CheckCollision(const OpenRAVE::TriMesh& trimesh, KinBodyConstPtr pbody, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if( !!report ) {
         report->Reset(_options);
     }
@@ -575,6 +693,7 @@ bool FCLCollisionChecker::CheckCollision(const OpenRAVE::TriMesh& trimesh, KinBo
 
 bool FCLCollisionChecker::CheckCollision(const OpenRAVE::TriMesh& trimesh, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if( !!report ) {
         report->Reset(_options);
     }
@@ -619,6 +738,7 @@ bool FCLCollisionChecker::CheckCollision(const OpenRAVE::TriMesh& trimesh, Colli
 
 bool FCLCollisionChecker::CheckCollision(const OpenRAVE::AABB& ab, const OpenRAVE::Transform& aabbPose, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if( !!report ) {
         report->Reset(_options);
     }
@@ -652,6 +772,7 @@ bool FCLCollisionChecker::CheckCollision(const OpenRAVE::AABB& ab, const OpenRAV
 
 bool FCLCollisionChecker::CheckCollision(const OpenRAVE::AABB& ab, const OpenRAVE::Transform& aabbPose, const std::vector<OpenRAVE::KinBodyConstPtr>& vIncludedBodies, OpenRAVE::CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     if( !!report ) {
         report->Reset(_options);
     }
@@ -693,6 +814,7 @@ bool FCLCollisionChecker::CheckCollision(const OpenRAVE::AABB& ab, const OpenRAV
 
 bool FCLCollisionChecker::CheckStandaloneSelfCollision(KinBodyConstPtr pbody, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "BodySelf",_options,pbody->IsRobot());
     if( !!report ) {
         report->Reset(_options);
@@ -759,6 +881,7 @@ bool FCLCollisionChecker::CheckStandaloneSelfCollision(KinBodyConstPtr pbody, Co
 
 bool FCLCollisionChecker::CheckStandaloneSelfCollision(LinkConstPtr plink, CollisionReportPtr report)
 {
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
     START_TIMING_OPT(_statistics, "LinkSelf",_options,false);
     if( !!report ) {
         report->Reset(_options);
@@ -826,6 +949,397 @@ bool FCLCollisionChecker::CheckStandaloneSelfCollision(LinkConstPtr plink, Colli
     return query._bCollision;
 }
 
+int FCLCollisionChecker::CheckCollisionBatch(KinBodyConstPtr pbody, const dReal* pconfigs, int numconfigs, const std::vector<int>& dofindices, std::vector<uint8_t>& vresults, int checkflags, CollisionReportPtr report)
+{
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    if( _options & OpenRAVE::CO_Distance ) {
+        // distance queries are not shared across configurations
+        return CollisionCheckerBase::CheckCollisionBatch(pbody, pconfigs, numconfigs, dofindices, vresults, checkflags, report);
+    }
+
+    START_TIMING_OPT(_statistics, "BodyBatch",_options,pbody->IsRobot());
+    vresults.resize(0);
+    vresults.resize(std::max(0, numconfigs), 0);
+    if( !!report ) {
+        report->Reset(_options);
+    }
+
+    if( numconfigs <= 0 || pbody->GetLinks().size() == 0 ) {
+        return 0;
+    }
+
+    // the body is only moved temporarily, its state is restored before returning
+    KinBodyPtr pmutablebody = boost::const_pointer_cast<KinBody>(pbody);
+    KinBody::KinBodyStateSaver saver(pmutablebody, KinBody::Save_LinkTransformation);
+
+    // pbody and its attached bodies are excluded from the environment manager, so it does not need to be synchronized again while only pbody moves
+    const bool bCheckEnv = (checkflags & OpenRAVE::CBF_Env) && _IsEnabled(*pbody);
+    _fclspace->Synchronize();
+    FCLCollisionManagerInstance& bodyManager = _GetBodyManager(pbody, !!(_options & OpenRAVE::CO_ActiveDOFs));
+    std::vector<int> attachedBodyIndices;
+    pbody->GetAttachedEnvironmentBodyIndices(attachedBodyIndices);
+    FCLCollisionManagerInstance& envManager = _GetEnvManager(attachedBodyIndices);
+
+    const std::vector<KinBodyConstPtr> vbodyexcluded;
+    const std::vector<LinkConstPtr> vlinkexcluded;
+    CollisionCallbackData query(shared_checker(), report, vbodyexcluded, vlinkexcluded);
+    CollisionReportPtr reportfirst = report; // reset once the first collision is recorded
+    const int dof = dofindices.size() > 0 ? (int)dofindices.size() : pbody->GetDOF();
+    int numcolliding = 0;
+    ADD_TIMING(_statistics);
+    for(int iconfig = 0; iconfig < numconfigs; ++iconfig) {
+        pmutablebody->SetDOFValues(pconfigs + iconfig*dof, dof, KinBody::CLA_Nothing, dofindices);
+        uint8_t result = 0;
+        if( bCheckEnv ) {
+            _fclspace->SynchronizeWithAttached(*pbody);
+            bodyManager.Synchronize();
+            query._bCollision = false;
+            query._bStopChecking = false;
+            if( !!query._report && query._report != report ) {
+                query._report->Reset(_options);
+            }
+#ifdef FCLRAVE_CHECKPARENTLESS
+            boost::shared_ptr<void> onexit((void*) 0, boost::bind(&FCLCollisionChecker::_PrintCollisionManagerInstanceBE, this, boost::ref(*pbody), boost::ref(bodyManager), boost::ref(envManager)));
+#endif
+            envManager.GetManager()->collide(bodyManager.GetManager().get(), &query, &FCLCollisionChecker::CheckNarrowPhaseCollision);
+            if( query._bCollision ) {
+                result |= OpenRAVE::CBF_Env;
+                if( !!reportfirst ) {
+                    reportfirst.reset();
+                    // keep the report of the first collision, callbacks still need a report to be filled
+                    query._report.reset();
+                    if( query._bHasCallbacks ) {
+                        query._report = boost::make_shared<CollisionReport>();
+                    }
+                }
+            }
+        }
+        if( (checkflags & OpenRAVE::CBF_Self) && CheckStandaloneSelfCollision(pbody, reportfirst) ) {
+            result |= OpenRAVE::CBF_Self;
+            if( !!reportfirst ) {
+                reportfirst.reset();
+                query._report.reset();
+                if( query._bHasCallbacks ) {
+                    query._report = boost::make_shared<CollisionReport>();
+                }
+            }
+        }
+        vresults[iconfig] = result;
+        if( result != 0 ) {
+            ++numcolliding;
+        }
+    }
+    return numcolliding;
+}
+
+bool FCLCollisionChecker::CheckContinuousCollision(KinBodyConstPtr pbody, const std::vector<dReal>& q0, const std::vector<dReal>& q1, const std::vector<int>& dofindices, int checkflags, dReal* pfContactTime, CollisionReportPtr report)
+{
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    const int dof = dofindices.size() > 0 ? (int)dofindices.size() : pbody->GetDOF();
+    OPENRAVE_ASSERT_OP((int)q0.size(), ==, dof);
+    OPENRAVE_ASSERT_OP((int)q1.size(), ==, dof);
+    if( (_options & OpenRAVE::CO_Distance) || pbody->GetClosedLoops().size() > 0 ) {
+        return CollisionCheckerBase::CheckContinuousCollision(pbody, q0, q1, dofindices, checkflags, pfContactTime, report);
+    }
+    FOREACHC(itjoint, pbody->GetPassiveJoints()) {
+        if( (*itjoint)->IsMimic() ) {
+            return CollisionCheckerBase::CheckContinuousCollision(pbody, q0, q1, dofindices, checkflags, pfContactTime, report);
+        }
+    }
+
+    // the joints that move along the segment and how much they move
+    std::vector<KinBody::JointPtr> vmovingjoints;
+    std::vector<dReal> vmovingdeltas;
+    for(int idof = 0; idof < dof; ++idof) {
+        const dReal fdelta = RaveFabs(q1[idof] - q0[idof]);
+        if( fdelta <= 0 ) {
+            continue;
+        }
+        const KinBody::JointPtr& pjoint = pbody->GetJointFromDOFIndex(dofindices.size() > 0 ? dofindices[idof] : idof);
+        if( !pjoint || pjoint->GetDOF() != 1 || pjoint->IsMimic() || (!pjoint->IsRevolute(0) && !pjoint->IsPrismatic(0)) ) {
+            return CollisionCheckerBase::CheckContinuousCollision(pbody, q0, q1, dofindices, checkflags, pfContactTime, report);
+        }
+        vmovingjoints.push_back(pjoint);
+        vmovingdeltas.push_back(fdelta);
+    }
+
+    std::vector<KinBodyPtr> vgrabbed;
+    std::vector<int> vgrabbinglinkindices;
+    pbody->GetGrabbed(vgrabbed);
+    FOREACHC(itgrabbed, vgrabbed) {
+        KinBody::LinkPtr pgrabbinglink = pbody->IsGrabbing(**itgrabbed);
+        vgrabbinglinkindices.push_back(!!pgrabbinglink ? pgrabbinglink->GetIndex() : -1);
+    }
+
+    // the body is only moved temporarily, its state is restored before returning
+    KinBodyPtr pmutablebody = boost::const_pointer_cast<KinBody>(pbody);
+    KinBody::KinBodyStateSaver saver(pmutablebody, KinBody::Save_LinkTransformation);
+    CollisionReportPtr pdistancereport = boost::make_shared<CollisionReport>();
+    std::vector<dReal> vconfig(dof);
+    dReal ftime = 0;
+    while(true) {
+        for(int idof = 0; idof < dof; ++idof) {
+            vconfig[idof] = q0[idof] + ftime*(q1[idof] - q0[idof]);
+        }
+        pmutablebody->SetDOFValues(vconfig, KinBody::CLA_Nothing, dofindices);
+        if( ((checkflags & OpenRAVE::CBF_Env) && CheckCollision(pbody, report)) || ((checkflags & OpenRAVE::CBF_Self) && CheckStandaloneSelfCollision(pbody, report)) ) {
+            if( !!pfContactTime ) {
+                *pfContactTime = ftime;
+            }
+            return true;
+        }
+        if( ftime >= 1 || vmovingjoints.size() == 0 ) {
+            return false;
+        }
+
+        // how far every point of the body can move before touching something. Two links of the same body can move towards each other, so the self distance counts half.
+        dReal fallowed = std::numeric_limits<dReal>::infinity();
+        if( checkflags & OpenRAVE::CBF_Env ) {
+            fallowed = std::min(fallowed, _ComputeEnvironmentDistance(pbody, pdistancereport));
+        }
+        if( checkflags & OpenRAVE::CBF_Self ) {
+            fallowed = std::min(fallowed, dReal(0.5)*_ComputeSelfDistanceLowerBound(pbody, pdistancereport));
+        }
+        fallowed = std::max(fallowed, _fContinuousCollisionTolerance);
+
+        // freach bounds the distance from the anchor of a moving revolute joint to the points it moves
+        dReal frevolutedelta = 0, fprismaticdelta = 0, freach = 0;
+        for(size_t ijoint = 0; ijoint < vmovingjoints.size(); ++ijoint) {
+            const KinBody::Joint& joint = *vmovingjoints[ijoint];
+            if( joint.IsPrismatic(0) ) {
+                fprismaticdelta += vmovingdeltas[ijoint]*RaveSqrt(joint.GetAxis(0).lengthsqr3());
+                continue;
+            }
+            frevolutedelta += vmovingdeltas[ijoint];
+            const Vector vanchor = joint.GetAnchor();
+            FOREACHC(itlink, pbody->GetLinks()) {
+                if( !pbody->DoesAffect(joint.GetJointIndex(), (*itlink)->GetIndex()) ) {
+                    continue;
+                }
+                const AABB ab = (*itlink)->ComputeAABB();
+                freach = std::max(freach, RaveSqrt((ab.pos - vanchor).lengthsqr3()) + RaveSqrt(ab.extents.lengthsqr3()));
+                for(size_t igrabbed = 0; igrabbed < vgrabbed.size(); ++igrabbed) {
+                    if( vgrabbinglinkindices[igrabbed] == (*itlink)->GetIndex() ) {
+                        const AABB abgrabbed = vgrabbed[igrabbed]->ComputeAABB();
+                        freach = std::max(freach, RaveSqrt((abgrabbed.pos - vanchor).lengthsqr3()) + RaveSqrt(abgrabbed.extents.lengthsqr3()));
+                    }
+                }
+            }
+            // the anchors of the child joints also move, so their distance bounds how much the reach can grow
+            FOREACHC(itotherjoint, vmovingjoints) {
+                const KinBody::LinkPtr pchildlink = (*itotherjoint)->GetHierarchyChildLink();
+                if( !!pchildlink && pbody->DoesAffect(joint.GetJointIndex(), pchildlink->GetIndex()) ) {
+                    freach = std::max(freach, RaveSqrt(((*itotherjoint)->GetAnchor() - vanchor).lengthsqr3()));
+                }
+            }
+        }
+
+        // a point at distance r from a revolute anchor moves at speed frevolutedelta*r, and r can grow by the motion of the point and of the anchor.
+        // so the motion m over a time dt is bounded by dm/dt <= frevolutedelta*(freach + 2*m) + fprismaticdelta
+        dReal fdeltatime = 1;
+        if( frevolutedelta > 1e-10 ) {
+            const dReal fscale = freach + fprismaticdelta/frevolutedelta;
+            if( fscale > 0 ) {
+                fdeltatime = RaveLog(1 + 2*fallowed/fscale)/(2*frevolutedelta);
+            }
+        }
+        else if( fprismaticdelta > 0 ) {
+            fdeltatime = fallowed/fprismaticdelta;
+        }
+        ftime = std::min(dReal(1), ftime + fdeltatime);
+    }
+}
+
+dReal FCLCollisionChecker::ComputeStaticClearance(KinBodyConstPtr pbody)
+{
+    std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+    if( !_pStaticDistanceField ) {
+        return CollisionCheckerBase::ComputeStaticClearance(pbody);
+    }
+
+    if( !pbody->IsRobot() && pbody->IsStatic() ) {
+        // pbody is part of the field
+        return CollisionCheckerBase::ComputeStaticClearance(pbody);
+    }
+    if( pbody->HasAttached() ) {
+        // the field cannot leave out static bodies attached to pbody
+        std::vector<KinBodyConstPtr> vattached;
+        pbody->GetAttached(vattached);
+        for (const KinBodyConstPtr& pattached : vattached) {
+            if( pattached != pbody && !pattached->IsRobot() && pattached->IsStatic() ) {
+                return CollisionCheckerBase::ComputeStaticClearance(pbody);
+            }
+        }
+    }
+
+    // collect the static bodies every time since any body can become static with Link::SetStatic
+    std::vector<KinBodyPtr> vbodies;
+    GetEnv()->GetBodies(vbodies);
+    std::vector<KinBodyConstPtr> vstaticbodies;
+    for (const KinBodyPtr& pstaticbody : vbodies) {
+        if( !pstaticbody->IsRobot() && pstaticbody->IsStatic() ) {
+            vstaticbodies.push_back(pstaticbody);
+        }
+    }
+    _pStaticDistanceField->Update(vstaticbodies);
+    return _pStaticDistanceField->ComputeClearance(*pbody);
+}
+
+int FCLCollisionChecker::CheckCollisionRays(const std::vector<RAY>& vrays, KinBodyConstPtr pbody, std::vector<OpenRAVE::RayCollisionResult>& vresults)
+{
+    static const size_t s_nMinRaysPerThread = 1024;
+    vresults.resize(0);
+    vresults.resize(vrays.size());
+    if( vrays.size() == 0 ) {
+        return 0;
+    }
+
+    // the geometries are copied into the ray caster, so only gathering them uses the fcl space
+    FCLRayCaster rayCaster;
+    bool bAnyHit;
+    {
+        std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
+        _AddRayBodies(pbody, rayCaster);
+        bAnyHit = !!(_options & OpenRAVE::CO_RayAnyHit);
+    }
+
+    const size_t numthreads = std::min((size_t)std::max(1u, std::thread::hardware_concurrency()), (vrays.size() + s_nMinRaysPerThread - 1)/s_nMinRaysPerThread);
+    if( numthreads <= 1 ) {
+        return rayCaster.CastRays(vrays, 0, vrays.size(), bAnyHit, vresults);
+    }
+
+    // CastRays only reads the ray caster, so every thread casts its own range of rays
+    const size_t numraysperthread = (vrays.size() + numthreads - 1)/numthreads;
+    std::vector<int> vnumhits(numthreads, 0);
+    std::vector<std::thread> vthreads;
+    for(size_t ithread = 1; ithread < numthreads; ++ithread) {
+        vthreads.emplace_back([&, ithread]() {
+            vnumhits[ithread] = rayCaster.CastRays(vrays, std::min(vrays.size(), ithread*numraysperthread), std::min(vrays.size(), (ithread+1)*numraysperthread), bAnyHit, vresults);
+        });
+    }
+    vnumhits[0] = rayCaster.CastRays(vrays, 0, numraysperthread, bAnyHit, vresults);
+    for (std::thread& thread : vthreads) {
+        thread.join();
+    }
+    return std::accumulate(vnumhits.begin(), vnumhits.end(), 0);
+}
+
+void FCLCollisionChecker::_AddRayBodies(KinBodyConstPtr pbody, FCLRayCaster& rayCaster)
+{
+    if( !!pbody ) {
+        if( pbody->IsEnabled() ) {
+            _fclspace->Synchronize(*pbody);
+            rayCaster.AddBody(*_fclspace, *pbody, _rayMeshTrees);
+        }
+        return;
+    }
+    _fclspace->Synchronize();
+    for (const KinBodyConstPtr& penvbody : _fclspace->GetEnvBodies()) {
+        if( !!penvbody && penvbody->IsEnabled() ) {
+            rayCaster.AddBody(*_fclspace, *penvbody, _rayMeshTrees);
+        }
+    }
+}
+
+bool FCLCollisionChecker::_CheckRay(const RAY& ray, const FCLRayCaster& rayCaster, CollisionReportPtr report)
+{
+    std::vector<RAY> vrays(1, ray);
+    std::vector<OpenRAVE::RayCollisionResult> vresults(1);
+    if( rayCaster.CastRays(vrays, 0, 1, !!(_options & OpenRAVE::CO_RayAnyHit), vresults) == 0 ) {
+        return false;
+    }
+    const OpenRAVE::RayCollisionResult& result = vresults[0];
+    if( !report ) {
+        return true;
+    }
+    _reportcache.Reset(_options);
+    _reportcache.plink1 = result.plink;
+    _reportcache.minDistance = result.fDistance;
+    _reportcache.contacts.push_back(CollisionReport::CONTACT(result.pos, result.norm, result.fDistance));
+    if( !(_options & OpenRAVE::CO_IgnoreCallbacks) && GetEnv()->HasRegisteredCollisionCallbacks() ) {
+        std::list<EnvironmentBase::CollisionCallbackFn> listcallbacks;
+        GetEnv()->GetRegisteredCollisionCallbacks(listcallbacks);
+        CollisionReportPtr preport(&_reportcache, OpenRAVE::utils::null_deleter());
+        FOREACH(callback, listcallbacks) {
+            if( (*callback)(preport, false) == OpenRAVE::CA_Ignore ) {
+                return false;
+            }
+        }
+    }
+    report->plink1 = _reportcache.plink1;
+    report->minDistance = _reportcache.minDistance;
+    report->contacts.swap(_reportcache.contacts);
+    return true;
+}
+
+dReal FCLCollisionChecker::_ComputeEnvironmentDistance(KinBodyConstPtr pbody, CollisionReportPtr report)
+{
+    report->Reset(_options);
+    if( pbody->GetLinks().size() == 0 || !_IsEnabled(*pbody) ) {
+        return report->minDistance;
+    }
+
+    _fclspace->Synchronize();
+    FCLCollisionManagerInstance& bodyManager = _GetBodyManager(pbody, !!(_options & OpenRAVE::CO_ActiveDOFs));
+    std::vector<int> attachedBodyIndices;
+    pbody->GetAttachedEnvironmentBodyIndices(attachedBodyIndices);
+    FCLCollisionManagerInstance& envManager = _GetEnvManager(attachedBodyIndices);
+
+    const std::vector<KinBodyConstPtr> vbodyexcluded;
+    const std::vector<LinkConstPtr> vlinkexcluded;
+    CollisionCallbackData query(shared_checker(), report, vbodyexcluded, vlinkexcluded);
+    envManager.GetManager()->distance(bodyManager.GetManager().get(), &query, &FCLCollisionChecker::CheckNarrowPhaseDistance);
+    return report->minDistance;
+}
+
+dReal FCLCollisionChecker::_ComputeSelfDistanceLowerBound(KinBodyConstPtr pbody, CollisionReportPtr report)
+{
+    report->Reset(_options);
+    if( pbody->GetLinks().size() <= 1 ) {
+        return report->minDistance;
+    }
+
+    int adjacentOptions = KinBody::AO_Enabled;
+    if( (_options & OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
+        adjacentOptions |= KinBody::AO_ActiveDOFs;
+    }
+    const std::vector<int> &nonadjacent = pbody->GetNonAdjacentLinks(adjacentOptions);
+    // We need to synchronize after calling GetNonAdjacentLinks since it can move pbody even if it is const
+    _fclspace->SynchronizeWithAttached(*pbody);
+
+    const std::vector<KinBodyConstPtr> vbodyexcluded;
+    const std::vector<LinkConstPtr> vlinkexcluded;
+    CollisionCallbackData query(shared_checker(), report, vbodyexcluded, vlinkexcluded);
+    query.bselfCollision = true;
+    dReal fmindistance = report->minDistance;
+    FCLKinBodyInfoPtr pinfo = _fclspace->GetInfo(*pbody);
+    FOREACH(itset, nonadjacent) {
+        size_t index1 = *itset&0xffff, index2 = *itset>>16;
+        const FCLSpace::FCLKinBodyInfo::LinkInfo& pLINK1 = *pinfo->vlinks.at(index1);
+        const FCLSpace::FCLKinBodyInfo::LinkInfo& pLINK2 = *pinfo->vlinks.at(index2);
+        if( pLINK1.GetLink()->IsSelfCollisionIgnored() || pLINK2.GetLink()->IsSelfCollisionIgnored() ) {
+            continue;
+        }
+        FOREACH(itgeom1, pLINK1.vgeoms) {
+            FOREACH(itgeom2, pLINK2.vgeoms) {
+                // the distance between the bounding boxes is a lower bound of the distance between the geometries
+                const dReal fboxdistance = (*itgeom1).second->getAABB().distance((*itgeom2).second->getAABB());
+                if( fboxdistance >= fmindistance ) {
+                    continue;
+                }
+                if( fboxdistance > 0 ) {
+                    fmindistance = fboxdistance;
+                    continue;
+                }
+                fcl::FCL_REAL dist = -1.0;
+                CheckNarrowPhaseGeomDistance((*itgeom1).second.get(), (*itgeom2).second.get(), &query, dist);
+                fmindistance = std::min(fmindistance, dReal(dist));
+            }
+        }
+    }
+    return fmindistance;
+}
+
 bool FCLCollisionChecker::CheckNarrowPhaseCollision(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data) {
     CollisionCallbackData* pcb = static_cast<CollisionCallbackData *>(data);
     return pcb->_pchecker->CheckNarrowPhaseCollision(o1, o2, pcb);
@@ -1219,8 +1733,17 @@ std::pair<FCLSpace::FCLKinBodyInfo::LinkInfo*, LinkConstPtr> FCLCollisionChecker
 
 std::pair<FCLSpace::FCLKinBodyInfo::FCLGeometryInfo*, GeometryConstPtr> FCLCollisionChecker::GetCollisionGeometry(const fcl::CollisionObject &collObj)
 {
-    const std::shared_ptr<const fcl::CollisionGeometry>& collgeom = collObj.collisionGeometry();
-    FCLSpace::FCLKinBodyInfo::FCLGeometryInfo* geom_raw = static_cast<FCLSpace::FCLKinBodyInfo::FCLGeometryInfo *>(collgeom->getUserData());
+    // the fcl geometries can be shared between bodies, so the geometry info is found from the link info of the collision object. vgeominfos and vgeoms are filled in the same order when the link is not using a geometry group.
+    FCLSpace::FCLKinBodyInfo::FCLGeometryInfo* geom_raw = nullptr;
+    const FCLSpace::FCLKinBodyInfo::LinkInfo* link_raw = static_cast<const FCLSpace::FCLKinBodyInfo::LinkInfo *>(collObj.getUserData());
+    if( !!link_raw && link_raw->vgeominfos.size() == link_raw->vgeoms.size() ) {
+        for (size_t igeom = 0; igeom < link_raw->vgeoms.size(); ++igeom) {
+            if( link_raw->vgeoms[igeom].second.get() == &collObj ) {
+                geom_raw = link_raw->vgeominfos[igeom].get();
+                break;
+            }
+        }
+    }
     if( !!geom_raw ) {
         const GeometryConstPtr pgeom = geom_raw->GetGeometry();
         if( !pgeom ) {
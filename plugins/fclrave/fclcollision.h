@@ -5,12 +5,15 @@
 #include <boost/bind/bind.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/lexical_cast.hpp>
+#include <mutex>
 #include <openrave/utils.h>
 
 #include <openrave/openrave.h>
 
 #include "fclspace.h"
 #include "fclmanagercache.h"
+#include "fcldistancefield.h"
+#include "fclraycast.h"
 
 #include "fclstatistics.h"
 
@@ -96,6 +99,7 @@ public:
     void Clone(InterfaceBaseConstPtr preference, int cloningoptions);
 
     void SetNumMaxContacts(int numMaxContacts) {
+        std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
         _numMaxContacts = numMaxContacts;
     }
 
@@ -105,6 +109,7 @@ public:
 
     void SetGeometryGroup(const std::string& groupname)
     {
+        std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
         _fclspace->SetGeometryGroup(groupname);
     }
 
@@ -115,6 +120,7 @@ public:
 
     bool SetBodyGeometryGroup(KinBodyConstPtr pbody, const std::string& groupname)
     {
+        std::lock_guard<std::recursive_mutex> lockquery(_mutexQuery);
         return _fclspace->SetBodyGeometryGroup(pbody, groupname);
     }
 
@@ -123,6 +129,14 @@ public:
         return _fclspace->GetBodyGeometryGroup(*pbody);
     }
 
+    /// \brief not reentrant, the queries synchronize and update the fcl space and managers shared by all the queries, so they still need the environment mutex to run with the state changes of the bodies.
+    ///
+    /// _mutexQuery only keeps the queries and the setters of this checker from running at the same time.
+    bool IsReentrant() const override
+    {
+        return false;
+    }
+
     virtual bool SetCollisionOptions(int collision_options);
 
     virtual int GetCollisionOptions() const
@@ -196,6 +210,39 @@ public:
 
     bool CheckStandaloneSelfCollision(LinkConstPtr plink, CollisionReportPtr report = CollisionReportPtr()) override;
 
+    /// \brief reuses the body and environment managers across all the configurations, only the moved body is synchronized between configurations
+    int CheckCollisionBatch(KinBodyConstPtr pbody, const dReal* pconfigs, int numconfigs, const std::vector<int>& dofindices, std::vector<uint8_t>& vresults, int checkflags=OpenRAVE::CBF_Env|OpenRAVE::CBF_Self, CollisionReportPtr report = CollisionReportPtr()) override;
+
+    /// \brief conservative advancement along the segment. At every step, the distance of the body to the environment and to itself bounds how far the body can move before it can collide, and the motion of the joints bounds how far the links move.
+    ///
+    /// Bodies with mimic joints, closed loops or joints with more than one dof are checked with the default discretization.
+    bool CheckContinuousCollision(KinBodyConstPtr pbody, const std::vector<dReal>& q0, const std::vector<dReal>& q1, const std::vector<int>& dofindices, int checkflags=OpenRAVE::CBF_Env|OpenRAVE::CBF_Self, dReal* pfContactTime=NULL, CollisionReportPtr report = CollisionReportPtr()) override;
+
+    /// Sets the distance under which CheckContinuousCollision stops advancing conservatively and moves the links by this distance instead. Obstacles thinner than this can be missed.
+    /// e.g. "SetContinuousCollisionTolerance 0.001"
+    bool SetContinuousCollisionToleranceCommand(ostream& sout, istream& sinput);
+
+    /// \brief casts all the rays against the geometries of the synchronized bodies, see FCLRayCaster. Large batches are split across threads.
+    ///
+    /// The registered collision callbacks are not called for the hits. Only gathering the geometries is serialized with the other queries, so several threads can cast rays at the same time.
+    int CheckCollisionRays(const std::vector<RAY>& vrays, KinBodyConstPtr pbody, std::vector<OpenRAVE::RayCollisionResult>& vresults) override;
+
+    /// \brief if a static distance field is set, answers from it with spheres enclosing the link geometries instead of computing exact distances.
+    ///
+    /// The field is rebuilt lazily when the static bodies change. Static bodies and bodies that have static bodies attached use the exact distance.
+    dReal ComputeStaticClearance(KinBodyConstPtr pbody) override;
+
+    /// Sets the voxel size and the padding of the distance field of the static bodies used by ComputeStaticClearance. A voxel size of 0 removes the field.
+    /// e.g. "SetStaticDistanceField 0.01 0.5"
+    bool SetStaticDistanceFieldCommand(ostream& sout, istream& sinput);
+
+    /// Returns an id of the fcl collision geometry of every geometry of the body, link by link. Bodies with the same meshes share their BVH models, so their ids are the same.
+    /// e.g. "GetGeometryBVHIds mug1"
+    bool GetGeometryBVHIdsCommand(ostream& sout, istream& sinput);
+
+    /// Removes the BVH models that are not used by any body from the process-wide cache of the current representation and returns the number of models left
+    bool PurgeSharedMeshBVHCacheCommand(ostream& sout, istream& sinput);
+
 
 private:
     inline boost::shared_ptr<FCLCollisionChecker> shared_checker() {
@@ -225,6 +272,18 @@ private:
 
     static LinkPair MakeLinkPair(LinkConstPtr plink1, LinkConstPtr plink2);
 
+    /// \brief synchronizes pbody, or all the bodies if pbody is empty, and adds their geometries to rayCaster. _mutexQuery has to be locked.
+    void _AddRayBodies(KinBodyConstPtr pbody, FCLRayCaster& rayCaster);
+
+    /// \brief casts one ray, fills the report and calls the collision callbacks with it like the other queries
+    bool _CheckRay(const RAY& ray, const FCLRayCaster& rayCaster, CollisionReportPtr report);
+
+    /// \brief returns the distance between pbody and the rest of the environment
+    dReal _ComputeEnvironmentDistance(KinBodyConstPtr pbody, CollisionReportPtr report);
+
+    /// \brief returns a lower bound of the distance between the non-adjacent links of pbody. Only the pairs of geometries with overlapping bounding boxes compute their exact distance.
+    dReal _ComputeSelfDistanceLowerBound(KinBodyConstPtr pbody, CollisionReportPtr report);
+
     std::pair<FCLSpace::FCLKinBodyInfo::LinkInfo*, LinkConstPtr> GetCollisionLink(const fcl::CollisionObject &collObj);
 
     std::pair<FCLSpace::FCLKinBodyInfo::FCLGeometryInfo*, GeometryConstPtr> GetCollisionGeometry(const fcl::CollisionObject &collObj);
@@ -266,9 +325,13 @@ private:
         return false;
     }
 
+    std::recursive_mutex _mutexQuery; ///< serializes the queries and the setters of this checker, recursive since the queries call each other and the collision callbacks can query again
     int _options;
     boost::shared_ptr<FCLSpace> _fclspace;
     int _numMaxContacts;
+    dReal _fContinuousCollisionTolerance; ///< distance under which CheckContinuousCollision does not advance conservatively anymore
+    StaticDistanceFieldPtr _pStaticDistanceField; ///< if set, used by ComputeStaticClearance
+    RayMeshTreeCache _rayMeshTrees; ///< mesh trees of the ray queries, shared by the ray casters of all queries
     std::string _userdatakey;
     std::string _broadPhaseCollisionManagerAlgorithm; ///< broadphase algorithm to use to create a manager. tested: Naive, DynamicAABBTree2
 
@@ -0,0 +1,359 @@
+#include "plugindefs.h"
+
+#include "fclspace.h"
+#include "fcldistancefield.h"
+
+namespace fclrave {
+
+namespace {
+
+static const size_t s_nMaxDistanceFieldVoxels = 1<<26; ///< the resolution is coarsened until the grid fits
+static const float s_fInfiniteDistance = 1e20f;
+
+enum VoxelState
+{
+    VS_Free = 0, ///< not touched by any triangle, still unknown if inside or outside
+    VS_Surface = 1, ///< touched by a triangle
+    VS_Outside = 2, ///< free and reachable from the border of the grid
+};
+
+/// \brief exact squared euclidean distance transform of a sampled function (Felzenszwalb and Huttenlocher). Entries of f equal to s_fInfiniteDistance are ignored.
+///
+/// \param v, z buffers of size n and n+1
+void _ComputeDistanceTransform1D(const float* f, int n, float* d, int* v, float* z)
+{
+    int k = -1;
+    for(int q = 0; q < n; ++q) {
+        if( f[q] >= s_fInfiniteDistance ) {
+            continue;
+        }
+        if( k < 0 ) {
+            k = 0;
+            v[0] = q;
+            z[0] = -s_fInfiniteDistance;
+            z[1] = s_fInfiniteDistance;
+            continue;
+        }
+        double s;
+        for(;;) {
+            const int p = v[k];
+            s = ((double(f[q]) + double(q)*q) - (double(f[p]) + double(p)*p))/(2.0*(q - p));
+            if( s > z[k] ) {
+                break;
+            }
+            --k; // z[0] is -infinity, so k never goes below 0
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k+1] = s_fInfiniteDistance;
+    }
+
+    if( k < 0 ) {
+        std::fill(d, d + n, s_fInfiniteDistance);
+        return;
+    }
+    k = 0;
+    for(int q = 0; q < n; ++q) {
+        while( z[k+1] < q ) {
+            ++k;
+        }
+        d[q] = float(q - v[k])*float(q - v[k]) + f[v[k]];
+    }
+}
+
+/// \brief computes the squared distance transform of vgrid in place along all three axes
+void _ComputeDistanceTransform3D(std::vector<float>& vgrid, const int dims[3])
+{
+    const int maxdim = std::max(dims[0], std::max(dims[1], dims[2]));
+    std::vector<float> vline(maxdim), vresult(maxdim), vz(maxdim+1);
+    std::vector<int> vv(maxdim);
+    const size_t strides[3] = { 1, (size_t)dims[0], (size_t)dims[0]*dims[1] };
+    for(int iaxis = 0; iaxis < 3; ++iaxis) {
+        // the two other axes enumerate the lines along iaxis
+        const int iaxis1 = (iaxis+1)%3, iaxis2 = (iaxis+2)%3;
+        const int n = dims[iaxis];
+        for(int i2 = 0; i2 < dims[iaxis2]; ++i2) {
+            for(int i1 = 0; i1 < dims[iaxis1]; ++i1) {
+                const size_t offset = i1*strides[iaxis1] + i2*strides[iaxis2];
+                for(int i = 0; i < n; ++i) {
+                    vline[i] = vgrid[offset + i*strides[iaxis]];
+                }
+                _ComputeDistanceTransform1D(vline.data(), n, vresult.data(), vv.data(), vz.data());
+                for(int i = 0; i < n; ++i) {
+                    vgrid[offset + i*strides[iaxis]] = vresult[i];
+                }
+            }
+        }
+    }
+}
+
+} // end namespace
+
+StaticDistanceField::StaticDistanceField(dReal fResolution, dReal fPadding) : _fResolution(fResolution), _fPadding(fPadding), _bInvalidated(true), _fBuildResolution(fResolution), _fConservativeOffset(0)
+{
+    BOOST_ASSERT(fResolution > 0);
+    _dims[0] = _dims[1] = _dims[2] = 0;
+}
+
+void StaticDistanceField::_InitBodyStamp(const KinBody& body, BodyStamp& stamp)
+{
+    stamp.pbody = body.shared_kinbody_const();
+    stamp.updateStamp = body.GetUpdateStamp();
+    stamp.structureRevision = body.GetStructureRevision();
+    stamp.geometryHash = body.GetKinematicsGeometryHash();
+    stamp.transform = body.GetTransform();
+    stamp.vLinkEnableStatesMasks = body.GetLinkEnableStatesMasks();
+}
+
+bool StaticDistanceField::_IsSameBody(const KinBody& body, const BodyStamp& stamp)
+{
+    return body.GetStructureRevision() == stamp.structureRevision
+           && body.GetTransform() == stamp.transform
+           && body.GetLinkEnableStatesMasks() == stamp.vLinkEnableStatesMasks
+           && body.GetKinematicsGeometryHash() == stamp.geometryHash;
+}
+
+bool StaticDistanceField::IsUpToDate(const std::vector<KinBodyConstPtr>& vstaticbodies) const
+{
+    if( _bInvalidated || vstaticbodies.size() != _vbodystamps.size() ) {
+        return false;
+    }
+    for(size_t ibody = 0; ibody < vstaticbodies.size(); ++ibody) {
+        BodyStamp& stamp = _vbodystamps[ibody];
+        const KinBody& body = *vstaticbodies[ibody];
+        if( stamp.pbody.lock() != vstaticbodies[ibody] ) {
+            return false;
+        }
+        if( body.GetUpdateStamp() == stamp.updateStamp ) {
+            continue;
+        }
+        // the stamp also changes when nothing relevant to the field changed, so compare the contents
+        if( !_IsSameBody(body, stamp) ) {
+            return false;
+        }
+        stamp.updateStamp = body.GetUpdateStamp();
+    }
+    return true;
+}
+
+void StaticDistanceField::Update(const std::vector<KinBodyConstPtr>& vstaticbodies)
+{
+    if( IsUpToDate(vstaticbodies) ) {
+        return;
+    }
+    _bInvalidated = false;
+    _Build(vstaticbodies);
+}
+
+void StaticDistanceField::_Build(const std::vector<KinBodyConstPtr>& vstaticbodies)
+{
+    uint64_t starttime = OpenRAVE::utils::GetMicroTime();
+    _vbodystamps.resize(vstaticbodies.size());
+    OpenRAVE::TriMesh worldmesh;
+    for(size_t ibody = 0; ibody < vstaticbodies.size(); ++ibody) {
+        const KinBody& body = *vstaticbodies[ibody];
+        _InitBodyStamp(body, _vbodystamps[ibody]);
+        for (const KinBody::LinkPtr& plink : body.GetLinks()) {
+            if( plink->IsEnabled() ) {
+                worldmesh.Append(plink->GetCollisionData(), plink->GetTransform());
+            }
+        }
+    }
+
+    _vvalues.clear();
+    _dims[0] = _dims[1] = _dims[2] = 0;
+    if( worldmesh.indices.size() == 0 ) {
+        return;
+    }
+    _abstatic = worldmesh.ComputeAABB();
+
+    // the padding keeps at least two free voxels at the border so that the outside can be flooded from there
+    dReal fresolution = _fResolution, fpadding = 0;
+    size_t numvoxels = 0;
+    for(;;) {
+        fpadding = std::max(_fPadding, 2*fresolution);
+        numvoxels = 1;
+        for(int iaxis = 0; iaxis < 3; ++iaxis) {
+            _dims[iaxis] = std::max(2, (int)OpenRAVE::RaveCeil(2*(_abstatic.extents[iaxis] + fpadding)/fresolution) + 1);
+            numvoxels *= _dims[iaxis];
+        }
+        if( numvoxels <= s_nMaxDistanceFieldVoxels ) {
+            break;
+        }
+        fresolution *= 1.25;
+    }
+    if( fresolution > _fResolution ) {
+        RAVELOG_WARN_FORMAT("static distance field with resolution %f would have too many voxels, using resolution %f", _fResolution%fresolution);
+    }
+    _fBuildResolution = fresolution;
+    _vorigin = _abstatic.pos - _abstatic.extents - Vector(fpadding, fpadding, fpadding);
+
+    // mark the voxels touched by the triangles. The samples are at most half a voxel apart, so the surface voxels of a triangle are connected and the flood fill cannot leak through them
+    std::vector<uint8_t> vstates(numvoxels, VS_Free);
+    const dReal finvresolution = 1/fresolution;
+    for(size_t itri = 0; itri+2 < worldmesh.indices.size(); itri += 3) {
+        const Vector& v0 = worldmesh.vertices.at(worldmesh.indices[itri]);
+        const Vector v01 = worldmesh.vertices.at(worldmesh.indices[itri+1]) - v0;
+        const Vector v02 = worldmesh.vertices.at(worldmesh.indices[itri+2]) - v0;
+        const dReal fmaxedge = RaveSqrt(std::max(v01.lengthsqr3(), std::max(v02.lengthsqr3(), (v02-v01).lengthsqr3())));
+        const int numsteps = std::max(1, (int)OpenRAVE::RaveCeil(2*fmaxedge*finvresolution));
+        for(int i = 0; i <= numsteps; ++i) {
+            for(int j = 0; i + j <= numsteps; ++j) {
+                const Vector vpoint = v0 + v01*(dReal(i)/numsteps) + v02*(dReal(j)/numsteps);
+                int index[3];
+                for(int iaxis = 0; iaxis < 3; ++iaxis) {
+                    index[iaxis] = std::min(_dims[iaxis]-1, std::max(0, (int)std::floor((vpoint[iaxis] - _vorigin[iaxis])*finvresolution + 0.5)));
+                }
+                vstates[((size_t)index[2]*_dims[1] + index[1])*_dims[0] + index[0]] = VS_Surface;
+            }
+        }
+    }
+
+    // flood the outside from the border of the grid, the free voxels that are not reached are inside of a body
+    std::vector<size_t> vstack;
+    for(int iz = 0; iz < _dims[2]; ++iz) {
+        for(int iy = 0; iy < _dims[1]; ++iy) {
+            for(int ix = 0; ix < _dims[0]; ++ix) {
+                if( ix == 0 || iy == 0 || iz == 0 || ix == _dims[0]-1 || iy == _dims[1]-1 || iz == _dims[2]-1 ) {
+                    const size_t index = ((size_t)iz*_dims[1] + iy)*_dims[0] + ix;
+                    if( vstates[index] == VS_Free ) {
+                        vstates[index] = VS_Outside;
+                        vstack.push_back(index);
+                    }
+                }
+            }
+        }
+    }
+    const size_t strides[3] = { 1, (size_t)_dims[0], (size_t)_dims[0]*_dims[1] };
+    while( !vstack.empty() ) {
+        const size_t index = vstack.back();
+        vstack.pop_back();
+        size_t remainder = index;
+        int voxel[3];
+        voxel[2] = remainder/strides[2]; remainder -= voxel[2]*strides[2];
+        voxel[1] = remainder/strides[1];
+        voxel[0] = remainder - voxel[1]*strides[1];
+        for(int iaxis = 0; iaxis < 3; ++iaxis) {
+            if( voxel[iaxis] > 0 && vstates[index - strides[iaxis]] == VS_Free ) {
+                vstates[index - strides[iaxis]] = VS_Outside;
+                vstack.push_back(index - strides[iaxis]);
+            }
+            if( voxel[iaxis]+1 < _dims[iaxis] && vstates[index + strides[iaxis]] == VS_Free ) {
+                vstates[index + strides[iaxis]] = VS_Outside;
+                vstack.push_back(index + strides[iaxis]);
+            }
+        }
+    }
+
+    // outside voxels store the distance to the closest occupied voxel, occupied voxels the negated distance to the closest outside voxel
+    std::vector<float> voutside(numvoxels), vinside(numvoxels);
+    for(size_t index = 0; index < numvoxels; ++index) {
+        const bool bOutside = vstates[index] == VS_Outside;
+        voutside[index] = bOutside ? s_fInfiniteDistance : 0;
+        vinside[index] = bOutside ? 0 : s_fInfiniteDistance;
+    }
+    _ComputeDistanceTransform3D(voutside, _dims);
+    _ComputeDistanceTransform3D(vinside, _dims);
+    _vvalues.resize(numvoxels);
+    for(size_t index = 0; index < numvoxels; ++index) {
+        _vvalues[index] = vstates[index] == VS_Outside ? float(RaveSqrt(voutside[index])*fresolution) : -float(RaveSqrt(vinside[index])*fresolution);
+    }
+
+    // every surface point is at most half a voxel from a sample, which is at most half a voxel diagonal from the center of its voxel. The interpolation adds at most one voxel diagonal.
+    _fConservativeOffset = (dReal(0.5) + dReal(1.5)*RaveSqrt(dReal(3)))*fresolution;
+    RAVELOG_DEBUG_FORMAT("built static distance field of %d bodies with %dx%dx%d voxels of size %f in %fs", vstaticbodies.size()%_dims[0]%_dims[1]%_dims[2]%fresolution%(1e-6*(OpenRAVE::utils::GetMicroTime()-starttime)));
+}
+
+dReal StaticDistanceField::GetDistance(const Vector& vpoint) const
+{
+    if( _vvalues.size() == 0 ) {
+        return s_fInfiniteDistance;
+    }
+
+    // points outside of the grid are clamped to it, the field changes by at most the distance moved
+    int index[3];
+    dReal fweights[3];
+    dReal fclampdistsqr = 0;
+    dReal fboxdistsqr = 0;
+    for(int iaxis = 0; iaxis < 3; ++iaxis) {
+        dReal f = (vpoint[iaxis] - _vorigin[iaxis])/_fBuildResolution;
+        const dReal fmax = _dims[iaxis]-1;
+        if( f < 0 ) {
+            fclampdistsqr += f*f;
+            f = 0;
+        }
+        else if( f > fmax ) {
+            fclampdistsqr += (f - fmax)*(f - fmax);
+            f = fmax;
+        }
+        index[iaxis] = std::min(_dims[iaxis]-2, (int)f);
+        fweights[iaxis] = f - index[iaxis];
+
+        const dReal fboxdist = RaveFabs(vpoint[iaxis] - _abstatic.pos[iaxis]) - _abstatic.extents[iaxis];
+        if( fboxdist > 0 ) {
+            fboxdistsqr += fboxdist*fboxdist;
+        }
+    }
+
+    const int ix = index[0], iy = index[1], iz = index[2];
+    const dReal wx = fweights[0], wy = fweights[1], wz = fweights[2];
+    const dReal c00 = _GetValue(ix, iy, iz)*(1-wx) + _GetValue(ix+1, iy, iz)*wx;
+    const dReal c10 = _GetValue(ix, iy+1, iz)*(1-wx) + _GetValue(ix+1, iy+1, iz)*wx;
+    const dReal c01 = _GetValue(ix, iy, iz+1)*(1-wx) + _GetValue(ix+1, iy, iz+1)*wx;
+    const dReal c11 = _GetValue(ix, iy+1, iz+1)*(1-wx) + _GetValue(ix+1, iy+1, iz+1)*wx;
+    const dReal fvalue = (c00*(1-wy) + c10*wy)*(1-wz) + (c01*(1-wy) + c11*wy)*wz;
+    const dReal fdistance = fvalue - RaveSqrt(fclampdistsqr)*_fBuildResolution - _fConservativeOffset;
+    if( fboxdistsqr > 0 ) {
+        // all the static geometries are inside of their bounding box
+        return std::max(fdistance, RaveSqrt(fboxdistsqr));
+    }
+    return fdistance;
+}
+
+const StaticDistanceField::BodySpheres& StaticDistanceField::_GetBodySpheres(const KinBody& body)
+{
+    BodySpheres& spheres = _mapbodyspheres[&body];
+    if( spheres.pbody.lock().get() == &body && spheres.structureRevision == body.GetStructureRevision() ) {
+        return spheres;
+    }
+
+    spheres.pbody = body.shared_kinbody_const();
+    spheres.structureRevision = body.GetStructureRevision();
+    spheres.tree = OpenRAVE::GetLinkSphereTree(body);
+    return spheres;
+}
+
+dReal StaticDistanceField::ComputeClearance(const KinBody& body)
+{
+    dReal fclearance = s_fInfiniteDistance;
+    if( _vvalues.size() == 0 ) {
+        return fclearance;
+    }
+
+    body.GetGrabbed(_vCachedGrabbedBodies);
+    for(size_t ibody = 0; ibody <= _vCachedGrabbedBodies.size(); ++ibody) {
+        const KinBody& querybody = ibody == 0 ? body : *_vCachedGrabbedBodies[ibody-1];
+        const BodySpheres& spheres = _GetBodySpheres(querybody);
+        for (const KinBody::LinkPtr& plink : querybody.GetLinks()) {
+            if( !plink->IsEnabled() ) {
+                continue;
+            }
+            const Transform& tlink = plink->GetTransform();
+            for (const Vector& vsphere : spheres.tree->vlinks.at(plink->GetIndex()).vouter) {
+                fclearance = std::min(fclearance, GetDistance(tlink*vsphere) - vsphere.w);
+                if( fclearance <= 0 ) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return fclearance;
+}
+
+void StaticDistanceField::RemoveBody(const KinBody& body)
+{
+    _mapbodyspheres.erase(&body);
+}
+
+} // fclrave
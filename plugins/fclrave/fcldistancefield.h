@@ -0,0 +1,105 @@
+// -*- coding: utf-8 -*-
+#ifndef OPENRAVE_FCL_DISTANCEFIELD
+#define OPENRAVE_FCL_DISTANCEFIELD
+
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fclrave {
+
+/// \brief signed distance field of the static bodies of the environment sampled on a voxel grid.
+///
+/// The field is built from the collision meshes of the enabled links of the static bodies. Voxels touched by a triangle are occupied, free voxels that cannot be reached from the border of the grid are inside of a body. Distances are computed with an exact euclidean distance transform and looked up with trilinear interpolation.
+///
+/// Bodies are queried through spheres that enclose the geometries of their links, so a query costs one lookup per sphere independent of the complexity of the static scene.
+class StaticDistanceField
+{
+public:
+    /// \param fResolution edge length of a voxel
+    /// \param fPadding free space added around the static bodies
+    StaticDistanceField(dReal fResolution, dReal fPadding);
+
+    inline dReal GetResolution() const {
+        return _fResolution;
+    }
+
+    inline dReal GetPadding() const {
+        return _fPadding;
+    }
+
+    /// \brief forces the next IsUpToDate to return false, for example when bodies are added to or removed from the environment
+    inline void Invalidate() {
+        _bInvalidated = true;
+    }
+
+    /// \brief returns true if the field was built from exactly vstaticbodies and none of them changed their geometry, transform or enabled links
+    ///
+    /// The caller has to pass all the current static bodies, so that bodies that became static after the field was built are detected.
+    bool IsUpToDate(const std::vector<KinBodyConstPtr>& vstaticbodies) const;
+
+    /// \brief rebuilds the field if it is not up to date with vstaticbodies. \see IsUpToDate
+    void Update(const std::vector<KinBodyConstPtr>& vstaticbodies);
+
+    /// \brief returns a lower bound of the distance from the point to the static bodies, negative inside of them
+    dReal GetDistance(const Vector& vpoint) const;
+
+    /// \brief returns a lower bound of the distance between the enabled links of the body and its attached bodies to the static bodies, 0 if in collision
+    dReal ComputeClearance(const KinBody& body);
+
+    /// \brief drops the cached sphere approximation of the body
+    void RemoveBody(const KinBody& body);
+
+private:
+    /// \brief what a static body looked like when the field was built
+    struct BodyStamp
+    {
+        KinBodyConstWeakPtr pbody;
+        int updateStamp = 0; ///< fast check, if equal then none of the other fields need to be compared
+        uint32_t structureRevision = 0;
+        std::string geometryHash;
+        Transform transform;
+        std::vector<uint64_t> vLinkEnableStatesMasks;
+    };
+
+    /// \brief spheres enclosing the geometries of each link of a body, the outer spheres of OpenRAVE::GetLinkSphereTree
+    struct BodySpheres
+    {
+        KinBodyConstWeakPtr pbody;
+        uint32_t structureRevision = 0;
+        OpenRAVE::LinkSphereTreeConstPtr tree;
+    };
+
+    static void _InitBodyStamp(const KinBody& body, BodyStamp& stamp);
+    static bool _IsSameBody(const KinBody& body, const BodyStamp& stamp);
+
+    void _Build(const std::vector<KinBodyConstPtr>& vstaticbodies);
+
+    const BodySpheres& _GetBodySpheres(const KinBody& body);
+
+    /// \brief value at voxel (ix, iy, iz)
+    inline float _GetValue(int ix, int iy, int iz) const {
+        return _vvalues[((size_t)iz*_dims[1] + iy)*_dims[0] + ix];
+    }
+
+    dReal _fResolution, _fPadding;
+    bool _bInvalidated; ///< if true, the static bodies have to be collected again
+    mutable std::vector<BodyStamp> _vbodystamps;
+
+    dReal _fBuildResolution; ///< resolution of the current grid, larger than _fResolution if the grid had too many voxels
+    dReal _fConservativeOffset; ///< subtracted from every lookup, covers the error of the voxelization and of the interpolation
+    Vector _vorigin; ///< center of voxel (0,0,0)
+    int _dims[3];
+    std::vector<float> _vvalues; ///< signed distance at the center of every voxel, x varies fastest. Empty if there are no static geometries.
+    OpenRAVE::AABB _abstatic; ///< bounding box of the static geometries
+
+    std::map<const KinBody*, BodySpheres> _mapbodyspheres;
+    std::vector<KinBodyPtr> _vCachedGrabbedBodies;
+};
+
+typedef boost::shared_ptr<StaticDistanceField> StaticDistanceFieldPtr;
+
+} // fclrave
+
+#endif
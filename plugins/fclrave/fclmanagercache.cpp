@@ -597,6 +597,8 @@ void FCLCollisionManagerInstance::Synchronize() {
                 // body.GetEnv()->GetId()%this%_fclspace.IsSelfCollisionChecker()%_lastSyncTimeStamp%body.GetName()%body.GetEnvironmentBodyIndex()%kinBodyInfo.nLastStamp%cache.nLastStamp%kinBodyInfo.vlinks.size()%_GetLinkMask(cache.linkEnableStatesBitmasks)%tpose.trans.x%tpose.trans.y%tpose.trans.z);
             }
             // transform changed
+            // if the body only went through one partial SetDOFValues since the last sync, only the moved links need updating in the manager
+            const bool bOnlyChangedLinks = body.GetChangedLinksUpdateStamp() == kinBodyInfo.nLastStamp && cache.nLastStamp == body.GetChangedLinksBaseUpdateStamp();
             CollisionObjectPtr pcolobj;
             for (uint64_t ilink = 0; ilink < kinBodyInfo.vlinks.size(); ++ilink) {
                 if (OpenRAVE::IsLinkStateBitEnabled(cache.linkEnableStatesBitmasks, ilink)) {
@@ -605,6 +607,9 @@ void FCLCollisionManagerInstance::Synchronize() {
                         // RAVELOG_VERBOSE_FORMAT("env=%d, %x (self=%d), body %s adding obj %x from link %d",
                         // body.GetEnv()->GetId()%this%_fclspace.IsSelfCollisionChecker()%body.GetName()%pColObjRaw%ilink);
                         if (cache.vcolobjs.at(ilink) == pcolobj) {
+                            if (bOnlyChangedLinks && !OpenRAVE::IsLinkStateBitEnabled(body.GetChangedLinksMasks(), ilink)) {
+                                continue;
+                            }
 #ifdef FCLRAVE_USE_BULK_UPDATE
                             // same object, so just update
                             pmanager->update(cache.vcolobjs.at(ilink).get(), false);
@@ -0,0 +1,502 @@
+#include "plugindefs.h"
+
+#include "fclspace.h"
+#include "fclraycast.h"
+
+namespace fclrave {
+
+namespace {
+
+static const size_t s_nRayPacketSize = 64; ///< number of consecutive rays that share the culling of the geometries
+static const int s_nMaxTrianglesPerLeaf = 4;
+static const dReal s_fParallelEpsilon = 1e-15;
+
+/// \brief clips the parameters [ftmin, ftmax] of vpos + t*vdir to the box, returns false if nothing is left
+inline bool _ClipRayToBox(const Vector& vpos, const Vector& vdir, const Vector& vmin, const Vector& vmax, dReal& ftmin, dReal& ftmax)
+{
+    for(int iaxis = 0; iaxis < 3; ++iaxis) {
+        if( OpenRAVE::RaveFabs(vdir[iaxis]) < s_fParallelEpsilon ) {
+            if( vpos[iaxis] < vmin[iaxis] || vpos[iaxis] > vmax[iaxis] ) {
+                return false;
+            }
+            continue;
+        }
+        const dReal finv = 1/vdir[iaxis];
+        dReal ft0 = (vmin[iaxis] - vpos[iaxis])*finv, ft1 = (vmax[iaxis] - vpos[iaxis])*finv;
+        if( ft0 > ft1 ) {
+            std::swap(ft0, ft1);
+        }
+        ftmin = std::max(ftmin, ft0);
+        ftmax = std::min(ftmax, ft1);
+        if( ftmin > ftmax ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// \brief box centered at the origin with half extents vextents. If vpos is inside, the exit point is returned.
+bool _IntersectBox(const Vector& vpos, const Vector& vdir, const Vector& vextents, dReal& ft, Vector& vnormal)
+{
+    dReal ftenter = -std::numeric_limits<dReal>::infinity(), ftexit = std::numeric_limits<dReal>::infinity();
+    int ienteraxis = -1, iexitaxis = -1;
+    for(int iaxis = 0; iaxis < 3; ++iaxis) {
+        if( OpenRAVE::RaveFabs(vdir[iaxis]) < s_fParallelEpsilon ) {
+            if( OpenRAVE::RaveFabs(vpos[iaxis]) > vextents[iaxis] ) {
+                return false;
+            }
+            continue;
+        }
+        dReal ft0 = (-vextents[iaxis] - vpos[iaxis])/vdir[iaxis], ft1 = (vextents[iaxis] - vpos[iaxis])/vdir[iaxis];
+        if( ft0 > ft1 ) {
+            std::swap(ft0, ft1);
+        }
+        if( ft0 > ftenter ) {
+            ftenter = ft0;
+            ienteraxis = iaxis;
+        }
+        if( ft1 < ftexit ) {
+            ftexit = ft1;
+            iexitaxis = iaxis;
+        }
+    }
+    if( ftenter > ftexit ) {
+        return false;
+    }
+    if( ienteraxis >= 0 && ftenter >= 0 ) {
+        if( ftenter > ft ) {
+            return false;
+        }
+        ft = ftenter;
+        vnormal = Vector();
+        vnormal[ienteraxis] = vdir[ienteraxis] > 0 ? -1 : 1;
+        return true;
+    }
+    if( iexitaxis < 0 || ftexit < 0 || ftexit > ft ) {
+        return false;
+    }
+    ft = ftexit;
+    vnormal = Vector();
+    vnormal[iexitaxis] = vdir[iexitaxis] > 0 ? 1 : -1;
+    return true;
+}
+
+/// \brief sphere centered at the origin
+bool _IntersectSphere(const Vector& vpos, const Vector& vdir, dReal fradius, dReal& ft, Vector& vnormal)
+{
+    const dReal fa = vdir.lengthsqr3();
+    if( fa <= 0 || fradius <= 0 ) {
+        return false;
+    }
+    const dReal fb = vpos.dot3(vdir), fc = vpos.lengthsqr3() - fradius*fradius;
+    const dReal fdisc = fb*fb - fa*fc;
+    if( fdisc < 0 ) {
+        return false;
+    }
+    const dReal fsqrtdisc = OpenRAVE::RaveSqrt(fdisc);
+    dReal fthit = (-fb - fsqrtdisc)/fa;
+    if( fthit < 0 ) {
+        fthit = (-fb + fsqrtdisc)/fa;
+    }
+    if( fthit < 0 || fthit > ft ) {
+        return false;
+    }
+    ft = fthit;
+    vnormal = (vpos + vdir*fthit)*(1/fradius);
+    return true;
+}
+
+/// \brief cylinder centered at the origin along the z axis
+bool _IntersectCylinder(const Vector& vpos, const Vector& vdir, dReal fradius, dReal fhalfheight, dReal& ft, Vector& vnormal)
+{
+    if( fradius <= 0 ) {
+        return false;
+    }
+    bool bHit = false;
+    const dReal fa = vdir.x*vdir.x + vdir.y*vdir.y;
+    if( fa > s_fParallelEpsilon ) {
+        const dReal fb = vpos.x*vdir.x + vpos.y*vdir.y, fc = vpos.x*vpos.x + vpos.y*vpos.y - fradius*fradius;
+        const dReal fdisc = fb*fb - fa*fc;
+        if( fdisc >= 0 ) {
+            const dReal fsqrtdisc = OpenRAVE::RaveSqrt(fdisc);
+            for (dReal fthit : {(-fb - fsqrtdisc)/fa, (-fb + fsqrtdisc)/fa}) {
+                if( fthit >= 0 && fthit <= ft && OpenRAVE::RaveFabs(vpos.z + fthit*vdir.z) <= fhalfheight ) {
+                    ft = fthit;
+                    vnormal = Vector((vpos.x + fthit*vdir.x)/fradius, (vpos.y + fthit*vdir.y)/fradius, 0);
+                    bHit = true;
+                    break;
+                }
+            }
+        }
+    }
+    if( OpenRAVE::RaveFabs(vdir.z) > s_fParallelEpsilon ) {
+        for (dReal fsign : {dReal(-1), dReal(1)}) {
+            const dReal fthit = (fsign*fhalfheight - vpos.z)/vdir.z;
+            if( fthit >= 0 && fthit <= ft ) {
+                const dReal fx = vpos.x + fthit*vdir.x, fy = vpos.y + fthit*vdir.y;
+                if( fx*fx + fy*fy <= fradius*fradius ) {
+                    ft = fthit;
+                    vnormal = Vector(0, 0, fsign);
+                    bHit = true;
+                }
+            }
+        }
+    }
+    return bHit;
+}
+
+template <typename T>
+void _GetModelMesh(const fcl::CollisionGeometry& geom, OpenRAVE::TriMesh& mesh)
+{
+    const fcl::BVHModel<T>& model = static_cast<const fcl::BVHModel<T>&>(geom);
+    mesh.vertices.resize(model.num_vertices);
+    for(int ivertex = 0; ivertex < model.num_vertices; ++ivertex) {
+        mesh.vertices[ivertex] = ConvertVectorFromFCL(model.vertices[ivertex]);
+    }
+    mesh.indices.resize(3*model.num_tris);
+    for(int itri = 0; itri < model.num_tris; ++itri) {
+        for(int j = 0; j < 3; ++j) {
+            mesh.indices[3*itri + j] = model.tri_indices[itri][j];
+        }
+    }
+}
+
+/// \brief copies the mesh of a BVH model built by FCLSpace, returns false for other fcl geometries
+bool _GetModelMesh(const fcl::CollisionGeometry& geom, OpenRAVE::TriMesh& mesh)
+{
+    switch(geom.getNodeType()) {
+    case fcl::BV_AABB: _GetModelMesh<fcl::AABB>(geom, mesh); return true;
+    case fcl::BV_OBB: _GetModelMesh<fcl::OBB>(geom, mesh); return true;
+    case fcl::BV_RSS: _GetModelMesh<fcl::RSS>(geom, mesh); return true;
+    case fcl::BV_kIOS: _GetModelMesh<fcl::kIOS>(geom, mesh); return true;
+    case fcl::BV_OBBRSS: _GetModelMesh<fcl::OBBRSS>(geom, mesh); return true;
+    case fcl::BV_KDOP16: _GetModelMesh< fcl::KDOP<16> >(geom, mesh); return true;
+    case fcl::BV_KDOP18: _GetModelMesh< fcl::KDOP<18> >(geom, mesh); return true;
+    case fcl::BV_KDOP24: _GetModelMesh< fcl::KDOP<24> >(geom, mesh); return true;
+    default:
+        return false;
+    }
+}
+
+} // end namespace
+
+RayMeshTree::RayMeshTree(const OpenRAVE::TriMesh& mesh)
+{
+    const int numtriangles = mesh.indices.size()/3;
+    std::vector<Triangle> vtriangles(numtriangles);
+    std::vector<Vector> vcentroids(numtriangles);
+    std::vector<int> vindices(numtriangles);
+    for(int itri = 0; itri < numtriangles; ++itri) {
+        const Vector& v0 = mesh.vertices.at(mesh.indices[3*itri]);
+        const Vector& v1 = mesh.vertices.at(mesh.indices[3*itri+1]);
+        const Vector& v2 = mesh.vertices.at(mesh.indices[3*itri+2]);
+        vtriangles[itri].v0 = v0;
+        vtriangles[itri].vedge1 = v1 - v0;
+        vtriangles[itri].vedge2 = v2 - v0;
+        vcentroids[itri] = (v0 + v1 + v2)*(dReal(1)/3);
+        vindices[itri] = itri;
+    }
+    if( numtriangles > 0 ) {
+        _vnodes.reserve(2*numtriangles/s_nMaxTrianglesPerLeaf + 1);
+        _vtriangles.reserve(numtriangles);
+        _Build(vindices, vcentroids, vtriangles, 0, numtriangles);
+    }
+}
+
+void RayMeshTree::_Build(std::vector<int>& vindices, std::vector<Vector>& vcentroids, const std::vector<Triangle>& vtriangles, int start, int end)
+{
+    const int inode = _vnodes.size();
+    _vnodes.push_back(Node());
+
+    Vector vmin = vtriangles[vindices[start]].v0, vmax = vmin;
+    Vector vcentroidmin = vcentroids[vindices[start]], vcentroidmax = vcentroidmin;
+    for(int i = start; i < end; ++i) {
+        const Triangle& tri = vtriangles[vindices[i]];
+        for (const Vector& v : {tri.v0, tri.v0 + tri.vedge1, tri.v0 + tri.vedge2}) {
+            for(int iaxis = 0; iaxis < 3; ++iaxis) {
+                vmin[iaxis] = std::min(vmin[iaxis], v[iaxis]);
+                vmax[iaxis] = std::max(vmax[iaxis], v[iaxis]);
+            }
+        }
+        const Vector& vcentroid = vcentroids[vindices[i]];
+        for(int iaxis = 0; iaxis < 3; ++iaxis) {
+            vcentroidmin[iaxis] = std::min(vcentroidmin[iaxis], vcentroid[iaxis]);
+            vcentroidmax[iaxis] = std::max(vcentroidmax[iaxis], vcentroid[iaxis]);
+        }
+    }
+    _vnodes[inode].vmin = vmin;
+    _vnodes[inode].vmax = vmax;
+
+    int isplitaxis = 0;
+    const Vector vcentroidextents = vcentroidmax - vcentroidmin;
+    for(int iaxis = 1; iaxis < 3; ++iaxis) {
+        if( vcentroidextents[iaxis] > vcentroidextents[isplitaxis] ) {
+            isplitaxis = iaxis;
+        }
+    }
+    if( end - start <= s_nMaxTrianglesPerLeaf || vcentroidextents[isplitaxis] <= 0 ) {
+        _vnodes[inode].index = _vtriangles.size();
+        _vnodes[inode].numtriangles = end - start;
+        for(int i = start; i < end; ++i) {
+            _vtriangles.push_back(vtriangles[vindices[i]]);
+        }
+        return;
+    }
+
+    const int mid = (start + end)/2;
+    std::nth_element(vindices.begin() + start, vindices.begin() + mid, vindices.begin() + end, [&vcentroids, isplitaxis](int i0, int i1) {
+        return vcentroids[i0][isplitaxis] < vcentroids[i1][isplitaxis];
+    });
+    _Build(vindices, vcentroids, vtriangles, start, mid);
+    _vnodes[inode].index = _vnodes.size();
+    _Build(vindices, vcentroids, vtriangles, mid, end);
+}
+
+bool RayMeshTree::Intersect(const Vector& vpos, const Vector& vdir, dReal& ft, Vector& vnormal) const
+{
+    if( _vnodes.size() == 0 ) {
+        return false;
+    }
+    // the tree is split at the median, so its depth is bounded by the number of bits of the triangle count
+    int vstack[64];
+    int numstack = 0;
+    vstack[numstack++] = 0;
+    bool bHit = false;
+    while( numstack > 0 ) {
+        const int inode = vstack[--numstack];
+        const Node& node = _vnodes[inode];
+        dReal ftmin = 0, ftmax = ft;
+        if( !_ClipRayToBox(vpos, vdir, node.vmin, node.vmax, ftmin, ftmax) ) {
+            continue;
+        }
+        if( node.numtriangles == 0 ) {
+            vstack[numstack++] = node.index;
+            vstack[numstack++] = inode + 1;
+            continue;
+        }
+        for(int itri = node.index; itri < node.index + node.numtriangles; ++itri) {
+            // Moller-Trumbore
+            const Triangle& tri = _vtriangles[itri];
+            const Vector vp = vdir.cross(tri.vedge2);
+            const dReal fdet = tri.vedge1.dot3(vp);
+            if( OpenRAVE::RaveFabs(fdet) < s_fParallelEpsilon ) {
+                continue;
+            }
+            const dReal finvdet = 1/fdet;
+            const Vector vt = vpos - tri.v0;
+            const dReal fu = vt.dot3(vp)*finvdet;
+            if( fu < 0 || fu > 1 ) {
+                continue;
+            }
+            const Vector vq = vt.cross(tri.vedge1);
+            const dReal fv = vdir.dot3(vq)*finvdet;
+            if( fv < 0 || fu + fv > 1 ) {
+                continue;
+            }
+            const dReal fthit = tri.vedge2.dot3(vq)*finvdet;
+            if( fthit < 0 || fthit > ft ) {
+                continue;
+            }
+            ft = fthit;
+            vnormal = tri.vedge1.cross(tri.vedge2);
+            bHit = true;
+        }
+    }
+    if( bHit ) {
+        const dReal flength = OpenRAVE::RaveSqrt(vnormal.lengthsqr3());
+        if( flength > 0 ) {
+            vnormal *= 1/flength;
+        }
+    }
+    return bHit;
+}
+
+void FCLRayCaster::AddBody(FCLSpace& space, const KinBody& body, RayMeshTreeCache& meshtrees)
+{
+    const FCLSpace::FCLKinBodyInfoPtr& pinfo = space.GetInfo(body);
+    if( !pinfo ) {
+        return;
+    }
+    for (const FCLSpace::LinkInfoPtr& plinkinfo : pinfo->vlinks) {
+        AddLink(*plinkinfo, meshtrees);
+    }
+}
+
+void FCLRayCaster::AddLink(const FCLSpace::FCLKinBodyInfo::LinkInfo& linkinfo, RayMeshTreeCache& meshtrees)
+{
+    const KinBody::LinkPtr plink = linkinfo.GetLink();
+    if( !plink || !plink->IsEnabled() ) {
+        return;
+    }
+    const Transform& tlink = plink->GetTransform();
+    for(size_t igeom = 0; igeom < linkinfo.vgeoms.size(); ++igeom) {
+        const TransformCollisionPair& geompair = linkinfo.vgeoms[igeom];
+        if( !geompair.second ) {
+            continue;
+        }
+        const CollisionGeometryPtr& pfclgeom = geompair.second->collisionGeometry();
+        RayGeometry raygeom;
+        switch(pfclgeom->getNodeType()) {
+        case fcl::GEOM_BOX:
+            raygeom.type = OpenRAVE::GT_Box;
+            raygeom.vsize = ConvertVectorFromFCL(static_cast<const fcl::Box&>(*pfclgeom).side)*dReal(0.5);
+            break;
+        case fcl::GEOM_SPHERE:
+            raygeom.type = OpenRAVE::GT_Sphere;
+            raygeom.vsize.x = static_cast<const fcl::Sphere&>(*pfclgeom).radius;
+            break;
+        case fcl::GEOM_CYLINDER:
+            raygeom.type = OpenRAVE::GT_Cylinder;
+            raygeom.vsize.x = static_cast<const fcl::Cylinder&>(*pfclgeom).radius;
+            raygeom.vsize.y = 0.5*static_cast<const fcl::Cylinder&>(*pfclgeom).lz;
+            break;
+        default: {
+            // geometry groups do not keep the openrave geometries, so only their BVH models can be used
+            KinBody::GeometryPtr pgeom;
+            if( igeom < linkinfo.vgeominfos.size() && !!linkinfo.vgeominfos[igeom] ) {
+                pgeom = linkinfo.vgeominfos[igeom]->GetGeometry();
+            }
+            raygeom.type = OpenRAVE::GT_TriMesh;
+            raygeom.ptree = meshtrees.GetMeshTree(pgeom.get(), pfclgeom);
+            if( !raygeom.ptree ) {
+                continue;
+            }
+            break;
+        }
+        }
+        const fcl::AABB& ab = geompair.second->getAABB();
+        raygeom.vmin = ConvertVectorFromFCL(ab.min_);
+        raygeom.vmax = ConvertVectorFromFCL(ab.max_);
+        raygeom.tgeom = tlink*geompair.first;
+        raygeom.tgeominv = raygeom.tgeom.inverse();
+        raygeom.plink = plink;
+        _vgeoms.push_back(raygeom);
+    }
+}
+
+int FCLRayCaster::CastRays(const std::vector<RAY>& vrays, size_t start, size_t end, bool bAnyHit, std::vector<OpenRAVE::RayCollisionResult>& vresults) const
+{
+    int numhits = 0;
+    std::vector<int> vpacketgeoms;
+    vpacketgeoms.reserve(_vgeoms.size());
+    for(size_t packetstart = start; packetstart < end; packetstart += s_nRayPacketSize) {
+        const size_t packetend = std::min(end, packetstart + s_nRayPacketSize);
+
+        // the box of all the segments of the packet
+        Vector vpacketmin = vrays[packetstart].pos, vpacketmax = vpacketmin;
+        for(size_t iray = packetstart; iray < packetend; ++iray) {
+            for (const Vector& v : {vrays[iray].pos, vrays[iray].pos + vrays[iray].dir}) {
+                for(int iaxis = 0; iaxis < 3; ++iaxis) {
+                    vpacketmin[iaxis] = std::min(vpacketmin[iaxis], v[iaxis]);
+                    vpacketmax[iaxis] = std::max(vpacketmax[iaxis], v[iaxis]);
+                }
+            }
+        }
+        vpacketgeoms.resize(0);
+        for(size_t igeom = 0; igeom < _vgeoms.size(); ++igeom) {
+            const RayGeometry& raygeom = _vgeoms[igeom];
+            if( raygeom.vmin.x <= vpacketmax.x && raygeom.vmax.x >= vpacketmin.x
+                && raygeom.vmin.y <= vpacketmax.y && raygeom.vmax.y >= vpacketmin.y
+                && raygeom.vmin.z <= vpacketmax.z && raygeom.vmax.z >= vpacketmin.z ) {
+                vpacketgeoms.push_back(igeom);
+            }
+        }
+        if( vpacketgeoms.size() == 0 ) {
+            continue;
+        }
+
+        for(size_t iray = packetstart; iray < packetend; ++iray) {
+            const RAY& ray = vrays[iray];
+            dReal fthit = 1; // the length of RAY::dir is the maximum distance
+            int ihitgeom = -1;
+            Vector vhitnormal;
+            for (int igeom : vpacketgeoms) {
+                const RayGeometry& raygeom = _vgeoms[igeom];
+                dReal ftmin = 0, ftmax = fthit;
+                if( !_ClipRayToBox(ray.pos, ray.dir, raygeom.vmin, raygeom.vmax, ftmin, ftmax) ) {
+                    continue;
+                }
+                const Vector vlocalpos = raygeom.tgeominv*ray.pos, vlocaldir = raygeom.tgeominv.rotate(ray.dir);
+                Vector vlocalnormal;
+                bool bHit = false;
+                switch(raygeom.type) {
+                case OpenRAVE::GT_Box:
+                    bHit = _IntersectBox(vlocalpos, vlocaldir, raygeom.vsize, fthit, vlocalnormal);
+                    break;
+                case OpenRAVE::GT_Sphere:
+                    bHit = _IntersectSphere(vlocalpos, vlocaldir, raygeom.vsize.x, fthit, vlocalnormal);
+                    break;
+                case OpenRAVE::GT_Cylinder:
+                    bHit = _IntersectCylinder(vlocalpos, vlocaldir, raygeom.vsize.x, raygeom.vsize.y, fthit, vlocalnormal);
+                    break;
+                default:
+                    bHit = raygeom.ptree->Intersect(vlocalpos, vlocaldir, fthit, vlocalnormal);
+                    break;
+                }
+                if( bHit ) {
+                    ihitgeom = igeom;
+                    vhitnormal = raygeom.tgeom.rotate(vlocalnormal);
+                    if( bAnyHit ) {
+                        break;
+                    }
+                }
+            }
+
+            OpenRAVE::RayCollisionResult& result = vresults[iray];
+            if( ihitgeom < 0 ) {
+                result = OpenRAVE::RayCollisionResult();
+                continue;
+            }
+            result.plink = _vgeoms[ihitgeom].plink;
+            result.pos = ray.pos + ray.dir*fthit;
+            result.norm = vhitnormal;
+            result.fDistance = fthit*OpenRAVE::RaveSqrt(ray.dir.lengthsqr3());
+            ++numhits;
+        }
+    }
+    return numhits;
+}
+
+RayMeshTreeConstPtr RayMeshTreeCache::GetMeshTree(const KinBody::Geometry* pgeom, const CollisionGeometryPtr& pfclgeom)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<const fcl::CollisionGeometry*, std::pair<std::weak_ptr<fcl::CollisionGeometry>, RayMeshTreeConstPtr> >::iterator it = _mapMeshTrees.find(pfclgeom.get());
+    if( it != _mapMeshTrees.end() && it->second.first.lock() == pfclgeom ) {
+        return it->second.second;
+    }
+
+    // the address can be reused by a new fcl geometry once the old one is destroyed
+    OpenRAVE::TriMesh mesh;
+    if( !_GetModelMesh(*pfclgeom, mesh) ) {
+        if( !pgeom ) {
+            return RayMeshTreeConstPtr();
+        }
+        mesh = pgeom->GetCollisionMesh();
+    }
+    _Prune();
+    std::pair<std::weak_ptr<fcl::CollisionGeometry>, RayMeshTreeConstPtr>& entry = _mapMeshTrees[pfclgeom.get()];
+    entry.first = pfclgeom;
+    entry.second.reset(new RayMeshTree(mesh));
+    return entry.second;
+}
+
+void RayMeshTreeCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _mapMeshTrees.clear();
+}
+
+void RayMeshTreeCache::_Prune()
+{
+    std::map<const fcl::CollisionGeometry*, std::pair<std::weak_ptr<fcl::CollisionGeometry>, RayMeshTreeConstPtr> >::iterator it = _mapMeshTrees.begin();
+    while( it != _mapMeshTrees.end() ) {
+        if( it->second.first.expired() ) {
+            it = _mapMeshTrees.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+} // fclrave
@@ -0,0 +1,103 @@
+// -*- coding: utf-8 -*-
+#ifndef OPENRAVE_FCL_RAYCAST
+#define OPENRAVE_FCL_RAYCAST
+
+#include <boost/shared_ptr.hpp>
+#include <limits>
+#include <map>
+#include <memory> // c++11
+#include <mutex>
+#include <vector>
+
+namespace fclrave {
+
+/// \brief bounding box hierarchy over the triangles of a mesh, used for ray queries in the frame of the mesh
+class RayMeshTree
+{
+public:
+    RayMeshTree(const OpenRAVE::TriMesh& mesh);
+
+    /// \brief finds the closest triangle hit by vpos + t*vdir for t in [0, ft]
+    ///
+    /// \param[inout] ft the upper bound of t, set to t of the hit
+    /// \param[out] vnormal the unit normal of the hit triangle, in the direction given by the winding of its indices
+    /// \return true if a triangle was hit
+    bool Intersect(const Vector& vpos, const Vector& vdir, dReal& ft, Vector& vnormal) const;
+
+private:
+    struct Node
+    {
+        Vector vmin, vmax;
+        int index = 0; ///< if a leaf, index of the first triangle in _vtriangles, otherwise index of the second child. The first child always follows its parent.
+        int numtriangles = 0; ///< 0 for internal nodes
+    };
+
+    /// \brief v0, v1-v0, v2-v0 of a triangle
+    struct Triangle
+    {
+        Vector v0, vedge1, vedge2;
+    };
+
+    void _Build(std::vector<int>& vindices, std::vector<Vector>& vcentroids, const std::vector<Triangle>& vtriangles, int start, int end);
+
+    std::vector<Node> _vnodes; ///< depth first, root at 0
+    std::vector<Triangle> _vtriangles; ///< ordered so that the triangles of every leaf are consecutive
+};
+
+typedef boost::shared_ptr<RayMeshTree const> RayMeshTreeConstPtr;
+
+/// \brief mesh trees of the fcl geometries, shared by the ray casters of all the queries of a checker. Can be used from several threads.
+class RayMeshTreeCache
+{
+public:
+    /// \brief returns the mesh tree of a fcl geometry, shared by all the geometries that share the same BVH model
+    ///
+    /// \param pgeom [optional] the geometry the fcl geometry was built from, its collision mesh is used if pfclgeom is not a BVH model
+    RayMeshTreeConstPtr GetMeshTree(const KinBody::Geometry* pgeom, const CollisionGeometryPtr& pfclgeom);
+
+    void Clear();
+
+private:
+    /// \brief drops the trees of the fcl geometries that were destroyed. _mutex has to be locked.
+    void _Prune();
+
+    std::mutex _mutex; ///< protects _mapMeshTrees
+    std::map<const fcl::CollisionGeometry*, std::pair<std::weak_ptr<fcl::CollisionGeometry>, RayMeshTreeConstPtr> > _mapMeshTrees; ///< indexed by the fcl geometries built from the meshes
+};
+
+/// \brief casts many rays against the enabled geometries of a set of links.
+///
+/// The rays are processed in packets of consecutive rays. A packet first culls the geometries with the box enclosing all of its rays, so neighboring rays of a sensor share the broadphase. The geometries are then tested with the world boxes computed by fcl and the exact box, sphere and cylinder shapes or the collision meshes of all other geometries.
+/// The geometries are copied when they are added, so every query builds its own ray caster and CastRays can be called from several threads without locking the fcl space.
+class FCLRayCaster
+{
+public:
+    /// \brief gathers the enabled geometries of the enabled links of the body. The body has to be synchronized with space.
+    void AddBody(FCLSpace& space, const KinBody& body, RayMeshTreeCache& meshtrees);
+
+    /// \brief gathers the geometries of one link. The link has to be synchronized.
+    void AddLink(const FCLSpace::FCLKinBodyInfo::LinkInfo& linkinfo, RayMeshTreeCache& meshtrees);
+
+    /// \brief casts the rays [start, end) of vrays and writes their closest hits into vresults
+    ///
+    /// \param bAnyHit if true, a ray stops at the first geometry it hits, which is not necessarily the closest
+    /// \return the number of rays that hit a geometry
+    int CastRays(const std::vector<RAY>& vrays, size_t start, size_t end, bool bAnyHit, std::vector<OpenRAVE::RayCollisionResult>& vresults) const;
+
+private:
+    struct RayGeometry
+    {
+        Vector vmin, vmax; ///< world box of the geometry
+        Transform tgeom, tgeominv; ///< world transform of the geometry and its inverse
+        OpenRAVE::GeometryType type = OpenRAVE::GT_None;
+        Vector vsize; ///< half extents of boxes, x is the radius of spheres and cylinders, y is the half height of cylinders
+        RayMeshTreeConstPtr ptree; ///< set for all types other than boxes, spheres and cylinders
+        LinkConstPtr plink;
+    };
+
+    std::vector<RayGeometry> _vgeoms;
+};
+
+} // fclrave
+
+#endif
@@ -3,6 +3,9 @@
 #include "fclspace.h"
 #include <fcl/container.h>
 
+#include <boost/functional/hash.hpp>
+#include <mutex>
+
 namespace fclrave {
 
 template <class T>
@@ -15,6 +18,154 @@ CollisionGeometryPtr ConvertMeshToFCL(std::vector<fcl::Vec3f> const &points,std:
     return model;
 }
 
+/// \brief process-wide cache of the BVH models of meshes indexed by their content
+///
+/// There is one cache per BVH type. The cached models are shared between all bodies, clones and checkers in the process, so they are never modified after being built. The cache only holds weak references, so models are freed when the last body using them is destroyed.
+template <class T>
+class SharedMeshBVHCache
+{
+public:
+    static SharedMeshBVHCache& GetInstance()
+    {
+        static SharedMeshBVHCache s_cache;
+        return s_cache;
+    }
+
+    CollisionGeometryPtr GetGeometry(std::vector<fcl::Vec3f> const &points, std::vector<fcl::Triangle> const &triangles)
+    {
+        const std::size_t hash = _ComputeMeshHash(points, triangles);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            CollisionGeometryPtr pgeom = _Find(hash, points, triangles);
+            if( !!pgeom ) {
+                return pgeom;
+            }
+        }
+
+        // building the BVH is the expensive part, so do not hold the lock. If another thread built the same mesh in the meantime, use its model.
+        CollisionGeometryPtr pnewgeom = ConvertMeshToFCL<T>(points, triangles);
+        pnewgeom->setUserData(nullptr);
+        pnewgeom->computeLocalAABB();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        CollisionGeometryPtr pgeom = _Find(hash, points, triangles);
+        if( !!pgeom ) {
+            return pgeom;
+        }
+        if( _mapGeometries.size() >= 2*_nLastPurgeSize ) {
+            _PurgeExpired();
+        }
+        _mapGeometries.insert(std::make_pair(hash, std::weak_ptr<fcl::CollisionGeometry>(pnewgeom)));
+        return pnewgeom;
+    }
+
+    /// \brief removes the models that are not used anymore
+    ///
+    /// \return the number of models left in the cache
+    size_t Purge()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _PurgeExpired();
+        return _mapGeometries.size();
+    }
+
+private:
+    SharedMeshBVHCache() : _nLastPurgeSize(64) {
+    }
+
+    static std::size_t _ComputeMeshHash(std::vector<fcl::Vec3f> const &points, std::vector<fcl::Triangle> const &triangles)
+    {
+        std::size_t hash = 0;
+        boost::hash_combine(hash, points.size());
+        boost::hash_combine(hash, triangles.size());
+        for (const fcl::Vec3f& point : points) {
+            boost::hash_combine(hash, point[0]);
+            boost::hash_combine(hash, point[1]);
+            boost::hash_combine(hash, point[2]);
+        }
+        for (const fcl::Triangle& triangle : triangles) {
+            boost::hash_combine(hash, triangle[0]);
+            boost::hash_combine(hash, triangle[1]);
+            boost::hash_combine(hash, triangle[2]);
+        }
+        return hash;
+    }
+
+    /// \brief compares the mesh the model was built from since two different meshes can have the same hash
+    static bool _IsSameMesh(const fcl::BVHModel<T>& model, std::vector<fcl::Vec3f> const &points, std::vector<fcl::Triangle> const &triangles)
+    {
+        if( model.num_vertices != (int)points.size() || model.num_tris != (int)triangles.size() ) {
+            return false;
+        }
+        for (size_t ipoint = 0; ipoint < points.size(); ++ipoint) {
+            const fcl::Vec3f& v0 = model.vertices[ipoint];
+            const fcl::Vec3f& v1 = points[ipoint];
+            if( v0[0] != v1[0] || v0[1] != v1[1] || v0[2] != v1[2] ) {
+                return false;
+            }
+        }
+        for (size_t itri = 0; itri < triangles.size(); ++itri) {
+            const fcl::Triangle& t0 = model.tri_indices[itri];
+            const fcl::Triangle& t1 = triangles[itri];
+            if( t0[0] != t1[0] || t0[1] != t1[1] || t0[2] != t1[2] ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// \brief has to be called with _mutex locked
+    CollisionGeometryPtr _Find(std::size_t hash, std::vector<fcl::Vec3f> const &points, std::vector<fcl::Triangle> const &triangles)
+    {
+        typename GeometryMap::iterator it = _mapGeometries.find(hash);
+        while( it != _mapGeometries.end() && it->first == hash ) {
+            CollisionGeometryPtr pgeom = it->second.lock();
+            if( !pgeom ) {
+                it = _mapGeometries.erase(it);
+                continue;
+            }
+            if( _IsSameMesh(static_cast<const fcl::BVHModel<T>&>(*pgeom), points, triangles) ) {
+                return pgeom;
+            }
+            ++it;
+        }
+        return CollisionGeometryPtr();
+    }
+
+    /// \brief has to be called with _mutex locked
+    void _PurgeExpired()
+    {
+        typename GeometryMap::iterator it = _mapGeometries.begin();
+        while( it != _mapGeometries.end() ) {
+            if( it->second.expired() ) {
+                it = _mapGeometries.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        _nLastPurgeSize = std::max(_mapGeometries.size(), (size_t)64);
+    }
+
+    typedef std::multimap<std::size_t, std::weak_ptr<fcl::CollisionGeometry> > GeometryMap;
+
+    std::mutex _mutex;
+    GeometryMap _mapGeometries; ///< indexed by the hash of the mesh content
+    size_t _nLastPurgeSize; ///< size of _mapGeometries after the last purge of the expired models
+};
+
+template <class T>
+CollisionGeometryPtr GetSharedMeshFCL(std::vector<fcl::Vec3f> const &points,std::vector<fcl::Triangle> const &triangles)
+{
+    return SharedMeshBVHCache<T>::GetInstance().GetGeometry(points, triangles);
+}
+
+template <class T>
+size_t PurgeSharedMeshFCL()
+{
+    return SharedMeshBVHCache<T>::GetInstance().Purge();
+}
+
 FCLSpace::FCLKinBodyInfo::FCLKinBodyInfo()
     : nLastStamp(0)
     , nLinkUpdateStamp(0)
@@ -115,7 +266,6 @@ FCLSpace::FCLKinBodyInfoPtr FCLSpace::InitKinBody(KinBodyConstPtr pbody, FCLKinB
                 if( !pfclgeom ) {
                     continue;
                 }
-                pfclgeom->setUserData(nullptr);
 
                 // We do not set the transformation here and leave it to _Synchronize
                 CollisionObjectPtr pfclcoll = boost::make_shared<fcl::CollisionObject>(pfclgeom);
@@ -143,8 +293,7 @@ FCLSpace::FCLKinBodyInfoPtr FCLSpace::InitKinBody(KinBodyConstPtr pbody, FCLKinB
                 }
                 boost::shared_ptr<FCLKinBodyInfo::FCLGeometryInfo> pfclgeominfo(new FCLKinBodyInfo::FCLGeometryInfo(pgeom));
                 pfclgeominfo->bodylinkgeomname = pbody->GetName() + "/" + plink->GetName() + "/" + pgeom->GetName();
-                pfclgeom->setUserData(pfclgeominfo.get());
-                // save the pointers
+                // save the pointers. the geometry info is not stored as user data of pfclgeom since mesh geometries are shared with other bodies, FCLCollisionChecker::GetCollisionGeometry finds it through vgeominfos.
                 linkinfo->vgeominfos.push_back(pfclgeominfo);
 
                 // We do not set the transformation here and leave it to _Synchronize
@@ -301,27 +450,43 @@ void FCLSpace::SetBVHRepresentation(std::string const &type)
     if (type == "AABB") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL<fcl::AABB>;
+        _sharedMeshFactory = &GetSharedMeshFCL<fcl::AABB>;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL<fcl::AABB>;
     } else if (type == "OBB") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL<fcl::OBB>;
+        _sharedMeshFactory = &GetSharedMeshFCL<fcl::OBB>;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL<fcl::OBB>;
     } else if (type == "RSS") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL<fcl::RSS>;
+        _sharedMeshFactory = &GetSharedMeshFCL<fcl::RSS>;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL<fcl::RSS>;
     } else if (type == "OBBRSS") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL<fcl::OBBRSS>;
+        _sharedMeshFactory = &GetSharedMeshFCL<fcl::OBBRSS>;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL<fcl::OBBRSS>;
     } else if (type == "kDOP16") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL< fcl::KDOP<16> >;
+        _sharedMeshFactory = &GetSharedMeshFCL< fcl::KDOP<16> >;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL< fcl::KDOP<16> >;
     } else if (type == "kDOP18") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL< fcl::KDOP<18> >;
+        _sharedMeshFactory = &GetSharedMeshFCL< fcl::KDOP<18> >;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL< fcl::KDOP<18> >;
     } else if (type == "kDOP24") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL< fcl::KDOP<24> >;
+        _sharedMeshFactory = &GetSharedMeshFCL< fcl::KDOP<24> >;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL< fcl::KDOP<24> >;
     } else if (type == "kIOS") {
         _bvhRepresentation = type;
         _meshFactory = &ConvertMeshToFCL<fcl::kIOS>;
+        _sharedMeshFactory = &GetSharedMeshFCL<fcl::kIOS>;
+        _sharedMeshCachePurge = &PurgeSharedMeshFCL<fcl::kIOS>;
     } else {
         RAVELOG_WARN(str(boost::format("Unknown BVH representation '%s', keeping '%s' representation") % type % _bvhRepresentation));
         return;
@@ -455,6 +620,15 @@ void _AppendFclBoxCollsionObject(const OpenRAVE::Vector& fullExtents, const Open
     contents.emplace_back(std::make_shared<fcl::CollisionObject>(fclGeom, fclTrans));
 }
 
+/// \brief creates a primitive fcl geometry that is not shared with any other body
+template <class G, class... Args>
+CollisionGeometryPtr _MakeFCLGeometry(Args&&... args)
+{
+    CollisionGeometryPtr pgeom = std::make_shared<G>(std::forward<Args>(args)...);
+    pgeom->setUserData(nullptr);
+    return pgeom;
+}
+
 CollisionGeometryPtr FCLSpace::_CreateFCLGeomFromGeometryInfo(const KinBody::GeometryInfo &info)
 {
     switch(info._type) {
@@ -464,13 +638,13 @@ CollisionGeometryPtr FCLSpace::_CreateFCLGeomFromGeometryInfo(const KinBody::Geo
 
     case OpenRAVE::GT_CalibrationBoard:
     case OpenRAVE::GT_Box:
-        return std::make_shared<fcl::Box>(info._vGeomData.x*2.0f,info._vGeomData.y*2.0f,info._vGeomData.z*2.0f);
+        return _MakeFCLGeometry<fcl::Box>(info._vGeomData.x*2.0f,info._vGeomData.y*2.0f,info._vGeomData.z*2.0f);
 
     case OpenRAVE::GT_Sphere:
-        return std::make_shared<fcl::Sphere>(info._vGeomData.x);
+        return _MakeFCLGeometry<fcl::Sphere>(info._vGeomData.x);
 
     case OpenRAVE::GT_Cylinder:
-        return std::make_shared<fcl::Cylinder>(info._vGeomData.x, info._vGeomData.y);
+        return _MakeFCLGeometry<fcl::Cylinder>(info._vGeomData.x, info._vGeomData.y);
 
     case OpenRAVE::GT_Container:
     {
@@ -512,7 +686,7 @@ CollisionGeometryPtr FCLSpace::_CreateFCLGeomFromGeometryInfo(const KinBody::Geo
                 _AppendFclBoxCollsionObject(bottom, Vector(0.0, 0.0, bottom[2] / 2.0), contents);
             }
         }
-        return std::make_shared<fcl::Container>(contents);
+        return _MakeFCLGeometry<fcl::Container>(contents);
     }
     case OpenRAVE::GT_Cage:
     {
@@ -526,7 +700,7 @@ CollisionGeometryPtr FCLSpace::_CreateFCLGeomFromGeometryInfo(const KinBody::Geo
         }
         // finally add the base
         _AppendFclBoxCollsionObject(2.0*vCageBaseExtents, Vector(0, 0, vCageBaseExtents.z), contents);
-        return std::make_shared<fcl::Container>(contents);
+        return _MakeFCLGeometry<fcl::Container>(contents);
     }
     case OpenRAVE::GT_ConicalFrustum:
     case OpenRAVE::GT_Axial:
@@ -553,7 +727,8 @@ CollisionGeometryPtr FCLSpace::_CreateFCLGeomFromGeometryInfo(const KinBody::Geo
             fcl_triangles[itri] = fcl::Triangle(tri_indices[0], tri_indices[1], tri_indices[2]);
         }
 
-        return _meshFactory(fcl_points, fcl_triangles);
+        // the BVH models of meshes are immutable, so they can be shared with every other body having the same mesh
+        return _sharedMeshFactory(fcl_points, fcl_triangles);
     }
 
     default:
@@ -566,18 +741,29 @@ void FCLSpace::_Synchronize(FCLKinBodyInfo& info, const KinBody& body)
 {
     //KinBodyPtr pbody = info.GetBody();
     if( info.nLastStamp != body.GetUpdateStamp()) {
+        // if only the last update was a partial SetDOFValues, then only the moved links need to be synchronized
+        const bool bOnlyChangedLinks = body.GetChangedLinksUpdateStamp() == body.GetUpdateStamp() && info.nLastStamp == body.GetChangedLinksBaseUpdateStamp();
         info.nLastStamp = body.GetUpdateStamp();
         if( body.GetLinks().size() != info.vlinks.size() ) {
             throw OpenRAVE::OpenRAVEException(str(boost::format("env=%s, the current number of links in body '%s' are %d, and are not the same as the number cached links %d")%_penv->GetNameId()%body.GetName()%body.GetLinks().size()%info.vlinks.size()), OpenRAVE::ORE_InvalidState);
         }
 
         for(size_t i = 0; i < body.GetLinks().size(); ++i) {
+            if( bOnlyChangedLinks && !OpenRAVE::IsLinkStateBitEnabled(body.GetChangedLinksMasks(), i) ) {
+                continue;
+            }
             FCLSpace::FCLKinBodyInfo::LinkInfo& linkInfo = *info.vlinks[i];
             CollisionObjectPtr& pcoll = linkInfo.linkBV.second; // avoid copying shared pointer for performance
             if( !pcoll ) {
                 continue;
             }
             const Transform& linkTransform = body.GetLinks()[i]->GetTransform();
+            if( linkInfo.bSynchronized && linkInfo.tSynchronized == linkTransform ) {
+                // only some of the links move when a subset of the dofs change, no need to recompute the AABBs of the others
+                continue;
+            }
+            linkInfo.tSynchronized = linkTransform;
+            linkInfo.bSynchronized = true;
             Transform pose = linkTransform;
             pose.trans += pose.rotate(linkInfo.linkBV.first);
             const fcl::Vec3f newPosition = ConvertVectorToFCL(pose.trans);
@@ -118,6 +118,7 @@ public:
                     (*itgeompair).second.reset();
                 }
                 vgeoms.resize(0);
+                bSynchronized = false;
 
                 // make sure to clear vgeominfos after vgeoms because the CollisionObject inside each vgeom element has a corresponding vgeominfo as a void pointer.
                 vgeominfos.resize(0);
@@ -133,6 +134,8 @@ public:
             //int nLastStamp; ///< Tracks if the collision geometries are up to date wrt the body update stamp. This is for narrow phase collision
             TranslationCollisionPair linkBV; ///< pair of the translation and collision object corresponding to a bounding OBB for the link
             std::vector<TransformCollisionPair> vgeoms; ///< vector of transformations and collision object; one per geometries
+            Transform tSynchronized; ///< link transform the collision objects were last synchronized with, valid if bSynchronized is true
+            bool bSynchronized = false; ///< if true, then the collision objects have been placed at tSynchronized
             std::string bodylinkname; // for debugging purposes
             bool bFromKinBodyLink; ///< if true, then from kinbodylink. Otherwise from standalone object that does not have any KinBody associations
         };
@@ -257,6 +260,13 @@ public:
         return _meshFactory;
     }
 
+    /// \brief removes the models that are not used by any body from the process-wide BVH cache of the current representation
+    ///
+    /// \return the number of models left in the cache
+    inline size_t PurgeSharedMeshBVHCache() const {
+        return _sharedMeshCachePurge();
+    }
+
     inline int GetEnvironmentId() const {
         return _penv->GetId();
     }
@@ -320,7 +330,9 @@ private:
     //SynchronizeCallbackFn _synccallback;
 
     std::string _bvhRepresentation;
-    MeshFactory _meshFactory;
+    MeshFactory _meshFactory; ///< builds a new BVH model for every call, used for temporary meshes
+    MeshFactory _sharedMeshFactory; ///< returns the BVH model from the process-wide cache of the _bvhRepresentation type, used for the geometries of the bodies
+    boost::function<size_t ()> _sharedMeshCachePurge; ///< purges the process-wide cache of the _bvhRepresentation type
 
     std::vector<KinBodyConstPtr> _vecInitializedBodies; ///< vector of the kinbody initialized in this space. index is the environment body index. nullptr means uninitialized.
     std::vector<std::map< std::string, FCLKinBodyInfoPtr> > _cachedpinfo; ///< Associates to each body id and geometry group name the corresponding kinbody info if already initialized and not currently set as user data. Index of vector is the environment id. index 0 holds null pointer because kin bodies in the env should have positive index.
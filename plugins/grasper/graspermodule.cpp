@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <condition_variable>
 #include <mutex>
+#include <thread>
 #include <cmath>
 #include <boost/bind/bind.hpp>
 
@@ -86,7 +87,13 @@ public:
         RegisterCommand("Grasp",boost::bind(&GrasperModule::_GraspCommand,this,_1,_2),
                         "Performs a grasp and returns contact points");
         RegisterCommand("GraspThreaded",boost::bind(&GrasperModule::_GraspThreadedCommand,this,_1,_2),
-                        "Parllelizes the computation of the grasp planning and force closure. Number of threads can be specified with 'numthreads'.");
+                        "Parllelizes the computation of the grasp planning and force closure. Number of threads can be specified with 'numthreads'. The worker threads and their environments are kept for the next call unless 'keepworkers 0' is given.");
+        RegisterCommand("StartGraspThreaded",boost::bind(&GrasperModule::_StartGraspThreadedCommand,this,_1,_2),
+                        "Same parameters as GraspThreaded, except returns once the grasps are started. The results are read with GetGraspThreadedResults.");
+        RegisterCommand("GetGraspThreadedResults",boost::bind(&GrasperModule::_GetGraspThreadedResultsCommand,this,_1,_2),
+                        "Returns the grasps of StartGraspThreaded that succeeded since the last call. If 'wait 1', waits for at least one new grasp or for the end of the grasps.");
+        RegisterCommand("StopGraspThreaded",boost::bind(&GrasperModule::_StopGraspThreadedCommand,this,_1,_2),
+                        "Stops the grasps of StartGraspThreaded and returns the next grasp index to resume from.");
         RegisterCommand("ComputeDistanceMap",boost::bind(&GrasperModule::_ComputeDistanceMapCommand,this,_1,_2),
                         "Computes a distance map around a particular point in space");
         RegisterCommand("GetStableContacts",boost::bind(&GrasperModule::_GetStableContactsCommand,this,_1,_2),
@@ -95,6 +102,7 @@ public:
                         "Given a point cloud, returns information about its convex hull like normal planes, vertex indices, and triangle indices. Computed planes point outside the mesh, face indices are not ordered, triangles point outside the mesh (counter-clockwise)");
     }
     virtual ~GrasperModule() {
+        _ShutdownGraspWorkers();
         if( !!outfile )
             fclose(outfile);
         if( !!errfile )
@@ -103,6 +111,7 @@ public:
 
     virtual void Destroy()
     {
+        _ShutdownGraspWorkers();
         _planner.reset();
         _robot.reset();
     }
@@ -668,6 +677,7 @@ public:
             forceclosurethreshold = 0;
             ffinestep = 0.001f;
             bCheckGraspIK = false;
+            coloptions = 0;
         }
 
         string targetname;
@@ -683,12 +693,14 @@ public:
         dReal ftranslationstepmult;
         dReal ffinestep;
 
+        string robotname;
         string manipname;
         vector<int> vactiveindices;
         int affinedofs;
         Vector affineaxis;
 
         bool bCheckGraspIK;
+        int coloptions; ///< collision options of the environment checker when the grasps were started
     };
 
     struct GraspParametersThread
@@ -711,20 +723,178 @@ public:
     typedef boost::shared_ptr<GraspParametersThread> GraspParametersThreadPtr;
     typedef boost::shared_ptr<WorkerParameters> WorkerParametersPtr;
 
-    virtual bool _GraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    /// \brief grasps of one GraspThreaded or StartGraspThreaded command, evaluated by the workers of the pool. Protected by _mutexGrasp.
+    struct GraspJob
     {
-        EnvironmentLock lock543(GetEnv()->GetMutex());
+        GraspJob() : worker_params(new WorkerParameters()) {
+        }
 
-        WorkerParametersPtr worker_params(new WorkerParameters());
-        int numthreads = 2;
-        string cmd;
+        /// \brief returns the parameters of grasp id, the grasps iterate over the standoffs first and the manipulator directions last
+        GraspParametersThreadPtr CreateGraspParameters(size_t id) const
+        {
+            size_t istandoff = id % standoffs.size();
+            size_t ipreshape = (id / standoffs.size()) % preshapes.size();
+            size_t iroll = (id / (preshapes.size() * standoffs.size())) % rolls.size();
+            size_t iapproachray = (id / (rolls.size() * preshapes.size() * standoffs.size()))%approachrays.size();
+            size_t imanipulatordirection = (id / (rolls.size() * preshapes.size() * standoffs.size()*approachrays.size()));
+
+            GraspParametersThreadPtr grasp_params(new GraspParametersThread());
+            grasp_params->id = id;
+            grasp_params->vtargetposition = approachrays.at(iapproachray).first;
+            grasp_params->vtargetdirection = approachrays.at(iapproachray).second;
+            grasp_params->vmanipulatordirection = manipulatordirections.at(imanipulatordirection);
+            grasp_params->ftargetroll = rolls.at(iroll);
+            grasp_params->fstandoff = standoffs.at(istandoff);
+            grasp_params->preshape = preshapes.at(ipreshape);
+            return grasp_params;
+        }
+
+        /// \brief true if workers can still take grasps from the job
+        inline bool HasWork() const {
+            return !bStop && nextid < numgrasps;
+        }
+
+        /// \brief true once no grasp is handed out anymore and all the handed out grasps are evaluated
+        inline bool IsFinished() const {
+            return numbusy == 0 && !HasWork();
+        }
+
+        WorkerParametersPtr worker_params;
         vector< pair<Vector, Vector> > approachrays;
         vector<dReal> rolls;
         vector< vector<dReal> > preshapes;
         vector<Vector> manipulatordirections;
         vector<dReal> standoffs;
-        size_t startindex = 0;
-        size_t maxgrasps = 0;
+        int numthreads = 2; ///< maximum number of workers evaluating grasps of this job at the same time
+        size_t nextid = 0; ///< next grasp to hand out to a worker
+        size_t numgrasps = 0;
+        size_t maxgrasps = 0; ///< no more grasps are handed out once this many grasps succeeded
+        int numbusy = 0; ///< number of workers evaluating grasps of this job
+        bool bStop = false; ///< if true, no more grasps are handed out
+        list<GraspParametersThreadPtr> listResults; ///< all the successful grasps in the order they finished
+        list<GraspParametersThreadPtr> listNewResults; ///< successful grasps not returned by GetGraspThreadedResults yet
+    };
+    typedef boost::shared_ptr<GraspJob> GraspJobPtr;
+
+    /// \brief worker of the grasp evaluation pool. Keeps its clone of the environment between commands, and resynchronizes it with _pGraspEnv when a new job starts.
+    struct GraspWorker
+    {
+        EnvironmentBasePtr penv;
+        PlannerBasePtr planner;
+        int envstamp = 0; ///< value of _nGraspEnvStamp when penv was last synchronized
+        boost::shared_ptr<std::thread> thread;
+    };
+    typedef boost::shared_ptr<GraspWorker> GraspWorkerPtr;
+
+    virtual bool _GraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    {
+        EnvironmentLock lock543(GetEnv()->GetMutex());
+
+        bool bKeepWorkers = true;
+        GraspJobPtr job(new GraspJob());
+        if( !_ParseGraspJob(sinput, *job, bKeepWorkers) ) {
+            return false;
+        }
+        // stop the workers even if interrupted
+        boost::shared_ptr<void> onexit;
+        if( !bKeepWorkers ) {
+            onexit.reset((void*)0, boost::bind(&GrasperModule::_ShutdownGraspWorkers, this));
+        }
+        _StartGraspJob(job);
+
+        std::unique_lock<std::mutex> lock(_mutexGrasp);
+        _condGraspResults.wait(lock, [&job]() {
+            return job->IsFinished();
+        });
+        job->listNewResults.clear();
+
+        // parse results to output
+        sout << job->nextid << " " << job->listResults.size() << " ";
+        _WriteGraspResults(sout, job->listResults);
+        return true;
+    }
+
+    /// \brief starts evaluating grasps on the workers and returns immediately, the results are read with GetGraspThreadedResults
+    virtual bool _StartGraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    {
+        EnvironmentLock lock543(GetEnv()->GetMutex());
+
+        bool bKeepWorkers = true;
+        GraspJobPtr job(new GraspJob());
+        if( !_ParseGraspJob(sinput, *job, bKeepWorkers) ) {
+            return false;
+        }
+        _StartGraspJob(job);
+        sout << job->numgrasps;
+        return true;
+    }
+
+    /// \brief returns the grasps that succeeded since the last call
+    ///
+    /// Outputs the next grasp id to hand out, whether the job is finished, and the new results in the same format as GraspThreaded.
+    virtual bool _GetGraspThreadedResultsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        bool bWait = false;
+        string cmd;
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
+                break;
+            }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+
+            if( cmd == "wait" ) {
+                sinput >> bWait;
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
+
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(_mutexGrasp);
+        GraspJobPtr job = _graspJob;
+        if( !job ) {
+            RAVELOG_WARN("no grasps were started with StartGraspThreaded\n");
+            return false;
+        }
+        if( bWait ) {
+            // wait until there is something to stream back
+            _condGraspResults.wait(lock, [&job]() {
+                return job->listNewResults.size() > 0 || job->IsFinished();
+            });
+        }
+
+        sout << job->nextid << " " << job->IsFinished() << " " << job->listNewResults.size() << " ";
+        _WriteGraspResults(sout, job->listNewResults);
+        job->listNewResults.clear();
+        return true;
+    }
+
+    /// \brief stops handing out grasps and waits for the grasps that are being evaluated. Outputs the next grasp id to resume from.
+    virtual bool _StopGraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    {
+        _StopGraspJob();
+        std::lock_guard<std::mutex> lock(_mutexGrasp);
+        sout << (!!_graspJob ? _graspJob->nextid : 0);
+        return true;
+    }
+
+    /// \brief parses the parameters of GraspThreaded and StartGraspThreaded. Has to be called with the environment locked.
+    bool _ParseGraspJob(std::istream& sinput, GraspJob& job, bool& bKeepWorkers)
+    {
+        WorkerParametersPtr worker_params = job.worker_params;
+        vector< pair<Vector, Vector> >& approachrays = job.approachrays;
+        vector<dReal>& rolls = job.rolls;
+        vector< vector<dReal> >& preshapes = job.preshapes;
+        vector<Vector>& manipulatordirections = job.manipulatordirections;
+        vector<dReal>& standoffs = job.standoffs;
+        string cmd;
 
         while(!sinput.eof()) {
             sinput >> cmd;
@@ -742,10 +912,10 @@ public:
                 worker_params->vavoidlinkgeometry.push_back(linkname);
             }
             else if( cmd == "startindex" ) {
-                sinput >> startindex;
+                sinput >> job.nextid;
             }
             else if( cmd == "maxgrasps" ) {
-                sinput >> maxgrasps;
+                sinput >> job.maxgrasps;
             }
             else if( cmd == "onlycontacttarget" ) {
                 sinput >> worker_params->bonlycontacttarget;
@@ -772,7 +942,10 @@ public:
                 sinput >> worker_params->ffinestep;
             }
             else if( cmd == "numthreads" ) {
-                sinput >> numthreads;
+                sinput >> job.numthreads;
+            }
+            else if( cmd == "keepworkers" ) {
+                sinput >> bKeepWorkers;
             }
             // grasp specific
             else if( cmd == "approachrays" ) {
@@ -833,64 +1006,91 @@ public:
             }
         }
 
+        worker_params->robotname = _robot->GetName();
         worker_params->manipname = _robot->GetActiveManipulator()->GetName();
         worker_params->vactiveindices = _robot->GetActiveDOFIndices();
         worker_params->affinedofs = _robot->GetAffineDOF();
         worker_params->affineaxis = _robot->GetAffineRotationAxis();
+        worker_params->coloptions = GetEnv()->GetCollisionChecker()->GetCollisionOptions();
 
-        EnvironmentBasePtr pcloneenv = GetEnv()->CloneSelf(Clone_Bodies|Clone_Simulation);
-
-        _bContinueWorker = true;
-        // start worker threads
-        vector<boost::shared_ptr<std::thread> > listthreads(numthreads);
-        for (int threadIdx = 0; threadIdx < numthreads; ++threadIdx) {
-            listthreads[threadIdx] = boost::make_shared<std::thread>(std::bind(&GrasperModule::_WorkerThread, this, worker_params, pcloneenv));
+        job.numgrasps = approachrays.size()*rolls.size()*preshapes.size()*standoffs.size()*manipulatordirections.size();
+        if( job.maxgrasps == 0 ) {
+            job.maxgrasps = job.numgrasps;
         }
+        if( job.numthreads <= 0 ) {
+            job.numthreads = max(1, (int)std::thread::hardware_concurrency());
+        }
+        RAVELOG_INFO(str(boost::format("number of grasps to test: %d\n")%job.numgrasps));
+        return true;
+    }
 
-        _listGraspResults.clear();
-        size_t numgrasps = approachrays.size()*rolls.size()*preshapes.size()*standoffs.size()*manipulatordirections.size();
-        if( maxgrasps == 0 ) {
-            maxgrasps = numgrasps;
+    /// \brief synchronizes the environment of the workers with the current environment and hands the job to the workers. Has to be called with the environment locked.
+    ///
+    /// A previous job that is still running is stopped first.
+    void _StartGraspJob(GraspJobPtr job)
+    {
+        _StopGraspJob();
+
+        // only the bodies that changed since the last job are updated
+        if( !_pGraspEnv ) {
+            _pGraspEnv = GetEnv()->CloneSelf(Clone_Bodies|Clone_Simulation);
+        }
+        else {
+            _pGraspEnv->Clone(GetEnv(), Clone_Bodies|Clone_Simulation);
         }
-        RAVELOG_INFO(str(boost::format("number of grasps to test: %d\n")%numgrasps));
-        size_t id = startindex;
-        for(id=startindex; id < numgrasps; ++id) {
-            size_t istandoff = id % standoffs.size();
-            size_t ipreshape = (id / standoffs.size()) % preshapes.size();
-            size_t iroll = (id / (preshapes.size() * standoffs.size())) % rolls.size();
-            size_t iapproachray = (id / (rolls.size() * preshapes.size() * standoffs.size()))%approachrays.size();
-            size_t imanipulatordirection = (id / (rolls.size() * preshapes.size() * standoffs.size()*approachrays.size()));
 
-            std::unique_lock<std::mutex> lock123(_mutexGrasp);
-            if( _listGraspResults.size() >= maxgrasps ) {
-                break;
-            }
+        std::lock_guard<std::mutex> lock(_mutexGrasp);
+        ++_nGraspEnvStamp;
+        _bShutdownGraspWorkers = false;
+        while( (int)_vGraspWorkers.size() < job->numthreads ) {
+            GraspWorkerPtr worker(new GraspWorker());
+            worker->thread = boost::make_shared<std::thread>(std::bind(&GrasperModule::_GraspWorkerThread, this, worker));
+            _vGraspWorkers.push_back(worker);
+        }
+        _graspJob = job;
+        _condGraspHasWork.notify_all();
+    }
 
-            // initialize _graspParamsWork
-            BOOST_ASSERT(!_graspParamsWork);
-            _graspParamsWork.reset(new GraspParametersThread());
-            _graspParamsWork->id = id;
-            _graspParamsWork->vtargetposition = approachrays.at(iapproachray).first;
-            _graspParamsWork->vtargetdirection = approachrays.at(iapproachray).second;
-            _graspParamsWork->vmanipulatordirection = manipulatordirections.at(imanipulatordirection);
-            _graspParamsWork->ftargetroll = rolls.at(iroll);
-            _graspParamsWork->fstandoff = standoffs.at(istandoff);
-            _graspParamsWork->preshape = preshapes.at(ipreshape);
-            _condGraspHasWork.notify_one();     // notify there is work
-            _condGraspReceivedWork.wait(lock123);     // wait for more work
+    /// \brief stops handing out the grasps of the current job and waits for the grasps that are being evaluated
+    void _StopGraspJob()
+    {
+        std::unique_lock<std::mutex> lock(_mutexGrasp);
+        if( !_graspJob ) {
+            return;
         }
+        GraspJobPtr job = _graspJob;
+        job->bStop = true;
+        _condGraspResults.wait(lock, [&job]() {
+            return job->IsFinished();
+        });
+    }
 
-        // wait for workers
-        _bContinueWorker = false;
-        FOREACH(itthread,listthreads) {
-            _condGraspHasWork.notify_all();     // signal
-            (*itthread)->join();
+    /// \brief stops the current job and destroys the workers and their environments
+    void _ShutdownGraspWorkers()
+    {
+        _StopGraspJob();
+        vector<GraspWorkerPtr> vGraspWorkers;
+        {
+            std::lock_guard<std::mutex> lock(_mutexGrasp);
+            _bShutdownGraspWorkers = true;
+            vGraspWorkers.swap(_vGraspWorkers);
         }
-        listthreads.clear();
+        _condGraspHasWork.notify_all();
+        FOREACH(itworker, vGraspWorkers) {
+            (*itworker)->thread->join();
+            if( !!(*itworker)->penv ) {
+                (*itworker)->penv->Destroy();
+            }
+        }
+        if( !!_pGraspEnv ) {
+            _pGraspEnv->Destroy();
+            _pGraspEnv.reset();
+        }
+    }
 
-        // parse results to output
-        sout << id << " " << _listGraspResults.size() << " ";
-        FOREACH(itresult, _listGraspResults) {
+    void _WriteGraspResults(std::ostream& sout, const list<GraspParametersThreadPtr>& listGraspResults)
+    {
+        FOREACHC(itresult, listGraspResults) {
             sout << (*itresult)->vtargetposition.x << " " << (*itresult)->vtargetposition.y << " " << (*itresult)->vtargetposition.z << " ";
             sout << (*itresult)->vtargetdirection.x << " " << (*itresult)->vtargetdirection.y << " " << (*itresult)->vtargetdirection.z << " ";
             sout << (*itresult)->ftargetroll << " " << (*itresult)->fstandoff << " ";
@@ -909,272 +1109,318 @@ public:
                 sout << c.pos.x << " " << c.pos.y << " " << c.pos.z << " " << c.norm.x << " " << c.norm.y << " " << c.norm.z << " ";
             }
         }
-        return true;
     }
 
-    void _WorkerThread(const WorkerParametersPtr worker_params, EnvironmentBasePtr penv)
+    void _GraspWorkerThread(GraspWorkerPtr worker)
     {
-        // clone environment
-        EnvironmentBasePtr pcloneenv = penv->CloneSelf(Clone_Bodies|Clone_Simulation);
-        {
-            EnvironmentLock lock765(pcloneenv->GetMutex());
-            boost::shared_ptr<CollisionCheckerMngr> pcheckermngr(new CollisionCheckerMngr(pcloneenv, worker_params->collisionchecker));
-            PlannerBasePtr planner = RaveCreatePlanner(pcloneenv,"Grasper");
-            RobotBasePtr probot = pcloneenv->GetRobot(_robot->GetName());
-            string strsavetraj;
-
-            probot->SetActiveManipulator(worker_params->manipname);
-
-            // setup parameters
-            GraspParametersPtr params(new GraspParameters(pcloneenv));
-            params->targetbody = pcloneenv->GetKinBody(worker_params->targetname);
-            params->vavoidlinkgeometry = worker_params->vavoidlinkgeometry;
-            params->btransformrobot = true;
-            params->bonlycontacttarget = worker_params->bonlycontacttarget;
-            params->btightgrasp = worker_params->btightgrasp;
-            params->fgraspingnoise = 0;
-            params->ftranslationstepmult = worker_params->ftranslationstepmult;
+        while(1) {
+            GraspJobPtr job;
+            int envstamp = 0;
+            {
+                std::unique_lock<std::mutex> lock(_mutexGrasp);
+                _condGraspHasWork.wait(lock, [this]() {
+                    return _bShutdownGraspWorkers || (!!_graspJob && _graspJob->HasWork() && _graspJob->numbusy < _graspJob->numthreads);
+                });
+                if( _bShutdownGraspWorkers ) {
+                    return;
+                }
+                job = _graspJob;
+                envstamp = _nGraspEnvStamp;
+                ++job->numbusy;
+            }
 
-            CollisionReportPtr report(new CollisionReport());
-            TrajectoryBasePtr ptraj = RaveCreateTrajectory(pcloneenv,"");
-            GraspParametersThreadPtr grasp_params;
+            try {
+                if( !worker->penv ) {
+                    worker->penv = _pGraspEnv->CloneSelf(Clone_Bodies|Clone_Simulation);
+                    worker->planner = RaveCreatePlanner(worker->penv,"Grasper");
+                }
+                else if( worker->envstamp != envstamp ) {
+                    worker->penv->Clone(_pGraspEnv, Clone_Bodies|Clone_Simulation);
+                }
+                worker->envstamp = envstamp;
+                _EvaluateGraspJob(*worker, job);
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_WARN_FORMAT("grasp worker failed, stopping the job: %s", ex.what());
+                std::lock_guard<std::mutex> lock(_mutexGrasp);
+                job->bStop = true;
+            }
 
-            // calculate the contact normals
-            std::vector<KinBody::LinkPtr> vlinks, vindependentlinks;
-            probot->GetActiveManipulator()->GetChildLinks(vlinks);
-            probot->GetActiveManipulator()->GetIndependentLinks(vindependentlinks);
-            Transform trobotstart = probot->GetTransform();
-
-            // use CO_ActiveDOFs since might be calling FindIKSolution
-            int coloptions = GetEnv()->GetCollisionChecker()->GetCollisionOptions()|(worker_params->bCheckGraspIK ? CO_ActiveDOFs : 0);
-            coloptions &= ~CO_Contacts;
-            pcloneenv->GetCollisionChecker()->SetCollisionOptions(coloptions|CO_Contacts);
-
-            while(_bContinueWorker) {
-                {
-                    // wait for work
-                    std::unique_lock<std::mutex> lock653(_mutexGrasp);
-                    if( !_graspParamsWork ) {
-                        _condGraspHasWork.wait(lock653);
-                        // after signal
-                        if( !_graspParamsWork ) {
-                            continue;
-                        }
-                    }
-                    grasp_params = _graspParamsWork;
-                    _graspParamsWork.reset();
-                    _condGraspReceivedWork.notify_all();
+            {
+                std::lock_guard<std::mutex> lock(_mutexGrasp);
+                --job->numbusy;
+            }
+            _condGraspResults.notify_all();
+        }
+    }
+
+    /// \brief evaluates grasps of the job in the environment of the worker until the job has no more grasps to hand out
+    void _EvaluateGraspJob(GraspWorker& worker, const GraspJobPtr& job)
+    {
+        const WorkerParametersPtr& worker_params = job->worker_params;
+        EnvironmentBasePtr pcloneenv = worker.penv;
+        PlannerBasePtr planner = worker.planner;
+        EnvironmentLock lock765(pcloneenv->GetMutex());
+        boost::shared_ptr<CollisionCheckerMngr> pcheckermngr(new CollisionCheckerMngr(pcloneenv, worker_params->collisionchecker));
+        RobotBasePtr probot = pcloneenv->GetRobot(worker_params->robotname);
+        if( !probot ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("env=%s, robot %s is not in the worker environment"), pcloneenv->GetNameId()%worker_params->robotname, ORE_InvalidArguments);
+        }
+
+        probot->SetActiveManipulator(worker_params->manipname);
+
+        // setup parameters
+        GraspParametersPtr params(new GraspParameters(pcloneenv));
+        params->targetbody = pcloneenv->GetKinBody(worker_params->targetname);
+        params->vavoidlinkgeometry = worker_params->vavoidlinkgeometry;
+        params->btransformrobot = true;
+        params->bonlycontacttarget = worker_params->bonlycontacttarget;
+        params->btightgrasp = worker_params->btightgrasp;
+        params->fgraspingnoise = 0;
+        params->ftranslationstepmult = worker_params->ftranslationstepmult;
+
+        CollisionReportPtr report(new CollisionReport());
+        TrajectoryBasePtr ptraj = RaveCreateTrajectory(pcloneenv,"");
+        GraspParametersThreadPtr grasp_params;
+
+        // calculate the contact normals
+        std::vector<KinBody::LinkPtr> vlinks, vindependentlinks;
+        probot->GetActiveManipulator()->GetChildLinks(vlinks);
+        probot->GetActiveManipulator()->GetIndependentLinks(vindependentlinks);
+        Transform trobotstart = probot->GetTransform();
+
+        // use CO_ActiveDOFs since might be calling FindIKSolution
+        int coloptions = worker_params->coloptions|(worker_params->bCheckGraspIK ? CO_ActiveDOFs : 0);
+        coloptions &= ~CO_Contacts;
+        pcloneenv->GetCollisionChecker()->SetCollisionOptions(coloptions|CO_Contacts);
+
+        while(1) {
+            {
+                std::lock_guard<std::mutex> lock(_mutexGrasp);
+                if( !job->HasWork() ) {
+                    break;
                 }
+                grasp_params = job->CreateGraspParameters(job->nextid++);
+            }
 
-                RAVELOG_DEBUG(str(boost::format("grasp %d: start")%grasp_params->id));
+            RAVELOG_DEBUG(str(boost::format("grasp %d: start")%grasp_params->id));
 
-                // fill params
-                params->vtargetdirection = grasp_params->vtargetdirection;
-                params->ftargetroll = grasp_params->ftargetroll;
-                params->vtargetposition = grasp_params->vtargetposition;
-                params->vmanipulatordirection = grasp_params->vmanipulatordirection;
-                params->fstandoff = grasp_params->fstandoff;
-                probot->SetActiveDOFs(worker_params->vactiveindices);
-                probot->SetActiveDOFValues(grasp_params->preshape);
-                probot->SetActiveDOFs(worker_params->vactiveindices,worker_params->affinedofs,worker_params->affineaxis);
-                params->SetRobotActiveJoints(probot);
+            // fill params
+            params->vtargetdirection = grasp_params->vtargetdirection;
+            params->ftargetroll = grasp_params->ftargetroll;
+            params->vtargetposition = grasp_params->vtargetposition;
+            params->vmanipulatordirection = grasp_params->vmanipulatordirection;
+            params->fstandoff = grasp_params->fstandoff;
+            probot->SetActiveDOFs(worker_params->vactiveindices);
+            probot->SetActiveDOFValues(grasp_params->preshape);
+            probot->SetActiveDOFs(worker_params->vactiveindices,worker_params->affinedofs,worker_params->affineaxis);
+            params->SetRobotActiveJoints(probot);
 
-                RobotBase::RobotStateSaver saver(probot);
-                probot->Enable(true);
+            RobotBase::RobotStateSaver saver(probot);
+            probot->Enable(true);
 
-                params->fgraspingnoise = 0;
-                ptraj->Init(probot->GetActiveConfigurationSpecification());
+            params->fgraspingnoise = 0;
+            ptraj->Init(probot->GetActiveConfigurationSpecification());
 
-                // InitPlan/PlanPath
-                if( !planner->InitPlan(probot, params) ) {
-                    RAVELOG_DEBUG(str(boost::format("grasp %d: grasper planner failed")%grasp_params->id));
-                    continue;
-                }
-                if( !planner->PlanPath(ptraj).GetStatusCode() ) {
-                    RAVELOG_DEBUG(str(boost::format("grasp %d: grasper planner failed")%grasp_params->id));
-                    continue;
-                }
+            // InitPlan/PlanPath
+            if( !planner->InitPlan(probot, params) ) {
+                RAVELOG_DEBUG(str(boost::format("grasp %d: grasper planner failed")%grasp_params->id));
+                continue;
+            }
+            if( !planner->PlanPath(ptraj).GetStatusCode() ) {
+                RAVELOG_DEBUG(str(boost::format("grasp %d: grasper planner failed")%grasp_params->id));
+                continue;
+            }
 
-                BOOST_ASSERT(ptraj->GetNumWaypoints() > 0);
-                vector<dReal> vtrajpoint;
-                ptraj->GetWaypoint(-1,vtrajpoint,probot->GetConfigurationSpecification());
-                probot->SetConfigurationValues(vtrajpoint.begin(),true);
-                grasp_params->transfinal = probot->GetTransform();
-                probot->GetDOFValues(grasp_params->finalshape);
-
-                FOREACHC(itlink, vlinks) {
-                    if( pcloneenv->CheckCollision(KinBody::LinkConstPtr(*itlink), KinBodyConstPtr(params->targetbody), report) ) {
-                        RAVELOG_VERBOSE(str(boost::format("contact %s\n")%report->__str__()));
-                        FOREACH(itcontact,report->contacts) {
-                            if( report->plink1 != *itlink ) {
-                                itcontact->norm = -itcontact->norm;
-                                itcontact->depth = -itcontact->depth;
-                            }
-                            grasp_params->contacts.emplace_back(*itcontact, (*itlink)->GetIndex());
+            BOOST_ASSERT(ptraj->GetNumWaypoints() > 0);
+            vector<dReal> vtrajpoint;
+            ptraj->GetWaypoint(-1,vtrajpoint,probot->GetConfigurationSpecification());
+            probot->SetConfigurationValues(vtrajpoint.begin(),true);
+            grasp_params->transfinal = probot->GetTransform();
+            probot->GetDOFValues(grasp_params->finalshape);
+
+            FOREACHC(itlink, vlinks) {
+                if( pcloneenv->CheckCollision(KinBody::LinkConstPtr(*itlink), KinBodyConstPtr(params->targetbody), report) ) {
+                    RAVELOG_VERBOSE(str(boost::format("contact %s\n")%report->__str__()));
+                    FOREACH(itcontact,report->contacts) {
+                        if( report->plink1 != *itlink ) {
+                            itcontact->norm = -itcontact->norm;
+                            itcontact->depth = -itcontact->depth;
                         }
+                        grasp_params->contacts.emplace_back(*itcontact, (*itlink)->GetIndex());
                     }
                 }
+            }
 
-                if ( worker_params->bCheckGraspIK ) {
-                    CollisionOptionsStateSaver optionstate(pcloneenv->GetCollisionChecker(),coloptions,false); // remove contacts
-                    Transform Tgoalgrasp = probot->GetActiveManipulator()->GetTransform();
-                    RobotBase::RobotStateSaver linksaver(probot);
-                    probot->SetTransform(trobotstart);
-                    FOREACH(itlink,vlinks) {
-                        (*itlink)->Enable(false);
-                    }
-                    probot->SetActiveDOFs(worker_params->vactiveindices);
-                    probot->SetActiveDOFValues(grasp_params->preshape);
-                    probot->SetActiveDOFs(probot->GetActiveManipulator()->GetArmIndices());
-                    vector<dReal> solution;
-                    if( !probot->GetActiveManipulator()->FindIKSolution(Tgoalgrasp, solution,IKFO_CheckEnvCollisions) ) {
-                        RAVELOG_DEBUG(str(boost::format("grasp %d: ik failed")%grasp_params->id));
-                        continue;     // ik failed
-                    }
+            if ( worker_params->bCheckGraspIK ) {
+                CollisionOptionsStateSaver optionstate(pcloneenv->GetCollisionChecker(),coloptions,false); // remove contacts
+                Transform Tgoalgrasp = probot->GetActiveManipulator()->GetTransform();
+                RobotBase::RobotStateSaver linksaver(probot);
+                probot->SetTransform(trobotstart);
+                FOREACH(itlink,vlinks) {
+                    (*itlink)->Enable(false);
+                }
+                probot->SetActiveDOFs(worker_params->vactiveindices);
+                probot->SetActiveDOFValues(grasp_params->preshape);
+                probot->SetActiveDOFs(probot->GetActiveManipulator()->GetArmIndices());
+                vector<dReal> solution;
+                if( !probot->GetActiveManipulator()->FindIKSolution(Tgoalgrasp, solution,IKFO_CheckEnvCollisions) ) {
+                    RAVELOG_DEBUG(str(boost::format("grasp %d: ik failed")%grasp_params->id));
+                    continue;     // ik failed
+                }
 
-                    grasp_params->transfinal = trobotstart;
-                    size_t index = 0;
-                    FOREACHC(itarmindex,probot->GetActiveManipulator()->GetArmIndices()) {
-                        grasp_params->finalshape.at(*itarmindex) = solution.at(index++);
-                    }
+                grasp_params->transfinal = trobotstart;
+                size_t index = 0;
+                FOREACHC(itarmindex,probot->GetActiveManipulator()->GetArmIndices()) {
+                    grasp_params->finalshape.at(*itarmindex) = solution.at(index++);
                 }
+            }
 
-                GRASPANALYSIS analysis;
-                if( worker_params->bComputeForceClosure ) {
-                    try {
-                        vector<CollisionReport::CONTACT> c(grasp_params->contacts.size());
-                        for(size_t i = 0; i < c.size(); ++i) {
-                            c[i] = grasp_params->contacts[i].first;
-                        }
-                        analysis = _AnalyzeContacts3D(c,worker_params->friction,8);
-                        if( analysis.mindist < worker_params->forceclosurethreshold ) {
-                            RAVELOG_DEBUG(str(boost::format("grasp %d: force closure failed")%grasp_params->id));
-                            continue;
-                        }
-                        grasp_params->mindist = analysis.mindist;
-                        grasp_params->volume = analysis.volume;
+            GRASPANALYSIS analysis;
+            if( worker_params->bComputeForceClosure ) {
+                try {
+                    vector<CollisionReport::CONTACT> c(grasp_params->contacts.size());
+                    for(size_t i = 0; i < c.size(); ++i) {
+                        c[i] = grasp_params->contacts[i].first;
                     }
-                    catch(const std::exception& ex) {
-                        RAVELOG_DEBUG(str(boost::format("grasp %d: force closure failed: %s")%grasp_params->id%ex.what()));
-                        continue;     // failed
+                    analysis = _AnalyzeContacts3D(c,worker_params->friction,8);
+                    if( analysis.mindist < worker_params->forceclosurethreshold ) {
+                        RAVELOG_DEBUG(str(boost::format("grasp %d: force closure failed")%grasp_params->id));
+                        continue;
                     }
+                    grasp_params->mindist = analysis.mindist;
+                    grasp_params->volume = analysis.volume;
                 }
+                catch(const std::exception& ex) {
+                    RAVELOG_DEBUG(str(boost::format("grasp %d: force closure failed: %s")%grasp_params->id%ex.what()));
+                    continue;     // failed
+                }
+            }
 
-                if( worker_params->fgraspingnoise > 0 && worker_params->nGraspingNoiseRetries > 0 ) {
-                    params->fgraspingnoise = worker_params->fgraspingnoise;
-                    vector<Transform> vfinaltransformations; vfinaltransformations.reserve(worker_params->nGraspingNoiseRetries);
-                    vector< vector<dReal> > vfinalvalues; vfinalvalues.reserve(worker_params->nGraspingNoiseRetries);
-                    for(int igrasp = 0; igrasp < worker_params->nGraspingNoiseRetries; ++igrasp) {
+            if( worker_params->fgraspingnoise > 0 && worker_params->nGraspingNoiseRetries > 0 ) {
+                params->fgraspingnoise = worker_params->fgraspingnoise;
+                vector<Transform> vfinaltransformations; vfinaltransformations.reserve(worker_params->nGraspingNoiseRetries);
+                vector< vector<dReal> > vfinalvalues; vfinalvalues.reserve(worker_params->nGraspingNoiseRetries);
+                for(int igrasp = 0; igrasp < worker_params->nGraspingNoiseRetries; ++igrasp) {
+                    probot->SetActiveDOFs(worker_params->vactiveindices);
+                    probot->SetActiveDOFValues(grasp_params->preshape);
+                    probot->SetActiveDOFs(worker_params->vactiveindices,worker_params->affinedofs,worker_params->affineaxis);
+                    params->vinitialconfig.resize(0);
+                    ptraj->Init(probot->GetActiveConfigurationSpecification());
+                    if( !planner->InitPlan(probot, params) ) {
+                        RAVELOG_VERBOSE(str(boost::format("grasp %d: grasping noise planner failed")%grasp_params->id));
+                        break;
+                    }
+                    if( !planner->PlanPath(ptraj).GetStatusCode() ) {
+                        RAVELOG_VERBOSE(str(boost::format("grasp %d: grasping noise planner failed")%grasp_params->id));
+                        break;
+                    }
+                    BOOST_ASSERT(ptraj->GetNumWaypoints() > 0);
+
+                    if ( worker_params->bCheckGraspIK ) {
+                        CollisionOptionsStateSaver optionstate(pcloneenv->GetCollisionChecker(),coloptions,false); // remove contacts
+                        RobotBase::RobotStateSaver linksaver(probot);
+                        ptraj->GetWaypoint(-1,vtrajpoint);
+                        Transform t = probot->GetTransform();
+                        ptraj->GetConfigurationSpecification().ExtractTransform(t,vtrajpoint.begin(),probot);
+                        probot->SetTransform(t);
+                        Transform Tgoalgrasp = probot->GetActiveManipulator()->GetTransform();
+                        probot->SetTransform(trobotstart);
+                        FOREACH(itlink,vlinks) {
+                            (*itlink)->Enable(false);
+                        }
                         probot->SetActiveDOFs(worker_params->vactiveindices);
                         probot->SetActiveDOFValues(grasp_params->preshape);
-                        probot->SetActiveDOFs(worker_params->vactiveindices,worker_params->affinedofs,worker_params->affineaxis);
-                        params->vinitialconfig.resize(0);
-                        ptraj->Init(probot->GetActiveConfigurationSpecification());
-                        if( !planner->InitPlan(probot, params) ) {
-                            RAVELOG_VERBOSE(str(boost::format("grasp %d: grasping noise planner failed")%grasp_params->id));
+                        probot->SetActiveDOFs(probot->GetActiveManipulator()->GetArmIndices());
+                        vector<dReal> solution;
+                        if( !probot->GetActiveManipulator()->FindIKSolution(Tgoalgrasp, solution,IKFO_CheckEnvCollisions) ) {
+                            RAVELOG_VERBOSE(str(boost::format("grasp %d: grasping noise ik failed")%grasp_params->id));
                             break;
                         }
-                        if( !planner->PlanPath(ptraj).GetStatusCode() ) {
-                            RAVELOG_VERBOSE(str(boost::format("grasp %d: grasping noise planner failed")%grasp_params->id));
-                            break;
-                        }
-                        BOOST_ASSERT(ptraj->GetNumWaypoints() > 0);
-
-                        if ( worker_params->bCheckGraspIK ) {
-                            CollisionOptionsStateSaver optionstate(pcloneenv->GetCollisionChecker(),coloptions,false); // remove contacts
-                            RobotBase::RobotStateSaver linksaver(probot);
-                            ptraj->GetWaypoint(-1,vtrajpoint);
-                            Transform t = probot->GetTransform();
-                            ptraj->GetConfigurationSpecification().ExtractTransform(t,vtrajpoint.begin(),probot);
-                            probot->SetTransform(t);
-                            Transform Tgoalgrasp = probot->GetActiveManipulator()->GetTransform();
-                            probot->SetTransform(trobotstart);
-                            FOREACH(itlink,vlinks) {
-                                (*itlink)->Enable(false);
-                            }
-                            probot->SetActiveDOFs(worker_params->vactiveindices);
-                            probot->SetActiveDOFValues(grasp_params->preshape);
-                            probot->SetActiveDOFs(probot->GetActiveManipulator()->GetArmIndices());
-                            vector<dReal> solution;
-                            if( !probot->GetActiveManipulator()->FindIKSolution(Tgoalgrasp, solution,IKFO_CheckEnvCollisions) ) {
-                                RAVELOG_VERBOSE(str(boost::format("grasp %d: grasping noise ik failed")%grasp_params->id));
-                                break;
-                            }
-                        }
-
-                        ptraj->GetWaypoint(-1,vtrajpoint,probot->GetConfigurationSpecification());
-                        probot->SetConfigurationValues(vtrajpoint.begin(),true);
-                        vfinalvalues.push_back(vector<dReal>());
-                        probot->GetDOFValues(vfinalvalues.back());
-                        vfinaltransformations.push_back(probot->GetActiveManipulator()->GetTransform());
                     }
 
-                    if( (int)vfinaltransformations.size() != worker_params->nGraspingNoiseRetries ) {
-                        RAVELOG_DEBUG(str(boost::format("grasp %d: grasping noise failed")%grasp_params->id));
-                        continue;
-                    }
+                    ptraj->GetWaypoint(-1,vtrajpoint,probot->GetConfigurationSpecification());
+                    probot->SetConfigurationValues(vtrajpoint.begin(),true);
+                    vfinalvalues.push_back(vector<dReal>());
+                    probot->GetDOFValues(vfinalvalues.back());
+                    vfinaltransformations.push_back(probot->GetActiveManipulator()->GetTransform());
+                }
 
-                    // take statistics
-                    Vector translationmean;
-                    FOREACHC(ittrans,vfinaltransformations) {
-                        translationmean += ittrans->trans;
-                    }
-                    translationmean *= (1.0/vfinaltransformations.size());
-                    Vector translationstd;
-                    FOREACHC(ittrans,vfinaltransformations) {
-                        Vector v = ittrans->trans - translationmean;
-                        translationstd += v*v;
+                if( (int)vfinaltransformations.size() != worker_params->nGraspingNoiseRetries ) {
+                    RAVELOG_DEBUG(str(boost::format("grasp %d: grasping noise failed")%grasp_params->id));
+                    continue;
+                }
+
+                // take statistics
+                Vector translationmean;
+                FOREACHC(ittrans,vfinaltransformations) {
+                    translationmean += ittrans->trans;
+                }
+                translationmean *= (1.0/vfinaltransformations.size());
+                Vector translationstd;
+                FOREACHC(ittrans,vfinaltransformations) {
+                    Vector v = ittrans->trans - translationmean;
+                    translationstd += v*v;
+                }
+                translationstd *= (1.0/vfinaltransformations.size());
+                dReal ftranslationdisplacement = (RaveSqrt(translationstd.x)+RaveSqrt(translationstd.y)+RaveSqrt(translationstd.z))/3;
+                vector<dReal> jointvaluesstd(vfinalvalues.at(0).size());
+                for(size_t i = 0; i < jointvaluesstd.size(); ++i) {
+                    dReal jointmean = 0;
+                    FOREACHC(it, vfinalvalues) {
+                        jointmean += it->at(i);
                     }
-                    translationstd *= (1.0/vfinaltransformations.size());
-                    dReal ftranslationdisplacement = (RaveSqrt(translationstd.x)+RaveSqrt(translationstd.y)+RaveSqrt(translationstd.z))/3;
-                    vector<dReal> jointvaluesstd(vfinalvalues.at(0).size());
-                    for(size_t i = 0; i < jointvaluesstd.size(); ++i) {
-                        dReal jointmean = 0;
-                        FOREACHC(it, vfinalvalues) {
-                            jointmean += it->at(i);
-                        }
-                        jointmean /= dReal(vfinalvalues.size());
-                        dReal jointstd = 0;
-                        FOREACHC(it, vfinalvalues) {
-                            jointstd += (it->at(i)-jointmean)*(it->at(i)-jointmean);
-                        }
-                        jointvaluesstd[i] = _vjointmaxlengths.at(i) * RaveSqrt(jointstd / dReal(vfinalvalues.size()));
+                    jointmean /= dReal(vfinalvalues.size());
+                    dReal jointstd = 0;
+                    FOREACHC(it, vfinalvalues) {
+                        jointstd += (it->at(i)-jointmean)*(it->at(i)-jointmean);
                     }
-                    dReal fmaxjointdisplacement = 0;
-                    FOREACHC(itlink, _robot->GetLinks()) {
-                        dReal f = 0;
-                        for(size_t ijoint = 0; ijoint < _robot->GetJoints().size(); ++ijoint) {
-                            if( _robot->DoesAffect(ijoint, (*itlink)->GetIndex()) ) {
-                                f += jointvaluesstd.at(ijoint);
-                            }
+                    jointvaluesstd[i] = _vjointmaxlengths.at(i) * RaveSqrt(jointstd / dReal(vfinalvalues.size()));
+                }
+                dReal fmaxjointdisplacement = 0;
+                FOREACHC(itlink, probot->GetLinks()) {
+                    dReal f = 0;
+                    for(size_t ijoint = 0; ijoint < probot->GetJoints().size(); ++ijoint) {
+                        if( probot->DoesAffect(ijoint, (*itlink)->GetIndex()) ) {
+                            f += jointvaluesstd.at(ijoint);
                         }
-                        fmaxjointdisplacement = max(fmaxjointdisplacement,f);
                     }
+                    fmaxjointdisplacement = max(fmaxjointdisplacement,f);
+                }
 
-                    dReal graspthresh = 0.005*RaveSqrt(0.49+400*worker_params->fgraspingnoise)-0.0035;
-                    if( graspthresh < worker_params->fgraspingnoise*0.1 ) {
-                        graspthresh = worker_params->fgraspingnoise*0.1;
-                    }
-                    if( ftranslationdisplacement+fmaxjointdisplacement > graspthresh ) {
-                        RAVELOG_DEBUG(str(boost::format("grasp %d: fragile grasp %f>%f\n")%grasp_params->id%(ftranslationdisplacement+fmaxjointdisplacement)%(0.7 * worker_params->fgraspingnoise)));
-                        continue;
-                    }
+                dReal graspthresh = 0.005*RaveSqrt(0.49+400*worker_params->fgraspingnoise)-0.0035;
+                if( graspthresh < worker_params->fgraspingnoise*0.1 ) {
+                    graspthresh = worker_params->fgraspingnoise*0.1;
+                }
+                if( ftranslationdisplacement+fmaxjointdisplacement > graspthresh ) {
+                    RAVELOG_DEBUG(str(boost::format("grasp %d: fragile grasp %f>%f\n")%grasp_params->id%(ftranslationdisplacement+fmaxjointdisplacement)%(0.7 * worker_params->fgraspingnoise)));
+                    continue;
                 }
+            }
 
-                RAVELOG_DEBUG(str(boost::format("grasp %d: success")%grasp_params->id));
+            RAVELOG_DEBUG(str(boost::format("grasp %d: success")%grasp_params->id));
 
+            {
                 std::lock_guard<std::mutex> lock(_mutexGrasp);
-                _listGraspResults.push_back(grasp_params);
+                job->listResults.push_back(grasp_params);
+                job->listNewResults.push_back(grasp_params);
+                if( job->listResults.size() >= job->maxgrasps ) {
+                    // enough grasps, the grasps that are being evaluated are still added to the results
+                    job->bStop = true;
+                }
             }
+            _condGraspResults.notify_all();
         }
-        pcloneenv->Destroy();
     }
 
-    bool _bContinueWorker;
-    std::mutex _mutexGrasp;
-    GraspParametersThreadPtr _graspParamsWork;
-    list<GraspParametersThreadPtr> _listGraspResults;
-    std::condition_variable _condGraspHasWork, _condGraspReceivedWork;
+    std::mutex _mutexGrasp; ///< protects _graspJob, _vGraspWorkers, _nGraspEnvStamp, _bShutdownGraspWorkers and the state of the jobs
+    GraspJobPtr _graspJob; ///< the last started job
+    vector<GraspWorkerPtr> _vGraspWorkers; ///< workers kept between the commands
+    EnvironmentBasePtr _pGraspEnv; ///< clone of the environment the workers synchronize with, updated when a job starts
+    int _nGraspEnvStamp = 0; ///< incremented every time _pGraspEnv is updated
+    bool _bShutdownGraspWorkers = false;
+    std::condition_variable _condGraspHasWork; ///< notified when a job starts or the workers shut down
+    std::condition_variable _condGraspResults; ///< notified when a grasp succeeds or a worker stops working on a job
 
 protected:
     void _ComputeJointMaxLengths(vector<dReal>& vjointlengths)
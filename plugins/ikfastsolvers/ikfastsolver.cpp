@@ -615,6 +615,18 @@ protected:
         bool _bCheckEndEffectorEnvCollision, _bCheckEndEffectorSelfCollision, _bCheckSelfCollision, _bDisabled;
     };
 
+    /// \brief buffers reused by every ik call of a free joint sweep so that the samples do not reallocate them
+    struct IkSweepScratch
+    {
+        IkSweepScratch() {
+            solutions.Reserve(16);
+        }
+
+        ikfast::IkSolutionList<IkReal> solutions; ///< cleared before every ik call, keeps the solutions that were allocated by previous samples
+        std::vector<int> vsolutionorder;
+        std::vector< std::pair<size_t,dReal> > vdists;
+    };
+
     virtual bool Solve(const IkParameterization& rawparam, const std::vector<dReal>& q0, int filteroptions, boost::shared_ptr< std::vector<dReal> > result)
     {
         std::vector<dReal> q0local = q0; // copy in case result points to q0
@@ -691,7 +703,8 @@ protected:
         std::vector<IkReal> vfree(_vfreeparams.size());
         StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
         CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
-        IkReturnAction retaction = ComposeSolution(_vfreeparams, vfree, 0, q0, boost::bind(&IkFastSolver::_SolveSingle,shared_solver(), boost::ref(param),boost::ref(vfree),boost::ref(q0),filteroptions,ikreturn,boost::ref(stateCheck)), _vFreeInc);
+        IkSweepScratch scratch;
+        IkReturnAction retaction = ComposeSolution(_vfreeparams, vfree, 0, q0, boost::bind(&IkFastSolver::_SolveSingle,shared_solver(), boost::ref(param),boost::ref(vfree),boost::ref(q0),filteroptions,ikreturn,boost::ref(stateCheck),boost::ref(scratch)), _vFreeInc);
         if( !!ikreturn ) {
             ikreturn->_action = retaction;
         }
@@ -710,7 +723,8 @@ protected:
         std::vector<IkReal> vfree(_vfreeparams.size());
         StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
         CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
-        IkReturnAction retaction = ComposeSolution(_vfreeparams, vfree, 0, vector<dReal>(), boost::bind(&IkFastSolver::_SolveAll,shared_solver(), param,boost::ref(vfree),filteroptions,boost::ref(vikreturns), boost::ref(stateCheck)), _vFreeInc);
+        IkSweepScratch scratch;
+        IkReturnAction retaction = ComposeSolution(_vfreeparams, vfree, 0, vector<dReal>(), boost::bind(&IkFastSolver::_SolveAll,shared_solver(), param,boost::ref(vfree),filteroptions,boost::ref(vikreturns), boost::ref(stateCheck), boost::ref(scratch)), _vFreeInc);
         if( retaction & IKRA_Quit ) {
             return false;
         }
@@ -738,7 +752,8 @@ protected:
         }
         StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
         CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
-        IkReturnAction retaction = _SolveSingle(param,vfree,q0,filteroptions,ikreturn,stateCheck);
+        IkSweepScratch scratch;
+        IkReturnAction retaction = _SolveSingle(param,vfree,q0,filteroptions,ikreturn,stateCheck,scratch);
         if( !!ikreturn ) {
             ikreturn->_action = retaction;
         }
@@ -763,7 +778,8 @@ protected:
         }
         StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
         CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
-        IkReturnAction retaction = _SolveAll(param,vfree,filteroptions,vikreturns, stateCheck);
+        IkSweepScratch scratch;
+        IkReturnAction retaction = _SolveAll(param,vfree,filteroptions,vikreturns, stateCheck, scratch);
         if( retaction & IKRA_Quit ) {
             return false;
         }
@@ -771,6 +787,116 @@ protected:
         return vikreturns.size()>0;
     }
 
+    virtual int SolveBatch(const std::vector<IkParameterization>& vrawparams, const std::vector<dReal>& q0, int filteroptions, std::vector<IkReturnPtr>& vikreturns)
+    {
+        vikreturns.resize(vrawparams.size());
+        if( vrawparams.size() == 0 ) {
+            return 0;
+        }
+        RobotBase::ManipulatorPtr pmanip(_pmanip);
+        RobotBasePtr probot = pmanip->GetRobot();
+        RobotBase::RobotStateSaver saver(probot);
+        probot->SetActiveDOFs(pmanip->GetArmIndices());
+        CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
+        IkSweepScratch scratch;
+
+        // the free joint samples only depend on q0, so enumerate them once in the order ComposeSolution would visit them
+        std::vector< std::vector<IkReal> > vfreesamples;
+        std::vector<IkReal> vfree(_vfreeparams.size());
+        ComposeSolution(_vfreeparams, vfree, 0, q0, [&vfreesamples, &vfree]() {
+            vfreesamples.push_back(vfree);
+            return IKRA_Reject;
+        }, _vFreeInc);
+
+        int nsuccess = 0;
+        IkParameterization ikparamdummy;
+        for(size_t iparam = 0; iparam < vrawparams.size(); ++iparam) {
+            IkReturnPtr& ikreturn = vikreturns[iparam];
+            if( !ikreturn ) {
+                ikreturn.reset(new IkReturn(IKRA_Reject));
+            }
+            ikreturn->Clear();
+            const IkParameterization& param = _ConvertIkParameterization(vrawparams[iparam], ikparamdummy);
+            // end effector checks are cached per target, so cannot be shared between goals
+            StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
+            int allres = IKRA_Reject;
+            FOREACHC(itfree, vfreesamples) {
+                IkReturnAction res = _SolveSingle(param, *itfree, q0, filteroptions, ikreturn, stateCheck, scratch);
+                if( !(res & IKRA_Reject) || (res & IKRA_Quit) ) {
+                    allres = res;
+                    break;
+                }
+                allres |= res;
+            }
+            ikreturn->_action = static_cast<IkReturnAction>(allres);
+            if( ikreturn->_action == IKRA_Success ) {
+                ++nsuccess;
+            }
+            else if( ikreturn->_action & IKRA_Quit ) {
+                for(size_t iremaining = iparam+1; iremaining < vikreturns.size(); ++iremaining) {
+                    if( !vikreturns[iremaining] ) {
+                        vikreturns[iremaining].reset(new IkReturn(IKRA_Quit));
+                    }
+                    else {
+                        vikreturns[iremaining]->Clear();
+                        vikreturns[iremaining]->_action = IKRA_Quit;
+                    }
+                }
+                break;
+            }
+        }
+        return nsuccess;
+    }
+
+    virtual int SolveAllBatch(const std::vector<IkParameterization>& vrawparams, int filteroptions, std::vector< std::vector<IkReturnPtr> >& vvikreturns)
+    {
+        vvikreturns.resize(vrawparams.size());
+        FOREACH(itikreturns, vvikreturns) {
+            itikreturns->resize(0);
+        }
+        if( vrawparams.size() == 0 ) {
+            return 0;
+        }
+        RobotBase::ManipulatorPtr pmanip(_pmanip);
+        RobotBasePtr probot = pmanip->GetRobot();
+        RobotBase::RobotStateSaver saver(probot);
+        probot->SetActiveDOFs(pmanip->GetArmIndices());
+        CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
+        IkSweepScratch scratch;
+
+        std::vector< std::vector<IkReal> > vfreesamples;
+        std::vector<IkReal> vfree(_vfreeparams.size());
+        ComposeSolution(_vfreeparams, vfree, 0, vector<dReal>(), [&vfreesamples, &vfree]() {
+            vfreesamples.push_back(vfree);
+            return IKRA_Reject;
+        }, _vFreeInc);
+
+        int nsuccess = 0;
+        IkParameterization ikparamdummy;
+        for(size_t iparam = 0; iparam < vrawparams.size(); ++iparam) {
+            std::vector<IkReturnPtr>& vikreturns = vvikreturns[iparam];
+            const IkParameterization& param = _ConvertIkParameterization(vrawparams[iparam], ikparamdummy);
+            StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
+            bool bquit = false;
+            FOREACHC(itfree, vfreesamples) {
+                IkReturnAction res = _SolveAll(param, *itfree, filteroptions, vikreturns, stateCheck, scratch);
+                if( res & IKRA_Quit ) {
+                    bquit = true;
+                    break;
+                }
+            }
+            if( bquit ) {
+                vikreturns.resize(0);
+                break;
+            }
+            _SortSolutions(probot, vikreturns);
+            if( vikreturns.size() > 0 ) {
+                ++nsuccess;
+            }
+        }
+        return nsuccess;
+    }
+
     virtual int GetNumFreeParameters() const
     {
         return (int)_vfreeparams.size();
@@ -1309,10 +1435,11 @@ protected:
         return p1.second < p2.second;
     }
 
-    IkReturnAction _SolveSingle(const IkParameterization& param, const vector<IkReal>& vfree, const vector<dReal>& q0, int filteroptions, IkReturnPtr ikreturn, StateCheckEndEffector& stateCheck)
+    IkReturnAction _SolveSingle(const IkParameterization& param, const vector<IkReal>& vfree, const vector<dReal>& q0, int filteroptions, IkReturnPtr ikreturn, StateCheckEndEffector& stateCheck, IkSweepScratch& scratch)
     {
         RobotBase::ManipulatorPtr pmanip(_pmanip);
-        ikfast::IkSolutionList<IkReal> solutions;
+        ikfast::IkSolutionList<IkReal>& solutions = scratch.solutions;
+        solutions.Clear();
         Transform tIkChainEndlinkToEE;
         if (!!pmanip->GetIkChainEndLink()) {
             tIkChainEndlinkToEE = pmanip->GetIkChainEndLink()->GetTransform().inverse() * pmanip->GetEndEffector()->GetTransform();
@@ -1329,10 +1456,13 @@ protected:
         // find the first valid solution that satisfies joint constraints and collisions
         boost::tuple<const vector<IkReal>&, const vector<dReal>&,int> textra(vsolfree, q0, filteroptions);
 
-        vector<int> vsolutionorder(solutions.GetNumSolutions());
+        // the solution order is only read by this call, nested solves use their own scratch
+        vector<int>& vsolutionorder = scratch.vsolutionorder;
+        vsolutionorder.resize(solutions.GetNumSolutions());
         if( vravesol.size() == q0.size() ) {
             // sort the solutions from closest to farthest
-            vector<pair<size_t,dReal> > vdists; vdists.reserve(solutions.GetNumSolutions());
+            vector<pair<size_t,dReal> >& vdists = scratch.vdists;
+            vdists.resize(0);
             for(size_t isolution = 0; isolution < solutions.GetNumSolutions(); ++isolution) {
                 const ikfast::IkSolution<IkReal>& iksol = dynamic_cast<const ikfast::IkSolution<IkReal>& >(solutions.GetSolution(isolution));
                 iksol.Validate();
@@ -1871,11 +2001,12 @@ protected:
 //        return IKRA_Success;
     }
 
-    IkReturnAction _SolveAll(const IkParameterization& param, const vector<IkReal>& vfree, int filteroptions, std::vector<IkReturnPtr>& vikreturns, StateCheckEndEffector& stateCheck)
+    IkReturnAction _SolveAll(const IkParameterization& param, const vector<IkReal>& vfree, int filteroptions, std::vector<IkReturnPtr>& vikreturns, StateCheckEndEffector& stateCheck, IkSweepScratch& scratch)
     {
         RobotBase::ManipulatorPtr pmanip(_pmanip);
         RobotBasePtr probot = pmanip->GetRobot();
-        ikfast::IkSolutionList<IkReal> solutions;
+        ikfast::IkSolutionList<IkReal>& solutions = scratch.solutions;
+        solutions.Clear();
         Transform tIkChainEndlinkToEE;
         if (!!pmanip->GetIkChainEndLink()) {
             tIkChainEndlinkToEE = pmanip->GetIkChainEndLink()->GetTransform().inverse() * pmanip->GetEndEffector()->GetTransform();
@@ -949,6 +949,8 @@ public:
         if( _bUsePerturbation ) {
             options |= CFO_CheckWithPerturbation;
         }
+        // most shortcuts are rejected because of a collision somewhere in the middle of the segment, so start checking from there
+        options |= CFO_CheckInBisectionOrder;
         bool bExpectModifiedConfigurations = _parameters->fCosManipAngleThresh > -1+g_fEpsilonLinear;
         if(bExpectModifiedConfigurations || _bmanipconstraints) {
             options |= CFO_FillCheckedConfiguration;
@@ -12,8 +12,12 @@
 // You should have received a copy of the GNU Lesser General Public License along with this program.
 // If not, see <http://www.gnu.org/licenses/>.
 #include "openraveplugindefs.h"
+#include <atomic>
 #include <cfloat>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include <openrave/planningutils.h>
 
 #include "rampoptimizer/interpolator.h"
@@ -364,6 +368,21 @@ public:
         _environmentid = GetEnv()->GetId();
         _vVisitedDiscretizationCache.resize(0x1000*0x1000,0); // pre-allocate in order to keep memory growth predictable
         _feasibilitychecker.SetEnvID(_environmentid); // set envid for logging purpose
+        _nNumShortcutCandidates = 0;
+        _nNumShortcutWorkers = 0;
+        _nNumBatchShortcutCandidates = 0;
+        _nShortcutBatchId = 0;
+        _nFinishedShortcutCandidates = 0;
+        _nBusyShortcutWorkers = 0;
+        _bStopShortcutWorkers = false;
+        RegisterCommand("SetNumShortcutCandidates", boost::bind(&ParabolicSmoother2::_SetNumShortcutCandidatesCommand,this,_1,_2),
+                        "sets the number of candidate shortcuts that are sampled in each shortcut iteration and checked for collisions concurrently on cloned environments. The candidate saving the most time is then verified by the usual constraints checking. If <= 1 (default), candidates are checked one at a time. An optional second number sets how many worker threads check the candidates, if <= 0 (default) then it depends on the number of cores.");
+    }
+
+    virtual ~ParabolicSmoother2()
+    {
+        _StopShortcutWorkers();
+        _DestroyShortcutWorkers();
     }
 
     virtual bool InitPlan(RobotBasePtr pbase, PlannerParametersConstPtr params)
@@ -1091,6 +1110,8 @@ public:
         if( _bUsePerturbation ) {
             options |= CFO_CheckWithPerturbation;
         }
+        // most shortcuts are rejected because of a collision somewhere in the middle of the segment, so start checking from there
+        options |= CFO_CheckInBisectionOrder;
 
         bool bExpectedModifiedConfigurations = (_parameters->fCosManipAngleThresh > -1 + g_fEpsilonLinear);
         if( bExpectedModifiedConfigurations || _bmanipconstraints ) {
@@ -2449,6 +2470,10 @@ protected:
 
         std::vector<RampOptimizer::RampND> rampndVect = parabolicpath.GetRampNDVect(); // for convenience
 
+        // candidate shortcuts are only sampled in batches when the workers could be started, the workers are stopped when leaving this function
+        const bool bSpeculativeShortcut = _StartShortcutWorkers();
+        boost::shared_ptr<void> stopworkers((void*) 0, boost::bind(&ParabolicSmoother2::_StopShortcutWorkers, this));
+
         // Caching stuff
         std::vector<RampOptimizer::RampND>& shortcutRampNDVect = _cacheRampNDVect; // for storing interpolated trajectory
         std::vector<RampOptimizer::RampND>& shortcutRampNDVectOut = _cacheRampNDVectOut, &shortcutRampNDVectOut1 = _cacheRampNDVectOut1; // for storing checked trajectory
@@ -2541,6 +2566,12 @@ protected:
                     fStartTimeAccelMult = max(0.8, fStartTimeAccelMult);
                 }
             }
+            else if( bSpeculativeShortcut ) {
+                if( !_SampleSpeculativeShortcut(parabolicpath, rampndVect, rng, tTotal, minTimeStep, fStartTimeVelMult, fStartTimeAccelMult, t0, t1) ) {
+                    // none of the candidates can be collision-free, so do not bother with the rest of the checks
+                    continue;
+                }
+            }
             else {
                 // Proceed normally
                 _SampleTime(t0, t1,
@@ -2642,32 +2673,7 @@ protected:
                 rampndVect[i1].EvalVel(u1, v1Vect);
                 ++_progress._iteration;
 
-                vellimits = _parameters->_vConfigVelocityLimit;
-                accellimits = _parameters->_vConfigAccelerationLimit;
-
-                if( _bmanipconstraints && _manipconstraintchecker && _bUseNewHeuristic ) {
-                    // pass
-                    // do nothing only when the new heuristic is used while having manipconstraints. otherwise, proceed normally
-                }
-                else {
-                    for (size_t j = 0; j < _parameters->_vConfigVelocityLimit.size(); ++j) {
-                        // Adjust vellimits and accellimits
-                        dReal fminvel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j])); // the scaled vellimits must be at least this value
-                        {
-                            dReal f = max(fminvel, fStartTimeVelMult * _parameters->_vConfigVelocityLimit[j]);
-                            if( vellimits[j] > f ) {
-                                vellimits[j] = f;
-                            }
-                        }
-
-                        {
-                            dReal f = fStartTimeAccelMult * _parameters->_vConfigAccelerationLimit[j];
-                            if( accellimits[j] > f ) {
-                                accellimits[j] = f;
-                            }
-                        }
-                    }
-                }
+                _ComputeShortcutVelAccelLimits(v0Vect, v1Vect, fStartTimeVelMult, fStartTimeAccelMult, vellimits, accellimits);
 
                 std::vector<dReal> reductionFactors2; // keeps track of the reduction factors got from this shortcut
 
@@ -3515,6 +3521,328 @@ protected:
         _EnsureValidlySampledTimes(t0, t1, tTotal);
     }
 
+    /// \brief scales down the vel/accel limits of a shortcut from t0 to t1 while keeping them large enough for the boundary velocities v0Vect and v1Vect
+    void _ComputeShortcutVelAccelLimits(const std::vector<dReal>& v0Vect, const std::vector<dReal>& v1Vect, dReal fStartTimeVelMult, dReal fStartTimeAccelMult, std::vector<dReal>& vellimits, std::vector<dReal>& accellimits) const
+    {
+        vellimits = _parameters->_vConfigVelocityLimit;
+        accellimits = _parameters->_vConfigAccelerationLimit;
+
+        if( _bmanipconstraints && _manipconstraintchecker && _bUseNewHeuristic ) {
+            // pass
+            // do nothing only when the new heuristic is used while having manipconstraints. otherwise, proceed normally
+            return;
+        }
+
+        for (size_t j = 0; j < _parameters->_vConfigVelocityLimit.size(); ++j) {
+            // Adjust vellimits and accellimits
+            dReal fminvel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j])); // the scaled vellimits must be at least this value
+            {
+                dReal f = max(fminvel, fStartTimeVelMult * _parameters->_vConfigVelocityLimit[j]);
+                if( vellimits[j] > f ) {
+                    vellimits[j] = f;
+                }
+            }
+
+            {
+                dReal f = fStartTimeAccelMult * _parameters->_vConfigAccelerationLimit[j];
+                if( accellimits[j] > f ) {
+                    accellimits[j] = f;
+                }
+            }
+        }
+    }
+
+    /// \brief a shortcut from t0 to t1 whose collisions are checked by one of the shortcut workers
+    struct ShortcutCandidate
+    {
+        dReal t0 = 0, t1 = 0;
+        dReal fTimeSaved = 0; ///< (t1 - t0) minus the duration of vrampnds
+        bool bCollisionFree = false; ///< set by the shortcut workers
+        std::vector<dReal> x0Vect, x1Vect, v0Vect, v1Vect, vellimits, accellimits;
+        std::vector<RampOptimizer::RampND> vrampnds; ///< the initial interpolation of the shortcut
+    };
+
+    /// \brief checks the collisions of candidate shortcuts on its own clone of the environment
+    struct ShortcutWorker
+    {
+        EnvironmentBasePtr penv;
+        RobotBasePtr probot; ///< the cloned robot whose active dofs match the configuration specification of the parameters
+        std::vector<int> vdofindices;
+        std::vector<dReal> vconfigs, vtempconfig;
+        std::vector<uint8_t> vresults;
+    };
+    typedef boost::shared_ptr<ShortcutWorker> ShortcutWorkerPtr;
+
+    bool _SetNumShortcutCandidatesCommand(std::ostream& sout, std::istream& sinput)
+    {
+        sinput >> _nNumShortcutCandidates;
+        if( !sinput ) {
+            return false;
+        }
+        int numworkers = 0;
+        if( sinput >> numworkers ) {
+            _nNumShortcutWorkers = numworkers;
+        }
+        else {
+            _nNumShortcutWorkers = 0;
+        }
+        return true;
+    }
+
+    /// \brief syncs the cloned environments of the shortcut workers with the current environment and starts their threads.
+    ///
+    /// \return false if candidate shortcuts should be checked one at a time
+    bool _StartShortcutWorkers()
+    {
+        if( _nNumShortcutCandidates <= 1 ) {
+            return false;
+        }
+
+        // the workers only check collisions of the robot, so the configuration space has to be the active dofs of one robot
+        std::vector<KinBodyPtr> vusedbodies;
+        _parameters->_configurationspecification.ExtractUsedBodies(GetEnv(), vusedbodies);
+        if( vusedbodies.size() != 1 || !vusedbodies[0]->IsRobot() ) {
+            RAVELOG_DEBUG_FORMAT("env=%d, speculative shortcutting needs exactly one robot in the configuration specification, checking shortcuts one at a time", _environmentid);
+            return false;
+        }
+        RobotBasePtr probot = RaveInterfaceCast<RobotBase>(vusedbodies[0]);
+        if( probot->GetAffineDOF() != 0 || _parameters->_configurationspecification != probot->GetActiveConfigurationSpecification() ) {
+            RAVELOG_DEBUG_FORMAT("env=%d, configuration specification is not the active dofs of robot %s, checking shortcuts one at a time", _environmentid%probot->GetName());
+            return false;
+        }
+
+        const int numworkers = min(_nNumShortcutCandidates, _nNumShortcutWorkers > 0 ? _nNumShortcutWorkers : max(1, (int)std::thread::hardware_concurrency()));
+        for(size_t iworker = numworkers; iworker < _vshortcutworkers.size(); ++iworker) {
+            if( !!_vshortcutworkers[iworker] && !!_vshortcutworkers[iworker]->penv ) {
+                _vshortcutworkers[iworker]->probot.reset();
+                _vshortcutworkers[iworker]->penv->Destroy();
+            }
+        }
+        _vshortcutworkers.resize(numworkers);
+        for(int iworker = 0; iworker < numworkers; ++iworker) {
+            ShortcutWorkerPtr& worker = _vshortcutworkers[iworker];
+            if( !worker ) {
+                worker.reset(new ShortcutWorker());
+            }
+            const std::string clonedenvname = str(boost::format("%s_parabolicsmoother2shortcut%d")%GetEnv()->GetName()%iworker);
+            if( !worker->penv ) {
+                worker->penv = GetEnv()->CloneSelf(clonedenvname, Clone_Bodies|Clone_ShareGeometries);
+            }
+            else {
+                // re-uses the bodies that did not change since the previous call
+                worker->penv->Clone(GetEnv(), clonedenvname, Clone_Bodies|Clone_ShareGeometries);
+            }
+
+            EnvironmentLock clonedlock(worker->penv->GetMutex());
+            worker->probot = worker->penv->GetRobot(probot->GetName());
+            if( !worker->probot ) {
+                RAVELOG_WARN_FORMAT("env=%d, failed to find robot %s in cloned environment %s, checking shortcuts one at a time", _environmentid%probot->GetName()%worker->penv->GetNameId());
+                return false;
+            }
+            worker->probot->SetActiveDOFs(probot->GetActiveDOFIndices());
+            worker->vdofindices = probot->GetActiveDOFIndices();
+        }
+
+        // read the batch id before starting the threads so that a worker starting late cannot skip the first batch
+        int nStartBatchId = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutexShortcutWorkers);
+            _bStopShortcutWorkers = false;
+            _nBusyShortcutWorkers = 0;
+            nStartBatchId = _nShortcutBatchId;
+        }
+        _vshortcutthreads.resize(numworkers);
+        for(int iworker = 0; iworker < numworkers; ++iworker) {
+            _vshortcutthreads[iworker].reset(new std::thread(boost::bind(&ParabolicSmoother2::_RunShortcutWorker, this, _vshortcutworkers[iworker], nStartBatchId)));
+        }
+        return true;
+    }
+
+    void _StopShortcutWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutexShortcutWorkers);
+            _bStopShortcutWorkers = true;
+        }
+        _condShortcutWork.notify_all();
+        FOREACH(itthread, _vshortcutthreads) {
+            (*itthread)->join();
+        }
+        _vshortcutthreads.clear();
+    }
+
+    void _DestroyShortcutWorkers()
+    {
+        FOREACH(itworker, _vshortcutworkers) {
+            if( !!*itworker ) {
+                (*itworker)->probot.reset();
+                if( !!(*itworker)->penv ) {
+                    (*itworker)->penv->Destroy();
+                }
+            }
+        }
+        _vshortcutworkers.clear();
+    }
+
+    /// \brief thread function of a shortcut worker, checks candidates of every batch until _bStopShortcutWorkers is set
+    ///
+    /// \param nLastBatchId the batch id when the worker was started, every batch after it is processed
+    void _RunShortcutWorker(ShortcutWorkerPtr worker, int nLastBatchId)
+    {
+        while(true) {
+            int numcandidates = 0;
+            {
+                std::unique_lock<std::mutex> lock(_mutexShortcutWorkers);
+                _condShortcutWork.wait(lock, [&] { return _bStopShortcutWorkers || _nShortcutBatchId != nLastBatchId; });
+                if( _bStopShortcutWorkers ) {
+                    return;
+                }
+                nLastBatchId = _nShortcutBatchId;
+                numcandidates = _nNumBatchShortcutCandidates;
+                ++_nBusyShortcutWorkers;
+            }
+
+            int numchecked = 0;
+            for(int icandidate = _nNextShortcutCandidate++; icandidate < numcandidates; icandidate = _nNextShortcutCandidate++) {
+                ShortcutCandidate& candidate = _vshortcutcandidates[icandidate];
+                try {
+                    candidate.bCollisionFree = _IsShortcutCandidateCollisionFree(*worker, candidate);
+                }
+                catch(const std::exception& ex) {
+                    RAVELOG_WARN_FORMAT("env=%d, failed to check shortcut candidate t0=%.15e, t1=%.15e: %s", _environmentid%candidate.t0%candidate.t1%ex.what());
+                    candidate.bCollisionFree = false;
+                }
+                ++numchecked;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutexShortcutWorkers);
+                _nFinishedShortcutCandidates += numchecked;
+                --_nBusyShortcutWorkers;
+            }
+            _condShortcutDone.notify_all();
+        }
+    }
+
+    /// \brief discretizes the interpolated ramps of the candidate at the configuration resolutions and checks them for env and self collisions on the clone of the worker
+    bool _IsShortcutCandidateCollisionFree(ShortcutWorker& worker, const ShortcutCandidate& candidate)
+    {
+        static const int s_nConfigsPerBatch = 16; ///< small batches so that a collision near the beginning of the shortcut skips the rest
+
+        EnvironmentLock lock(worker.penv->GetMutex());
+        const std::vector<dReal>& vConfigResolution = _parameters->_vConfigResolution;
+        const size_t ndof = worker.vdofindices.size();
+        worker.vconfigs.resize(0);
+        FOREACHC(itrampnd, candidate.vrampnds) {
+            const dReal duration = itrampnd->GetDuration();
+            // the velocities along the ramps are bounded by vellimits
+            int ndiv = 1;
+            for(size_t j = 0; j < ndof && j < vConfigResolution.size(); ++j) {
+                if( vConfigResolution[j] > 0 ) {
+                    ndiv = max(ndiv, (int)RaveCeil(candidate.vellimits[j]*duration/vConfigResolution[j]));
+                }
+            }
+            for(int idiv = 1; idiv <= ndiv; ++idiv) {
+                itrampnd->EvalPos(duration*idiv/ndiv, worker.vtempconfig);
+                worker.vconfigs.insert(worker.vconfigs.end(), worker.vtempconfig.begin(), worker.vtempconfig.end());
+            }
+        }
+
+        CollisionCheckerBasePtr pchecker = worker.penv->GetCollisionChecker();
+        const int numconfigs = worker.vconfigs.size()/ndof;
+        for(int istart = 0; istart < numconfigs; istart += s_nConfigsPerBatch) {
+            if( pchecker->CheckCollisionBatch(worker.probot, &worker.vconfigs[istart*ndof], min(s_nConfigsPerBatch, numconfigs - istart), worker.vdofindices, worker.vresults) > 0 ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// \brief computes the initial interpolation of a candidate shortcut the same way as the first slow down iteration of _Shortcut
+    ///
+    /// \return true if the interpolation saves at least minTimeStep
+    bool _ComputeShortcutCandidate(const RampOptimizer::ParabolicPath& parabolicpath, const std::vector<RampOptimizer::RampND>& rampndVect, dReal minTimeStep, dReal fStartTimeVelMult, dReal fStartTimeAccelMult, ShortcutCandidate& candidate)
+    {
+        int i0, i1;
+        dReal u0, u1;
+        parabolicpath.FindRampNDIndex(candidate.t0, i0, u0);
+        parabolicpath.FindRampNDIndex(candidate.t1, i1, u1);
+
+        rampndVect[i0].EvalPos(u0, candidate.x0Vect);
+        if( _parameters->SetStateValues(candidate.x0Vect) != 0 ) {
+            return false;
+        }
+        _parameters->_getstatefn(candidate.x0Vect);
+        rampndVect[i1].EvalPos(u1, candidate.x1Vect);
+        if( _parameters->SetStateValues(candidate.x1Vect) != 0 ) {
+            return false;
+        }
+        _parameters->_getstatefn(candidate.x1Vect);
+        rampndVect[i0].EvalVel(u0, candidate.v0Vect);
+        rampndVect[i1].EvalVel(u1, candidate.v1Vect);
+
+        _ComputeShortcutVelAccelLimits(candidate.v0Vect, candidate.v1Vect, fStartTimeVelMult, fStartTimeAccelMult, candidate.vellimits, candidate.accellimits);
+        if( !_interpolator.ComputeArbitraryVelNDTrajectory(candidate.x0Vect, candidate.x1Vect, candidate.v0Vect, candidate.v1Vect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, candidate.vellimits, candidate.accellimits, candidate.vrampnds, true) ) {
+            return false;
+        }
+
+        dReal segmentTime = 0;
+        FOREACHC(itrampnd, candidate.vrampnds) {
+            segmentTime += itrampnd->GetDuration();
+        }
+        candidate.fTimeSaved = candidate.t1 - candidate.t0 - segmentTime;
+        return candidate.fTimeSaved >= minTimeStep;
+    }
+
+    /// \brief samples _nNumShortcutCandidates shortcuts and checks their collisions concurrently on the shortcut workers.
+    ///
+    /// All random numbers are drawn on the calling thread and ties are broken by the sampling order, so the chosen shortcut only depends on the seed of rng.
+    /// \param[out] t0, t1 the collision-free candidate that saves the most time
+    /// \return false if none of the candidates is collision-free
+    bool _SampleSpeculativeShortcut(const RampOptimizer::ParabolicPath& parabolicpath, const std::vector<RampOptimizer::RampND>& rampndVect, RampOptimizer::RandomNumberGeneratorBase* rng, dReal tTotal, dReal minTimeStep, dReal fStartTimeVelMult, dReal fStartTimeAccelMult, dReal& t0, dReal& t1)
+    {
+        if( (int)_vshortcutcandidates.size() < _nNumShortcutCandidates ) {
+            _vshortcutcandidates.resize(_nNumShortcutCandidates);
+        }
+        int numcandidates = 0;
+        for(int isample = 0; isample < _nNumShortcutCandidates; ++isample) {
+            ShortcutCandidate& candidate = _vshortcutcandidates[numcandidates];
+            _SampleTime(candidate.t0, candidate.t1, rng->Rand(), rng->Rand(), tTotal, minTimeStep);
+            candidate.bCollisionFree = false;
+            if( _ComputeShortcutCandidate(parabolicpath, rampndVect, minTimeStep, fStartTimeVelMult, fStartTimeAccelMult, candidate) ) {
+                ++numcandidates;
+            }
+        }
+        if( numcandidates == 0 ) {
+            return false;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(_mutexShortcutWorkers);
+            _nNumBatchShortcutCandidates = numcandidates;
+            _nNextShortcutCandidate = 0;
+            _nFinishedShortcutCandidates = 0;
+            ++_nShortcutBatchId;
+            _condShortcutWork.notify_all();
+            // wait for the workers to leave the batch so that the candidates can be overwritten by the next call
+            _condShortcutDone.wait(lock, [&] { return _nFinishedShortcutCandidates >= numcandidates && _nBusyShortcutWorkers == 0; });
+        }
+
+        int ibest = -1;
+        for(int icandidate = 0; icandidate < numcandidates; ++icandidate) {
+            const ShortcutCandidate& candidate = _vshortcutcandidates[icandidate];
+            if( candidate.bCollisionFree && (ibest < 0 || candidate.fTimeSaved > _vshortcutcandidates[ibest].fTimeSaved) ) {
+                ibest = icandidate;
+            }
+        }
+        if( ibest < 0 ) {
+            return false;
+        }
+        t0 = _vshortcutcandidates[ibest].t0;
+        t1 = _vshortcutcandidates[ibest].t1;
+        return true;
+    }
+
     /// Members
     int _environmentid;
     ConstraintTrajectoryTimingParametersPtr _parameters;
@@ -3568,6 +3896,21 @@ protected:
     // in _Shortcut
     std::vector<uint8_t> _vVisitedDiscretizationCache;
 
+    // speculative shortcutting
+    int _nNumShortcutCandidates; ///< number of candidate shortcuts sampled in each shortcut iteration, if <= 1 then candidates are checked one at a time
+    int _nNumShortcutWorkers; ///< number of threads checking the candidates, if <= 0 then uses the number of cores
+    std::vector<ShortcutCandidate> _vshortcutcandidates; ///< the current batch, only the first _nNumBatchShortcutCandidates are valid
+    std::vector<ShortcutWorkerPtr> _vshortcutworkers; ///< the cloned environments are kept across PlanPath calls
+    std::vector<boost::shared_ptr<std::thread> > _vshortcutthreads; ///< only running inside _Shortcut
+    std::mutex _mutexShortcutWorkers; ///< protects the batch state below
+    std::condition_variable _condShortcutWork, _condShortcutDone;
+    int _nNumBatchShortcutCandidates;
+    int _nShortcutBatchId; ///< incremented every time a new batch is ready for the workers
+    int _nFinishedShortcutCandidates;
+    int _nBusyShortcutWorkers; ///< number of workers still processing the current batch
+    bool _bStopShortcutWorkers;
+    std::atomic<int> _nNextShortcutCandidate; ///< index of the next candidate of the batch to check
+
 #ifdef SMOOTHER2_TIMING_DEBUG
     // Statistics
     uint32_t _tShortcutStart, _tShortcutEnd;
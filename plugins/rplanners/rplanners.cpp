@@ -45,6 +45,7 @@ RPlannersPlugin::RPlannersPlugin()
 {
     _interfaces[PT_Planner].push_back("RAStar");
     _interfaces[PT_Planner].push_back("BiRRT");
+    _interfaces[PT_Planner].push_back("ParallelBiRRT");
     _interfaces[PT_Planner].push_back("BasicRRT");
     _interfaces[PT_Planner].push_back("ExplorationRRT");
     _interfaces[PT_Planner].push_back("GraspGradient");
@@ -76,6 +77,9 @@ OpenRAVE::InterfaceBasePtr RPlannersPlugin::CreateInterface(OpenRAVE::InterfaceT
         else if( interfacename == "birrt") {
             return boost::make_shared<BirrtPlanner>(penv);
         }
+        else if( interfacename == "parallelbirrt") {
+            return boost::make_shared<ParallelBirrtPlanner>(penv);
+        }
         else if( interfacename == "rbirrt") {
             RAVELOG_WARN("rBiRRT is deprecated, use BiRRT\n");
             return boost::make_shared<BirrtPlanner>(penv);
@@ -21,6 +21,10 @@
 
 #include <boost/pool/pool.hpp>
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 #define _(msgid) OpenRAVE::RaveGetLocalizedTextForDomain("openrave_plugins_rplanners", msgid)
 
 enum ExtendType {
@@ -159,6 +163,7 @@ public:
         _maxlevel = 0;
         _minlevel = 0;
         _fMaxLevelBound = 0;
+        _numFlatNodes = 0;
     }
 
     ~SpatialTree() {
@@ -179,6 +184,7 @@ public:
         }
         _planner = planner;
         _distmetricfn = distmetricfn;
+        _vFlatWeights2.resize(0);
         _fStepLength = fStepLength;
         _dof = dof;
         _vNewConfig.resize(dof);
@@ -212,6 +218,19 @@ public:
             _pNodesPool.reset(new boost::pool<>(sizeof(Node)+_dof*sizeof(dReal)));
         }
         _numnodes = 0;
+        _ClearFlatNodes();
+    }
+
+    /// \brief makes nearest neighbor queries scan a contiguous copy of the node configurations with a weighted euclidean distance instead of traversing the cover tree with _distmetricfn.
+    ///
+    /// Only valid when the distance metric is sqrt(sum_i vweights2[i]*(q0[i]-q1[i])^2), which is what SimpleDistanceMetric computes when none of the dofs are circular. Insertion and removal still go through the cover tree. Has to be called after Init and before any node is inserted.
+    /// \param vweights2 the squared weight of every dof. If empty, queries use the cover tree.
+    void SetFlatNearestNeighborWeights(const std::vector<dReal>& vweights2)
+    {
+        OPENRAVE_ASSERT_OP(_numnodes,==,0);
+        OPENRAVE_ASSERT_FORMAT(vweights2.size() == 0 || (int)vweights2.size() == _dof, "expected %d weights, but got %d", _dof%vweights2.size(), ORE_InvalidArguments);
+        _vFlatWeights2 = vweights2;
+        _ClearFlatNodes();
     }
 
     inline dReal _ComputeDistance(const dReal* config0, const dReal* config1) const
@@ -234,6 +253,22 @@ public:
         return _FindNearestNode(vquerystate);
     }
 
+    /// \brief returns the nearest neighbor found by traversing the cover tree with _distmetricfn, even if the flat index is used
+    std::pair<NodeBasePtr, dReal> FindNearestCoverTreeNode(const std::vector<dReal>& vquerystate) const
+    {
+        if( _numnodes == 0 ) {
+            return std::make_pair(NodeBasePtr(), std::numeric_limits<dReal>::infinity());
+        }
+        OPENRAVE_ASSERT_OP((int)vquerystate.size(),==,_dof);
+        return _FindNearestCoverTreeNode(vquerystate);
+    }
+
+    /// \brief true if nearest neighbor queries scan the flat index, see SetFlatNearestNeighborWeights
+    bool IsFlatNearestNeighbor() const
+    {
+        return _vFlatWeights2.size() > 0;
+    }
+
     virtual NodeBasePtr InsertNode(NodeBasePtr parent, const vector<dReal>& config, uint32_t userdata)
     {
         return _InsertNode((NodePtr)parent, config, userdata);
@@ -668,6 +703,22 @@ private:
         }
         OPENRAVE_ASSERT_OP((int)vquerystate.size(),==,_dof);
 
+        if( _vFlatWeights2.size() > 0 ) {
+            bestnode = _FindNearestFlatNode(vquerystate);
+            if( !!bestnode.first ) {
+                return bestnode;
+            }
+            // all nodes are invalidated, so let the cover tree decide like before
+        }
+        return _FindNearestCoverTreeNode(vquerystate);
+    }
+
+    /// \brief traverses the cover tree, assumes there is at least one node
+    std::pair<NodePtr, dReal> _FindNearestCoverTreeNode(const std::vector<dReal>& vquerystate) const
+    {
+        std::pair<NodePtr, dReal> bestnode;
+        bestnode.first = NULL;
+        bestnode.second = std::numeric_limits<dReal>::infinity();
         int currentlevel = _maxlevel; // where the root node is
         // traverse all levels gathering up the children at each level
         dReal fLevelBound = _fMaxLevelBound;
@@ -717,6 +768,9 @@ private:
             _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).insert(newnode); // add to the level
             newnode->_level = _maxlevel;
             _numnodes += 1;
+            if( _vFlatWeights2.size() > 0 ) {
+                _AddFlatNode(newnode);
+            }
         }
         else {
             _vCurrentLevelNodes.resize(1);
@@ -734,6 +788,9 @@ private:
             if( nParentFound < 0 ) {
                 return NodePtr();
             }
+            if( _vFlatWeights2.size() > 0 ) {
+                _AddFlatNode(newnode);
+            }
         }
         //BOOST_ASSERT(Validate());
         return newnode;
@@ -921,6 +978,7 @@ private:
         _vvCacheNodes.at(0).push_back(proot);
         bool bRemoved = _Remove(removenode, _vvCacheNodes, _maxlevel, _fMaxLevelBound);
         if( bRemoved ) {
+            _RemoveFlatNode(removenode);
             _DeleteNode(removenode);
         }
         if( removenode == proot ) {
@@ -928,12 +986,107 @@ private:
             BOOST_ASSERT(_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).size()==1);
             //_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).clear();
             _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).erase(proot);
+            _RemoveFlatNode(proot);
             bRemoved = true;
             _numnodes--;
         }
         return bRemoved;
     }
 
+    /// \brief linear scan of the flat nearest neighbor index, skips nodes that are not used for nearest neighbor
+    std::pair<NodePtr, dReal> _FindNearestFlatNode(const std::vector<dReal>& vquerystate) const
+    {
+        NodePtr bestnode = NULL;
+        dReal bestdist2 = std::numeric_limits<dReal>::infinity();
+        dReal vdist2[s_nFlatBlockSize];
+        const int numblocks = (int)_vFlatNodes.size()/s_nFlatBlockSize;
+        for(int iblock = 0; iblock < numblocks; ++iblock) {
+            _ComputeFlatBlockDistances2(&_vFlatConfigs[iblock*_dof*s_nFlatBlockSize], &vquerystate[0], vdist2);
+            for(int ilane = 0; ilane < s_nFlatBlockSize; ++ilane) {
+                NodePtr node = _vFlatNodes[iblock*s_nFlatBlockSize+ilane];
+                if( !!node && node->_usenn && vdist2[ilane] < bestdist2 ) {
+                    bestnode = node;
+                    bestdist2 = vdist2[ilane];
+                }
+            }
+        }
+        if( !bestnode ) {
+            return std::make_pair(bestnode, std::numeric_limits<dReal>::infinity());
+        }
+        return std::make_pair(bestnode, RaveSqrt(bestdist2));
+    }
+
+    /// \brief computes the squared weighted distances of the s_nFlatBlockSize nodes of one block to the query
+    inline void _ComputeFlatBlockDistances2(const dReal* pblock, const dReal* pquery, dReal* pdist2) const
+    {
+#if defined(__AVX__) && OPENRAVE_PRECISION
+        // one lane per node, s_nFlatBlockSize is the number of doubles in a register
+        __m256d vsum = _mm256_setzero_pd();
+        for(int idof = 0; idof < _dof; ++idof) {
+            __m256d vdiff = _mm256_sub_pd(_mm256_loadu_pd(pblock + idof*s_nFlatBlockSize), _mm256_set1_pd(pquery[idof]));
+            vsum = _mm256_add_pd(vsum, _mm256_mul_pd(_mm256_mul_pd(vdiff, vdiff), _mm256_set1_pd(_vFlatWeights2[idof])));
+        }
+        _mm256_storeu_pd(pdist2, vsum);
+#else
+        for(int ilane = 0; ilane < s_nFlatBlockSize; ++ilane) {
+            pdist2[ilane] = 0;
+        }
+        for(int idof = 0; idof < _dof; ++idof) {
+            const dReal* pdofvalues = pblock + idof*s_nFlatBlockSize;
+            for(int ilane = 0; ilane < s_nFlatBlockSize; ++ilane) {
+                dReal fdiff = pdofvalues[ilane] - pquery[idof];
+                pdist2[ilane] += _vFlatWeights2[idof]*fdiff*fdiff;
+            }
+        }
+#endif
+    }
+
+    /// \brief copies the configuration of node into lane index of the flat nearest neighbor index
+    inline void _SetFlatNode(int index, NodePtr node)
+    {
+        dReal* pvalues = &_vFlatConfigs[(index/s_nFlatBlockSize)*_dof*s_nFlatBlockSize + (index%s_nFlatBlockSize)];
+        for(int idof = 0; idof < _dof; ++idof) {
+            pvalues[idof*s_nFlatBlockSize] = node->q[idof];
+        }
+        _vFlatNodes[index] = node;
+    }
+
+    void _AddFlatNode(NodePtr node)
+    {
+        if( _numFlatNodes % s_nFlatBlockSize == 0 ) {
+            _vFlatConfigs.resize(_vFlatConfigs.size() + _dof*s_nFlatBlockSize, 0);
+            _vFlatNodes.resize(_vFlatNodes.size() + s_nFlatBlockSize, NULL);
+        }
+        _SetFlatNode(_numFlatNodes, node);
+        ++_numFlatNodes;
+    }
+
+    /// \brief removes node from the flat nearest neighbor index by moving the last node into its place
+    void _RemoveFlatNode(NodePtr node)
+    {
+        typename std::vector<NodePtr>::iterator itnode = std::find(_vFlatNodes.begin(), _vFlatNodes.begin()+_numFlatNodes, node);
+        if( itnode == _vFlatNodes.begin()+_numFlatNodes ) {
+            return;
+        }
+        int ilast = _numFlatNodes-1;
+        if( itnode-_vFlatNodes.begin() != ilast ) {
+            _SetFlatNode(itnode-_vFlatNodes.begin(), _vFlatNodes[ilast]);
+        }
+        _vFlatNodes[ilast] = NULL;
+        --_numFlatNodes;
+        if( _numFlatNodes % s_nFlatBlockSize == 0 ) {
+            _vFlatConfigs.resize(_vFlatConfigs.size() - _dof*s_nFlatBlockSize);
+            _vFlatNodes.resize(_vFlatNodes.size() - s_nFlatBlockSize);
+        }
+    }
+
+    inline void _ClearFlatNodes()
+    {
+        _vFlatConfigs.resize(0);
+        _vFlatNodes.resize(0);
+        _numFlatNodes = 0;
+    }
+
     bool _Remove(NodePtr removenode, std::vector< std::vector<NodePtr> >& vvCoverSetNodes, int currentlevel, dReal fLevelBound)
     {
         int enclevel = _EncodeLevel(currentlevel);
@@ -1068,6 +1221,13 @@ private:
     int _numnodes; ///< the number of nodes in the current tree starting at the root at _vsetLevelNodes.at(_EncodeLevel(_maxlevel))
     dReal _fMaxLevelBound; // pow(_base, _maxlevel)
 
+    // flat nearest neighbor index, see SetFlatNearestNeighborWeights
+    static const int s_nFlatBlockSize = 4; ///< number of nodes stored in one block of _vFlatConfigs
+    std::vector<dReal> _vFlatWeights2; ///< squared weights of the dofs. If empty, the flat index is not used.
+    std::vector<dReal> _vFlatConfigs; ///< configurations stored in blocks of s_nFlatBlockSize nodes. Inside a block, the values are ordered by dof so that each dof of the block is contiguous: _vFlatConfigs[(iblock*_dof+idof)*s_nFlatBlockSize+ilane]
+    std::vector<NodePtr> _vFlatNodes; ///< the node of every lane of _vFlatConfigs, padded with NULL to a multiple of s_nFlatBlockSize
+    int _numFlatNodes; ///< number of nodes in _vFlatNodes
+
     // cache
     vector<NodePtr> _vchildcache;
     set<NodePtr> _setchildcache;
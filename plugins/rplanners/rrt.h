@@ -18,6 +18,10 @@
 
 #include "rplanners.h"
 #include <boost/algorithm/string.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 static const dReal g_fEpsilonDotProduct = RavePow(g_fEpsilon,0.8);
 
@@ -36,6 +40,10 @@ Uses the Rapidly-Exploring Random Trees Algorithm.\n\
                         "returns the goal index of the plan");
         RegisterCommand("GetInitGoalIndices",boost::bind(&RrtPlanner<Node>::GetInitGoalIndicesCommand,this,_1,_2),
                         "returns the start and goal indices");
+        RegisterCommand("GetNearestNeighborType",boost::bind(&RrtPlanner<Node>::GetNearestNeighborTypeCommand,this,_1,_2),
+                        "returns 1 if the nearest neighbor queries of the forward tree scan the flat index, 0 if they traverse the cover tree");
+        RegisterCommand("FindNearestNode",boost::bind(&RrtPlanner<Node>::FindNearestNodeCommand,this,_1,_2),
+                        "returns the distance and the configuration of the node in the forward tree nearest to the configuration. if usecovertree is 1, then always traverses the cover tree. [usecovertree q0 q1 ...]");
         _filterreturn.reset(new ConstraintFilterReturn());
     }
     virtual ~RrtPlanner() {
@@ -69,6 +77,12 @@ Uses the Rapidly-Exploring Random Trees Algorithm.\n\
         _sampleConfig.resize(params->GetDOF());
         // TODO perhaps distmetricfn should take into number of revolutions of circular joints
         _treeForward.Init(shared_planner(), params->GetDOF(), params->_distmetricfn, params->_fStepLength, params->_distmetricfn(params->_vConfigLowerLimit, params->_vConfigUpperLimit));
+        _vFlatNearestNeighborWeights2.resize(0);
+        RRTParametersPtr rrtparams = boost::dynamic_pointer_cast<RRTParameters>(params);
+        if( !!rrtparams && rrtparams->_nNearestNeighborType == 1 ) {
+            _ComputeFlatNearestNeighborWeights(params->GetDOF(), _vFlatNearestNeighborWeights2);
+        }
+        _treeForward.SetFlatNearestNeighborWeights(_vFlatNearestNeighborWeights2);
         std::vector<dReal> vinitialconfig(params->GetDOF());
         for(size_t index = 0; index < params->vinitialconfig.size(); index += params->GetDOF()) {
             std::copy(params->vinitialconfig.begin()+index,params->vinitialconfig.begin()+index+params->GetDOF(),vinitialconfig.begin());
@@ -232,6 +246,29 @@ Uses the Rapidly-Exploring Random Trees Algorithm.\n\
         }
     }
 
+    /// \brief computes the squared dof weights for SpatialTree::SetFlatNearestNeighborWeights from the robot active dofs.
+    ///
+    /// vweights2 is left empty if the default distance metric of the active dofs is not a plain weighted euclidean distance.
+    void _ComputeFlatNearestNeighborWeights(int dof, std::vector<dReal>& vweights2)
+    {
+        vweights2.resize(0);
+        if( !_robot || _robot->GetActiveDOF() != dof || _robot->GetAffineDOF() != 0 ) {
+            RAVELOG_WARN_FORMAT("env=%s, flat nearest neighbor needs the planning configuration to be the active joint dofs, so using the cover tree", GetEnv()->GetNameId());
+            return;
+        }
+        FOREACHC(itdofindex, _robot->GetActiveDOFIndices()) {
+            KinBody::JointPtr pjoint = _robot->GetJointFromDOFIndex(*itdofindex);
+            if( pjoint->IsCircular(*itdofindex-pjoint->GetDOFIndex()) ) {
+                RAVELOG_WARN_FORMAT("env=%s, joint %s is circular, so using the cover tree for nearest neighbor", GetEnv()->GetNameId()%pjoint->GetName());
+                return;
+            }
+        }
+        _robot->GetActiveDOFWeights(vweights2);
+        FOREACH(itweight, vweights2) {
+            *itweight *= *itweight;
+        }
+    }
+
     bool GetGoalIndexCommand(std::ostream& os, std::istream& is)
     {
         os << _goalindex;
@@ -244,6 +281,35 @@ Uses the Rapidly-Exploring Random Trees Algorithm.\n\
         return !!os;
     }
 
+    bool GetNearestNeighborTypeCommand(std::ostream& os, std::istream& is)
+    {
+        os << (_treeForward.IsFlatNearestNeighbor() ? 1 : 0);
+        return !!os;
+    }
+
+    bool FindNearestNodeCommand(std::ostream& os, std::istream& is)
+    {
+        int usecovertree = 0;
+        is >> usecovertree;
+        std::vector<dReal> vquerystate(_treeForward.GetDOF());
+        FOREACH(itvalue, vquerystate) {
+            is >> *itvalue;
+        }
+        if( !is ) {
+            RAVELOG_WARN_FORMAT("env=%s, expected %d configuration values", GetEnv()->GetNameId()%_treeForward.GetDOF());
+            return false;
+        }
+        std::pair<NodeBasePtr, dReal> nn = usecovertree ? _treeForward.FindNearestCoverTreeNode(vquerystate) : _treeForward.FindNearestNode(vquerystate);
+        if( !nn.first ) {
+            return false;
+        }
+        os << std::setprecision(std::numeric_limits<dReal>::digits10+1) << nn.second;
+        FOREACHC(itvalue, _treeForward.GetVectorConfig(nn.first)) {
+            os << " " << *itvalue;
+        }
+        return !!os;
+    }
+
 protected:
     RobotBasePtr _robot;
     std::vector<dReal> _sampleConfig;
@@ -254,6 +320,7 @@ protected:
 
     SpatialTree< Node > _treeForward;
     std::vector< NodeBase* > _vecInitialNodes;
+    std::vector<dReal> _vFlatNearestNeighborWeights2; ///< squared dof weights passed to SpatialTree::SetFlatNearestNeighborWeights. empty if the trees use the cover tree for nearest neighbor
 
     inline boost::shared_ptr<RrtPlanner> shared_planner() {
         return boost::static_pointer_cast<RrtPlanner>(shared_from_this());
@@ -310,6 +377,7 @@ Some python code to display data::\n\
 
         // TODO perhaps distmetricfn should take into number of revolutions of circular joints
         _treeBackward.Init(shared_planner(), _parameters->GetDOF(), _parameters->_distmetricfn, _parameters->_fStepLength, _parameters->_distmetricfn(_parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit));
+        _treeBackward.SetFlatNearestNeighborWeights(_vFlatNearestNeighborWeights2);
 
         //read in all goals
         if( (_parameters->vgoalconfig.size() % _parameters->GetDOF()) != 0 ) {
@@ -677,6 +745,250 @@ protected:
     std::vector<GOALPATH> _vgoalpaths;
 };
 
+/// \brief runs several BiRRT searches in parallel, each in its own clone of the environment.
+///
+/// The searches only differ by their random seed. The first search that returns a solution interrupts the others, which mostly cuts down the long tail of the planning times. The cloned environments are kept between InitPlan calls and only re-synchronized with the source environment.
+class ParallelBirrtPlanner : public PlannerBase
+{
+    /// \brief one bidirectional search and its cloned environment
+    struct SearchWorker
+    {
+        EnvironmentBasePtr penv;
+        RobotBasePtr probot;
+        PlannerBasePtr planner;
+        UserDataPtr callbackhandle; ///< handle of the cancel callback registered in planner
+        TrajectoryBasePtr ptraj;
+        PlannerStatus status;
+    };
+    typedef boost::shared_ptr<SearchWorker> SearchWorkerPtr;
+
+public:
+    ParallelBirrtPlanner(EnvironmentBasePtr penv) : PlannerBase(penv), _nNumSearches(0), _nWinningSearch(-1), _nFinishedSearches(0), _bCancelSearches(false)
+    {
+        __description = "\
+:Interface Author:  Rosen Diankov\n\n\
+Runs several bi-directional RRTs in parallel, each inside a cloned environment with a different random seed. The first search to return a path interrupts the others. Only supports robot active DOFs as the configuration space since the searches re-create their parameters on the cloned robot.\n\
+";
+        RegisterCommand("SetNumSearches", boost::bind(&ParallelBirrtPlanner::_SetNumSearchesCommand,this,_1,_2),
+                        "sets the number of parallel searches used starting from the next InitPlan. If 0 (default), uses the number of hardware threads.");
+    }
+    virtual ~ParallelBirrtPlanner() {
+        _DestroySearches(0);
+    }
+
+    virtual bool InitPlan(RobotBasePtr pbase, PlannerParametersConstPtr pparams) override
+    {
+        EnvironmentLock lock(GetEnv()->GetMutex());
+        _parameters.reset();
+        _robot.reset();
+        if( !pbase ) {
+            RAVELOG_WARN_FORMAT("env=%s, ParallelBirrtPlanner needs a robot to plan for", GetEnv()->GetNameId());
+            return false;
+        }
+
+        RRTParametersPtr parameters(new RRTParameters());
+        parameters->copy(pparams);
+        if( parameters->_configurationspecification != pbase->GetActiveConfigurationSpecification() ) {
+            RAVELOG_WARN_FORMAT("env=%s, ParallelBirrtPlanner only supports the active dofs of robot %s as the configuration space", GetEnv()->GetNameId()%pbase->GetName());
+            return false;
+        }
+
+        int numsearches = _nNumSearches;
+        if( numsearches <= 0 ) {
+            numsearches = max(1, (int)std::thread::hardware_concurrency());
+        }
+        _DestroySearches(numsearches);
+
+        // user functions cannot be transferred to the cloned environments, so only pass the serialized parameters
+        std::stringstream ssparams;
+        ssparams << std::setprecision(std::numeric_limits<dReal>::digits10+1);
+        ssparams << *parameters;
+        const std::string sparams = ssparams.str();
+
+        _vsearches.resize(numsearches);
+        for(int isearch = 0; isearch < numsearches; ++isearch) {
+            SearchWorkerPtr& search = _vsearches[isearch];
+            if( !search ) {
+                search.reset(new SearchWorker());
+            }
+            const std::string clonedenvname = str(boost::format("%s_parallelbirrt%d")%GetEnv()->GetName()%isearch);
+            if( !search->penv ) {
+                search->penv = GetEnv()->CloneSelf(clonedenvname, Clone_Bodies|Clone_ShareGeometries);
+            }
+            else {
+                // re-uses the bodies that did not change since the previous InitPlan
+                search->penv->Clone(GetEnv(), clonedenvname, Clone_Bodies|Clone_ShareGeometries);
+            }
+
+            EnvironmentLock clonedlock(search->penv->GetMutex());
+            search->probot = search->penv->GetRobot(pbase->GetName());
+            if( !search->probot ) {
+                RAVELOG_WARN_FORMAT("env=%s, failed to find robot %s in cloned environment %s", GetEnv()->GetNameId()%pbase->GetName()%search->penv->GetNameId());
+                return false;
+            }
+            search->probot->SetActiveDOFs(pbase->GetActiveDOFIndices(), pbase->GetAffineDOF(), pbase->GetAffineRotationAxis());
+
+            RRTParametersPtr searchparameters(new RRTParameters());
+            searchparameters->SetRobotActiveJoints(search->probot);
+            std::stringstream ssin(sparams);
+            ssin >> *searchparameters;
+            // each search has to sample a different sequence
+            searchparameters->_nRandomGeneratorSeed = parameters->_nRandomGeneratorSeed + 0x9e3779b9*(uint32_t)isearch;
+
+            if( !search->planner ) {
+                search->planner = RaveCreatePlanner(search->penv, "BiRRT");
+                search->callbackhandle = search->planner->RegisterPlanCallback(boost::bind(&ParallelBirrtPlanner::_SearchCallback,this,_1));
+            }
+            if( !search->planner->InitPlan(search->probot, searchparameters) ) {
+                RAVELOG_WARN_FORMAT("env=%s, failed to init search %d", GetEnv()->GetNameId()%isearch);
+                return false;
+            }
+        }
+
+        _robot = pbase;
+        _parameters = parameters;
+        RAVELOG_DEBUG_FORMAT("env=%s, ParallelBiRRT Planner Initialized with %d searches", GetEnv()->GetNameId()%numsearches);
+        return true;
+    }
+
+    virtual PlannerStatus PlanPath(TrajectoryBasePtr ptraj, int planningoptions) override
+    {
+        if(!_parameters) {
+            return OPENRAVE_PLANNER_STATUS(str(boost::format("env=%s, ParallelBirrtPlanner::PlanPath - Error, planner not initialized")%GetEnv()->GetNameId()), PS_Failed);
+        }
+
+        uint64_t basetimeus = utils::GetMonotonicTime();
+        _nWinningSearch = -1;
+        _nFinishedSearches = 0;
+        _bCancelSearches = false;
+
+        std::vector<boost::shared_ptr<std::thread> > vthreads(_vsearches.size());
+        for(size_t isearch = 0; isearch < _vsearches.size(); ++isearch) {
+            _vsearches[isearch]->ptraj = RaveCreateTrajectory(_vsearches[isearch]->penv, ptraj->GetXMLId());
+            _vsearches[isearch]->status = PlannerStatus();
+            vthreads[isearch] = boost::make_shared<std::thread>(std::bind(&ParallelBirrtPlanner::_SearchThread, this, isearch, planningoptions));
+        }
+
+        // poll the user callbacks while waiting for the first search to finish
+        bool bInterrupted = false;
+        PlannerProgress progress;
+        {
+            std::unique_lock<std::mutex> lock(_mutexSearches);
+            while( _nWinningSearch < 0 && _nFinishedSearches < (int)_vsearches.size() ) {
+                _condSearchFinished.wait_for(lock, std::chrono::milliseconds(10));
+                if( _nWinningSearch >= 0 ) {
+                    break;
+                }
+                lock.unlock();
+                PlannerAction callbackaction = _CallCallbacks(progress);
+                lock.lock();
+                if( callbackaction == PA_Interrupt ) {
+                    bInterrupted = true;
+                    break;
+                }
+            }
+            _bCancelSearches = true;
+        }
+
+        FOREACH(itthread, vthreads) {
+            (*itthread)->join();
+        }
+
+        if( bInterrupted ) {
+            return OPENRAVE_PLANNER_STATUS(str(boost::format("env=%s, Planning was interrupted")%GetEnv()->GetNameId()), PS_Interrupted);
+        }
+
+        uint64_t elapsedtimeus = utils::GetMonotonicTime()-basetimeus;
+        if( _nWinningSearch < 0 ) {
+            std::string description = str(boost::format(_("env=%s, plan failed in all %d searches in %u[us]"))%GetEnv()->GetNameId()%_vsearches.size()%elapsedtimeus);
+            RAVELOG_WARN(description);
+            return OPENRAVE_PLANNER_STATUS(description, PS_Failed);
+        }
+
+        const SearchWorker& winner = *_vsearches.at(_nWinningSearch);
+        const ConfigurationSpecification& spec = winner.ptraj->GetConfigurationSpecification();
+        if( ptraj->GetConfigurationSpecification().GetDOF() == 0 ) {
+            ptraj->Init(spec);
+        }
+        std::vector<dReal> vdata;
+        winner.ptraj->GetWaypoints(0, winner.ptraj->GetNumWaypoints(), vdata);
+        ptraj->Insert(ptraj->GetNumWaypoints(), vdata, spec);
+
+        std::string description = str(boost::format(_("env=%s, plan success with search %d/%d, path=%d points, computation time=%u[us]"))%GetEnv()->GetNameId()%_nWinningSearch%_vsearches.size()%ptraj->GetNumWaypoints()%elapsedtimeus);
+        RAVELOG_DEBUG(description);
+        return OPENRAVE_PLANNER_STATUS(description, winner.status.GetStatusCode());
+    }
+
+    virtual PlannerParametersConstPtr GetParameters() const override {
+        return _parameters;
+    }
+
+protected:
+    void _SearchThread(size_t isearch, int planningoptions)
+    {
+        SearchWorker& search = *_vsearches.at(isearch);
+        PlannerStatus status;
+        try {
+            status = search.planner->PlanPath(search.ptraj, planningoptions);
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN_FORMAT("env=%s, search %d failed: %s", GetEnv()->GetNameId()%isearch%ex.what());
+            status = PlannerStatus(ex.what(), PS_Failed);
+        }
+
+        std::lock_guard<std::mutex> lock(_mutexSearches);
+        search.status = status;
+        if( status.HasSolution() && _nWinningSearch < 0 ) {
+            _nWinningSearch = isearch;
+            _bCancelSearches = true;
+        }
+        ++_nFinishedSearches;
+        _condSearchFinished.notify_all();
+    }
+
+    /// \brief registered in all the searches, interrupts them as soon as one has a solution
+    PlannerAction _SearchCallback(const PlannerProgress& progress)
+    {
+        return _bCancelSearches ? PA_Interrupt : PA_None;
+    }
+
+    /// \brief destroys the cloned environments of all searches with index >= numkeep
+    void _DestroySearches(size_t numkeep)
+    {
+        for(size_t isearch = numkeep; isearch < _vsearches.size(); ++isearch) {
+            if( !!_vsearches[isearch] ) {
+                _vsearches[isearch]->callbackhandle.reset();
+                _vsearches[isearch]->planner.reset();
+                _vsearches[isearch]->ptraj.reset();
+                _vsearches[isearch]->probot.reset();
+                if( !!_vsearches[isearch]->penv ) {
+                    _vsearches[isearch]->penv->Destroy();
+                }
+            }
+        }
+        if( _vsearches.size() > numkeep ) {
+            _vsearches.resize(numkeep);
+        }
+    }
+
+    bool _SetNumSearchesCommand(std::ostream& sout, std::istream& sinput)
+    {
+        sinput >> _nNumSearches;
+        return !!sinput;
+    }
+
+    RobotBasePtr _robot;
+    RRTParametersPtr _parameters;
+    int _nNumSearches; ///< number of parallel searches, if <= 0 then use the hardware threads
+
+    std::vector<SearchWorkerPtr> _vsearches;
+    std::mutex _mutexSearches; ///< protects _nWinningSearch and _nFinishedSearches
+    std::condition_variable _condSearchFinished;
+    int _nWinningSearch; ///< index of the first search that returned a solution, -1 if none
+    int _nFinishedSearches;
+    std::atomic<bool> _bCancelSearches; ///< if true, the searches are interrupted at their next iteration
+};
+
 class BasicRrtPlanner : public RrtPlanner<SimpleNode>
 {
 public:
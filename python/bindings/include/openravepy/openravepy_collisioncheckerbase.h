@@ -84,6 +84,10 @@ public:
 
     object CheckCollisionRays(object rays, PyKinBodyPtr pbody,bool bFrontFacingOnly=false, object oCheckPreemptFn=py::none_());
 
+    object CheckCollisionBatch(PyKinBodyPtr pbody, object oconfigs, object odofindices, int checkflags);
+    object CheckContinuousCollision(PyKinBodyPtr pbody, object oq0, object oq1, object odofindices, int checkflags);
+    object CheckCollisionRaysBatch(object rays, PyKinBodyPtr pbody);
+
     bool CheckCollision(OPENRAVE_SHARED_PTR<PyRay> pyray);
 
     bool CheckCollision(OPENRAVE_SHARED_PTR<PyRay> pyray, PyCollisionReportPtr pReport);
@@ -97,6 +101,8 @@ public:
     bool CheckCollisionOBB(object oaabb, object otransform, object bodiesincluded, PyCollisionReportPtr pReport);
 
     virtual bool CheckSelfCollision(object o1, PyCollisionReportPtr pReport);
+
+    dReal ComputeStaticClearance(PyKinBodyPtr pbody);
 };
 
 } // namespace openravepy
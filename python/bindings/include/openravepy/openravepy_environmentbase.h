@@ -135,6 +135,10 @@ public:
 
     object WriteToMemory(const std::string &filetype, const int options = EnvironmentBase::SelectionOptions::SO_Everything, object odictatts = py::none_());
 
+    /// \brief returns the delta as bytes
+    object ExtractDelta(OPENRAVE_SHARED_PTR<EnvironmentBase::DeltaStamp> pstamp);
+    bool ApplyDelta(const std::string& delta);
+
     /// will be unlocking GIL since doing FS or memory-intensive operations
     //@{
     object ReadRobotURI(const std::string &filename);
@@ -200,6 +204,8 @@ public:
     void StopSimulation(int shutdownthread=1);
     uint64_t GetSimulationTime();
     bool IsSimulationRunning();
+    void SetSimulationSensorThreads(int numthreads);
+    int GetSimulationSensorThreads();
 
     void Lock();
 
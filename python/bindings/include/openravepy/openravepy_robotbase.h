@@ -133,6 +133,8 @@ public:
 
         object FindIKSolutions(object oparam, object freeparams, int filteroptions, bool ikreturn=false, bool releasegil=false) const;
 
+        object FindIKSolutionBatch(object oparams, int filteroptions, int numthreads=1, bool ikreturn=false, bool releasegil=false) const;
+
         object GetIkParameterization(object oparam, bool inworld=true);
 
         object GetChildJoints();
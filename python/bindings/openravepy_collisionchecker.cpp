@@ -615,6 +615,81 @@ object PyCollisionCheckerBase::CheckCollisionRays(object rays, PyKinBodyPtr pbod
 #endif // USE_PYBIND11_PYTHON_BINDINGS
 }
 
+object PyCollisionCheckerBase::CheckCollisionBatch(PyKinBodyPtr pbody, object oconfigs, object odofindices, int checkflags)
+{
+    KinBodyConstPtr pkinbody = openravepy::GetKinBody(pbody);
+    if( !pkinbody ) {
+        throw OPENRAVE_EXCEPTION_FORMAT0(_("invalid body to CheckCollisionBatch"), ORE_InvalidArguments);
+    }
+    const std::vector<int> vdofindices = IS_PYTHONOBJECT_NONE(odofindices) ? std::vector<int>() : ExtractArray<int>(odofindices);
+    const std::vector<dReal> vconfigs = ExtractArray<dReal>(oconfigs.attr("flat"));
+    const size_t numdofs = vdofindices.size() > 0 ? vdofindices.size() : (size_t)pkinbody->GetDOF();
+    if( numdofs == 0 || vconfigs.size() % numdofs != 0 ) {
+        throw OPENRAVE_EXCEPTION_FORMAT(_("configs needs to be a Nx%d array"), numdofs, ORE_InvalidArguments);
+    }
+    std::vector<uint8_t> vresults;
+    {
+        openravepy::PythonThreadSaver threadsaver;
+        _pCollisionChecker->CheckCollisionBatch(pkinbody, vconfigs.data(), vconfigs.size()/numdofs, vdofindices, vresults, checkflags);
+    }
+    return toPyArray(std::vector<int>(vresults.begin(), vresults.end()));
+}
+
+object PyCollisionCheckerBase::CheckContinuousCollision(PyKinBodyPtr pbody, object oq0, object oq1, object odofindices, int checkflags)
+{
+    KinBodyConstPtr pkinbody = openravepy::GetKinBody(pbody);
+    if( !pkinbody ) {
+        throw OPENRAVE_EXCEPTION_FORMAT0(_("invalid body to CheckContinuousCollision"), ORE_InvalidArguments);
+    }
+    const std::vector<int> vdofindices = IS_PYTHONOBJECT_NONE(odofindices) ? std::vector<int>() : ExtractArray<int>(odofindices);
+    const std::vector<dReal> vq0 = ExtractArray<dReal>(oq0), vq1 = ExtractArray<dReal>(oq1);
+    const size_t numdofs = vdofindices.size() > 0 ? vdofindices.size() : (size_t)pkinbody->GetDOF();
+    if( vq0.size() != numdofs || vq1.size() != numdofs ) {
+        throw OPENRAVE_EXCEPTION_FORMAT(_("q0 and q1 need to have %d values"), numdofs, ORE_InvalidArguments);
+    }
+    bool bCollision = false;
+    dReal fContactTime = -1;
+    {
+        openravepy::PythonThreadSaver threadsaver;
+        bCollision = _pCollisionChecker->CheckContinuousCollision(pkinbody, vq0, vq1, vdofindices, checkflags, &fContactTime);
+    }
+    return py::make_tuple(bCollision, bCollision ? fContactTime : dReal(-1));
+}
+
+object PyCollisionCheckerBase::CheckCollisionRaysBatch(object rays, PyKinBodyPtr pbody)
+{
+    const std::vector<dReal> vraysvalues = ExtractArray<dReal>(rays.attr("flat"));
+    if( vraysvalues.size() % 6 != 0 ) {
+        throw openrave_exception(_("rays object needs to be a Nx6 vector\n"));
+    }
+    std::vector<RAY> vrays(vraysvalues.size()/6);
+    for(size_t iray = 0; iray < vrays.size(); ++iray) {
+        vrays[iray].pos = Vector(vraysvalues[6*iray], vraysvalues[6*iray+1], vraysvalues[6*iray+2]);
+        vrays[iray].dir = Vector(vraysvalues[6*iray+3], vraysvalues[6*iray+4], vraysvalues[6*iray+5]);
+    }
+    std::vector<RayCollisionResult> vresults;
+    {
+        openravepy::PythonThreadSaver threadsaver;
+        _pCollisionChecker->CheckCollisionRays(vrays, !pbody ? KinBodyConstPtr() : KinBodyConstPtr(openravepy::GetKinBody(pbody)), vresults);
+    }
+    std::vector<int> vhits(vrays.size(), 0);
+    std::vector<dReal> vhitposnorms(6*vrays.size(), 0), vdistances(vrays.size(), 0);
+    for(size_t iray = 0; iray < vresults.size(); ++iray) {
+        const RayCollisionResult& result = vresults[iray];
+        if( !result.plink ) {
+            continue;
+        }
+        vhits[iray] = 1;
+        for(int j = 0; j < 3; ++j) {
+            vhitposnorms[6*iray+j] = result.pos[j];
+            vhitposnorms[6*iray+3+j] = result.norm[j];
+        }
+        vdistances[iray] = result.fDistance;
+    }
+    std::vector<npy_intp> dims = { (npy_intp)vrays.size(), 6 };
+    return py::make_tuple(toPyArray(vhits), toPyArray(vhitposnorms, dims), toPyArray(vdistances));
+}
+
 bool PyCollisionCheckerBase::CheckCollision(OPENRAVE_SHARED_PTR<PyRay> pyray)
 {
     return _pCollisionChecker->CheckCollision(pyray->r);
@@ -696,6 +771,11 @@ bool PyCollisionCheckerBase::CheckSelfCollision(object o1, PyCollisionReportPtr
     return bCollision;
 }
 
+dReal PyCollisionCheckerBase::ComputeStaticClearance(PyKinBodyPtr pbody)
+{
+    return _pCollisionChecker->ComputeStaticClearance(KinBodyConstPtr(openravepy::GetKinBody(pbody)));
+}
+
 CollisionCheckerBasePtr GetCollisionChecker(PyCollisionCheckerBasePtr pyCollisionChecker)
 {
     return !pyCollisionChecker ? CollisionCheckerBasePtr() : pyCollisionChecker->GetCollisionChecker();
@@ -798,6 +878,17 @@ void init_openravepy_collisionchecker()
     .export_values()
 #endif
     ;
+#ifdef USE_PYBIND11_PYTHON_BINDINGS
+    enum_<CollisionBatchFlags>(m, "CollisionBatchFlags", py::arithmetic() DOXY_ENUM(CollisionBatchFlags))
+#else
+    enum_<CollisionBatchFlags>("CollisionBatchFlags" DOXY_ENUM(CollisionBatchFlags))
+#endif
+    .value("Env",CBF_Env)
+    .value("Self",CBF_Self)
+#ifdef USE_PYBIND11_PYTHON_BINDINGS
+    .export_values()
+#endif
+    ;
 
 #ifdef USE_PYBIND11_PYTHON_BINDINGS
     // should this be inside CollisionReport, instead of module "m"?
@@ -904,6 +995,10 @@ void init_openravepy_collisionchecker()
     .def("CheckCollisionOBB", pcolobb, PY_ARGS("aabb", "pose", "report") DOXY_FN(CollisionCheckerBase,CheckCollision "const AABB; const Transform; CollisionReport"))
     .def("CheckCollisionOBB", pcolobbi, PY_ARGS("aabb", "pose", "bodiesincluded", "report") DOXY_FN(CollisionCheckerBase,CheckCollision "const AABB; const Transform; const std::vector; CollisionReport"))
     .def("CheckSelfCollision",&PyCollisionCheckerBase::CheckSelfCollision, PY_ARGS("linkbody", "report") DOXY_FN(CollisionCheckerBase,CheckSelfCollision "KinBodyConstPtr, CollisionReportPtr"))
+    .def("ComputeStaticClearance",&PyCollisionCheckerBase::ComputeStaticClearance, PY_ARGS("body") DOXY_FN(CollisionCheckerBase,ComputeStaticClearance))
+    .def("CheckCollisionBatch",&PyCollisionCheckerBase::CheckCollisionBatch, PY_ARGS("body","configs","dofindices","checkflags") "Checks many configurations of the body with a single call of CollisionCheckerBase::CheckCollisionBatch. configs is a NxM array ordered by dofindices, or by all the dofs of the body if dofindices is None. checkflags is a bitmask of CollisionBatchFlags. Returns a N array of the CollisionBatchFlags that are in collision for each configuration.")
+    .def("CheckContinuousCollision",&PyCollisionCheckerBase::CheckContinuousCollision, PY_ARGS("body","q0","q1","dofindices","checkflags") "Checks the straight segment from q0 to q1 with CollisionCheckerBase::CheckContinuousCollision. q0 and q1 are ordered by dofindices, or by all the dofs of the body if dofindices is None. checkflags is a bitmask of CollisionBatchFlags. Returns (collision, contacttime) where contacttime is the first time in [0,1] found in collision, or -1 if the segment is free.")
+    .def("CheckCollisionRaysBatch",&PyCollisionCheckerBase::CheckCollisionRaysBatch, PY_ARGS("rays","body") "Casts all the rays with a single call of CollisionCheckerBase::CheckCollisionRays. Rays is a Nx6 array, first 3 columns are position, last 3 are direction*range. body can be None to check against the environment. The return value is: (N array of hit flags, Nx6 array of hit positions and surface normals, N array of hit distances).")
 #ifdef USE_PYBIND11_PYTHON_BINDINGS
     .def("CheckCollisionRays", &PyCollisionCheckerBase::CheckCollisionRays,
          "rays"_a,
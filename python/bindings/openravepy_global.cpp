@@ -1503,6 +1503,7 @@ void init_openravepy_global()
     .value("Modules",Clone_Modules)
     .value("PassOnMissingBodyReferences",Clone_PassOnMissingBodyReferences)
     .value("IgnoreGrabbedBodies",Clone_IgnoreGrabbedBodies)
+    .value("ShareGeometries",Clone_ShareGeometries)
 #ifdef USE_PYBIND11_PYTHON_BINDINGS
     // Cannot export because openravepy_viewer already has "Viewer"
     // .export_values()
@@ -1576,6 +1577,7 @@ void init_openravepy_global()
     .value("FromPathSampling", CFO_FromPathSampling)
     .value("FromPathShortcutting", CFO_FromPathShortcutting)
     .value("FromTrajectorySmoother", CFO_FromTrajectorySmoother)
+    .value("CheckInBisectionOrder", CFO_CheckInBisectionOrder)
     .value("FinalValuesNotReached", CFO_FinalValuesNotReached)
     .value("StateSettingError", CFO_StateSettingError)
     .value("RecommendedOptions", CFO_RecommendedOptions)
@@ -1830,6 +1830,32 @@ object PyEnvironmentBase::WriteToMemory(const std::string &filetype, const int o
     }
 }
 
+object PyEnvironmentBase::ExtractDelta(OPENRAVE_SHARED_PTR<EnvironmentBase::DeltaStamp> pstamp)
+{
+    std::stringstream ssdelta(std::ios::in|std::ios::out|std::ios::binary);
+    {
+        openravepy::PythonThreadSaver threadsaver;
+        _penv->ExtractDelta(ssdelta, *pstamp);
+    }
+    const std::string delta = ssdelta.str();
+#ifdef USE_PYBIND11_PYTHON_BINDINGS
+#if PY_MAJOR_VERSION >= 3
+    return py::cast<py::object>(PyBytes_FromStringAndSize(delta.data(), delta.size()));
+#else
+    return py::cast<py::object>(PyString_FromStringAndSize(delta.data(), delta.size()));
+#endif
+#else
+    return py::to_object(py::handle<>(PyString_FromStringAndSize(delta.data(), delta.size())));
+#endif
+}
+
+bool PyEnvironmentBase::ApplyDelta(const std::string& delta)
+{
+    std::stringstream ssdelta(delta, std::ios::in|std::ios::binary);
+    openravepy::PythonThreadSaver threadsaver;
+    return _penv->ApplyDelta(ssdelta);
+}
+
 object PyEnvironmentBase::ReadRobotURI(const string &filename)
 {
     RobotBasePtr probot;
@@ -2187,6 +2213,12 @@ uint64_t PyEnvironmentBase::GetSimulationTime() {
 bool PyEnvironmentBase::IsSimulationRunning() {
     return _penv->IsSimulationRunning();
 }
+void PyEnvironmentBase::SetSimulationSensorThreads(int numthreads) {
+    _penv->SetSimulationSensorThreads(numthreads);
+}
+int PyEnvironmentBase::GetSimulationSensorThreads() {
+    return _penv->GetSimulationSensorThreads();
+}
 
 void PyEnvironmentBase::Lock()
 {
@@ -3399,6 +3431,15 @@ Because race conditions can pop up when trying to lock the openrave environment
 #endif
     ;
 
+#ifdef USE_PYBIND11_PYTHON_BINDINGS
+    class_<EnvironmentBase::DeltaStamp, OPENRAVE_SHARED_PTR<EnvironmentBase::DeltaStamp> >(m, "DeltaStamp", DOXY_CLASS(EnvironmentBase::DeltaStamp))
+    .def(init<>())
+#else
+    class_<EnvironmentBase::DeltaStamp, OPENRAVE_SHARED_PTR<EnvironmentBase::DeltaStamp> >("DeltaStamp", DOXY_CLASS(EnvironmentBase::DeltaStamp))
+#endif
+    .def("Reset",&EnvironmentBase::DeltaStamp::Reset, DOXY_FN(EnvironmentBase::DeltaStamp,Reset))
+    ;
+
     {
         void (PyEnvironmentBase::*pclone)(PyEnvironmentBasePtr, int) = &PyEnvironmentBase::Clone;
         void (PyEnvironmentBase::*pclonename)(PyEnvironmentBasePtr, const std::string&, int) = &PyEnvironmentBase::Clone;
@@ -3549,6 +3590,8 @@ Because race conditions can pop up when trying to lock the openrave environment
 #else
                      .def("WriteToMemory",&PyEnvironmentBase::WriteToMemory,WriteToMemory_overloads(PY_ARGS("filetype","options","atts") DOXY_FN(EnvironmentBase,WriteToMemory)))
 #endif
+                     .def("ExtractDelta",&PyEnvironmentBase::ExtractDelta, PY_ARGS("stamp") DOXY_FN(EnvironmentBase,ExtractDelta))
+                     .def("ApplyDelta",&PyEnvironmentBase::ApplyDelta, PY_ARGS("delta") DOXY_FN(EnvironmentBase,ApplyDelta))
                      .def("ReadRobotURI",readrobotxmlfile1, PY_ARGS("filename") DOXY_FN(EnvironmentBase,ReadRobotURI "const std::string"))
                      .def("ReadRobotXMLFile",readrobotxmlfile1, PY_ARGS("filename") DOXY_FN(EnvironmentBase,ReadRobotURI "const std::string"))
                      .def("ReadRobotURI",readrobotxmlfile2, PY_ARGS("filename","atts") DOXY_FN(EnvironmentBase,ReadRobotURI "RobotBasePtr; const std::string; const AttributesList"))
@@ -3653,6 +3696,8 @@ Because race conditions can pop up when trying to lock the openrave environment
 #endif
                      .def("GetSimulationTime",&PyEnvironmentBase::GetSimulationTime, DOXY_FN(EnvironmentBase,GetSimulationTime))
                      .def("IsSimulationRunning",&PyEnvironmentBase::IsSimulationRunning, DOXY_FN(EnvironmentBase,IsSimulationRunning))
+                     .def("SetSimulationSensorThreads",&PyEnvironmentBase::SetSimulationSensorThreads, PY_ARGS("numthreads") DOXY_FN(EnvironmentBase,SetSimulationSensorThreads))
+                     .def("GetSimulationSensorThreads",&PyEnvironmentBase::GetSimulationSensorThreads, DOXY_FN(EnvironmentBase,GetSimulationSensorThreads))
                      .def("Lock",Lock1,"Locks the environment mutex.")
                      .def("Lock",Lock2,PY_ARGS("timeout") "Locks the environment mutex with a timeout.")
                      .def("Unlock",&PyEnvironmentBase::Unlock,"Unlocks the environment mutex.")
@@ -3935,6 +3935,12 @@ object PyKinBody::GetDOFDynamicAccelerationJerkLimits(py::object oDOFPositions,
     return py::make_tuple(py::none_(), py::none_());
 }
 
+bool PyKinBody::SetUnrolledKinematicsGenerator(bool enable)
+{
+    _pbody->SetKinematicsGenerator(enable ? OpenRAVE::GetUnrolledKinematicsGenerator() : KinematicsGeneratorPtr());
+    return !!_pbody->GetKinematicsFunctions();
+}
+
 void PyKinBody::SetSelfCollisionChecker(PyCollisionCheckerBasePtr pycollisionchecker)
 {
     _pbody->SetSelfCollisionChecker(openravepy::GetCollisionChecker(pycollisionchecker));
@@ -5955,6 +5961,7 @@ void init_openravepy_kinbody()
                          .def("ComputeInverseDynamics",&PyKinBody::ComputeInverseDynamics, ComputeInverseDynamics_overloads(PY_ARGS("dofaccelerations","externalforcetorque","returncomponents") sComputeInverseDynamicsDoc.c_str()))
 #endif
                          .def("GetDOFDynamicAccelerationJerkLimits",&PyKinBody::GetDOFDynamicAccelerationJerkLimits, PY_ARGS("dofPositions","dofVelocities") DOXY_FN(KinBody,ComputeDynamicLimits))
+                         .def("SetUnrolledKinematicsGenerator",&PyKinBody::SetUnrolledKinematicsGenerator,PY_ARGS("enable") "Sets the built-in unrolled forward kinematics generator with KinBody::SetKinematicsGenerator if enable is true, removes the generator otherwise. Returns true if the body uses generated kinematics functions.")
                          .def("SetSelfCollisionChecker",&PyKinBody::SetSelfCollisionChecker,PY_ARGS("collisionchecker") DOXY_FN(KinBody,SetSelfCollisionChecker))
                          .def("GetSelfCollisionChecker", &PyKinBody::GetSelfCollisionChecker, /*PY_ARGS("collisionchecker")*/ DOXY_FN(KinBody,GetSelfCollisionChecker))
 #ifdef USE_PYBIND11_PYTHON_BINDINGS
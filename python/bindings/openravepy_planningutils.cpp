@@ -314,6 +314,30 @@ public:
         _pconstraints->SetTorqueLimitMode(static_cast<DynamicsConstraintsType>(torquelimitmode));
     }
 
+    void SetUserCheckFunction(object fncallback, bool bCallAfterCheckCollision=false) {
+        if( IS_PYTHONOBJECT_NONE(fncallback) ) {
+            _pconstraints->SetUserCheckFunction(boost::function<bool()>(), bCallAfterCheckCollision);
+        }
+        else {
+            _pconstraints->SetUserCheckFunction(boost::bind(&PyDynamicsCollisionConstraint::_UserCheckCallback, fncallback), bCallAfterCheckCollision);
+        }
+    }
+
+    static bool _UserCheckCallback(object fncallback)
+    {
+        bool bvalid = false;
+        PyGILState_STATE gstate = PyGILState_Ensure();
+        try {
+            bvalid = py::extract<bool>(fncallback());
+        }
+        catch(...) {
+            RAVELOG_ERROR("exception occured in _UserCheckCallback:\n");
+            PyErr_Print();
+        }
+        PyGILState_Release(gstate);
+        return bvalid;
+    }
+
 
     PyEnvironmentBasePtr _pyenv;
     OpenRAVE::planningutils::DynamicsCollisionConstraintPtr _pconstraints;
@@ -529,6 +553,7 @@ BOOST_PYTHON_FUNCTION_OVERLOADS(VerifyTrajectory_overloads, planningutils::pyVer
 
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(Check_overloads, Check, 5, 8)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckWithAccelerations_overloads, CheckWithAccelerations, 7, 10)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetUserCheckFunction_overloads, SetUserCheckFunction, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PlanPath_overloads, PlanPath, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PlanPath_overloads2, PlanPath, 3, 5)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PlanPath_overloads3, PlanPath, 1, 3)
@@ -980,6 +1005,15 @@ void InitPlanningUtils()
         .def("SetFilterMask", &planningutils::PyDynamicsCollisionConstraint::SetFilterMask, PY_ARGS("filtermask") DOXY_FN(planningutils::DynamicsCollisionConstraint,SetFilterMask))
         .def("SetPerturbation", &planningutils::PyDynamicsCollisionConstraint::SetPerturbation, PY_ARGS("parameters") DOXY_FN(planningutils::DynamicsCollisionConstraint,SetPerturbation))
         .def("SetTorqueLimitMode", &planningutils::PyDynamicsCollisionConstraint::SetTorqueLimitMode, PY_ARGS("torquelimitmode") DOXY_FN(planningutils::DynamicsCollisionConstraint,SetTorqueLimitMode))
+#ifdef USE_PYBIND11_PYTHON_BINDINGS
+        .def("SetUserCheckFunction", &planningutils::PyDynamicsCollisionConstraint::SetUserCheckFunction,
+             "usercheckfn"_a,
+             "callaftercheckcollision"_a = false,
+             DOXY_FN(planningutils::DynamicsCollisionConstraint,SetUserCheckFunction)
+             )
+#else
+        .def("SetUserCheckFunction", &planningutils::PyDynamicsCollisionConstraint::SetUserCheckFunction, SetUserCheckFunction_overloads(PY_ARGS("usercheckfn", "callaftercheckcollision") DOXY_FN(planningutils::DynamicsCollisionConstraint,SetUserCheckFunction)))
+#endif
         ;
     }
 }
@@ -995,6 +995,41 @@ object PyRobotBase::PyManipulator::FindIKSolution(object oparam, object freepara
     }
 }
 
+object PyRobotBase::PyManipulator::FindIKSolutionBatch(object oparams, int filteroptions, int numthreads, bool ikreturn, bool releasegil) const
+{
+    std::vector<IkParameterization> vikparams(len(oparams));
+    for(size_t iparam = 0; iparam < vikparams.size(); ++iparam) {
+        object oparam = oparams[py::to_object(iparam)];
+        if( !ExtractIkParameterization(oparam,vikparams[iparam]) ) {
+            // assume transformation matrix
+            vikparams[iparam].SetTransform6D(ExtractTransform(oparam));
+        }
+    }
+    std::vector<IkReturnPtr> vikreturns;
+    {
+        EnvironmentLock lock(openravepy::GetEnvironment(_pyenv)->GetMutex()); // lock just in case since many users call this without locking...
+        openravepy::PythonThreadSaverPtr statesaver;
+        if( releasegil ) {
+            statesaver.reset(new openravepy::PythonThreadSaver());
+        }
+        _pmanip->FindIKSolutionBatch(vikparams, filteroptions, vikreturns, numthreads);
+    }
+
+    py::list osolutions;
+    FOREACH(it,vikreturns) {
+        if( ikreturn ) {
+            osolutions.append(openravepy::toPyIkReturn(!!*it ? **it : IkReturn(IKRA_Reject)));
+        }
+        else if( !!*it && (*it)->_action == IKRA_Success ) {
+            osolutions.append(toPyArray((*it)->_vsolution));
+        }
+        else {
+            osolutions.append(py::none_());
+        }
+    }
+    return osolutions;
+}
+
 object PyRobotBase::PyManipulator::FindIKSolutions(object oparam, int filteroptions, bool ikreturn, bool releasegil) const
 {
     IkParameterization ikparam;
@@ -2319,6 +2354,7 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolution_overloads, FindIKSolution,
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutionFree_overloads, FindIKSolution, 3, 5)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutions_overloads, FindIKSolutions, 2, 4)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutionsFree_overloads, FindIKSolutions, 3, 5)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutionBatch_overloads, FindIKSolutionBatch, 2, 5)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetArmConfigurationSpecification_overloads, GetArmConfigurationSpecification, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetIkConfigurationSpecification_overloads, GetIkConfigurationSpecification, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CreateRobotStateSaver_overloads, CreateRobotStateSaver, 0,1)
@@ -2832,6 +2868,18 @@ void init_openravepy_robot()
 #else
         .def("FindIKSolutions",pmanipiksf,FindIKSolutionsFree_overloads(PY_ARGS("param","freevalues","filteroptions","ikreturn","releasegil") DOXY_FN(RobotBase::Manipulator,FindIKSolutions "const IkParameterization; const std::vector; std::vector; int")))
 #endif
+#ifdef USE_PYBIND11_PYTHON_BINDINGS
+        .def("FindIKSolutionBatch", &PyRobotBase::PyManipulator::FindIKSolutionBatch,
+             "params"_a,
+             "filteroptions"_a,
+             "numthreads"_a = 1,
+             "ikreturn"_a = false,
+             "releasegil"_a = false,
+             DOXY_FN(RobotBase::Manipulator, FindIKSolutionBatch)
+             )
+#else
+        .def("FindIKSolutionBatch",&PyRobotBase::PyManipulator::FindIKSolutionBatch,FindIKSolutionBatch_overloads(PY_ARGS("params","filteroptions","numthreads","ikreturn","releasegil") DOXY_FN(RobotBase::Manipulator,FindIKSolutionBatch)))
+#endif
 #ifdef USE_PYBIND11_PYTHON_BINDINGS
         .def("GetIkParameterization", &PyRobotBase::PyManipulator::GetIkParameterization,
              "iktype"_a,
@@ -190,6 +190,12 @@ public:
     IkSolution() {
     }
 
+    /// \brief overwrites the solution, reusing the already allocated memory
+    void SetSolution(const std::vector<IkSingleDOFSolutionBase<T> >& vinfos, const std::vector<int>& vfree) {
+        _vbasesol = vinfos;
+        _vfree = vfree;
+    }
+
     // IkSolution(const std::vector<T>& v, uint32_t nvars) {
     //   this->SetSolution(v, nvars);
     // }
@@ -312,60 +318,71 @@ public:
 };
 
 /// \brief Default implementation of \ref IkSolutionListBase
+///
+/// Clear keeps the solutions that were already allocated and AddSolution overwrites them, so one list can be passed to many ComputeIk calls without reallocating.
 template <typename T>
 class IkSolutionList : public IkSolutionListBase<T>
 {
 public:
+    IkSolutionList() : _nsolutions(0) {
+    }
+
     virtual size_t AddSolution(const std::vector<IkSingleDOFSolutionBase<T> >& vinfos, const std::vector<int>& vfree)
     {
-        size_t index = _listsolutions.size();
-        _listsolutions.push_back(IkSolution<T>(vinfos,vfree));
+        size_t index = _nsolutions;
+        if( index < _vsolutions.size() ) {
+            _vsolutions[index].SetSolution(vinfos, vfree);
+        }
+        else {
+            _vsolutions.push_back(IkSolution<T>(vinfos,vfree));
+        }
+        ++_nsolutions;
         return index;
     }
 
     virtual const IkSolutionBase<T>& GetSolution(size_t index) const
     {
-        if( index >= _listsolutions.size() ) {
+        if( index >= _nsolutions ) {
             throw std::runtime_error("GetSolution index is invalid");
         }
-        typename std::list< IkSolution<T> >::const_iterator it = _listsolutions.begin();
-        std::advance(it,index);
-        return *it;
+        return _vsolutions[index];
     }
 
     virtual size_t GetNumSolutions() const {
-        return _listsolutions.size();
+        return _nsolutions;
     }
 
     virtual void Clear() {
-        _listsolutions.clear();
+        _nsolutions = 0;
+    }
+
+    /// \brief preallocates space for num solutions
+    void Reserve(size_t num) {
+        _vsolutions.reserve(num);
     }
 
     IkSolution<T>& operator[](size_t i) {
-        // assert(i < _listsolutions.size());
-        return _listsolutions[i];
+        // assert(i < _nsolutions);
+        return _vsolutions[i];
     }
 
     void SetSolutions(std::vector<IkSolution<T> > &vecsols) {
-        _listsolutions.clear();
-        std::move( std::make_move_iterator(vecsols.begin()),
-                   std::make_move_iterator(vecsols.end()),
-                   std::back_inserter(_listsolutions)
-                   );
+        _vsolutions = std::move(vecsols);
+        _nsolutions = _vsolutions.size();
+        vecsols.clear();
     }
 
     virtual void Print() const {
-        unsigned int i = 0;
-        for (typename std::list<IkSolution<T> >::const_iterator it=_listsolutions.cbegin();
-             it != _listsolutions.cend(); ++it) {
-            std::cout << "Solution " << i++ << ":" << std::endl;
+        for (size_t i = 0; i < _nsolutions; ++i) {
+            std::cout << "Solution " << i << ":" << std::endl;
             std::cout << "===========" << std::endl;
-            it->Print();
+            _vsolutions[i].Print();
         }
     }
 
 protected:
-    std::list< IkSolution<T> > _listsolutions;
+    std::vector< IkSolution<T> > _vsolutions; ///< the first _nsolutions are valid, the rest are kept to be reused
+    size_t _nsolutions;
 };
 
 /// \brief Contains information of a solution where two axes align.
@@ -119,13 +119,57 @@ class Grasper:
         contacts = reshape(array([float64(s) for s in resvalues],float64),(len(resvalues)//6,6))
         return contacts,finalconfig,mindist,volume
 
-    def GraspThreaded(self,approachrays,standoffs,preshapes,rolls,manipulatordirections=None,target=None,transformrobot=True,onlycontacttarget=True,tightgrasp=False,graspingnoise=None,forceclosurethreshold=None,collisionchecker=None,translationstepmult=None,numthreads=None,startindex=None,maxgrasps=None,finestep=None):
+    def GraspThreaded(self,approachrays,standoffs,preshapes,rolls,manipulatordirections=None,target=None,transformrobot=True,onlycontacttarget=True,tightgrasp=False,graspingnoise=None,forceclosurethreshold=None,collisionchecker=None,translationstepmult=None,numthreads=None,startindex=None,maxgrasps=None,finestep=None,keepworkers=None):
         """See :ref:`module-grasper-graspthreaded`
+
+        :param keepworkers: if False, the worker threads and their environments are destroyed once the grasps are done. By default they are kept for the next call.
+        :return: (nextid, grasps)
+        """
+        cmd = 'GraspThreaded ' + self._GetGraspThreadedParameters(approachrays,standoffs,preshapes,rolls,manipulatordirections=manipulatordirections,target=target,onlycontacttarget=onlycontacttarget,tightgrasp=tightgrasp,graspingnoise=graspingnoise,forceclosurethreshold=forceclosurethreshold,translationstepmult=translationstepmult,numthreads=numthreads,startindex=startindex,maxgrasps=maxgrasps,finestep=finestep,keepworkers=keepworkers)
+        res = self.prob.SendCommand(cmd)
+        if res is None:
+            raise PlanningError('Grasp failed')
+        resultgrasps = res.split()
+        nextid = int(resultgrasps.pop(0))
+        return nextid, self._ParseGraspThreadedResults(resultgrasps)
+
+    def StartGraspThreaded(self,approachrays,standoffs,preshapes,rolls,manipulatordirections=None,target=None,onlycontacttarget=True,tightgrasp=False,graspingnoise=None,forceclosurethreshold=None,translationstepmult=None,numthreads=None,startindex=None,maxgrasps=None,finestep=None,keepworkers=None):
+        """Starts evaluating the grasps on the worker threads and returns immediately. Takes the same parameters as :meth:`GraspThreaded`.
+
+        :return: the number of grasps of the job
+        """
+        cmd = 'StartGraspThreaded ' + self._GetGraspThreadedParameters(approachrays,standoffs,preshapes,rolls,manipulatordirections=manipulatordirections,target=target,onlycontacttarget=onlycontacttarget,tightgrasp=tightgrasp,graspingnoise=graspingnoise,forceclosurethreshold=forceclosurethreshold,translationstepmult=translationstepmult,numthreads=numthreads,startindex=startindex,maxgrasps=maxgrasps,finestep=finestep,keepworkers=keepworkers)
+        res = self.prob.SendCommand(cmd)
+        if res is None:
+            raise PlanningError('Grasp failed')
+        return int(res)
+
+    def GetGraspThreadedResults(self,wait=False):
+        """Returns the grasps that succeeded since the last call.
+
+        :param wait: if True, blocks until there is a new grasp or the job is finished
+        :return: (nextid, isfinished, grasps)
         """
-        cmd = 'GraspThreaded '
+        res = self.prob.SendCommand('GetGraspThreadedResults wait %d'%wait)
+        if res is None:
+            raise PlanningError('no grasps were started')
+        resultgrasps = res.split()
+        nextid = int(resultgrasps.pop(0))
+        isfinished = int(resultgrasps.pop(0)) != 0
+        return nextid, isfinished, self._ParseGraspThreadedResults(resultgrasps)
+
+    def StopGraspThreaded(self):
+        """Stops handing out grasps and waits for the grasps that are being evaluated.
+
+        :return: the next grasp id to resume from
+        """
+        return int(self.prob.SendCommand('StopGraspThreaded'))
+
+    def _GetGraspThreadedParameters(self,approachrays,standoffs,preshapes,rolls,manipulatordirections=None,target=None,onlycontacttarget=True,tightgrasp=False,graspingnoise=None,forceclosurethreshold=None,translationstepmult=None,numthreads=None,startindex=None,maxgrasps=None,finestep=None,keepworkers=None):
+        cmd = ''
         if target is not None:
             cmd += 'target %s '%target.GetName()
-        cmd += 'forceclosure %d %g onlycontacttarget %d tightgrasp %d '%(forceclosurethreshold is not None,forceclosurethreshold,onlycontacttarget,tightgrasp)
+        cmd += 'forceclosure %d %g onlycontacttarget %d tightgrasp %d '%(forceclosurethreshold is not None,forceclosurethreshold if forceclosurethreshold is not None else 0,onlycontacttarget,tightgrasp)
         if self.friction is not None:
             cmd += 'friction %.15e '%self.friction
         if startindex is not None:
@@ -142,6 +186,8 @@ class Grasper:
             cmd += 'finestep %.15e '%finestep
         if numthreads is not None:
             cmd += 'numthreads %d '%numthreads
+        if keepworkers is not None:
+            cmd += 'keepworkers %d '%keepworkers
         cmd += 'approachrays %d '%len(approachrays)
         for f in approachrays.flat:
             cmd += str(f) + ' '
@@ -157,12 +203,12 @@ class Grasper:
         cmd += 'manipulatordirections %d '%len(manipulatordirections)
         for f in manipulatordirections.flat:
             cmd += str(f) + ' '
-        res = self.prob.SendCommand(cmd)
-        if res is None:
-            raise PlanningError('Grasp failed')
-        resultgrasps = res.split()
+        return cmd
+
+    def _ParseGraspThreadedResults(self,resultgrasps):
+        """parses the number of grasps followed by the grasps, see _WriteGraspResults in the grasper module
+        """
         resvalues=[]
-        nextid = int(resultgrasps.pop(0))
         preshapelen = len(self.robot.GetActiveManipulator().GetGripperIndices())
         for i in range(int(resultgrasps.pop(0))):
             position = array([float64(resultgrasps.pop(0)) for i in range(3)])
@@ -179,7 +225,7 @@ class Grasper:
             contacts=[float64(resultgrasps.pop(0)) for i in range(contacts_num*6)]
             contacts = reshape(contacts,(contacts_num,6))
             resvalues.append([position, direction, roll, standoff, manipulatordirection, mindist, volume, preshape,Tfinal,finalshape,contacts])
-        return nextid, resvalues
+        return resvalues
 
     def ConvexHull(self,points,returnplanes=True,returnfaces=True,returntriangles=True):
         """See :ref:`module-grasper-convexhull`
@@ -26,7 +26,10 @@
 #include <boost/filesystem/operations.hpp>
 #endif
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <mutex>
 #include <shared_mutex>
 #include <thread>
@@ -231,6 +234,143 @@ protected:
     friend class BodyCallbackData;
     typedef boost::shared_ptr<BodyCallbackData> BodyCallbackDataPtr;
 
+    /// \brief locks the environment for a const collision query and holds the checker to run it with
+    ///
+    /// If the current checker is reentrant, only locks the environment state shared so that the queries of several threads can run concurrently. Otherwise locks the environment mutex.
+    class CollisionQueryLock
+    {
+public:
+        CollisionQueryLock(const Environment& env) : _lockstate(env._mutexEnvironmentState, defer_lock_t()), _lockenv(env.GetMutex(), defer_lock_t())
+        {
+            if( env._bConcurrentCollisionQuery ) {
+                _lockstate.lock();
+                // SetCollisionChecker changes the checker under the exclusive lock, so check again
+                if( env._bConcurrentCollisionQuery ) {
+                    _pchecker = env._pCurrentChecker;
+                    return;
+                }
+                _lockstate.unlock();
+            }
+            _lockenv.lock();
+            _pchecker = env._pCurrentChecker;
+        }
+
+        inline const CollisionCheckerBasePtr& GetChecker() const {
+            return _pchecker;
+        }
+
+private:
+        EnvironmentStateSharedLock _lockstate;
+        EnvironmentLock _lockenv;
+        CollisionCheckerBasePtr _pchecker;
+    };
+
+    /// \brief threads kept alive across simulation steps that step the read-only sensors, see \ref SetSimulationSensorThreads
+    class SensorStepThreadPool
+    {
+public:
+        /// \param numthreads the number of worker threads. The thread calling StepSensors also steps sensors.
+        SensorStepThreadPool(int numthreads)
+        {
+            for(int ithread = 0; ithread < numthreads; ++ithread) {
+                _vthreads.emplace_back(&SensorStepThreadPool::_RunThread, this);
+            }
+        }
+        virtual ~SensorStepThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _bShutdown = true;
+            }
+            _condition.notify_all();
+            for (std::thread& thread : _vthreads) {
+                thread.join();
+            }
+        }
+
+        inline int GetNumThreads() const {
+            return (int)_vthreads.size();
+        }
+
+        /// \brief calls SimulationStep on all the sensors and returns once all of them are done.
+        ///
+        /// \throw rethrows the first exception thrown by a sensor after all the sensors are done
+        void StepSensors(const std::vector<SensorBasePtr>& vsensors, dReal fTimeStep)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _pvsensors = &vsensors;
+                _fTimeStep = fTimeStep;
+                _nextsensor = 0;
+                _exception = std::exception_ptr();
+                ++_generation;
+            }
+            _condition.notify_all();
+            _StepSensors();
+
+            // barrier, the sensors cannot be stepped again before the next tick
+            std::unique_lock<std::mutex> lock(_mutex);
+            _conditionDone.wait(lock, [this]() {
+                return _numbusy == 0;
+            });
+            _pvsensors = nullptr;
+            if( !!_exception ) {
+                std::rethrow_exception(_exception);
+            }
+        }
+
+private:
+        void _RunThread()
+        {
+            uint64_t generation = 0;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(1) {
+                _condition.wait(lock, [this, &generation]() {
+                    return _bShutdown || (_generation != generation && !!_pvsensors);
+                });
+                if( _bShutdown ) {
+                    return;
+                }
+                generation = _generation;
+                ++_numbusy;
+                lock.unlock();
+                _StepSensors();
+                lock.lock();
+                if( --_numbusy == 0 ) {
+                    _conditionDone.notify_all();
+                }
+            }
+        }
+
+        void _StepSensors()
+        {
+            for(size_t isensor = _nextsensor++; isensor < _pvsensors->size(); isensor = _nextsensor++) {
+                try {
+                    (*_pvsensors)[isensor]->SimulationStep(_fTimeStep);
+                }
+                catch(...) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if( !_exception ) {
+                        _exception = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        std::vector<std::thread> _vthreads;
+        std::mutex _mutex; ///< protects all the members below except _nextsensor
+        std::condition_variable _condition; ///< notified when there are new sensors to step or on shutdown
+        std::condition_variable _conditionDone; ///< notified when the last busy worker is done
+        const std::vector<SensorBasePtr>* _pvsensors = nullptr; ///< sensors of the current step, only set during StepSensors
+        dReal _fTimeStep = 0;
+        std::atomic<size_t> _nextsensor{0}; ///< index of the next sensor to step
+        uint64_t _generation = 0; ///< incremented every StepSensors call so that every worker joins a step at most once
+        int _numbusy = 0; ///< number of workers currently stepping sensors
+        std::exception_ptr _exception; ///< first exception thrown by a sensor in the current step
+        bool _bShutdown = false;
+    };
+    typedef boost::shared_ptr<SensorStepThreadPool> SensorStepThreadPoolPtr;
+
 public:
     Environment() : EnvironmentBase()
     {
@@ -340,6 +480,7 @@ public:
             RAVELOG_WARN_FORMAT("env=%s, _vecbodies.size():%d, _mapBodyNameIndex.size():%d, _mapBodyIdIndex.size():%d seems large, maybe there is memory leak", GetNameId()%_vecbodies.size()%_mapBodyNameIndex.size());
         }
         _StopSimulationThread();
+        _pSensorStepThreadPool.reset();
 
         // destroy the modules (their destructors could attempt to lock environment, so have to do it before global lock)
         // however, do not clear the _listModules yet
@@ -367,6 +508,7 @@ public:
         // lock the environment
         {
             EnvironmentLock lockenv(GetMutex());
+            EnvironmentStateExclusiveLock lockstate(*this, true);
             _bEnableSimulation = false;
             if( !!_pPhysicsEngine ) {
                 _pPhysicsEngine->DestroyEnvironment();
@@ -374,6 +516,7 @@ public:
             if( !!_pCurrentChecker ) {
                 _pCurrentChecker->DestroyEnvironment();
             }
+            _bConcurrentCollisionQuery = false;
 
             // clear internal interface lists, have to Destroy all kinbodys without locking _mutexInterfaces since some can hold BodyCallbackData, which requires to lock _mutexInterfaces
             std::vector<KinBodyPtr> vecbodies;
@@ -430,6 +573,8 @@ public:
         }
 
         EnvironmentLock lockenv(GetMutex());
+        // reentrant collision queries have to wait until the bodies are removed from the checker. unlocked before calling into user callbacks
+        EnvironmentStateExclusiveLock lockstate(*this, true);
 
         if( !!_pPhysicsEngine ) {
             _pPhysicsEngine->DestroyEnvironment();
@@ -472,6 +617,7 @@ public:
             }
             _listSensors.clear();
         }
+        lockstate.unlock();
         if( vcallbackbodies.size() > 0 ) {
             FOREACH(itbody, vcallbackbodies) {
                 _CallBodyCallbacks(*itbody, 0);
@@ -493,6 +639,7 @@ public:
         listModules.clear();
         listOwnedInterfaces.clear();
 
+        lockstate.lock();
         if( !!_pCurrentChecker ) {
             _pCurrentChecker->InitEnvironment();
         }
@@ -1006,18 +1153,22 @@ public:
             _EnsureUniqueId(pbody);
         }
         {
-            ExclusiveLock lock969(_mutexInterfaces);
-            const int newBodyIndex = _AssignEnvironmentBodyIndex(pbody);
-            _AddKinBodyInternal(pbody, newBodyIndex);
-            _nBodiesModifiedStamp++;
-        }
-        pbody->_ComputeInternalInformation();
-        _pCurrentChecker->InitKinBody(pbody);
-        if( !!pbody->GetSelfCollisionChecker() && pbody->GetSelfCollisionChecker() != _pCurrentChecker ) {
-            // also initialize external collision checker if specified for this body
-            pbody->GetSelfCollisionChecker()->InitKinBody(pbody);
+            // reentrant collision queries should not see the body before the checkers are initialized with it
+            EnvironmentStateExclusiveLock lockstate(*this, true);
+            {
+                ExclusiveLock lock969(_mutexInterfaces);
+                const int newBodyIndex = _AssignEnvironmentBodyIndex(pbody);
+                _AddKinBodyInternal(pbody, newBodyIndex);
+                _nBodiesModifiedStamp++;
+            }
+            pbody->_ComputeInternalInformation();
+            _pCurrentChecker->InitKinBody(pbody);
+            if( !!pbody->GetSelfCollisionChecker() && pbody->GetSelfCollisionChecker() != _pCurrentChecker ) {
+                // also initialize external collision checker if specified for this body
+                pbody->GetSelfCollisionChecker()->InitKinBody(pbody);
+            }
+            _pPhysicsEngine->InitKinBody(pbody);
         }
-        _pPhysicsEngine->InitKinBody(pbody);
         // send all the changed callbacks of the body since anything could have changed
         const uint32_t maskPotentialyChanged(0xffffffff&~KinBody::Prop_JointMimic& ~KinBody::Prop_LinkStatic& ~KinBody::Prop_BodyRemoved& ~KinBody::Prop_LinkGeometry& ~KinBody::Prop_LinkGeometryGroup& ~KinBody::Prop_LinkDynamics);
         pbody->_PostprocessChangedParameters(maskPotentialyChanged);
@@ -1047,18 +1198,21 @@ public:
             _EnsureUniqueId(robot);
         }
         {
-            ExclusiveLock lock823(_mutexInterfaces);
-            const int newBodyIndex = _AssignEnvironmentBodyIndex(robot);
-            _AddKinBodyInternal(robot, newBodyIndex);
-            _nBodiesModifiedStamp++;
-        }
-        robot->_ComputeInternalInformation(); // have to do this after _vecbodies is added since SensorBase::SetName can call EnvironmentBase::GetSensor to initialize itself
-        _pCurrentChecker->InitKinBody(robot);
-        if( !!robot->GetSelfCollisionChecker() && robot->GetSelfCollisionChecker() != _pCurrentChecker ) {
-            // also initialize external collision checker if specified for this body
-            robot->GetSelfCollisionChecker()->InitKinBody(robot);
+            EnvironmentStateExclusiveLock lockstate(*this, true);
+            {
+                ExclusiveLock lock823(_mutexInterfaces);
+                const int newBodyIndex = _AssignEnvironmentBodyIndex(robot);
+                _AddKinBodyInternal(robot, newBodyIndex);
+                _nBodiesModifiedStamp++;
+            }
+            robot->_ComputeInternalInformation(); // have to do this after _vecbodies is added since SensorBase::SetName can call EnvironmentBase::GetSensor to initialize itself
+            _pCurrentChecker->InitKinBody(robot);
+            if( !!robot->GetSelfCollisionChecker() && robot->GetSelfCollisionChecker() != _pCurrentChecker ) {
+                // also initialize external collision checker if specified for this body
+                robot->GetSelfCollisionChecker()->InitKinBody(robot);
+            }
+            _pPhysicsEngine->InitKinBody(robot);
         }
-        _pPhysicsEngine->InitKinBody(robot);
         // send all the changed callbacks of the body since anything could have changed
         const uint32_t maskPotentialyChanged(0xffffffff&~KinBody::Prop_JointMimic& ~KinBody::Prop_LinkStatic& ~KinBody::Prop_BodyRemoved& ~KinBody::Prop_LinkGeometry& ~KinBody::Prop_LinkGeometryGroup& ~KinBody::Prop_LinkDynamics);
         robot->_PostprocessChangedParameters(maskPotentialyChanged);
@@ -1099,6 +1253,7 @@ public:
             KinBodyPtr pbody = RaveInterfaceCast<KinBody>(pinterface);
             const int envBodyIndex = pbody->GetEnvironmentBodyIndex();
             {
+                EnvironmentStateExclusiveLock lockstate(*this, true);
                 ExclusiveLock lock534(_mutexInterfaces);
                 if ( envBodyIndex <= 0 || envBodyIndex > ((int) _vecbodies.size()) - 1 || !_vecbodies.at(envBodyIndex)) {
                     return false;
@@ -1152,6 +1307,7 @@ public:
         EnvironmentLock lockenv(GetMutex());
         KinBodyPtr pbody;
         {
+            EnvironmentStateExclusiveLock lockstate(*this, true);
             ExclusiveLock lock101(_mutexInterfaces);
             const std::unordered_map<std::string, int>::const_iterator it = _mapBodyNameIndex.find(name);
             if (it == _mapBodyNameIndex.end()) {
@@ -1371,6 +1527,7 @@ public:
         if( _pCurrentChecker == pchecker ) {
             return true;
         }
+        EnvironmentStateExclusiveLock lockstate(*this, true);
         if( !!_pCurrentChecker ) {
             _pCurrentChecker->DestroyEnvironment();     // delete all resources
         }
@@ -1389,6 +1546,7 @@ public:
                 pbody->_ResetInternalCollisionCache();
             }
         }
+        _bConcurrentCollisionQuery = _pCurrentChecker->IsReentrant();
         return _pCurrentChecker->InitEnvironment();
     }
 
@@ -1398,85 +1556,86 @@ public:
 
     virtual bool CheckCollision(KinBodyConstPtr pbody1, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(pbody1);
-        return _pCurrentChecker->CheckCollision(pbody1,report);
+        return lockquery.GetChecker()->CheckCollision(pbody1,report);
     }
 
     virtual bool CheckCollision(KinBodyConstPtr pbody1, KinBodyConstPtr pbody2, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(pbody1);
         CHECK_COLLISION_BODY(pbody2);
-        return _pCurrentChecker->CheckCollision(pbody1,pbody2,report);
+        return lockquery.GetChecker()->CheckCollision(pbody1,pbody2,report);
     }
 
     virtual bool CheckCollision(KinBody::LinkConstPtr plink, CollisionReportPtr report ) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(plink->GetParent());
-        return _pCurrentChecker->CheckCollision(plink,report);
+        return lockquery.GetChecker()->CheckCollision(plink,report);
     }
 
     virtual bool CheckCollision(KinBody::LinkConstPtr plink1, KinBody::LinkConstPtr plink2, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(plink1->GetParent());
         CHECK_COLLISION_BODY(plink2->GetParent());
-        return _pCurrentChecker->CheckCollision(plink1,plink2,report);
+        return lockquery.GetChecker()->CheckCollision(plink1,plink2,report);
     }
 
     virtual bool CheckCollision(KinBody::LinkConstPtr plink, KinBodyConstPtr pbody, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(plink->GetParent());
         CHECK_COLLISION_BODY(pbody);
-        return _pCurrentChecker->CheckCollision(plink,pbody,report);
+        return lockquery.GetChecker()->CheckCollision(plink,pbody,report);
     }
 
     virtual bool CheckCollision(KinBody::LinkConstPtr plink, const std::vector<KinBodyConstPtr>& vbodyexcluded, const std::vector<KinBody::LinkConstPtr>& vlinkexcluded, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(plink->GetParent());
-        return _pCurrentChecker->CheckCollision(plink,vbodyexcluded,vlinkexcluded,report);
+        return lockquery.GetChecker()->CheckCollision(plink,vbodyexcluded,vlinkexcluded,report);
     }
 
     virtual bool CheckCollision(KinBodyConstPtr pbody, const std::vector<KinBodyConstPtr>& vbodyexcluded, const std::vector<KinBody::LinkConstPtr>& vlinkexcluded, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(pbody);
-        return _pCurrentChecker->CheckCollision(pbody,vbodyexcluded,vlinkexcluded,report);
+        return lockquery.GetChecker()->CheckCollision(pbody,vbodyexcluded,vlinkexcluded,report);
     }
 
     virtual bool CheckCollision(const RAY& ray, KinBody::LinkConstPtr plink, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(plink->GetParent());
-        return _pCurrentChecker->CheckCollision(ray,plink,report);
+        return lockquery.GetChecker()->CheckCollision(ray,plink,report);
     }
     virtual bool CheckCollision(const RAY& ray, KinBodyConstPtr pbody, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(pbody);
-        return _pCurrentChecker->CheckCollision(ray,pbody,report);
+        return lockquery.GetChecker()->CheckCollision(ray,pbody,report);
     }
     virtual bool CheckCollision(const RAY& ray, CollisionReportPtr report) override
     {
-        return _pCurrentChecker->CheckCollision(ray,report);
+        CollisionQueryLock lockquery(*this);
+        return lockquery.GetChecker()->CheckCollision(ray,report);
     }
 
     virtual bool CheckCollision(const TriMesh& trimesh, KinBodyConstPtr pbody, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(pbody);
-        return _pCurrentChecker->CheckCollision(trimesh,pbody,report);
+        return lockquery.GetChecker()->CheckCollision(trimesh,pbody,report);
     }
 
     virtual bool CheckStandaloneSelfCollision(KinBodyConstPtr pbody, CollisionReportPtr report) override
     {
-        EnvironmentLock lockenv(GetMutex());
+        CollisionQueryLock lockquery(*this);
         CHECK_COLLISION_BODY(pbody);
-        return _pCurrentChecker->CheckStandaloneSelfCollision(pbody,report);
+        return lockquery.GetChecker()->CheckStandaloneSelfCollision(pbody,report);
     }
 
     virtual void StepSimulation(dReal fTimeStep) override
@@ -1513,8 +1672,16 @@ public:
         }
 
         // simulate the sensors last (ie, they always reflect the most recent bodies
+        // the read-only sensors only read the scene, so they can be stepped concurrently once all other sensors are done. collision queries from several threads need a reentrant checker
+        const bool bParallelSensors = _nSimulationSensorThreads > 1 && _bConcurrentCollisionQuery;
+        std::vector<SensorBasePtr> vReadOnlySensors;
         FOREACH(itsensor, listSensors) {
-            (*itsensor)->SimulationStep(fTimeStep);
+            if( bParallelSensors && (*itsensor)->IsSimulationStepReadOnly() ) {
+                vReadOnlySensors.push_back(*itsensor);
+            }
+            else {
+                (*itsensor)->SimulationStep(fTimeStep);
+            }
         }
         for (const KinBodyPtr& pBody : vecbodies) {
             if (!pBody) {
@@ -1525,11 +1692,27 @@ public:
             }
             const RobotBasePtr& probot = RaveInterfaceCast<RobotBase>(pBody);
             FOREACHC(itsensor, probot->GetAttachedSensors()) {
-                if( !!(*itsensor)->GetSensor() ) {
-                    (*itsensor)->GetSensor()->SimulationStep(fTimeStep);
+                const SensorBasePtr& psensor = (*itsensor)->GetSensor();
+                if( !psensor ) {
+                    continue;
+                }
+                if( bParallelSensors && psensor->IsSimulationStepReadOnly() ) {
+                    vReadOnlySensors.push_back(psensor);
+                }
+                else {
+                    psensor->SimulationStep(fTimeStep);
                 }
             }
         }
+        if( vReadOnlySensors.size() == 1 ) {
+            vReadOnlySensors[0]->SimulationStep(fTimeStep);
+        }
+        else if( vReadOnlySensors.size() > 1 ) {
+            if( !_pSensorStepThreadPool || _pSensorStepThreadPool->GetNumThreads() != _nSimulationSensorThreads-1 ) {
+                _pSensorStepThreadPool.reset(new SensorStepThreadPool(_nSimulationSensorThreads-1));
+            }
+            _pSensorStepThreadPool->StepSensors(vReadOnlySensors, fTimeStep);
+        }
         _nCurSimTime += step;
     }
 
@@ -1537,6 +1720,14 @@ public:
         return _mutexEnvironment;
     }
 
+    virtual EnvironmentStateMutex& GetStateMutex() const override {
+        return _mutexEnvironmentState;
+    }
+
+    bool IsConcurrentCollisionQueryEnabled() const override {
+        return _bConcurrentCollisionQuery;
+    }
+
     virtual void GetBodies(std::vector<KinBodyPtr>& bodies, uint64_t timeout) const override
     {
         TimedSharedLock lock853(_mutexInterfaces, timeout);
@@ -2610,6 +2801,22 @@ public:
         return _bEnableSimulation;
     }
 
+    virtual void SetSimulationSensorThreads(int numthreads) override
+    {
+        if( numthreads <= 0 ) {
+            numthreads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+        EnvironmentLock lockenv(GetMutex());
+        if( _nSimulationSensorThreads != numthreads ) {
+            _nSimulationSensorThreads = numthreads;
+            _pSensorStepThreadPool.reset(); // created on the next step that needs it
+        }
+    }
+
+    virtual int GetSimulationSensorThreads() const override {
+        return _nSimulationSensorThreads;
+    }
+
     virtual void StopSimulation(int shutdownthread=1)
     {
         {
@@ -3332,6 +3539,8 @@ protected:
         _nCurSimTime = 0;
         _nSimStartTime = utils::GetMicroTime();
         _bRealTime = true;
+        _nSimulationSensorThreads = 1;
+        _bConcurrentCollisionQuery = false;
         _bInit = false;
         _bEnableSimulation = true;     // need to start by default
         _unitInfo = UnitInfo();
@@ -3449,6 +3658,7 @@ protected:
         _nCurSimTime = 0;
         _nSimStartTime = utils::GetMicroTime();
         _bRealTime = r->_bRealTime;
+        _nSimulationSensorThreads = r->_nSimulationSensorThreads;
 
         _description = r->_description;
         _keywords = r->_keywords;
@@ -4314,10 +4524,15 @@ protected:
     PhysicsEngineBasePtr _pPhysicsEngine;
 
     boost::shared_ptr<std::thread> _threadSimulation;                      ///< main loop for environment simulation
+    int _nSimulationSensorThreads; ///< number of threads stepping the read-only sensors, see SetSimulationSensorThreads
+    SensorStepThreadPoolPtr _pSensorStepThreadPool; ///< created by StepSimulation when the read-only sensors are stepped concurrently
 
     mutable EnvironmentMutex _mutexEnvironment;          ///< protects internal data from multithreading issues
     mutable std::shared_timed_mutex _mutexInterfaces;     ///< lock when managing interfaces like _listOwnedInterfaces, _listModules as well as _vecbodies and supporting data such as _mapBodyNameIndex, _mapBodyIdIndex and _environmentIndexRecyclePool
 
+    mutable EnvironmentStateMutex _mutexEnvironmentState; ///< locked shared by the const collision queries of reentrant checkers, exclusively when bodies are added/removed, move or the checker changes. see EnvironmentStateExclusiveLock
+    std::atomic<bool> _bConcurrentCollisionQuery; ///< true if _pCurrentChecker is reentrant. only changed under the exclusive lock of _mutexEnvironmentState
+
     using ExclusiveLock = std::lock_guard< std::shared_timed_mutex >;
     using SharedLock = std::shared_lock< std::shared_timed_mutex >;
 
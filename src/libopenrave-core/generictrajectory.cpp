@@ -18,8 +18,14 @@
 #include <boost/bind/bind.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <openrave/xmlreaders.h>
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 using namespace boost::placeholders;
 
 namespace OpenRAVE {
@@ -27,6 +33,10 @@ namespace OpenRAVE {
 // To distinguish between binary and XML trajectory files
 static const uint16_t BINARY_TRAJECTORY_MAGIC_NUMBER = 0x62ff;
 static const uint16_t BINARY_TRAJECTORY_VERSION_NUMBER = 0x0003;  // Version number for serialization
+static const uint16_t BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER = 0x0004;  // Version number of the aligned layout that can be memory mapped
+static const size_t BINARY_TRAJECTORY_ALIGNMENT = 64; // alignment in bytes of the data blocks in the aligned layout relative to the start of the file
+static const size_t BINARY_TRAJECTORY_ALIGNED_HEADER_SIZE = 24; // size of the data block header in the aligned layout before padding
+static const int TRAJECTORY_SERIALIZE_ALIGNED = 0x4000; // serialize option for writing the aligned layout
 
 static const dReal g_fEpsilonLinear = RavePow(g_fEpsilon,0.9);
 static const dReal g_fEpsilonQuadratic = RavePow(g_fEpsilon,0.45); // should be 0.6...perhaps this is related to parabolic smoother epsilons?
@@ -42,11 +52,32 @@ inline void WriteBinaryUInt32(std::ostream& f, uint32_t value)
     f.write((const char*) &value, sizeof(value));
 }
 
+inline void WriteBinaryUInt64(std::ostream& f, uint64_t value)
+{
+    f.write((const char*) &value, sizeof(value));
+}
+
 inline void WriteBinaryInt(std::ostream& f, int value)
 {
     f.write((const char*) &value, sizeof(value));
 }
 
+inline void WriteBinaryPadding(std::ostream& f, size_t numBytes)
+{
+    static const char s_zeros[BINARY_TRAJECTORY_ALIGNMENT] = {0};
+    while( numBytes > 0 ) {
+        const size_t numWrite = std::min(numBytes, BINARY_TRAJECTORY_ALIGNMENT);
+        f.write(s_zeros, numWrite);
+        numBytes -= numWrite;
+    }
+}
+
+/// \brief returns the number of bytes needed to pad numBytes to BINARY_TRAJECTORY_ALIGNMENT
+inline size_t GetBinaryPaddingSize(uint64_t numBytes)
+{
+    return (BINARY_TRAJECTORY_ALIGNMENT - (numBytes % BINARY_TRAJECTORY_ALIGNMENT)) % BINARY_TRAJECTORY_ALIGNMENT;
+}
+
 inline void WriteBinaryString(std::ostream& f, const std::string& s)
 {
     BOOST_ASSERT(s.length() <= std::numeric_limits<uint16_t>::max());
@@ -58,15 +89,25 @@ inline void WriteBinaryString(std::ostream& f, const std::string& s)
     }
 }
 
-inline void WriteBinaryVector(std::ostream&f, const std::vector<dReal>& v)
+inline void WriteBinaryVector(std::ostream&f, const dReal* pdata, size_t numData)
 {
     // Indicate number of data points
-    const uint32_t numDataPoints = v.size();
+    const uint32_t numDataPoints = numData;
     WriteBinaryUInt32(f, numDataPoints);
 
     // Write vector memory block to binary file
     const uint64_t vectorLengthBytes = numDataPoints*sizeof(dReal);
-    f.write((const char*) &v[0], vectorLengthBytes);
+    f.write((const char*) pdata, vectorLengthBytes);
+}
+
+/// \brief writes the array and pads it so that the next block is aligned
+inline void WriteBinaryAlignedArray(std::ostream& f, const dReal* pdata, size_t numDataPoints)
+{
+    const uint64_t arrayLengthBytes = numDataPoints*sizeof(dReal);
+    if( arrayLengthBytes > 0 ) {
+        f.write((const char*) pdata, arrayLengthBytes);
+    }
+    WriteBinaryPadding(f, GetBinaryPaddingSize(arrayLengthBytes));
 }
 
 /* Helper functions for binary trajectory file reading */
@@ -84,6 +125,12 @@ inline bool ReadBinaryUInt32(std::istream& f, uint32_t& value)
     return !!f;
 }
 
+inline bool ReadBinaryUInt64(std::istream& f, uint64_t& value)
+{
+    f.read((char*) &value, sizeof(value));
+    return !!f;
+}
+
 inline bool ReadBinaryInt(std::istream& f, int& value)
 {
     f.read((char*) &value, sizeof(value));
@@ -120,6 +167,17 @@ inline bool ReadBinaryVector(std::istream& f, std::vector<dReal>& v)
     return !!f;
 }
 
+inline bool ReadBinaryAlignedArray(std::istream& f, std::vector<dReal>& v, size_t numDataPoints)
+{
+    v.resize(numDataPoints);
+    const uint64_t arrayLengthBytes = numDataPoints*sizeof(dReal);
+    if( arrayLengthBytes > 0 ) {
+        f.read((char*) &v[0], arrayLengthBytes);
+    }
+    f.ignore(GetBinaryPaddingSize(arrayLengthBytes));
+    return !!f;
+}
+
 // raw pointers
 inline void ReadBinaryUInt16(const uint8_t*& f, uint16_t& value)
 {
@@ -133,6 +191,12 @@ inline void ReadBinaryUInt32(const uint8_t*& f, uint32_t& value)
     f += sizeof(uint32_t);
 }
 
+inline void ReadBinaryUInt64(const uint8_t*& f, uint64_t& value)
+{
+    std::copy(f, f+sizeof(uint64_t), (uint8_t*)&value);
+    f += sizeof(uint64_t);
+}
+
 inline void ReadBinaryInt(const uint8_t*& f, int& value)
 {
     value = *(int*)f;
@@ -167,6 +231,61 @@ inline void ReadBinaryVector(const uint8_t*& f, std::vector<dReal>& v)
     f += vectorLengthBytes;
 }
 
+/// \brief read-only view of a contiguous dReal array. Points either into a std::vector owned by the trajectory or into a memory mapped file.
+class ConstRealArrayView
+{
+public:
+    ConstRealArrayView() : _pdata(NULL), _size(0) {
+    }
+    ConstRealArrayView(const dReal* pdata, size_t size) : _pdata(pdata), _size(size) {
+    }
+
+    inline const dReal* begin() const {
+        return _pdata;
+    }
+    inline const dReal* end() const {
+        return _pdata+_size;
+    }
+    inline size_t size() const {
+        return _size;
+    }
+    inline const dReal& operator[](size_t index) const {
+        return _pdata[index];
+    }
+    inline const dReal& at(size_t index) const {
+        if( index >= _size ) {
+            throw std::out_of_range("ConstRealArrayView::at");
+        }
+        return _pdata[index];
+    }
+    inline const dReal& back() const {
+        return _pdata[_size-1];
+    }
+
+private:
+    const dReal* _pdata;
+    size_t _size;
+};
+
+/// \brief pout[i] = c0[i] + t*(c1[i] + t*(c2[i] + t*c3[i])) for i in [0, num)
+inline void EvaluateCubicPolynomials(dReal* pout, const dReal* c0, const dReal* c1, const dReal* c2, const dReal* c3, int num, dReal t)
+{
+    int i = 0;
+#if defined(__AVX__) && OPENRAVE_PRECISION
+    const __m256d vt = _mm256_set1_pd(t);
+    for(; i + 4 <= num; i += 4) {
+        __m256d v = _mm256_loadu_pd(c3+i);
+        v = _mm256_add_pd(_mm256_loadu_pd(c2+i), _mm256_mul_pd(vt, v));
+        v = _mm256_add_pd(_mm256_loadu_pd(c1+i), _mm256_mul_pd(vt, v));
+        v = _mm256_add_pd(_mm256_loadu_pd(c0+i), _mm256_mul_pd(vt, v));
+        _mm256_storeu_pd(pout+i, v);
+    }
+#endif
+    for(; i < num; ++i) {
+        pout[i] = c0[i] + t*(c1[i] + t*(c2[i] + t*c3[i]));
+    }
+}
+
 class GenericTrajectory : public TrajectoryBase
 {
     std::map<string,int> _maporder;
@@ -187,6 +306,8 @@ public:
         _maporder["joint_torques"] = 11;
         _bInit = false;
         _bSamplingVerified = false;
+        RegisterCommand("MapFile",boost::bind(&GenericTrajectory::_MapFileCommand,this,_1,_2),
+                        "Memory maps a trajectory file written with the aligned binary layout (serialize option 0x4000) and samples directly from it without copying. Any modification of the trajectory copies the data out of the file first.");
     }
 
     bool SortGroups(const ConfigurationSpecification::Group& g1, const ConfigurationSpecification::Group& g2)
@@ -243,9 +364,11 @@ public:
             }
             _InitializeGroupFunctions();
         }
+        _pmappedregion.reset();
         _vtrajdata.clear();
         _vaccumtime.clear();
         _vdeltainvtime.clear();
+        _UpdateDataViews();
         _bChanged = true;
         _bSamplingVerified = false;
         _bInit = true;
@@ -254,10 +377,12 @@ public:
     void ClearWaypoints() override
     {
         if( _bInit ) {
+            _DetachMappedData();
             if( _vtrajdata.size() > 0 ) {
                 _bSamplingVerified = false;
                 _bChanged = true;
                 _vtrajdata.clear();
+                _UpdateDataViews();
             }
         }
     }
@@ -276,6 +401,7 @@ public:
         }
         BOOST_ASSERT(_spec.GetDOF()>0);
         OPENRAVE_ASSERT_FORMAT((nDataElements%_spec.GetDOF()) == 0, "%d does not divide dof %d", nDataElements%_spec.GetDOF(), ORE_InvalidArguments);
+        _DetachMappedData();
         OPENRAVE_ASSERT_OP(index*_spec.GetDOF(),<=,_vtrajdata.size());
         if( bOverwrite && index*_spec.GetDOF() < _vtrajdata.size() ) {
             const size_t copysize = min(nDataElements, _vtrajdata.size()-index*_spec.GetDOF());
@@ -287,6 +413,7 @@ public:
         else {
             _vtrajdata.insert(_vtrajdata.begin()+index*_spec.GetDOF(), pdata, pdata+nDataElements);
         }
+        _UpdateDataViews();
         _bChanged = true;
     }
 
@@ -303,6 +430,7 @@ public:
         }
         BOOST_ASSERT(spec.GetDOF()>0);
         OPENRAVE_ASSERT_FORMAT((nDataElements%spec.GetDOF()) == 0, "%d does not divide dof %d", nDataElements%spec.GetDOF(), ORE_InvalidArguments);
+        _DetachMappedData();
         OPENRAVE_ASSERT_OP(index*_spec.GetDOF(),<=,_vtrajdata.size());
         if( _spec == spec ) {
             Insert(index, pdata, nDataElements, bOverwrite);
@@ -329,6 +457,7 @@ public:
                 _ConvertData(ittargetdata, pdata+sourceindex, vconvertgroups, spec, numelements, true);
                 _vtrajdata.insert(_vtrajdata.begin()+index*_spec.GetDOF(),vtemp.begin(),vtemp.end());
             }
+            _UpdateDataViews();
             _bChanged = true;
         }
     }
@@ -339,9 +468,11 @@ public:
         if( startindex == endindex ) {
             return;
         }
+        _DetachMappedData();
         BOOST_ASSERT(startindex*_spec.GetDOF() <= _vtrajdata.size() && endindex*_spec.GetDOF() <= _vtrajdata.size());
         OPENRAVE_ASSERT_OP(startindex,<,endindex);
         _vtrajdata.erase(_vtrajdata.begin()+startindex*_spec.GetDOF(),_vtrajdata.begin()+endindex*_spec.GetDOF());
+        _UpdateDataViews();
         _bChanged = true;
     }
 
@@ -351,25 +482,25 @@ public:
         BOOST_ASSERT(_timeoffset>=0);
         BOOST_ASSERT(time >= 0);
         _ComputeInternal();
-        OPENRAVE_ASSERT_OP_FORMAT0((int)_vtrajdata.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
+        OPENRAVE_ASSERT_OP_FORMAT0((int)_trajdataview.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
         if( IS_DEBUGLEVEL(Level_Verbose) || (RaveGetDebugLevel() & Level_VerifyPlans) ) {
             _VerifySampling();
         }
         data.resize(0);
         data.resize(_spec.GetDOF(),0);
         if( time >= GetDuration() ) {
-            std::copy(_vtrajdata.end()-_spec.GetDOF(),_vtrajdata.end(),data.begin());
+            std::copy(_trajdataview.end()-_spec.GetDOF(),_trajdataview.end(),data.begin());
         }
         else {
-            std::vector<dReal>::iterator it = std::lower_bound(_vaccumtime.begin(),_vaccumtime.end(),time);
-            if( it == _vaccumtime.begin() ) {
-                std::copy(_vtrajdata.begin(),_vtrajdata.begin()+_spec.GetDOF(),data.begin());
+            const dReal* it = std::lower_bound(_accumtimeview.begin(),_accumtimeview.end(),time);
+            if( it == _accumtimeview.begin() ) {
+                std::copy(_trajdataview.begin(),_trajdataview.begin()+_spec.GetDOF(),data.begin());
                 data.at(_timeoffset) = time;
             }
             else {
-                size_t index = it-_vaccumtime.begin();
-                dReal deltatime = time-_vaccumtime.at(index-1);
-                dReal waypointdeltatime = _vtrajdata.at(_spec.GetDOF()*index + _timeoffset);
+                size_t index = it-_accumtimeview.begin();
+                dReal deltatime = time-_accumtimeview.at(index-1);
+                dReal waypointdeltatime = _trajdataview.at(_spec.GetDOF()*index + _timeoffset);
                 // unfortunately due to floating-point error deltatime might not be in the range [0, waypointdeltatime], so double check!
                 if( deltatime < 0 ) {
                     // most likely small epsilon
@@ -395,7 +526,7 @@ public:
         OPENRAVE_ASSERT_OP(_timeoffset,>=,0);
         OPENRAVE_ASSERT_OP(time, >=, -g_fEpsilon);
         _ComputeInternal();
-        OPENRAVE_ASSERT_OP_FORMAT0((int)_vtrajdata.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
+        OPENRAVE_ASSERT_OP_FORMAT0((int)_trajdataview.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
         if( IS_DEBUGLEVEL(Level_Verbose) || (RaveGetDebugLevel() & Level_VerifyPlans) ) {
             _VerifySampling();
         }
@@ -404,19 +535,19 @@ public:
         }
         data.resize(spec.GetDOF(),0);
         if( time >= GetDuration() ) {
-            ConfigurationSpecification::ConvertData(data.begin(),spec,_vtrajdata.end()-_spec.GetDOF(),_spec,1,GetEnv());
+            _ConvertWaypoints(data.begin(),spec,GetNumWaypoints()-1,1);
         }
         else {
-            std::vector<dReal>::iterator it = std::lower_bound(_vaccumtime.begin(),_vaccumtime.end(),time);
-            if( it == _vaccumtime.begin() ) {
-                ConfigurationSpecification::ConvertData(data.begin(),spec,_vtrajdata.begin(),_spec,1,GetEnv());
+            const dReal* it = std::lower_bound(_accumtimeview.begin(),_accumtimeview.end(),time);
+            if( it == _accumtimeview.begin() ) {
+                _ConvertWaypoints(data.begin(),spec,0,1);
             }
             else {
                 // could be faster
                 vector<dReal> vinternaldata(_spec.GetDOF(),0);
-                size_t index = it-_vaccumtime.begin();
-                dReal deltatime = time-_vaccumtime.at(index-1);
-                dReal waypointdeltatime = _vtrajdata.at(_spec.GetDOF()*index + _timeoffset);
+                size_t index = it-_accumtimeview.begin();
+                dReal deltatime = time-_accumtimeview.at(index-1);
+                dReal waypointdeltatime = _trajdataview.at(_spec.GetDOF()*index + _timeoffset);
                 // unfortunately due to floating-point error deltatime might not be in the range [0, waypointdeltatime], so double check!
                 if( deltatime < 0 ) {
                     // most likely small epsilon
@@ -438,12 +569,48 @@ public:
         }
     }
 
+    void SamplePoints(std::vector<dReal>& data, const std::vector<dReal>& times) const override
+    {
+        data.resize(_spec.GetDOF()*times.size());
+        if( times.size() > 0 ) {
+            SamplePoints(data.data(), times.data(), times.size());
+        }
+    }
+
+    void SamplePoints(std::vector<dReal>& data, const std::vector<dReal>& times, const ConfigurationSpecification& spec) const override
+    {
+        if( spec == _spec ) {
+            return SamplePoints(data, times);
+        }
+
+        std::vector<dReal> dataInSourceSpec;
+        SamplePoints(dataInSourceSpec, times);
+        data.resize(spec.GetDOF()*times.size());
+        if( times.size() > 0 ) {
+            ConfigurationSpecification::ConvertData(data.begin(), spec, dataInSourceSpec.begin(), _spec, times.size(), GetEnv());
+        }
+    }
+
+    void SamplePoints(dReal* pdata, const dReal* ptimes, size_t numtimes) const override
+    {
+        BOOST_ASSERT(_bInit);
+        BOOST_ASSERT(_timeoffset>=0);
+        _ComputeInternal();
+        OPENRAVE_ASSERT_OP_FORMAT0((int)_trajdataview.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
+        if( IS_DEBUGLEVEL(Level_Verbose) || (RaveGetDebugLevel() & Level_VerifyPlans) ) {
+            _VerifySampling();
+        }
+        _SamplePointsInternal(pdata, numtimes, [ptimes](size_t isample) {
+            return ptimes[isample];
+        });
+    }
+
     void SamplePointsSameDeltaTime(std::vector<dReal>& data, dReal deltatime, bool ensureLastPoint) const override
     {
         BOOST_ASSERT(_bInit);
         BOOST_ASSERT(_timeoffset>=0);
         _ComputeInternal();
-        OPENRAVE_ASSERT_OP_FORMAT0((int)_vtrajdata.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
+        OPENRAVE_ASSERT_OP_FORMAT0((int)_trajdataview.size(),>=,_spec.GetDOF(), "trajectory needs at least one point to sample from", ORE_InvalidArguments);
         if( IS_DEBUGLEVEL(Level_Verbose) || (RaveGetDebugLevel() & Level_VerifyPlans) ) {
             _VerifySampling();
         }
@@ -455,53 +622,18 @@ public:
         }
 
         int dof = GetConfigurationSpecification().GetDOF();
-        //std::vector<dReal> dataPerTimestep(dof,0);
         data.resize(dof*numPoints);
-
-        const std::vector<dReal>::const_iterator begin = _vaccumtime.begin();
-        std::vector<dReal>::const_iterator it = begin;
-
-        std::vector<dReal>::iterator itdata = data.begin();
-
-        for(int i = 0; i < (ensureLastPoint ? numPoints-1 : numPoints); ++i, itdata += dof) {
-            dReal sampletime = i * deltatime;
-            if( sampletime >= duration ) {
-                std::copy(_vtrajdata.end() - _spec.GetDOF(), _vtrajdata.end(), itdata);
-            }
-            else {
-                // knowing time always increases, it is safe to search in [it, end] instead of [begin, end]
-                it = std::lower_bound(it, _vaccumtime.cend(), sampletime);
-
-                if( it == begin ) {
-                    std::copy(_vtrajdata.begin(),_vtrajdata.begin()+_spec.GetDOF(),itdata);
-                    *(itdata + _timeoffset) = sampletime;
-                }
-                else {
-                    size_t index = it - begin;
-                    dReal timeFromLowerWaypoint = sampletime - _vaccumtime.at(index-1);
-                    dReal waypointdeltatime = _vtrajdata.at(_spec.GetDOF()*index + _timeoffset);
-                    // unfortunately due to floating-point error timeFromLowerWaypoint might not be in the range [0, waypointdeltatime], so double check!
-                    if( timeFromLowerWaypoint < 0 ) {
-                        // most likely small epsilon
-                        timeFromLowerWaypoint = 0;
-                    }
-                    else if( timeFromLowerWaypoint > waypointdeltatime ) {
-                        timeFromLowerWaypoint = waypointdeltatime;
-                    }
-                    for(size_t j = 0; j < _vgroupinterpolators.size(); ++j) {
-                        if( !!_vgroupinterpolators[j] ) {
-                            _vgroupinterpolators[j](index-1, timeFromLowerWaypoint, itdata);
-                        }
-                    }
-                    // should return the sample time relative to the last endpoint so it is easier to re-insert in the trajectory
-                    *(itdata + _timeoffset) = timeFromLowerWaypoint;
-                }
-            }
+        if( numPoints <= 0 ) {
+            return;
         }
 
+        _SamplePointsInternal(data.data(), ensureLastPoint ? numPoints-1 : numPoints, [deltatime](size_t isample) {
+            return isample * deltatime;
+        });
+
         if (ensureLastPoint) {
-            // copy the last point, itdata should point to that
-            std::copy(_vtrajdata.end() - _spec.GetDOF(), _vtrajdata.end(), itdata);
+            // copy the last point
+            std::copy(_trajdataview.end() - _spec.GetDOF(), _trajdataview.end(), data.end() - dof);
         }
     }
 
@@ -537,24 +669,24 @@ public:
     size_t GetNumWaypoints() const override
     {
         BOOST_ASSERT(_bInit);
-        return _vtrajdata.size()/_spec.GetDOF();
+        return _trajdataview.size()/_spec.GetDOF();
     }
 
     void GetWaypoints(size_t startindex, size_t endindex, std::vector<dReal>& data) const override
     {
         BOOST_ASSERT(_bInit);
-        BOOST_ASSERT(startindex<=endindex && startindex*_spec.GetDOF() <= _vtrajdata.size() && endindex*_spec.GetDOF() <= _vtrajdata.size());
+        BOOST_ASSERT(startindex<=endindex && startindex*_spec.GetDOF() <= _trajdataview.size() && endindex*_spec.GetDOF() <= _trajdataview.size());
         data.resize((endindex-startindex)*_spec.GetDOF(),0);
-        std::copy(_vtrajdata.begin()+startindex*_spec.GetDOF(),_vtrajdata.begin()+endindex*_spec.GetDOF(),data.begin());
+        std::copy(_trajdataview.begin()+startindex*_spec.GetDOF(),_trajdataview.begin()+endindex*_spec.GetDOF(),data.begin());
     }
 
     void GetWaypoints(size_t startindex, size_t endindex, std::vector<dReal>& data, const ConfigurationSpecification& spec) const override
     {
         BOOST_ASSERT(_bInit);
-        BOOST_ASSERT(startindex<=endindex && startindex*_spec.GetDOF() <= _vtrajdata.size() && endindex*_spec.GetDOF() <= _vtrajdata.size());
+        BOOST_ASSERT(startindex<=endindex && startindex*_spec.GetDOF() <= _trajdataview.size() && endindex*_spec.GetDOF() <= _trajdataview.size());
         data.resize(spec.GetDOF()*(endindex-startindex),0);
         if( startindex < endindex ) {
-            ConfigurationSpecification::ConvertData(data.begin(),spec,_vtrajdata.begin()+startindex*_spec.GetDOF(),_spec,endindex-startindex,GetEnv());
+            _ConvertWaypoints(data.begin(),spec,startindex,endindex-startindex);
         }
     }
 
@@ -563,24 +695,24 @@ public:
         BOOST_ASSERT(_bInit);
         BOOST_ASSERT(_timeoffset>=0);
         _ComputeInternal();
-        if( _vaccumtime.size() == 0 ) {
+        if( _accumtimeview.size() == 0 ) {
             return 0;
         }
-        if( time < _vaccumtime.at(0) ) {
+        if( time < _accumtimeview.at(0) ) {
             return 0;
         }
-        if( time >= _vaccumtime.at(_vaccumtime.size()-1) ) {
+        if( time >= _accumtimeview.at(_accumtimeview.size()-1) ) {
             return GetNumWaypoints();
         }
-        std::vector<dReal>::const_iterator itaccum = std::lower_bound(_vaccumtime.begin(), _vaccumtime.end(), time);
-        return itaccum-_vaccumtime.begin();
+        const dReal* itaccum = std::lower_bound(_accumtimeview.begin(), _accumtimeview.end(), time);
+        return itaccum-_accumtimeview.begin();
     }
 
     dReal GetDuration() const override
     {
         BOOST_ASSERT(_bInit);
         _ComputeInternal();
-        return _vaccumtime.size() > 0 ? _vaccumtime.back() : 0;
+        return _accumtimeview.size() > 0 ? _accumtimeview.back() : 0;
     }
 
     // New feature: Store trajectory file in binary
@@ -591,48 +723,55 @@ public:
             TrajectoryBase::serialize(O, options);
         }
         else {
-            // NOTE: Ignore 'options' argument for now
+            // if TRAJECTORY_SERIALIZE_ALIGNED is set, write the aligned layout that can be memory mapped, otherwise ignore 'options' argument for now
+            const bool bAligned = !!(options & TRAJECTORY_SERIALIZE_ALIGNED);
 
             // Write binary file header
             WriteBinaryUInt16(O, BINARY_TRAJECTORY_MAGIC_NUMBER);
-            WriteBinaryUInt16(O, BINARY_TRAJECTORY_VERSION_NUMBER);
+            WriteBinaryUInt16(O, bAligned ? BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER : BINARY_TRAJECTORY_VERSION_NUMBER);
+
+            // for the aligned layout, the meta-data size has to be known in order to pad the data blocks
+            std::stringstream ssmetadata;
+            std::ostream& OMetadata = bAligned ? static_cast<std::ostream&>(ssmetadata) : O;
 
             /* Store meta-data */
 
             // Indicate size of meta data
             const ConfigurationSpecification& spec = this->GetConfigurationSpecification();
             const uint16_t numGroups = spec._vgroups.size();
-            WriteBinaryUInt16(O, numGroups);
+            WriteBinaryUInt16(OMetadata, numGroups);
 
             FOREACHC(itgroup, spec._vgroups)
             {
-                WriteBinaryString(O, itgroup->name);   // Writes group name
-                WriteBinaryInt(O, itgroup->offset);    // Writes offset
-                WriteBinaryInt(O, itgroup->dof);       // Writes dof
-                WriteBinaryString(O, itgroup->interpolation);  // Writes interpolation
+                WriteBinaryString(OMetadata, itgroup->name);   // Writes group name
+                WriteBinaryInt(OMetadata, itgroup->offset);    // Writes offset
+                WriteBinaryInt(OMetadata, itgroup->dof);       // Writes dof
+                WriteBinaryString(OMetadata, itgroup->interpolation);  // Writes interpolation
             }
 
-            /* Store data waypoints */
-            WriteBinaryVector(O, this->_vtrajdata);
+            /* Store data waypoints, the aligned layout stores them after the meta-data */
+            if( !bAligned ) {
+                WriteBinaryVector(OMetadata, _trajdataview.begin(), _trajdataview.size());
+            }
 
-            WriteBinaryString(O, GetDescription());
+            WriteBinaryString(OMetadata, GetDescription());
 
             // Readable interfaces, added on BINARY_TRAJECTORY_VERSION_NUMBER=0x0002
             std::stringstream ss;
             const uint16_t numReadableInterfaces = GetReadableInterfaces().size();
-            WriteBinaryUInt16(O, numReadableInterfaces);
+            WriteBinaryUInt16(OMetadata, numReadableInterfaces);
 
             rapidjson::Document document;
             int zerooptions = 0;
             FOREACHC(itReadableInterface, GetReadableInterfaces()) {
-                WriteBinaryString(O, itReadableInterface->first);  // readable interface id
+                WriteBinaryString(OMetadata, itReadableInterface->first);  // readable interface id
 
                 // try to serialize to json first
                 if (!!itReadableInterface->second) {
                     rapidjson::Value rReadable;
                     if( itReadableInterface->second->SerializeJSON(rReadable, document.GetAllocator(), fUnitScale, zerooptions) ) {
-                        WriteBinaryString(O, rReadable.GetString());
-                        WriteBinaryString(O, "StringReadable");
+                        WriteBinaryString(OMetadata, rReadable.GetString());
+                        WriteBinaryString(OMetadata, "StringReadable");
                         continue;
                     }
                     else {
@@ -647,8 +786,8 @@ public:
                             pHierarchical->SerializeXML(writer, options);
                             writer->Serialize(ss);
 
-                            WriteBinaryString(O, ss.str());
-                            WriteBinaryString(O, "HierarchicalXMLReadable");
+                            WriteBinaryString(OMetadata, ss.str());
+                            WriteBinaryString(OMetadata, "HierarchicalXMLReadable");
                             continue;
                         }
                         else {
@@ -657,8 +796,8 @@ public:
                                 ss.clear();
                                 ss.str(std::string());
                                 writer->Serialize(ss);
-                                WriteBinaryString(O, ss.str());
-                                WriteBinaryString(O, "StringReadable");
+                                WriteBinaryString(OMetadata, ss.str());
+                                WriteBinaryString(OMetadata, "StringReadable");
                                 continue;
                             }
                         }
@@ -666,8 +805,17 @@ public:
                 }
 
                 // if neither json or xml serializable, write an empty string
-                WriteBinaryString(O, "");
-                WriteBinaryString(O, "StringReadable");
+                WriteBinaryString(OMetadata, "");
+                WriteBinaryString(OMetadata, "StringReadable");
+            }
+
+            if( bAligned ) {
+                const std::string metadata = ssmetadata.str();
+                O.write(metadata.c_str(), metadata.size());
+                const size_t numPaddingBytes = GetBinaryPaddingSize(3*sizeof(uint16_t) + metadata.size());
+                WriteBinaryUInt16(O, numPaddingBytes);
+                WriteBinaryPadding(O, numPaddingBytes);
+                _SerializeAlignedData(O);
             }
         }
     }
@@ -687,8 +835,8 @@ public:
             uint16_t versionNumber = 0;
             ReadBinaryUInt16(I, versionNumber);
 
-            // currently supported versions: 0x0001, 0x0002
-            if (versionNumber > BINARY_TRAJECTORY_VERSION_NUMBER || versionNumber < 0x0001)
+            // currently supported versions: 0x0001, 0x0002, 0x0003, 0x0004
+            if (versionNumber > BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER || versionNumber < 0x0001)
             {
                 throw OPENRAVE_EXCEPTION_FORMAT(_("unsupported trajectory format version %d "),versionNumber,ORE_InvalidArguments);
             }
@@ -710,8 +858,11 @@ public:
             }
             this->Init(_spec);
 
-            /* Read trajectory data */
-            ReadBinaryVector(I, this->_vtrajdata);
+            /* Read trajectory data, the aligned layout stores it after the meta-data */
+            if (versionNumber < BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER) {
+                ReadBinaryVector(I, this->_vtrajdata);
+                _UpdateDataViews();
+            }
             ReadBinaryString(I, __description);
 
             // clear out existing readable interfaces
@@ -758,6 +909,13 @@ public:
                     SetReadableInterface(xmlid, readableInterface);
                 }
             }
+
+            if (versionNumber >= BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER) {
+                uint16_t numPaddingBytes = 0;
+                ReadBinaryUInt16(I, numPaddingBytes);
+                I.ignore(numPaddingBytes);
+                _DeserializeAlignedData(I);
+            }
         }
         else {
             // try XML deserialization
@@ -767,6 +925,52 @@ public:
     }
 
     void DeserializeFromRawData(const uint8_t* pdata, size_t nDataSize) override
+    {
+        _DeserializeFromRawData(pdata, nDataSize, boost::shared_ptr<boost::interprocess::mapped_region>());
+    }
+
+    void Clone(InterfaceBaseConstPtr preference, int cloningoptions) override
+    {
+        InterfaceBase::Clone(preference,cloningoptions);
+        TrajectoryBaseConstPtr r = RaveInterfaceConstCast<TrajectoryBase>(preference);
+        Init(r->GetConfigurationSpecification());
+        r->GetWaypoints(0,r->GetNumWaypoints(),_vtrajdata);
+        _UpdateDataViews();
+        _bChanged = true;
+    }
+
+    void Swap(TrajectoryBasePtr rawtraj) override
+    {
+        OPENRAVE_ASSERT_OP(GetXMLId(),==,rawtraj->GetXMLId());
+        boost::shared_ptr<GenericTrajectory> traj = boost::dynamic_pointer_cast<GenericTrajectory>(rawtraj);
+        _spec.Swap(traj->_spec);
+        _vderivoffsets.swap(traj->_vderivoffsets);
+        _vddoffsets.swap(traj->_vddoffsets);
+        _vdddoffsets.swap(traj->_vdddoffsets);
+        _vintegraloffsets.swap(traj->_vintegraloffsets);
+        _viioffsets.swap(traj->_viioffsets);
+        _vgroupbatchdegrees.swap(traj->_vgroupbatchdegrees);
+        std::swap(_timeoffset, traj->_timeoffset);
+        std::swap(_bInit, traj->_bInit);
+        std::swap(_vtrajdata, traj->_vtrajdata);
+        std::swap(_vaccumtime, traj->_vaccumtime);
+        std::swap(_vdeltainvtime, traj->_vdeltainvtime);
+        std::swap(_pmappedregion, traj->_pmappedregion);
+        std::swap(_trajdataview, traj->_trajdataview);
+        std::swap(_accumtimeview, traj->_accumtimeview);
+        std::swap(_deltainvtimeview, traj->_deltainvtimeview);
+        std::swap(_bChanged, traj->_bChanged);
+        std::swap(_bSamplingVerified, traj->_bSamplingVerified);
+        _InitializeGroupFunctions();
+        _UpdateDataViews();
+        traj->_UpdateDataViews();
+    }
+
+protected:
+    /// \brief deserializes the binary trajectory from memory.
+    ///
+    /// \param pmappedregion if not empty, pdata points into this region and the data blocks of the aligned layout are referenced directly instead of copied
+    void _DeserializeFromRawData(const uint8_t* pdata, size_t nDataSize, boost::shared_ptr<boost::interprocess::mapped_region> pmappedregion)
     {
         // Check whether binary or XML file
         const uint8_t* I = pdata;
@@ -779,8 +983,8 @@ public:
             uint16_t versionNumber = 0;
             ReadBinaryUInt16(I, versionNumber);
 
-            // currently supported versions: 0x0001, 0x0002
-            if (versionNumber > BINARY_TRAJECTORY_VERSION_NUMBER || versionNumber < 0x0001)
+            // currently supported versions: 0x0001, 0x0002, 0x0003, 0x0004
+            if (versionNumber > BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER || versionNumber < 0x0001)
             {
                 throw OPENRAVE_EXCEPTION_FORMAT(_("unsupported trajectory format version %d "),versionNumber,ORE_InvalidArguments);
             }
@@ -802,8 +1006,11 @@ public:
             }
             this->Init(_spec);
 
-            /* Read trajectory data */
-            ReadBinaryVector(I, this->_vtrajdata);
+            /* Read trajectory data, the aligned layout stores it after the meta-data */
+            if (versionNumber < BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER) {
+                ReadBinaryVector(I, this->_vtrajdata);
+                _UpdateDataViews();
+            }
             ReadBinaryString(I, __description);
 
             // clear out existing readable interfaces
@@ -850,6 +1057,13 @@ public:
                     SetReadableInterface(xmlid, readableInterface);
                 }
             }
+
+            if (versionNumber >= BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER) {
+                uint16_t numPaddingBytes = 0;
+                ReadBinaryUInt16(I, numPaddingBytes);
+                I += numPaddingBytes;
+                _DeserializeAlignedData(I, pdata, nDataSize, pmappedregion);
+            }
         }
         else {
             // try XML deserialization
@@ -857,36 +1071,193 @@ public:
         }
     }
 
-    void Clone(InterfaceBaseConstPtr preference, int cloningoptions) override
+    /// \brief reads the data block header of the aligned layout and checks that it is compatible with this build
+    template <typename T>
+    void _ReadAlignedDataHeader(T& I, uint64_t& numWaypoints, uint64_t& numAccumTime)
     {
-        InterfaceBase::Clone(preference,cloningoptions);
-        TrajectoryBaseConstPtr r = RaveInterfaceConstCast<TrajectoryBase>(preference);
-        Init(r->GetConfigurationSpecification());
-        r->GetWaypoints(0,r->GetNumWaypoints(),_vtrajdata);
+        uint16_t realSize = 0, reserved = 0;
+        uint32_t dof = 0;
+        ReadBinaryUInt16(I, realSize);
+        ReadBinaryUInt16(I, reserved);
+        ReadBinaryUInt32(I, dof);
+        ReadBinaryUInt64(I, numWaypoints);
+        ReadBinaryUInt64(I, numAccumTime);
+        if( realSize != sizeof(dReal) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("aligned trajectory was written with %d byte reals, but this build uses %d byte reals"), realSize%sizeof(dReal), ORE_InvalidArguments);
+        }
+        if( (int)dof != _spec.GetDOF() ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("aligned trajectory data has dof %d, but its configuration specification has dof %d"), dof%_spec.GetDOF(), ORE_InvalidArguments);
+        }
+        if( numAccumTime != 0 && numAccumTime != numWaypoints ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("aligned trajectory has %d accumulated times for %d waypoints"), numAccumTime%numWaypoints, ORE_InvalidArguments);
+        }
+    }
+
+    /// \brief reads the data blocks of the aligned layout from a stream. The accumulated time index is taken as is instead of recomputed.
+    void _DeserializeAlignedData(std::istream& I)
+    {
+        uint64_t numWaypoints = 0, numAccumTime = 0;
+        _ReadAlignedDataHeader(I, numWaypoints, numAccumTime);
+        I.ignore(BINARY_TRAJECTORY_ALIGNMENT - BINARY_TRAJECTORY_ALIGNED_HEADER_SIZE);
+        ReadBinaryAlignedArray(I, _vaccumtime, numAccumTime);
+        ReadBinaryAlignedArray(I, _vdeltainvtime, numAccumTime);
+        if( !ReadBinaryAlignedArray(I, _vtrajdata, numWaypoints*_spec.GetDOF()) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT0(_("aligned trajectory data is truncated"), ORE_InvalidArguments);
+        }
+        _UpdateDataViews();
+        _bChanged = _timeoffset >= 0 && numAccumTime != numWaypoints;
+        _bSamplingVerified = false;
+    }
+
+    /// \brief reads the data blocks of the aligned layout from memory. If pmappedregion is set, the views point directly into the region.
+    void _DeserializeAlignedData(const uint8_t*& I, const uint8_t* pdata, size_t nDataSize, boost::shared_ptr<boost::interprocess::mapped_region> pmappedregion)
+    {
+        uint64_t numWaypoints = 0, numAccumTime = 0;
+        _ReadAlignedDataHeader(I, numWaypoints, numAccumTime);
+        I += BINARY_TRAJECTORY_ALIGNMENT - BINARY_TRAJECTORY_ALIGNED_HEADER_SIZE;
+
+        const uint64_t accumTimeBytes = numAccumTime*sizeof(dReal);
+        const uint64_t trajDataBytes = numWaypoints*_spec.GetDOF()*sizeof(dReal);
+        const uint64_t dataOffset = I - pdata;
+        const uint64_t requiredSize = dataOffset + 2*(accumTimeBytes + GetBinaryPaddingSize(accumTimeBytes)) + trajDataBytes;
+        if( requiredSize > nDataSize ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("aligned trajectory data is truncated, need %d bytes but have %d"), requiredSize%nDataSize, ORE_InvalidArguments);
+        }
+
+        const dReal* paccumtime = reinterpret_cast<const dReal*>(I);
+        I += accumTimeBytes + GetBinaryPaddingSize(accumTimeBytes);
+        const dReal* pdeltainvtime = reinterpret_cast<const dReal*>(I);
+        I += accumTimeBytes + GetBinaryPaddingSize(accumTimeBytes);
+        const dReal* ptrajdata = reinterpret_cast<const dReal*>(I);
+        I += trajDataBytes + GetBinaryPaddingSize(trajDataBytes);
+
+        if( !!pmappedregion ) {
+            // the region is page aligned, so all the blocks are aligned
+            BOOST_ASSERT(((uintptr_t)pdata % BINARY_TRAJECTORY_ALIGNMENT) == 0);
+            _vtrajdata.clear();
+            _vaccumtime.clear();
+            _vdeltainvtime.clear();
+            _pmappedregion = pmappedregion;
+            _trajdataview = ConstRealArrayView(ptrajdata, numWaypoints*_spec.GetDOF());
+            _accumtimeview = ConstRealArrayView(paccumtime, numAccumTime);
+            _deltainvtimeview = ConstRealArrayView(pdeltainvtime, numAccumTime);
+            if( _timeoffset >= 0 && numAccumTime != numWaypoints ) {
+                // cannot recompute the accumulated time index inside a read-only region
+                _DetachMappedData();
+            }
+        }
+        else {
+            // pdata might not be aligned, so copy byte-wise
+            _vaccumtime.resize(numAccumTime);
+            _vdeltainvtime.resize(numAccumTime);
+            _vtrajdata.resize(numWaypoints*_spec.GetDOF());
+            if( accumTimeBytes > 0 ) {
+                std::copy((const uint8_t*)paccumtime, (const uint8_t*)paccumtime + accumTimeBytes, (uint8_t*)&_vaccumtime[0]);
+                std::copy((const uint8_t*)pdeltainvtime, (const uint8_t*)pdeltainvtime + accumTimeBytes, (uint8_t*)&_vdeltainvtime[0]);
+            }
+            if( trajDataBytes > 0 ) {
+                std::copy((const uint8_t*)ptrajdata, (const uint8_t*)ptrajdata + trajDataBytes, (uint8_t*)&_vtrajdata[0]);
+            }
+            _UpdateDataViews();
+        }
+        _bChanged = _timeoffset >= 0 && numAccumTime != numWaypoints;
+        _bSamplingVerified = false;
+    }
+
+    /// \brief writes the data blocks of the aligned layout. Assumes the stream is currently aligned to BINARY_TRAJECTORY_ALIGNMENT relative to the start of the trajectory.
+    void _SerializeAlignedData(std::ostream& O) const
+    {
+        _ComputeInternal();
+        const uint32_t dof = _spec.GetDOF();
+        const uint64_t numWaypoints = dof > 0 ? _trajdataview.size()/dof : 0;
+        WriteBinaryUInt16(O, sizeof(dReal));
+        WriteBinaryUInt16(O, 0); // reserved
+        WriteBinaryUInt32(O, dof);
+        WriteBinaryUInt64(O, numWaypoints);
+        WriteBinaryUInt64(O, _accumtimeview.size());
+        WriteBinaryPadding(O, BINARY_TRAJECTORY_ALIGNMENT - BINARY_TRAJECTORY_ALIGNED_HEADER_SIZE);
+        WriteBinaryAlignedArray(O, _accumtimeview.begin(), _accumtimeview.size());
+        WriteBinaryAlignedArray(O, _deltainvtimeview.begin(), _deltainvtimeview.size());
+        WriteBinaryAlignedArray(O, _trajdataview.begin(), _trajdataview.size());
+    }
+
+    /// \brief memory maps a trajectory file in the aligned layout and samples from it without copying
+    void _MapFile(const std::string& filename)
+    {
+        boost::shared_ptr<boost::interprocess::mapped_region> pmappedregion;
+        try {
+            boost::interprocess::file_mapping filemapping(filename.c_str(), boost::interprocess::read_only);
+            pmappedregion.reset(new boost::interprocess::mapped_region(filemapping, boost::interprocess::read_only));
+        }
+        catch(const boost::interprocess::interprocess_exception& ex) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("failed to memory map trajectory file '%s': %s"), filename%ex.what(), ORE_InvalidArguments);
+        }
+
+        const uint8_t* pdata = static_cast<const uint8_t*>(pmappedregion->get_address());
+        const size_t nDataSize = pmappedregion->get_size();
+        if( nDataSize < 2*sizeof(uint16_t) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("trajectory file '%s' is too small to be memory mapped"), filename, ORE_InvalidArguments);
+        }
+        const uint8_t* I = pdata;
+        uint16_t binaryFileHeader = 0, versionNumber = 0;
+        ReadBinaryUInt16(I, binaryFileHeader);
+        ReadBinaryUInt16(I, versionNumber);
+        if( binaryFileHeader != BINARY_TRAJECTORY_MAGIC_NUMBER || versionNumber != BINARY_TRAJECTORY_ALIGNED_VERSION_NUMBER ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("trajectory file '%s' is not in the aligned binary layout, serialize it with option 0x%x first"), filename%TRAJECTORY_SERIALIZE_ALIGNED, ORE_InvalidArguments);
+        }
+        _DeserializeFromRawData(pdata, nDataSize, pmappedregion);
+    }
+
+    bool _MapFileCommand(std::ostream& sout, std::istream& sinput)
+    {
+        std::string filename;
+        sinput >> filename;
+        if( !sinput ) {
+            return false;
+        }
+        _MapFile(filename);
+        return true;
+    }
+
+    /// \brief if the waypoints are memory mapped, copies them into _vtrajdata so that they can be modified
+    void _DetachMappedData()
+    {
+        if( !_pmappedregion ) {
+            return;
+        }
+        _vtrajdata.assign(_trajdataview.begin(), _trajdataview.end());
+        _vaccumtime.clear();
+        _vdeltainvtime.clear();
+        _pmappedregion.reset();
+        _UpdateDataViews();
         _bChanged = true;
+        _bSamplingVerified = false;
     }
 
-    void Swap(TrajectoryBasePtr rawtraj) override
+    /// \brief points the data views to the owned vectors. Has to be called every time the vectors are reallocated.
+    void _UpdateDataViews() const
     {
-        OPENRAVE_ASSERT_OP(GetXMLId(),==,rawtraj->GetXMLId());
-        boost::shared_ptr<GenericTrajectory> traj = boost::dynamic_pointer_cast<GenericTrajectory>(rawtraj);
-        _spec.Swap(traj->_spec);
-        _vderivoffsets.swap(traj->_vderivoffsets);
-        _vddoffsets.swap(traj->_vddoffsets);
-        _vdddoffsets.swap(traj->_vdddoffsets);
-        _vintegraloffsets.swap(traj->_vintegraloffsets);
-        _viioffsets.swap(traj->_viioffsets);
-        std::swap(_timeoffset, traj->_timeoffset);
-        std::swap(_bInit, traj->_bInit);
-        std::swap(_vtrajdata, traj->_vtrajdata);
-        std::swap(_vaccumtime, traj->_vaccumtime);
-        std::swap(_vdeltainvtime, traj->_vdeltainvtime);
-        std::swap(_bChanged, traj->_bChanged);
-        std::swap(_bSamplingVerified, traj->_bSamplingVerified);
-        _InitializeGroupFunctions();
+        if( !!_pmappedregion ) {
+            return;
+        }
+        _trajdataview = ConstRealArrayView(_vtrajdata.data(), _vtrajdata.size());
+        _accumtimeview = ConstRealArrayView(_vaccumtime.data(), _vaccumtime.size());
+        _deltainvtimeview = ConstRealArrayView(_vdeltainvtime.data(), _vdeltainvtime.size());
+    }
+
+    /// \brief converts numpoints waypoints starting at startindex into spec
+    void _ConvertWaypoints(std::vector<dReal>::iterator ittargetdata, const ConfigurationSpecification& spec, size_t startindex, size_t numpoints) const
+    {
+        if( !_pmappedregion ) {
+            ConfigurationSpecification::ConvertData(ittargetdata, spec, _vtrajdata.begin()+startindex*_spec.GetDOF(), _spec, numpoints, GetEnv());
+        }
+        else {
+            // ConvertData only accepts vector iterators
+            std::vector<dReal> vtemp(_trajdataview.begin()+startindex*_spec.GetDOF(), _trajdataview.begin()+(startindex+numpoints)*_spec.GetDOF());
+            ConfigurationSpecification::ConvertData(ittargetdata, spec, vtemp.begin(), _spec, numpoints, GetEnv());
+        }
     }
 
-protected:
     void _ConvertData(std::vector<dReal>::iterator ittargetdata, const dReal* psourcedata, const std::vector< std::vector<ConfigurationSpecification::Group>::const_iterator >& vconvertgroups, const ConfigurationSpecification& spec, size_t numelements, bool filluninitialized)
     {
         for(size_t igroup = 0; igroup < vconvertgroups.size(); ++igroup) {
@@ -919,6 +1290,142 @@ protected:
         }
     }
 
+    /// \brief samples numtimes points into pdata with a single pass over the waypoints. Assumes _ComputeInternal has finished.
+    ///
+    /// The polynomial coefficients of a segment are computed once for all the samples in it, groups without a polynomial form fall back to _vgroupinterpolators.
+    /// \param timefn returns the time of the i-th sample, times are expected to be increasing
+    template <typename TimeFunction>
+    void _SamplePointsInternal(dReal* pdata, size_t numtimes, const TimeFunction& timefn) const
+    {
+        const int dof = _spec.GetDOF();
+        const dReal duration = GetDuration();
+        const dReal* pbegin = _accumtimeview.begin();
+        const dReal* pend = _accumtimeview.end();
+        const dReal* it = pbegin;
+
+        std::vector<dReal> vcoeffs(4*dof, 0); // c0, c1, c2, c3 of the current segment, each indexed by the dof offset
+        std::vector<dReal> vtempdata(dof, 0); // for groups sampled through _vgroupinterpolators
+        const dReal* c0 = &vcoeffs[0], *c1 = &vcoeffs[dof], *c2 = &vcoeffs[2*dof], *c3 = &vcoeffs[3*dof];
+        size_t coeffsindex = 0; // index of the waypoint that ends the segment stored in vcoeffs, 0 if none
+
+        for(size_t isample = 0; isample < numtimes; ++isample, pdata += dof) {
+            const dReal sampletime = timefn(isample);
+            if( sampletime >= duration ) {
+                std::copy(_trajdataview.end() - dof, _trajdataview.end(), pdata);
+                continue;
+            }
+
+            // find the first accumulated time >= sampletime, same as std::lower_bound
+            if( it != pbegin && sampletime <= *(it-1) ) {
+                // time went backwards, so have to search again
+                it = std::lower_bound(pbegin, it, sampletime);
+            }
+            else {
+                while( it != pend && *it < sampletime ) {
+                    ++it;
+                }
+            }
+
+            if( it == pbegin ) {
+                std::copy(_trajdataview.begin(), _trajdataview.begin()+dof, pdata);
+                pdata[_timeoffset] = sampletime;
+                continue;
+            }
+
+            const size_t index = it - pbegin;
+            dReal deltatime = sampletime - pbegin[index-1];
+            const dReal waypointdeltatime = _trajdataview[dof*index + _timeoffset];
+            // unfortunately due to floating-point error deltatime might not be in the range [0, waypointdeltatime], so double check!
+            if( deltatime < 0 ) {
+                // most likely small epsilon
+                deltatime = 0;
+            }
+            else if( deltatime > waypointdeltatime ) {
+                deltatime = waypointdeltatime;
+            }
+
+            if( coeffsindex != index ) {
+                _ComputeSegmentCoefficients(index-1, vcoeffs);
+                coeffsindex = index;
+            }
+
+            for(size_t igroup = 0; igroup < _spec._vgroups.size(); ++igroup) {
+                const ConfigurationSpecification::Group& g = _spec._vgroups[igroup];
+                const int degree = _vgroupbatchdegrees[igroup];
+                if( degree > 0 ) {
+                    if( degree > 1 && deltatime <= g_fEpsilon ) {
+                        // same as the interpolators, return the start of the segment
+                        std::copy(c0+g.offset, c0+g.offset+g.dof, pdata+g.offset);
+                    }
+                    else {
+                        EvaluateCubicPolynomials(pdata+g.offset, c0+g.offset, c1+g.offset, c2+g.offset, c3+g.offset, g.dof, deltatime);
+                    }
+                }
+                else if( g.offset == _timeoffset ) {
+                    // set below
+                }
+                else if( !!_vgroupinterpolators[igroup] ) {
+                    _vgroupinterpolators[igroup](index-1, deltatime, vtempdata.begin());
+                    std::copy(vtempdata.begin()+g.offset, vtempdata.begin()+g.offset+g.dof, pdata+g.offset);
+                }
+                else {
+                    std::fill(pdata+g.offset, pdata+g.offset+g.dof, dReal(0));
+                }
+            }
+            // should return the sample time relative to the last endpoint so it is easier to re-insert in the trajectory
+            pdata[_timeoffset] = deltatime;
+        }
+    }
+
+    /// \brief computes the polynomial coefficients of the segment [ipoint, ipoint+1] for all groups with _vgroupbatchdegrees > 0. Matches _InterpolateLinear, _InterpolateQuadratic and _InterpolateCubic.
+    void _ComputeSegmentCoefficients(size_t ipoint, std::vector<dReal>& vcoeffs) const
+    {
+        const int dof = _spec.GetDOF();
+        const dReal* p0 = _trajdataview.begin() + ipoint*dof;
+        const dReal* p1 = p0 + dof;
+        dReal* c0 = &vcoeffs[0], *c1 = &vcoeffs[dof], *c2 = &vcoeffs[2*dof], *c3 = &vcoeffs[3*dof];
+        const dReal ideltatime = _deltainvtimeview[ipoint+1];
+        const dReal ideltatime2 = ideltatime*ideltatime;
+        const dReal ideltatime3 = ideltatime2*ideltatime;
+        for(size_t igroup = 0; igroup < _spec._vgroups.size(); ++igroup) {
+            const int degree = _vgroupbatchdegrees[igroup];
+            if( degree <= 0 ) {
+                continue;
+            }
+            const ConfigurationSpecification::Group& g = _spec._vgroups[igroup];
+            const int derivoffset = _vderivoffsets[g.offset];
+            const int integraloffset = _vintegraloffsets[g.offset];
+            for(int i = 0; i < g.dof; ++i) {
+                const int j = g.offset+i;
+                c0[j] = p0[j];
+                c2[j] = 0;
+                c3[j] = 0;
+                if( degree == 1 ) {
+                    c1[j] = derivoffset < 0 ? (p1[j]-p0[j])*ideltatime : p1[derivoffset+i];
+                }
+                else if( degree == 2 ) {
+                    if( derivoffset >= 0 ) {
+                        c1[j] = p0[derivoffset+i];
+                        c2[j] = 0.5*ideltatime*(p1[derivoffset+i]-p0[derivoffset+i]);
+                    }
+                    else {
+                        const dReal c1TimesDelta = 6*(p1[integraloffset+i]-p0[integraloffset+i])*ideltatime - 4*p0[j] - 2*p1[j];
+                        c1[j] = c1TimesDelta*ideltatime;
+                        c2[j] = (p1[j] - p0[j] - c1TimesDelta)*ideltatime2;
+                    }
+                }
+                else {
+                    const dReal deriv0 = p0[derivoffset+i];
+                    const dReal deriv1 = p1[derivoffset+i];
+                    const dReal px = p1[j] - p0[j];
+                    c1[j] = deriv0;
+                    c2[j] = 3*px*ideltatime2 - (2*deriv0+deriv1)*ideltatime;
+                    c3[j] = (deriv1+deriv0)*ideltatime2 - 2*px*ideltatime3;
+                }
+            }
+        }
+    }
+
     void _ComputeInternal() const
     {
         if( !_bChanged ) {
@@ -932,12 +1439,13 @@ protected:
             _vaccumtime.resize(GetNumWaypoints());
             _vdeltainvtime.resize(_vaccumtime.size());
             if( _vaccumtime.size() == 0 ) {
+                _UpdateDataViews();
                 return;
             }
-            _vaccumtime.at(0) = _vtrajdata.at(_timeoffset);
-            _vdeltainvtime.at(0) = 1/_vtrajdata.at(_timeoffset);
+            _vaccumtime.at(0) = _trajdataview.at(_timeoffset);
+            _vdeltainvtime.at(0) = 1/_trajdataview.at(_timeoffset);
             for(size_t i = 1; i < _vaccumtime.size(); ++i) {
-                dReal deltatime = _vtrajdata[_spec.GetDOF()*i+_timeoffset];
+                dReal deltatime = _trajdataview[_spec.GetDOF()*i+_timeoffset];
                 if( deltatime < 0 ) {
                     throw OPENRAVE_EXCEPTION_FORMAT("deltatime (%.15e) is < 0 at point %d/%d", deltatime%i%_vaccumtime.size(), ORE_InvalidState);
                 }
@@ -945,6 +1453,7 @@ protected:
                 _vaccumtime[i] = _vaccumtime[i-1] + deltatime;
             }
         }
+        _UpdateDataViews();
         _bChanged = false;
         _bSamplingVerified = false;
     }
@@ -977,8 +1486,8 @@ protected:
 
         if( IS_DEBUGLEVEL(Level_Debug) || (RaveGetDebugLevel() & Level_VerifyPlans) ) {
             // go through all the points
-            for(size_t ipoint = 0; ipoint+1 < _vaccumtime.size(); ++ipoint) {
-                dReal deltatime = _vaccumtime[ipoint+1] - _vaccumtime[ipoint];
+            for(size_t ipoint = 0; ipoint+1 < _accumtimeview.size(); ++ipoint) {
+                dReal deltatime = _accumtimeview[ipoint+1] - _accumtimeview[ipoint];
                 for(size_t i = 0; i < _vgroupvalidators.size(); ++i) {
                     if( !!_vgroupvalidators[i] ) {
                         _vgroupvalidators[i](ipoint,deltatime);
@@ -1000,7 +1509,9 @@ protected:
         _vdddoffsets.resize(0);
         _vintegraloffsets.resize(0);
         _viioffsets.resize(0);
+        _vgroupbatchdegrees.resize(0);
         _vgroupinterpolators.resize(_spec._vgroups.size());
+        _vgroupbatchdegrees.resize(_spec._vgroups.size(), 0);
         _vgroupvalidators.resize(_spec._vgroups.size());
         _vderivoffsets.resize(_spec.GetDOF(),-1);
         _vddoffsets.resize(_spec.GetDOF(),-1);
@@ -1030,6 +1541,7 @@ protected:
                 else {
                     _vgroupinterpolators[i] = boost::bind(&GenericTrajectory::_InterpolateLinear,this,boost::ref(_spec._vgroups[i]),_1,_2,_3);
                     _vgroupvalidators[i] = boost::bind(&GenericTrajectory::_ValidateLinear,this,boost::ref(_spec._vgroups[i]),_1,_2);
+                    _vgroupbatchdegrees[i] = 1;
                 }
                 nNeedNeighboringInfo = 2;
             }
@@ -1046,6 +1558,7 @@ protected:
                 else {
                     _vgroupinterpolators[i] = boost::bind(&GenericTrajectory::_InterpolateQuadratic,this,boost::ref(_spec._vgroups[i]),_1,_2,_3);
                     _vgroupvalidators[i] = boost::bind(&GenericTrajectory::_ValidateQuadratic,this,boost::ref(_spec._vgroups[i]),_1,_2);
+                    _vgroupbatchdegrees[i] = 2;
                 }
                 nNeedNeighboringInfo = 3;
             }
@@ -1060,6 +1573,7 @@ protected:
                 else {
                     _vgroupinterpolators[i] = boost::bind(&GenericTrajectory::_InterpolateCubic,this,boost::ref(_spec._vgroups[i]),_1,_2,_3);
                     _vgroupvalidators[i] = boost::bind(&GenericTrajectory::_ValidateCubic,this,boost::ref(_spec._vgroups[i]),_1,_2);
+                    _vgroupbatchdegrees[i] = 3;
                 }
                 nNeedNeighboringInfo = 3;
             }
@@ -1185,25 +1699,34 @@ protected:
                     }
                 }
             }
+
+            // batch sampling only has the polynomial forms that do not need the sample time for computing the coefficients
+            if( _vgroupbatchdegrees[i] > 1 && _spec._vgroups[i].dof > 0 ) {
+                const int derivoffset = _vderivoffsets[_spec._vgroups[i].offset];
+                const int integraloffset = _vintegraloffsets[_spec._vgroups[i].offset];
+                if( derivoffset < 0 && (_vgroupbatchdegrees[i] == 3 || integraloffset < 0) ) {
+                    _vgroupbatchdegrees[i] = 0;
+                }
+            }
         }
     }
 
     void _InterpolatePrevious(const ConfigurationSpecification::Group& g, size_t ipoint, dReal deltatime, const std::vector<dReal>::iterator& itdata)
     {
         size_t offset = ipoint*_spec.GetDOF()+g.offset;
-        if( (ipoint+1)*_spec.GetDOF() < _vtrajdata.size() ) {
+        if( (ipoint+1)*_spec.GetDOF() < _trajdataview.size() ) {
             // if point is so close the previous, then choose the next
-            dReal f = _vdeltainvtime.at(ipoint+1)*deltatime;
+            dReal f = _deltainvtimeview.at(ipoint+1)*deltatime;
             if( f > 1-g_fEpsilon ) {
                 offset += _spec.GetDOF();
             }
         }
-        std::copy(_vtrajdata.begin()+offset,_vtrajdata.begin()+offset+g.dof,itdata+g.offset);
+        std::copy(_trajdataview.begin()+offset,_trajdataview.begin()+offset+g.dof,itdata+g.offset);
     }
 
     void _InterpolateNext(const ConfigurationSpecification::Group& g, size_t ipoint, dReal deltatime, const std::vector<dReal>::iterator& itdata)
     {
-        if( (ipoint+1)*_spec.GetDOF() < _vtrajdata.size() ) {
+        if( (ipoint+1)*_spec.GetDOF() < _trajdataview.size() ) {
             ipoint += 1;
         }
         size_t offset = ipoint*_spec.GetDOF() + g.offset;
@@ -1211,7 +1734,7 @@ protected:
             // if point is so close the previous, then choose the previous
             offset -= _spec.GetDOF();
         }
-        std::copy(_vtrajdata.begin()+offset,_vtrajdata.begin()+offset+g.dof,itdata+g.offset);
+        std::copy(_trajdataview.begin()+offset,_trajdataview.begin()+offset+g.dof,itdata+g.offset);
     }
 
     void _InterpolateLinear(const ConfigurationSpecification::Group& g, size_t ipoint, dReal deltatime, const std::vector<dReal>::iterator& itdata)
@@ -1220,15 +1743,15 @@ protected:
         int derivoffset = _vderivoffsets[g.offset];
         if( derivoffset < 0 ) {
             // expected derivative offset, interpolation can be wrong for circular joints
-            dReal f = _vdeltainvtime.at(ipoint+1)*deltatime;
+            dReal f = _deltainvtimeview.at(ipoint+1)*deltatime;
             for(int i = 0; i < g.dof; ++i) {
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i]*(1-f) + f*_vtrajdata[_spec.GetDOF()+offset+g.offset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i]*(1-f) + f*_trajdataview[_spec.GetDOF()+offset+g.offset+i];
             }
         }
         else {
             for(int i = 0; i < g.dof; ++i) {
-                dReal deriv0 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i] + deltatime*deriv0;
+                dReal deriv0 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i] + deltatime*deriv0;
             }
         }
     }
@@ -1238,13 +1761,13 @@ protected:
         _InterpolateLinear(g,ipoint,deltatime,itdata);
         if( deltatime > g_fEpsilon ) {
             size_t offset = ipoint*_spec.GetDOF();
-            dReal f = _vdeltainvtime.at(ipoint+1)*deltatime;
+            dReal f = _deltainvtimeview.at(ipoint+1)*deltatime;
             switch(iktype) {
             case IKP_Rotation3D:
             case IKP_Transform6D: {
                 Vector q0, q1;
-                q0.Set4(&_vtrajdata[offset+g.offset]);
-                q1.Set4(&_vtrajdata[_spec.GetDOF()+offset+g.offset]);
+                q0.Set4(&_trajdataview[offset+g.offset]);
+                q1.Set4(&_trajdataview[_spec.GetDOF()+offset+g.offset]);
                 Vector q = quatSlerp(q0,q1,f);
                 *(itdata + g.offset+0) = q[0];
                 *(itdata + g.offset+1) = q[1];
@@ -1253,8 +1776,8 @@ protected:
                 break;
             }
             case IKP_TranslationDirection5D: {
-                Vector dir0(_vtrajdata[offset+g.offset+0],_vtrajdata[offset+g.offset+1],_vtrajdata[offset+g.offset+2]);
-                Vector dir1(_vtrajdata[_spec.GetDOF()+offset+g.offset+0],_vtrajdata[_spec.GetDOF()+offset+g.offset+1],_vtrajdata[_spec.GetDOF()+offset+g.offset+2]);
+                Vector dir0(_trajdataview[offset+g.offset+0],_trajdataview[offset+g.offset+1],_trajdataview[offset+g.offset+2]);
+                Vector dir1(_trajdataview[_spec.GetDOF()+offset+g.offset+0],_trajdataview[_spec.GetDOF()+offset+g.offset+1],_trajdataview[_spec.GetDOF()+offset+g.offset+2]);
                 Vector axisangle = dir0.cross(dir1);
                 dReal fsinangle = RaveSqrt(axisangle.lengthsqr3());
                 if( fsinangle > g_fEpsilon ) {
@@ -1280,14 +1803,14 @@ protected:
             if( derivoffset >= 0 ) {
                 for(int i = 0; i < g.dof; ++i) {
                     // coeff*t^2 + deriv0*t + pos0
-                    dReal deriv0 = _vtrajdata[offset+derivoffset+i];
-                    dReal deriv1 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                    dReal coeff = 0.5*_vdeltainvtime.at(ipoint+1)*(deriv1-deriv0);
-                    *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i] + deltatime*(deriv0 + deltatime*coeff);
+                    dReal deriv0 = _trajdataview[offset+derivoffset+i];
+                    dReal deriv1 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                    dReal coeff = 0.5*_deltainvtimeview.at(ipoint+1)*(deriv1-deriv0);
+                    *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i] + deltatime*(deriv0 + deltatime*coeff);
                 }
             }
             else {
-                dReal ideltatime = _vdeltainvtime.at(ipoint+1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint+1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 int integraloffset = _vintegraloffsets[g.offset];
                 for(int i = 0; i < g.dof; ++i) {
@@ -1297,10 +1820,10 @@ protected:
                     // mult by (3/deltatime): c2*deltatime**2 + 3/2*c1*deltatime + 3*v0 = 3*(p1-p0)/deltatime
                     // subtract by original: 0.5*c1*deltatime + 2*v0 - 3*(p1-p0)/deltatime + v1 = 0
                     // c1*deltatime = 6*(p1-p0)/deltatime - 4*v0 - 2*v1
-                    dReal integral0 = _vtrajdata[offset+integraloffset+i];
-                    dReal integral1 = _vtrajdata[_spec.GetDOF()+offset+integraloffset+i];
-                    dReal value0 = _vtrajdata[offset+g.offset+i];
-                    dReal value1 = _vtrajdata[_spec.GetDOF()+offset+g.offset+i];
+                    dReal integral0 = _trajdataview[offset+integraloffset+i];
+                    dReal integral1 = _trajdataview[_spec.GetDOF()+offset+integraloffset+i];
+                    dReal value0 = _trajdataview[offset+g.offset+i];
+                    dReal value1 = _trajdataview[_spec.GetDOF()+offset+g.offset+i];
                     dReal c1TimesDelta = 6*(integral1-integral0)*ideltatime - 4*value0 - 2*value1;
                     dReal c1 = c1TimesDelta*ideltatime;
                     dReal c2 = (value1 - value0 - c1TimesDelta)*ideltatime2;
@@ -1310,7 +1833,7 @@ protected:
         }
         else {
             for(int i = 0; i < g.dof; ++i) {
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i];
             }
         }
     }
@@ -1325,13 +1848,13 @@ protected:
             switch(iktype) {
             case IKP_Rotation3D:
             case IKP_Transform6D: {
-                q0.Set4(&_vtrajdata[offset+g.offset]);
-                q0vel.Set4(&_vtrajdata[offset+derivoffset]);
-                q1.Set4(&_vtrajdata[_spec.GetDOF()+offset+g.offset]);
-                q1vel.Set4(&_vtrajdata[_spec.GetDOF()+offset+derivoffset]);
+                q0.Set4(&_trajdataview[offset+g.offset]);
+                q0vel.Set4(&_trajdataview[offset+derivoffset]);
+                q1.Set4(&_trajdataview[_spec.GetDOF()+offset+g.offset]);
+                q1vel.Set4(&_trajdataview[_spec.GetDOF()+offset+derivoffset]);
                 Vector angularvelocity0 = quatMultiply(q0vel,quatInverse(q0))*2;
                 Vector angularvelocity1 = quatMultiply(q1vel,quatInverse(q1))*2;
-                Vector coeff = (angularvelocity1-angularvelocity0)*(0.5*_vdeltainvtime.at(ipoint+1));
+                Vector coeff = (angularvelocity1-angularvelocity0)*(0.5*_deltainvtimeview.at(ipoint+1));
                 Vector vtotaldelta = angularvelocity0*deltatime + coeff*(deltatime*deltatime);
                 Vector q = quatMultiply(quatFromAxisAngle(Vector(vtotaldelta.y,vtotaldelta.z,vtotaldelta.w)),q0);
                 *(itdata + g.offset+0) = q[0];
@@ -1342,13 +1865,13 @@ protected:
             }
             case IKP_TranslationDirection5D: {
                 Vector dir0, dir1, angularvelocity0, angularvelocity1;
-                dir0.Set3(&_vtrajdata[offset+g.offset]);
-                dir1.Set3(&_vtrajdata[_spec.GetDOF()+offset+g.offset]);
+                dir0.Set3(&_trajdataview[offset+g.offset]);
+                dir1.Set3(&_trajdataview[_spec.GetDOF()+offset+g.offset]);
                 Vector axisangle = dir0.cross(dir1);
                 if( axisangle.lengthsqr3() > g_fEpsilon ) {
-                    angularvelocity0.Set3(&_vtrajdata[offset+derivoffset]);
-                    angularvelocity1.Set3(&_vtrajdata[_spec.GetDOF()+offset+derivoffset]);
-                    Vector coeff = (angularvelocity1-angularvelocity0)*(0.5*_vdeltainvtime.at(ipoint+1));
+                    angularvelocity0.Set3(&_trajdataview[offset+derivoffset]);
+                    angularvelocity1.Set3(&_trajdataview[_spec.GetDOF()+offset+derivoffset]);
+                    Vector coeff = (angularvelocity1-angularvelocity0)*(0.5*_deltainvtimeview.at(ipoint+1));
                     Vector vtotaldelta = angularvelocity0*deltatime + coeff*(deltatime*deltatime);
                     Vector newdir = quatRotate(quatFromAxisAngle(vtotaldelta),dir0);
                     *(itdata + g.offset+0) = newdir[0];
@@ -1380,17 +1903,17 @@ protected:
                 // c2 = (3*(x1 - x0) - 2*v0*dt - v1*dt)/(dt**2)
                 // c1 = v0
                 // c0 = p0
-                dReal ideltatime = _vdeltainvtime.at(ipoint+1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint+1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 dReal ideltatime3 = ideltatime2*ideltatime;
                 for(int i = 0; i < g.dof; ++i) {
                     // coeff*t^2 + deriv0*t + pos0
-                    dReal deriv0 = _vtrajdata[offset+derivoffset+i];
-                    dReal deriv1 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                    dReal px = _vtrajdata.at(_spec.GetDOF()+offset+g.offset+i) - _vtrajdata[offset+g.offset+i];
+                    dReal deriv0 = _trajdataview[offset+derivoffset+i];
+                    dReal deriv1 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                    dReal px = _trajdataview.at(_spec.GetDOF()+offset+g.offset+i) - _trajdataview[offset+g.offset+i];
                     dReal c3 = (deriv1+deriv0)*ideltatime2 - 2*px*ideltatime3;
                     dReal c2 = 3*px*ideltatime2 - (2*deriv0+deriv1)*ideltatime;
-                    *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i] + deltatime*(deriv0 + deltatime*(c2 + deltatime*c3));
+                    *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i] + deltatime*(deriv0 + deltatime*(c2 + deltatime*c3));
                 }
             }
             else if( integoffset >= 0 && iioffset >= 0 ) {
@@ -1409,19 +1932,19 @@ protected:
                 // c2 = ((18*x0 - 12*x1)*dt**2 + 84*(i1 - i0)*dt - 180*(ii1 - ii0 - i0*dt))/(dt**4)
                 // c1 = ((3*x1 - 9*x0)*dt**2 - 24*(i1 - i0)*dt + 60*(ii1 - ii0 - i0*dt))/(dt**3)
                 // c0 = x0
-                dReal ideltatime = _vdeltainvtime.at(ipoint + 1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint + 1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 dReal ideltatime3 = ideltatime2*ideltatime;
                 dReal ideltatime4 = ideltatime3*ideltatime;
                 dReal ideltatime5 = ideltatime4*ideltatime;
                 for(int i = 0; i < g.dof; ++i) {
-                    dReal integ0 = _vtrajdata[offset + integoffset + i];
-                    dReal idiff = _vtrajdata[_spec.GetDOF() + offset + integoffset + i] - integ0; // i1 - i0
-                    dReal temp = _vtrajdata[_spec.GetDOF() + offset + iioffset + i] - _vtrajdata[offset + iioffset + i] - integ0*deltatime; // ii1 - ii0 - i0*dt
-                    dReal c3 =    10*(_vtrajdata.at(_spec.GetDOF() + offset + g.offset + i) - _vtrajdata[offset + g.offset + i])*ideltatime3 - 60*idiff*ideltatime4 + 120*temp*ideltatime5;
-                    dReal c2 = (18*_vtrajdata[offset + g.offset + i] - 12*_vtrajdata.at(_spec.GetDOF() + offset + g.offset + i))*ideltatime2 + 84*idiff*ideltatime3 - 180*temp*ideltatime4;
-                    dReal c1 = ( -9*_vtrajdata[offset + g.offset + i] + 3*_vtrajdata.at(_spec.GetDOF() + offset + g.offset + i))*ideltatime  - 24*idiff*ideltatime2 +  60*temp*ideltatime3;
-                    *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i] + deltatime*(c1 + deltatime*(c2 + deltatime*c3));
+                    dReal integ0 = _trajdataview[offset + integoffset + i];
+                    dReal idiff = _trajdataview[_spec.GetDOF() + offset + integoffset + i] - integ0; // i1 - i0
+                    dReal temp = _trajdataview[_spec.GetDOF() + offset + iioffset + i] - _trajdataview[offset + iioffset + i] - integ0*deltatime; // ii1 - ii0 - i0*dt
+                    dReal c3 =    10*(_trajdataview.at(_spec.GetDOF() + offset + g.offset + i) - _trajdataview[offset + g.offset + i])*ideltatime3 - 60*idiff*ideltatime4 + 120*temp*ideltatime5;
+                    dReal c2 = (18*_trajdataview[offset + g.offset + i] - 12*_trajdataview.at(_spec.GetDOF() + offset + g.offset + i))*ideltatime2 + 84*idiff*ideltatime3 - 180*temp*ideltatime4;
+                    dReal c1 = ( -9*_trajdataview[offset + g.offset + i] + 3*_trajdataview.at(_spec.GetDOF() + offset + g.offset + i))*ideltatime  - 24*idiff*ideltatime2 +  60*temp*ideltatime3;
+                    *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i] + deltatime*(c1 + deltatime*(c2 + deltatime*c3));
                 }
             }
             else {
@@ -1430,7 +1953,7 @@ protected:
         }
         else {
             for(int i = 0; i < g.dof; ++i) {
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i];
             }
         }
     }
@@ -1451,20 +1974,20 @@ protected:
                 switch( iktype ) {
                 case IKP_Rotation3D:
                 case IKP_Transform6D: {
-                    q0.Set4(&_vtrajdata[offset + g.offset]);
-                    q0vel.Set4(&_vtrajdata[offset + derivoffset]);
-                    q0acc.Set4(&_vtrajdata[offset + ddoffset]);
+                    q0.Set4(&_trajdataview[offset + g.offset]);
+                    q0vel.Set4(&_trajdataview[offset + derivoffset]);
+                    q0acc.Set4(&_trajdataview[offset + ddoffset]);
 
-                    q1.Set4(&_vtrajdata[nextoffset + g.offset]);
-                    q1vel.Set4(&_vtrajdata[nextoffset + derivoffset]);
-                    q1acc.Set4(&_vtrajdata[nextoffset + ddoffset]);
+                    q1.Set4(&_trajdataview[nextoffset + g.offset]);
+                    q1vel.Set4(&_trajdataview[nextoffset + derivoffset]);
+                    q1acc.Set4(&_trajdataview[nextoffset + ddoffset]);
 
                     const Vector angularVelocityPrev = 2.0*quatMultiply(q0vel, quatInverse(q0));
                     // const Vector angularVelocity = 2.0*quatMultiply(q1vel, quatInverse(q1)); // not used
                     const Vector angularAccelerationPrev = 2.0*quatMultiply(q0acc, quatInverse(q0));
                     const Vector angularAcceleration = 2.0*quatMultiply(q1acc, quatInverse(q1));
 
-                    const Vector j = (angularAcceleration - angularAccelerationPrev)*_vdeltainvtime.at(ipoint + 1);
+                    const Vector j = (angularAcceleration - angularAccelerationPrev)*_deltainvtimeview.at(ipoint + 1);
                     const Vector totalDelta = deltatime*(angularVelocityPrev + deltatime*(0.5*angularAccelerationPrev + (deltatime/6.0)*j));
                     const Vector q = quatMultiply(quatFromAxisAngle(Vector(totalDelta.y, totalDelta.z, totalDelta.w)), q0);
 
@@ -1511,17 +2034,17 @@ protected:
                 // c2 = a0/2
                 // c1 = v0
                 // c0 = p0
-                dReal ideltatime = _vdeltainvtime.at(ipoint+1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint+1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 dReal ideltatime3 = ideltatime2*ideltatime;
                 for(int i = 0; i < g.dof; ++i) {
-                    dReal deriv0 = _vtrajdata[offset+derivoffset+i];
-                    dReal deriv1 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                    dReal dd0 = _vtrajdata[offset+ddoffset+i];
-                    dReal dd1 = _vtrajdata[_spec.GetDOF()+offset+ddoffset+i];
+                    dReal deriv0 = _trajdataview[offset+derivoffset+i];
+                    dReal deriv1 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                    dReal dd0 = _trajdataview[offset+ddoffset+i];
+                    dReal dd1 = _trajdataview[_spec.GetDOF()+offset+ddoffset+i];
                     dReal c4 = -0.5*(deriv1-deriv0)*ideltatime3 + (dd0 + dd1)*ideltatime2*0.25;
                     dReal c3 = (deriv1-deriv0)*ideltatime2 - (2*dd0+dd1)*ideltatime/3.0;
-                    *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i] + deltatime*(deriv0 + deltatime*(0.5*dd0 + deltatime*(c3 + deltatime*c4)));
+                    *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i] + deltatime*(deriv0 + deltatime*(0.5*dd0 + deltatime*(c3 + deltatime*c4)));
                 }
             }
             else if( derivoffset >= 0 && integoffset >= 0 ) {
@@ -1540,17 +2063,17 @@ protected:
                 // c2 = (-4.5*v0 + 1.5*v1)/(dt) - (18*x0 + 12*x1)/(dt**2) + 30*(i1 - i0)/(dt**3)
                 // c1 = v0
                 // c0 = x0
-                dReal ideltatime = _vdeltainvtime.at(ipoint + 1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint + 1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 dReal ideltatime3 = ideltatime2*ideltatime;
                 dReal ideltatime4 = ideltatime3*ideltatime;
                 dReal ideltatime5 = ideltatime4*ideltatime;
                 for(int i = 0; i < g.dof; ++i) {
-                    dReal deriv0 = _vtrajdata[offset + derivoffset + i];
-                    dReal deriv1 = _vtrajdata[_spec.GetDOF() + offset + derivoffset + i];
-                    dReal pos0 = _vtrajdata[offset + g.offset + i];
-                    dReal pos1 = _vtrajdata[_spec.GetDOF() + offset + g.offset + i];
-                    dReal idiff = _vtrajdata[_spec.GetDOF() + offset + integoffset + i] - _vtrajdata[offset + integoffset + i];
+                    dReal deriv0 = _trajdataview[offset + derivoffset + i];
+                    dReal deriv1 = _trajdataview[_spec.GetDOF() + offset + derivoffset + i];
+                    dReal pos0 = _trajdataview[offset + g.offset + i];
+                    dReal pos1 = _trajdataview[_spec.GetDOF() + offset + g.offset + i];
+                    dReal idiff = _trajdataview[_spec.GetDOF() + offset + integoffset + i] - _trajdataview[offset + integoffset + i];
                     dReal c4 = 2.5*(deriv1 - deriv0)*ideltatime3     - 15*(pos0 + pos1)*ideltatime4    + 30*idiff*ideltatime5;
                     dReal c3 = (6*deriv0 - 4*deriv1)*ideltatime2     + (32*pos0 + 28*pos1)*ideltatime3 - 60*idiff*ideltatime4;
                     dReal c2 = (-4.5*deriv0 + 1.5*deriv1)*ideltatime - (18*pos0 + 12*pos1)*ideltatime2 + 30*idiff*ideltatime3;
@@ -1563,7 +2086,7 @@ protected:
         }
         else {
             for(int i = 0; i < g.dof; ++i) {
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i];
             }
         }
     }
@@ -1590,18 +2113,18 @@ protected:
             int derivoffset = _vderivoffsets[g.offset];
             int ddoffset = _vddoffsets[g.offset];
             if( derivoffset >= 0 && ddoffset >= 0 ) {
-                dReal ideltatime = _vdeltainvtime.at(ipoint+1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint+1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 dReal ideltatime3 = ideltatime2*ideltatime;
                 dReal ideltatime4 = ideltatime2*ideltatime2;
                 dReal ideltatime5 = ideltatime4*ideltatime;
                 for(int i = 0; i < g.dof; ++i) {
-                    dReal p0 = _vtrajdata[offset+g.offset+i];
-                    dReal px = _vtrajdata[_spec.GetDOF()+offset+g.offset+i] - p0;
-                    dReal deriv0 = _vtrajdata[offset+derivoffset+i];
-                    dReal deriv1 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                    dReal dd0 = _vtrajdata[offset+ddoffset+i];
-                    dReal dd1 = _vtrajdata[_spec.GetDOF()+offset+ddoffset+i];
+                    dReal p0 = _trajdataview[offset+g.offset+i];
+                    dReal px = _trajdataview[_spec.GetDOF()+offset+g.offset+i] - p0;
+                    dReal deriv0 = _trajdataview[offset+derivoffset+i];
+                    dReal deriv1 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                    dReal dd0 = _trajdataview[offset+ddoffset+i];
+                    dReal dd1 = _trajdataview[_spec.GetDOF()+offset+ddoffset+i];
                     dReal c5 = (-0.5*dd0 + dd1*0.5)*ideltatime3 - (3*deriv0 + 3*deriv1)*ideltatime4 + px*6*ideltatime5;
                     dReal c4 = (1.5*dd0 - dd1)*ideltatime2 + (8*deriv0 + 7*deriv1)*ideltatime3 - px*15*ideltatime4;
                     dReal c3 = (-1.5*dd0 + dd1*0.5)*ideltatime + (-6*deriv0 - 4*deriv1)*ideltatime2 + px*10*ideltatime3;
@@ -1614,7 +2137,7 @@ protected:
         }
         else {
             for(int i = 0; i < g.dof; ++i) {
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i];
             }
         }
     }
@@ -1640,7 +2163,7 @@ protected:
             int ddoffset = _vddoffsets[g.offset];
             int dddoffset = _vdddoffsets[g.offset];
             if( derivoffset >= 0 && ddoffset >= 0 && dddoffset >= 0 ) {
-                dReal ideltatime = _vdeltainvtime.at(ipoint+1);
+                dReal ideltatime = _deltainvtimeview.at(ipoint+1);
                 dReal ideltatime2 = ideltatime*ideltatime;
                 dReal ideltatime3 = ideltatime2*ideltatime;
                 dReal ideltatime4 = ideltatime2*ideltatime2;
@@ -1650,14 +2173,14 @@ protected:
                 //dReal deltatime4 = deltatime2*deltatime2;
                 //dReal deltatime5 = deltatime4*deltatime;
                 for(int i = 0; i < g.dof; ++i) {
-                    dReal p0 = _vtrajdata[offset+g.offset+i];
-                    //dReal px = _vtrajdata[_spec.GetDOF()+offset+g.offset+i] - p0;
-                    dReal deriv0 = _vtrajdata[offset+derivoffset+i];
-                    dReal deriv1 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                    dReal dd0 = _vtrajdata[offset+ddoffset+i];
-                    dReal dd1 = _vtrajdata[_spec.GetDOF()+offset+ddoffset+i];
-                    dReal ddd0 = _vtrajdata[offset+dddoffset+i];
-                    dReal ddd1 = _vtrajdata[_spec.GetDOF()+offset+dddoffset+i];
+                    dReal p0 = _trajdataview[offset+g.offset+i];
+                    //dReal px = _trajdataview[_spec.GetDOF()+offset+g.offset+i] - p0;
+                    dReal deriv0 = _trajdataview[offset+derivoffset+i];
+                    dReal deriv1 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                    dReal dd0 = _trajdataview[offset+ddoffset+i];
+                    dReal dd1 = _trajdataview[_spec.GetDOF()+offset+ddoffset+i];
+                    dReal ddd0 = _trajdataview[offset+dddoffset+i];
+                    dReal ddd1 = _trajdataview[_spec.GetDOF()+offset+dddoffset+i];
                     // matrix inverse is slow but at least it will work for now
                     // A=Matrix(3,3,[6*dt**5, 5*dt**4, 4*dt**3, 30*dt**4, 20*dt**3, 12*dt**2, 120*dt**3, 60*dt**2, 24*dt])
                     // A.inv() = [   dt**(-5), -1/(2*dt**4), 1/(12*dt**3)]
@@ -1684,7 +2207,7 @@ protected:
         }
         else {
             for(int i = 0; i < g.dof; ++i) {
-                *(itdata + g.offset+i) = _vtrajdata[offset+g.offset+i];
+                *(itdata + g.offset+i) = _trajdataview[offset+g.offset+i];
             }
         }
     }
@@ -1695,9 +2218,9 @@ protected:
         int derivoffset = _vderivoffsets[g.offset];
         if( derivoffset >= 0 ) {
             for(int i = 0; i < g.dof; ++i) {
-                dReal deriv0 = _vtrajdata[_spec.GetDOF()+offset+derivoffset+i];
-                dReal expected = _vtrajdata[offset+g.offset+i] + deltatime*deriv0;
-                dReal error = RaveFabs(_vtrajdata[_spec.GetDOF()+offset+g.offset+i] - expected);
+                dReal deriv0 = _trajdataview[_spec.GetDOF()+offset+derivoffset+i];
+                dReal expected = _trajdataview[offset+g.offset+i] + deltatime*deriv0;
+                dReal error = RaveFabs(_trajdataview[_spec.GetDOF()+offset+g.offset+i] - expected);
                 if( RaveFabs(error-2*PI) > g_fEpsilonLinear ) { // TODO, officially track circular joints
                     OPENRAVE_ASSERT_OP_FORMAT(error,<=,g_fEpsilonLinear, "trajectory segment for group %s interpolation %s points %d-%d dof %d is invalid", g.name%g.interpolation%ipoint%(ipoint+1)%i, ORE_InvalidState);
                 }
@@ -1713,10 +2236,10 @@ protected:
             if( derivoffset >= 0 ) {
                 for(int i = 0; i < g.dof; ++i) {
                     // coeff*t^2 + deriv0*t + pos0
-                    dReal deriv0 = _vtrajdata[offset+derivoffset+i];
-                    dReal coeff = 0.5*_vdeltainvtime.at(ipoint+1)*(_vtrajdata[_spec.GetDOF()+offset+derivoffset+i]-deriv0);
-                    dReal expected = _vtrajdata[offset+g.offset+i] + deltatime*(deriv0 + deltatime*coeff);
-                    dReal error = RaveFabs(_vtrajdata.at(_spec.GetDOF()+offset+g.offset+i)-expected);
+                    dReal deriv0 = _trajdataview[offset+derivoffset+i];
+                    dReal coeff = 0.5*_deltainvtimeview.at(ipoint+1)*(_trajdataview[_spec.GetDOF()+offset+derivoffset+i]-deriv0);
+                    dReal expected = _trajdataview[offset+g.offset+i] + deltatime*(deriv0 + deltatime*coeff);
+                    dReal error = RaveFabs(_trajdataview.at(_spec.GetDOF()+offset+g.offset+i)-expected);
                     if( RaveFabs(error-2*PI) > 1e-5 ) { // TODO, officially track circular joints
                         OPENRAVE_ASSERT_OP_FORMAT(error,<=,1e-4, "trajectory segment for group %s interpolation %s time %f points %d-%d dof %d is invalid", g.name%g.interpolation%deltatime%ipoint%(ipoint+1)%i, ORE_InvalidState);
                     }
@@ -1750,12 +2273,15 @@ protected:
     ConfigurationSpecification _spec;
     std::vector< boost::function<void(size_t,dReal,const std::vector<dReal>::iterator&)> > _vgroupinterpolators;
     std::vector< boost::function<void(size_t,dReal)> > _vgroupvalidators;
+    std::vector<int> _vgroupbatchdegrees; ///< for every group, the polynomial degree used by _SamplePointsInternal. 0 if the group has to be sampled through _vgroupinterpolators.
     std::vector<int> _vderivoffsets, _vddoffsets, _vdddoffsets; ///< for every group that relies on other info to compute its position, this will point to the derivative offset. -1 if invalid and not needed, -2 if invalid and needed
     std::vector<int> _vintegraloffsets, _viioffsets; ///< for every group that relies on other info to compute its position, this will point to the integral offset (ie the position for a velocity group). -1 if invalid and not needed, -2 if invalid and needed
     int _timeoffset;
 
-    std::vector<dReal> _vtrajdata;
+    std::vector<dReal> _vtrajdata; ///< owned waypoints, empty if the waypoints are memory mapped
     mutable std::vector<dReal> _vaccumtime, _vdeltainvtime;
+    boost::shared_ptr<boost::interprocess::mapped_region> _pmappedregion; ///< if not empty, the views point into this read-only region instead of the owned vectors
+    mutable ConstRealArrayView _trajdataview, _accumtimeview, _deltainvtimeview; ///< what sampling reads from. point either into _vtrajdata, _vaccumtime, _vdeltainvtime or into _pmappedregion
     bool _bInit;
     mutable bool _bChanged; ///< if true, then _ComputeInternal() has to be called in order to compute _vaccumtime and _vdeltainvtime
     mutable bool _bSamplingVerified; ///< if false, then _VerifySampling() has not be called yet to verify that all points can be sampled.
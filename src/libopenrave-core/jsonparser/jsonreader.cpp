@@ -27,8 +27,13 @@
 #include <openrave/openrave.h>
 #include <openrave/openraveexception.h>
 #include <rapidjson/istreamwrapper.h>
+#include <atomic>
+#include <cstdlib>
+#include <list>
+#include <mutex>
 #include <string>
 #include <fstream>
+#include <thread>
 #include <unordered_set>
 
 #ifdef HAVE_BOOST_FILESYSTEM
@@ -75,6 +80,155 @@ static void OpenRapidJsonDocument(const std::string& filename, rapidjson::Docume
     }
 }
 
+/// \brief opens a .json or .msgpack file
+static void OpenUnencryptedDocument(const std::string& filename, rapidjson::Document& doc)
+{
+    if (StringEndsWith(filename, ".json")) {
+        OpenRapidJsonDocument(filename, doc);
+    }
+    else {
+        OpenMsgPackDocument(filename, doc);
+    }
+}
+
+/// \brief parses the content of a .json or .msgpack file that was already read
+static void ParseUnencryptedDocument(const std::string& filename, const std::string& content, rapidjson::Document& doc)
+{
+    if (StringEndsWith(filename, ".json")) {
+        rapidjson::ParseResult ok = doc.Parse<rapidjson::kParseFullPrecisionFlag>(content.c_str(), content.size());
+        if (!ok) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to parse json document \"%s\"", filename, ORE_InvalidArguments);
+        }
+    }
+    else {
+        try {
+            MsgPack::ParseMsgPack(doc, content);
+        }
+        catch(const std::exception& ex) {
+            throw OPENRAVE_EXCEPTION_FORMAT("Failed to parse msgpack format for file '%s': %s", filename%ex.what(), ORE_Failed);
+        }
+    }
+}
+
+/// \brief process-wide cache of the documents opened from local .json and .msgpack files, shared by all readers and environments.
+///
+/// Entries are keyed by the resolved filename and only reused while the md5 hash of the file content is unchanged, so a hit still reads the file but skips parsing it. Modification times are not used since they can stay the same when a file is rewritten quickly.
+/// The least recently used documents are evicted once the memory of all cached documents goes over the budget, which is set in bytes by the OPENRAVE_JSON_DOCUMENT_CACHE_SIZE environment variable (256MB by default, 0 disables the cache).
+class JSONDocumentCache
+{
+public:
+    static JSONDocumentCache& GetInstance()
+    {
+        static JSONDocumentCache s_cache;
+        return s_cache;
+    }
+
+    inline bool IsEnabled() const {
+        return _nBudget > 0;
+    }
+
+    /// \return the cached document if the file content did not change since it was cached
+    boost::shared_ptr<const rapidjson::Document> Find(const std::string& fullFilename, const std::string& contentHash)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::map<std::string, std::list<Entry>::iterator>::iterator itEntry = _mapEntries.find(fullFilename);
+        if (itEntry == _mapEntries.end()) {
+            return boost::shared_ptr<const rapidjson::Document>();
+        }
+        if (itEntry->second->contentHash != contentHash) {
+            RAVELOG_VERBOSE_FORMAT("cached document '%s' changed on disk", fullFilename);
+            _nTotalSize -= itEntry->second->nSize;
+            _listEntries.erase(itEntry->second);
+            _mapEntries.erase(itEntry);
+            return boost::shared_ptr<const rapidjson::Document>();
+        }
+        RAVELOG_VERBOSE_FORMAT("reusing cached document '%s'", fullFilename);
+        // move to the front as the most recently used
+        _listEntries.splice(_listEntries.begin(), _listEntries, itEntry->second);
+        return itEntry->second->pDocument;
+    }
+
+    /// \param pDocument has to own its allocator since it outlives the load that opened it
+    void Insert(const std::string& fullFilename, const std::string& contentHash, boost::shared_ptr<rapidjson::Document> pDocument)
+    {
+        const size_t nSize = pDocument->GetAllocator().Size();
+        if (nSize > _nBudget) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::map<std::string, std::list<Entry>::iterator>::iterator itEntry = _mapEntries.find(fullFilename);
+        if (itEntry != _mapEntries.end()) {
+            _nTotalSize -= itEntry->second->nSize;
+            _listEntries.erase(itEntry->second);
+            _mapEntries.erase(itEntry);
+        }
+        RAVELOG_VERBOSE_FORMAT("caching document '%s' of %d bytes", fullFilename%nSize);
+        _listEntries.push_front(Entry());
+        Entry& entry = _listEntries.front();
+        entry.fullFilename = fullFilename;
+        entry.contentHash = contentHash;
+        entry.pDocument = pDocument;
+        entry.nSize = nSize;
+        _mapEntries[fullFilename] = _listEntries.begin();
+        _nTotalSize += nSize;
+        while (_nTotalSize > _nBudget && !_listEntries.empty()) {
+            const Entry& leastRecent = _listEntries.back();
+            RAVELOG_VERBOSE_FORMAT("evicting cached document '%s' of %d bytes", leastRecent.fullFilename%leastRecent.nSize);
+            _nTotalSize -= leastRecent.nSize;
+            _mapEntries.erase(leastRecent.fullFilename);
+            _listEntries.pop_back();
+        }
+    }
+
+private:
+    JSONDocumentCache()
+    {
+        const char* pCacheSize = std::getenv("OPENRAVE_JSON_DOCUMENT_CACHE_SIZE");
+        if (!!pCacheSize && !!pCacheSize[0]) {
+            _nBudget = strtoull(pCacheSize, NULL, 10);
+        }
+    }
+
+    struct Entry
+    {
+        std::string fullFilename;
+        std::string contentHash; ///< md5 hash of the file content that pDocument was parsed from
+        boost::shared_ptr<const rapidjson::Document> pDocument;
+        size_t nSize = 0; ///< bytes used by the allocator of pDocument
+    };
+
+    std::mutex _mutex;
+    std::list<Entry> _listEntries; ///< most recently used first
+    std::map<std::string, std::list<Entry>::iterator> _mapEntries; ///< indexed by fullFilename
+    size_t _nTotalSize = 0;
+    size_t _nBudget = 256*1024*1024;
+};
+
+/// \brief opens a local .json or .msgpack file through the process-wide JSONDocumentCache. Safe to call from multiple threads.
+static boost::shared_ptr<const rapidjson::Document> OpenCachedDocument(const std::string& fullFilename)
+{
+    JSONDocumentCache& cache = JSONDocumentCache::GetInstance();
+    boost::shared_ptr<rapidjson::Document> pDocument(new rapidjson::Document());
+    if (!cache.IsEnabled()) {
+        OpenUnencryptedDocument(fullFilename, *pDocument);
+        return pDocument;
+    }
+
+    std::string content;
+    {
+        std::ifstream ifs(fullFilename.c_str(), std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    const std::string contentHash = utils::GetMD5HashString(content);
+    boost::shared_ptr<const rapidjson::Document> pCachedDocument = cache.Find(fullFilename, contentHash);
+    if (!!pCachedDocument) {
+        return pCachedDocument;
+    }
+    ParseUnencryptedDocument(fullFilename, content, *pDocument);
+    cache.Insert(fullFilename, contentHash, pDocument);
+    return pDocument;
+}
+
 /// \brief open and cache an encrypted msgpack document
 static void OpenEncryptedMsgPackDocument(const std::string& filename, rapidjson::Document& doc)
 {
@@ -186,6 +340,13 @@ public:
             else if (itatt->first == "excludeBodyId") {
                 _excludeBodyIds.emplace(itatt->second);
             }
+            else if (itatt->first == "numloadthreads") {
+                stringstream ss(itatt->second);
+                ss >> _nNumLoadThreads;
+                if( _nNumLoadThreads <= 0 ) {
+                    _nNumLoadThreads = max(1, (int)std::thread::hardware_concurrency());
+                }
+            }
         }
         if (_vOpenRAVESchemeAliases.size() == 0) {
             _vOpenRAVESchemeAliases.push_back("openrave");
@@ -526,14 +687,10 @@ protected:
             doc = _rapidJSONDocuments[fullFilename];
         }
         else if (!IsDownloadingFromRemote()) {
+            // decrypted documents are not kept in the process-wide cache
             boost::shared_ptr<rapidjson::Document> newDoc;
-            if (StringEndsWith(fullFilename, ".json")) {
-                newDoc.reset(new rapidjson::Document(&alloc));
-                OpenRapidJsonDocument(fullFilename, *newDoc);
-            }
-            else if (StringEndsWith(fullFilename, ".msgpack")) {
-                newDoc.reset(new rapidjson::Document(&alloc));
-                OpenMsgPackDocument(fullFilename, *newDoc);
+            if (StringEndsWith(fullFilename, ".json") || StringEndsWith(fullFilename, ".msgpack")) {
+                doc = OpenCachedDocument(fullFilename);
             }
             else if (StringEndsWith(fullFilename, ".json.gpg")) {
                 newDoc.reset(new rapidjson::Document(&alloc));
@@ -545,17 +702,91 @@ protected:
             }
             if (!!newDoc) {
                 doc = newDoc;
+            }
+            if (!!doc) {
                 _rapidJSONDocuments[fullFilename] = doc;
             }
         }
         return doc;
     }
 
+    /// \brief opens the local .json and .msgpack files directly referenced by the bodies of rEnvInfo on _nNumLoadThreads threads and puts them into _rapidJSONDocuments.
+    ///
+    /// Files that cannot be resolved or opened here are left to _ExpandRapidJSON, which reports the errors.
+    void _PrefetchReferencedDocuments(const rapidjson::Value& rEnvInfo, const std::string& currentFilename)
+    {
+        if (_nNumLoadThreads <= 1 || IsDownloadingFromRemote() || !rEnvInfo.HasMember("bodies")) {
+            return;
+        }
+
+        std::vector<std::string> vFilenames;
+        const rapidjson::Value& rBodies = rEnvInfo["bodies"];
+        for (rapidjson::Value::ConstValueIterator itBody = rBodies.Begin(); itBody != rBodies.End(); ++itBody) {
+            const char* pReferenceUri = orjson::GetCStringJsonValueByKey(*itBody, "referenceUri", "");
+            if (!_IsExpandableReferenceUri(pReferenceUri)) {
+                continue;
+            }
+            std::string scheme, path, fragment;
+            ParseURI(pReferenceUri, scheme, path, fragment);
+            if (scheme.empty() || path.empty()) {
+                continue;
+            }
+            _ReplaceFilenameSuffix(path, ".dae", _defaultSuffix);
+            std::string fullFilename = ResolveURI(scheme, path, std::string(), GetOpenRAVESchemeAliases());
+#ifdef HAVE_BOOST_FILESYSTEM
+            if (fullFilename.empty()) {
+                fullFilename = ResolveURI(scheme, path, boost::filesystem::path(currentFilename).parent_path().string(), GetOpenRAVESchemeAliases());
+            }
+#endif
+            // encrypted files are left to _ExpandRapidJSON since initializing gpgme is not thread safe
+            if (fullFilename.empty() || (!StringEndsWith(fullFilename, ".json") && !StringEndsWith(fullFilename, ".msgpack"))) {
+                continue;
+            }
+            if (_rapidJSONDocuments.find(fullFilename) == _rapidJSONDocuments.end() && find(vFilenames.begin(), vFilenames.end(), fullFilename) == vFilenames.end()) {
+                vFilenames.push_back(fullFilename);
+            }
+        }
+        if (vFilenames.size() <= 1) {
+            return;
+        }
+
+        // the cached documents own their allocators, so they can be opened on different threads
+        std::vector<boost::shared_ptr<const rapidjson::Document> > vDocuments(vFilenames.size());
+        std::atomic<int> nextFile(0);
+        auto openfn = [&]() {
+            for (int iFile = nextFile++; iFile < (int)vFilenames.size(); iFile = nextFile++) {
+                try {
+                    vDocuments[iFile] = OpenCachedDocument(vFilenames[iFile]);
+                }
+                catch (const std::exception& ex) {
+                    RAVELOG_DEBUG_FORMAT("env=%d, failed to prefetch '%s', will retry when expanding references: %s", _penv->GetId()%vFilenames[iFile]%ex.what());
+                }
+            }
+        };
+        uint64_t starttimeus = utils::GetMonotonicTime();
+        std::vector<std::thread> vThreads;
+        for (int iThread = 1; iThread < min(_nNumLoadThreads, (int)vFilenames.size()); ++iThread) {
+            vThreads.emplace_back(openfn);
+        }
+        openfn();
+        for (std::thread& thread : vThreads) {
+            thread.join();
+        }
+        for (size_t iFile = 0; iFile < vFilenames.size(); ++iFile) {
+            if (!!vDocuments[iFile]) {
+                _rapidJSONDocuments[vFilenames[iFile]] = vDocuments[iFile];
+            }
+        }
+        RAVELOG_DEBUG_FORMAT("env=%d, prefetched %d referenced documents on %d threads in %u[us]", _penv->GetId()%vFilenames.size()%min(_nNumLoadThreads, (int)vFilenames.size())%(utils::GetMonotonicTime()-starttimeus));
+    }
+
     void _ProcessEnvInfoBodies(EnvironmentBase::EnvironmentBaseInfo& envInfo, const rapidjson::Value& rEnvInfo, rapidjson::Document::AllocatorType& alloc, const char* pCurrentUri, const std::string& currentFilename, std::map<RobotBase::ConnectedBodyInfoPtr, std::string>& mapProcessedConnectedBodyUris)
     {
         dReal fUnitScale = _GetUnitScale(rEnvInfo, 1.0);
         std::vector<int> vInputToBodyInfoMapping;
         if (rEnvInfo.HasMember("bodies")) {
+            _PrefetchReferencedDocuments(rEnvInfo, currentFilename);
+
             const rapidjson::Value& rBodies = rEnvInfo["bodies"];
             vInputToBodyInfoMapping.resize(rBodies.Size(),-1); // -1, no mapping by default
 
@@ -588,7 +819,7 @@ protected:
             }
         }
 
-        envInfo.DeserializeJSONWithMapping(rEnvInfo, fUnitScale, _deserializeOptions, vInputToBodyInfoMapping);
+        envInfo.DeserializeJSONWithMapping(rEnvInfo, fUnitScale, _deserializeOptions, vInputToBodyInfoMapping, _nNumLoadThreads);
         FOREACH(itBodyInfo, envInfo._vBodyInfos) {
             KinBody::KinBodyInfoPtr& pKinBodyInfo = *itBodyInfo;
             // ensure uri is set
@@ -1125,6 +1356,7 @@ protected:
     bool _bMustResolveURI = false; ///< if true, throw exception if object uri does not resolve
     bool _bMustResolveEnvironmentURI = false; ///< if true, throw exception if environment uri does not resolve
     bool _bIgnoreInvalidBodies = false; ///< if true, ignores any invalid bodies
+    int _nNumLoadThreads = 1; ///< number of threads for opening referenced documents and decoding body infos, set with the "numloadthreads" attribute. The bodies are always added to the environment one at a time.
 
     std::map<std::string, boost::shared_ptr<const rapidjson::Document> > _rapidJSONDocuments; ///< cache for opened rapidjson Documents
 
@@ -1168,8 +1400,8 @@ bool RaveParseJSONFile(EnvironmentBasePtr penv, const std::string& filename, Upd
     }
     JSONReader reader(atts, penv, ".json");
     reader.SetFilename(fullFilename);
-    rapidjson::Document rEnvInfo(&alloc);
-    OpenRapidJsonDocument(fullFilename, rEnvInfo);
+    boost::shared_ptr<const rapidjson::Document> prEnvInfo = OpenCachedDocument(fullFilename);
+    const rapidjson::Value& rEnvInfo = *prEnvInfo;
     std::vector<KinBodyPtr> vCreatedBodies, vModifiedBodies, vRemovedBodies;
     return reader.ExtractAll(rEnvInfo, updateMode, vCreatedBodies, vModifiedBodies, vRemovedBodies, alloc);
 }
@@ -1180,8 +1412,8 @@ bool RaveParseJSONFile(EnvironmentBasePtr penv, KinBodyPtr& ppbody, const std::s
     if (fullFilename.size() == 0 ) {
         return false;
     }
-    rapidjson::Document doc(&alloc);
-    OpenRapidJsonDocument(fullFilename, doc);
+    boost::shared_ptr<const rapidjson::Document> pdoc = OpenCachedDocument(fullFilename);
+    const rapidjson::Value& doc = *pdoc;
     JSONReader reader(atts, penv, ".json");
     reader.SetFilename(fullFilename);
     return reader.ExtractFirst(doc, ppbody, alloc);
@@ -1283,8 +1515,8 @@ bool RaveParseMsgPackFile(EnvironmentBasePtr penv, const std::string& filename,
     if (fullFilename.size() == 0 ) {
         return false;
     }
-    rapidjson::Document rEnvInfo(&alloc);
-    OpenMsgPackDocument(fullFilename, rEnvInfo);
+    boost::shared_ptr<const rapidjson::Document> prEnvInfo = OpenCachedDocument(fullFilename);
+    const rapidjson::Value& rEnvInfo = *prEnvInfo;
     JSONReader reader(atts, penv, ".msgpack");
     reader.SetFilename(fullFilename);
     std::vector<KinBodyPtr> vCreatedBodies, vModifiedBodies, vRemovedBodies;
@@ -1297,8 +1529,8 @@ bool RaveParseMsgPackFile(EnvironmentBasePtr penv, KinBodyPtr& ppbody, const std
     if (fullFilename.size() == 0 ) {
         return false;
     }
-    rapidjson::Document doc(&alloc);
-    OpenMsgPackDocument(fullFilename, doc);
+    boost::shared_ptr<const rapidjson::Document> pdoc = OpenCachedDocument(fullFilename);
+    const rapidjson::Value& doc = *pdoc;
     JSONReader reader(atts, penv, ".msgpack");
     reader.SetFilename(fullFilename);
     return reader.ExtractFirst(doc, ppbody, alloc);
@@ -16,6 +16,12 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "libopenrave.h"
 
+#include <atomic>
+#include <exception>
+#include <thread>
+
+#include <openrave/openravemsgpack.h>
+
 EnvironmentBase::EnvironmentBaseInfo::EnvironmentBaseInfo()
 {
     _gravity = Vector(0,0,-9.797930195020351);
@@ -103,6 +109,167 @@ void EnvironmentBase::EnvironmentBaseInfo::SerializeJSON(rapidjson::Value& rEnvI
     }
 }
 
+namespace {
+
+/// \brief finds the body info that rKinBodyInfo updates, either through the mapping, its id, or its name when the id is empty
+std::vector<KinBody::KinBodyInfoPtr>::iterator _FindExistingBodyInfo(std::vector<KinBody::KinBodyInfoPtr>& vBodyInfos, const rapidjson::Value& rKinBodyInfo, const std::string& id, int nMappedBodyInfoIndex)
+{
+    if( nMappedBodyInfoIndex >= 0 ) {
+        return vBodyInfos.begin() + nMappedBodyInfoIndex;
+    }
+    if (!id.empty()) {
+        // only try to find old info if id is not empty
+        FOREACH(itBodyInfo, vBodyInfos) {
+            if ((*itBodyInfo)->_id == id ) {
+                return itBodyInfo;
+            }
+        }
+        return vBodyInfos.end();
+    }
+
+    // id is empty, try finding the existing one from a matching name
+    rapidjson::Value::ConstMemberIterator itName = rKinBodyInfo.FindMember("name");
+    if( itName != rKinBodyInfo.MemberEnd() && itName->value.IsString() ) {
+        FOREACH(itBodyInfo, vBodyInfos) {
+            if ((*itBodyInfo)->_name.compare(itName->value.GetString()) == 0) {
+                return itBodyInfo;
+            }
+        }
+    }
+    return vBodyInfos.end();
+}
+
+/// \brief defers KinBodyInfo::DeserializeJSON calls so that the infos of different bodies can be decoded concurrently.
+///
+/// The decoding of meshes dominates the deserialization of big scenes. With numThreads <= 1 every info is decoded as soon as it is queued.
+class BodyInfoDecodeQueue
+{
+public:
+    BodyInfoDecodeQueue(std::vector<KinBody::KinBodyInfoPtr>& vBodyInfos, dReal fUnitScale, int options, int numThreads) : _vBodyInfos(vBodyInfos), _fUnitScale(fUnitScale), _options(options), _numThreads(numThreads) {
+    }
+
+    /// \param bNew if true, pKinBodyInfo was just added to the end of vBodyInfos and is removed again if it does not have a name after decoding
+    void Queue(KinBody::KinBodyInfoPtr pKinBodyInfo, const rapidjson::Value& rKinBodyInfo, const std::string& id, bool bNew)
+    {
+        if( bNew && _nFirstNewInfoIndex < 0 ) {
+            _nFirstNewInfoIndex = (int)_vBodyInfos.size() - 1;
+        }
+        _vjobs.push_back(DecodeJob());
+        DecodeJob& job = _vjobs.back();
+        job.pKinBodyInfo = pKinBodyInfo;
+        job.pValue = &rKinBodyInfo;
+        job.id = id;
+        job.bNew = bNew;
+        _setPendingIds.insert(id);
+        _setPendingInfos.insert(pKinBodyInfo.get());
+        if( _numThreads <= 1 ) {
+            Flush();
+        }
+    }
+
+    bool IsPendingId(const std::string& id) const {
+        return _setPendingIds.count(id) > 0;
+    }
+
+    bool IsPendingInfo(const KinBody::KinBodyInfoPtr& pKinBodyInfo) const {
+        return _setPendingInfos.count(pKinBodyInfo.get()) > 0;
+    }
+
+    /// \brief true if a new info that could still be removed is at or before bodyInfoIndex
+    bool HasPendingNewInfoBefore(int bodyInfoIndex) const {
+        return _nFirstNewInfoIndex >= 0 && _nFirstNewInfoIndex <= bodyInfoIndex;
+    }
+
+    /// \brief decodes all the queued infos in the order they were queued
+    ///
+    /// If some infos fail to decode, rethrows the exception of the first failed one in queue order, independent of which thread failed first. The new infos from that one on are removed like when decoding one info at a time, which stops at the first failure.
+    void Flush()
+    {
+        if( _vjobs.empty() ) {
+            return;
+        }
+
+        const int numjobs = _vjobs.size();
+        std::atomic<int> nextjob(0);
+        std::vector<std::exception_ptr> vExceptions(numjobs); ///< each job only writes its own entry
+        auto decodefn = [&]() {
+            for(int ijob = nextjob++; ijob < numjobs; ijob = nextjob++) {
+                const DecodeJob& job = _vjobs[ijob];
+                try {
+                    job.pKinBodyInfo->DeserializeJSON(*job.pValue, _fUnitScale, _options);
+                }
+                catch(...) {
+                    vExceptions[ijob] = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> vthreads;
+        for(int ithread = 1; ithread < min(_numThreads, numjobs); ++ithread) {
+            vthreads.emplace_back(decodefn);
+        }
+        decodefn();
+        for(std::thread& thread : vthreads) {
+            thread.join();
+        }
+
+        int nFirstFailedJob = numjobs;
+        for(int ijob = 0; ijob < numjobs; ++ijob) {
+            if( !!vExceptions[ijob] ) {
+                nFirstFailedJob = ijob;
+                break;
+            }
+        }
+
+        // remove the new infos without a name, the same as when deserializing one body at a time
+        for(int ijob = 0; ijob < numjobs; ++ijob) {
+            DecodeJob& job = _vjobs[ijob];
+            if( job.bNew ) {
+                const bool bFailed = ijob >= nFirstFailedJob;
+                if( bFailed || job.pKinBodyInfo->_name.empty() ) {
+                    if( !bFailed ) {
+                        RAVELOG_WARN_FORMAT("new body id='%s' does not have a name, so skip creating", job.id);
+                    }
+                    std::vector<KinBody::KinBodyInfoPtr>::iterator itBodyInfo = find(_vBodyInfos.begin(), _vBodyInfos.end(), job.pKinBodyInfo);
+                    if( itBodyInfo != _vBodyInfos.end() ) {
+                        _vBodyInfos.erase(itBodyInfo);
+                    }
+                    continue;
+                }
+                RAVELOG_VERBOSE_FORMAT("created new body id='%s'", job.id);
+            }
+            job.pKinBodyInfo->_id = job.id;
+        }
+        _vjobs.clear();
+        _setPendingIds.clear();
+        _setPendingInfos.clear();
+        _nFirstNewInfoIndex = -1;
+        if( nFirstFailedJob < numjobs ) {
+            std::rethrow_exception(vExceptions[nFirstFailedJob]);
+        }
+    }
+
+private:
+    struct DecodeJob
+    {
+        KinBody::KinBodyInfoPtr pKinBodyInfo;
+        const rapidjson::Value* pValue = nullptr;
+        std::string id;
+        bool bNew = false;
+    };
+
+    std::vector<KinBody::KinBodyInfoPtr>& _vBodyInfos;
+    dReal _fUnitScale;
+    int _options;
+    int _numThreads;
+    std::vector<DecodeJob> _vjobs;
+    std::set<std::string> _setPendingIds;
+    std::set<const KinBody::KinBodyInfo*> _setPendingInfos;
+    int _nFirstNewInfoIndex = -1; ///< index of the first queued new info in _vBodyInfos, -1 if none
+};
+
+} // end namespace
+
 void EnvironmentBase::EnvironmentBaseInfo::DeserializeJSON(const rapidjson::Value& rEnvInfo, dReal fUnitScale, int options)
 {
     std::vector<int> vInputToBodyInfoMapping;
@@ -110,6 +277,11 @@ void EnvironmentBase::EnvironmentBaseInfo::DeserializeJSON(const rapidjson::Valu
 }
 
 void EnvironmentBase::EnvironmentBaseInfo::DeserializeJSONWithMapping(const rapidjson::Value& rEnvInfo, dReal fUnitScale, int options, const std::vector<int>& vInputToBodyInfoMapping)
+{
+    DeserializeJSONWithMapping(rEnvInfo, fUnitScale, options, vInputToBodyInfoMapping, 1);
+}
+
+void EnvironmentBase::EnvironmentBaseInfo::DeserializeJSONWithMapping(const rapidjson::Value& rEnvInfo, dReal fUnitScale, int options, const std::vector<int>& vInputToBodyInfoMapping, int numThreads)
 {
     if( !rEnvInfo.IsObject() ) {
         throw OPENRAVE_EXCEPTION_FORMAT("Passed in JSON '%s' is not a valid EnvironmentInfo object", orjson::DumpJson(rEnvInfo), ORE_InvalidArguments);
@@ -185,39 +357,25 @@ void EnvironmentBase::EnvironmentBaseInfo::DeserializeJSONWithMapping(const rapi
     if (rEnvInfo.HasMember("bodies")) {
         _vBodyInfos.reserve(_vBodyInfos.size() + rEnvInfo["bodies"].Size());
         const rapidjson::Value& rBodies = rEnvInfo["bodies"];
+        BodyInfoDecodeQueue decodequeue(_vBodyInfos, fUnitScale, options, numThreads);
         for(int iInputBodyIndex = 0; iInputBodyIndex < (int)rBodies.Size(); ++iInputBodyIndex) {
             const rapidjson::Value& rKinBodyInfo = rBodies[iInputBodyIndex];
 
             std::string id = orjson::GetStringJsonValueByKey(rKinBodyInfo, "id");
             bool isDeleted = orjson::GetJsonValueByKey<bool>(rKinBodyInfo, "__deleted__", false);
+            const int nMappedBodyInfoIndex = iInputBodyIndex < (int)vInputToBodyInfoMapping.size() ? vInputToBodyInfoMapping[iInputBodyIndex] : -1;
+
+            // the lookups below depend on the decoded ids and names, so finish decoding the infos they could match
+            if( isDeleted || id.empty() || decodequeue.IsPendingId(id) || (nMappedBodyInfoIndex >= 0 && decodequeue.HasPendingNewInfoBefore(nMappedBodyInfoIndex)) ) {
+                decodequeue.Flush();
+            }
 
             // then find previous body
             bool isExistingRobot = false;
-            std::vector<KinBody::KinBodyInfoPtr>::iterator itExistingBodyInfo = _vBodyInfos.end();
-
-            if( iInputBodyIndex < (int)vInputToBodyInfoMapping.size() && vInputToBodyInfoMapping[iInputBodyIndex] >= 0 ) {
-                itExistingBodyInfo = _vBodyInfos.begin() + vInputToBodyInfoMapping[iInputBodyIndex];
-            }
-            else if (!id.empty()) {
-                // only try to find old info if id is not empty
-                FOREACH(itBodyInfo, _vBodyInfos) {
-                    if ((*itBodyInfo)->_id == id ) {
-                        itExistingBodyInfo = itBodyInfo;
-                        break;
-                    }
-                }
-            }
-            else {
-                // id is empty, try finding the existing one from a matching name
-                rapidjson::Value::ConstMemberIterator itName = rKinBodyInfo.FindMember("name");
-                if( itName != rKinBodyInfo.MemberEnd() && itName->value.IsString() ) {
-                    FOREACH(itBodyInfo, _vBodyInfos) {
-                        if ((*itBodyInfo)->_name.compare(itName->value.GetString()) == 0) {
-                            itExistingBodyInfo = itBodyInfo;
-                            break;
-                        }
-                    }
-                }
+            std::vector<KinBody::KinBodyInfoPtr>::iterator itExistingBodyInfo = _FindExistingBodyInfo(_vBodyInfos, rKinBodyInfo, id, nMappedBodyInfoIndex);
+            if( itExistingBodyInfo != _vBodyInfos.end() && decodequeue.IsPendingInfo(*itExistingBodyInfo) ) {
+                decodequeue.Flush();
+                itExistingBodyInfo = _FindExistingBodyInfo(_vBodyInfos, rKinBodyInfo, id, nMappedBodyInfoIndex);
             }
 
             if( itExistingBodyInfo != _vBodyInfos.end() ) {
@@ -230,77 +388,493 @@ void EnvironmentBase::EnvironmentBaseInfo::DeserializeJSONWithMapping(const rapi
 
             bool isRobot = orjson::GetJsonValueByKey<bool>(rKinBodyInfo, "isRobot", isExistingRobot);
             RAVELOG_VERBOSE_FORMAT("body id='%s', isRobot=%d", id%isRobot);
-            if (isRobot) {
-                if (itExistingBodyInfo == _vBodyInfos.end()) {
-                    // in case no such id
-                    if (!isDeleted) {
-                        RobotBase::RobotBaseInfoPtr pRobotBaseInfo(new RobotBase::RobotBaseInfo());
-                        pRobotBaseInfo->DeserializeJSON(rKinBodyInfo, fUnitScale, options);
-                        if (!pRobotBaseInfo->_name.empty()) {
-                            pRobotBaseInfo->_id = id;
-                            _vBodyInfos.push_back(pRobotBaseInfo);
-                            RAVELOG_VERBOSE_FORMAT("created new robot id='%s'", id);
-                        } else {
-                            RAVELOG_WARN_FORMAT("new robot id='%s' does not have a name, so skip creating", id);
-                        }
+            if (itExistingBodyInfo == _vBodyInfos.end()) {
+                // in case no such id
+                if (!isDeleted) {
+                    KinBody::KinBodyInfoPtr pKinBodyInfo;
+                    if (isRobot) {
+                        pKinBodyInfo.reset(new RobotBase::RobotBaseInfo());
                     }
-                    continue;
-                }
-                // in case same id exists before
-                if (isDeleted) {
-                    RAVELOG_VERBOSE_FORMAT("deleted robot id ='%s'", id);
-                    _vBodyInfos.erase(itExistingBodyInfo);
-                    continue;
+                    else {
+                        pKinBodyInfo.reset(new KinBody::KinBodyInfo());
+                    }
+                    // added now so that the order of _vBodyInfos does not depend on when the info is decoded, removed if it does not have a name
+                    _vBodyInfos.push_back(pKinBodyInfo);
+                    decodequeue.Queue(pKinBodyInfo, rKinBodyInfo, id, true);
                 }
-                KinBody::KinBodyInfoPtr pKinBodyInfo = *itExistingBodyInfo;
-                RobotBase::RobotBaseInfoPtr pRobotBaseInfo = OPENRAVE_DYNAMIC_POINTER_CAST<RobotBase::RobotBaseInfo>(pKinBodyInfo);
-                if (!pRobotBaseInfo) {
+                continue;
+            }
+            // in case same id exists before
+            if (isDeleted) {
+                RAVELOG_VERBOSE_FORMAT("deleted %s id ='%s'", (isRobot ? "robot" : "body")%id);
+                _vBodyInfos.erase(itExistingBodyInfo);
+                continue;
+            }
+            KinBody::KinBodyInfoPtr pKinBodyInfo = *itExistingBodyInfo;
+            if (isRobot) {
+                if (!isExistingRobot) {
                     // previous body was not a robot
                     // need to replace with a new RobotBaseInfo
-                    pRobotBaseInfo.reset(new RobotBase::RobotBaseInfo());
+                    RobotBase::RobotBaseInfoPtr pRobotBaseInfo(new RobotBase::RobotBaseInfo());
                     *itExistingBodyInfo = pRobotBaseInfo;
                     *((KinBody::KinBodyInfo*)pRobotBaseInfo.get()) = *pKinBodyInfo;
+                    pKinBodyInfo = pRobotBaseInfo;
                     RAVELOG_VERBOSE_FORMAT("replaced body as a robot id='%s'", id);
                 }
-                pRobotBaseInfo->DeserializeJSON(rKinBodyInfo, fUnitScale, options);
-                pRobotBaseInfo->_id = id;
+            }
+            else if (isExistingRobot) {
+                // previous body was a robot
+                // need to replace with a new KinBodyInfo
+                KinBody::KinBodyInfoPtr pNewKinBodyInfo(new KinBody::KinBodyInfo());
+                *itExistingBodyInfo = pNewKinBodyInfo;
+                *pNewKinBodyInfo = *((KinBody::KinBodyInfo*)pKinBodyInfo.get());
+                pKinBodyInfo = pNewKinBodyInfo;
+                RAVELOG_VERBOSE_FORMAT("replaced robot as a body id='%s'", id);
+            }
+            decodequeue.Queue(pKinBodyInfo, rKinBodyInfo, id, false);
+        }
+        decodequeue.Flush();
+    }
+}
+
+namespace {
+
+static const uint32_t s_nDeltaMagic = 0x4c44524f; // "ORDL"
+static const uint16_t s_nDeltaVersion = 1;
+
+enum DeltaBodyFlags
+{
+    DBF_Info = 1, ///< the full info of the body follows
+    DBF_State = 2, ///< the transform, dof values and link enable states follow
+    DBF_Grabbed = 4, ///< the grabbed infos follow
+};
+
+inline void _WriteDeltaValue(std::ostream& os, const void* pvalue, size_t numBytes)
+{
+    os.write((const char*)pvalue, numBytes);
+}
+
+template <typename T>
+inline void _WriteDeltaValue(std::ostream& os, T value)
+{
+    os.write((const char*)&value, sizeof(value));
+}
+
+inline void _WriteDeltaString(std::ostream& os, const std::string& s)
+{
+    _WriteDeltaValue<uint32_t>(os, s.size());
+    os.write(s.c_str(), s.size());
+}
+
+template <typename T>
+inline bool _ReadDeltaValue(std::istream& is, T& value)
+{
+    is.read((char*)&value, sizeof(value));
+    return !!is;
+}
+
+/// \brief reads numBytes into data, which is resized to numBytes.
+///
+/// The sizes come from the delta, so a malformed delta must not make data allocate more than what is left in is.
+template <typename Container>
+inline bool _ReadDeltaBytes(std::istream& is, size_t numBytes, Container& data)
+{
+    const std::istream::pos_type pos = is.tellg();
+    if( pos != std::istream::pos_type(-1) ) {
+        is.seekg(0, std::ios::end);
+        const std::istream::pos_type end = is.tellg();
+        is.seekg(pos);
+        if( !is || end - pos < (std::streamoff)numBytes ) {
+            return false;
+        }
+        data.resize(numBytes);
+        if( numBytes > 0 ) {
+            is.read((char*)&data[0], numBytes);
+        }
+        return !!is;
+    }
+
+    // cannot tell what is left in is, so grow data as the bytes arrive
+    static const size_t s_nChunkSize = 65536;
+    data.resize(0);
+    while( data.size() < numBytes ) {
+        const size_t offset = data.size();
+        data.resize(offset + std::min(numBytes - offset, s_nChunkSize));
+        is.read((char*)&data[offset], data.size() - offset);
+        if( !is ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool _ReadDeltaString(std::istream& is, std::string& s)
+{
+    uint32_t length = 0;
+    if( !_ReadDeltaValue(is, length) ) {
+        return false;
+    }
+    return _ReadDeltaBytes(is, length, s);
+}
+
+/// \brief writes the json value as msgpack prefixed by its size
+inline void _WriteDeltaMsgPack(std::ostream& os, const rapidjson::Value& value)
+{
+    std::vector<char> vdata;
+    MsgPack::DumpMsgPack(value, vdata);
+    _WriteDeltaValue<uint32_t>(os, vdata.size());
+    os.write(vdata.data(), vdata.size());
+}
+
+inline bool _ReadDeltaMsgPack(std::istream& is, rapidjson::Document& doc, std::string& buffer)
+{
+    if( !_ReadDeltaString(is, buffer) ) {
+        return false;
+    }
+    MsgPack::ParseMsgPack(doc, buffer.data(), buffer.size());
+    return true;
+}
+
+std::string _GetGrabbedHash(const KinBody& body)
+{
+    std::string grabbedHash;
+    if( body.GetNumGrabbed() > 0 ) {
+        std::vector<KinBody::GrabbedInfoPtr> vGrabbedInfos;
+        body.GetGrabbedInfo(vGrabbedInfos);
+        FOREACHC(itGrabbedInfo, vGrabbedInfos) {
+            grabbedHash += (*itGrabbedInfo)->GetGrabbedInfoHash();
+        }
+    }
+    return grabbedHash;
+}
+
+} // end namespace
+
+void EnvironmentBase::ExtractDelta(std::ostream& odelta, DeltaStamp& stamp)
+{
+    EnvironmentLock lock(GetMutex());
+    std::vector<KinBodyPtr> vBodies;
+    GetBodies(vBodies);
+
+    std::set<std::string> setCurrentIds;
+    std::stringstream ssbodies(std::ios::in|std::ios::out|std::ios::binary);
+    uint32_t numBodies = 0;
+    std::vector<dReal> vDOFValues;
+    std::vector<uint8_t> vLinkEnableStates;
+    FOREACHC(itbody, vBodies) {
+        const KinBodyPtr& pbody = *itbody;
+        const std::string& bodyId = pbody->GetId();
+        if( bodyId.empty() ) {
+            continue;
+        }
+        setCurrentIds.insert(bodyId);
+
+        DeltaStamp::BodyStamp& bodyStamp = stamp._mapBodyStamps[bodyId];
+        const bool bNewBody = bodyStamp.pbody.lock() != pbody;
+        const std::string grabbedHash = _GetGrabbedHash(*pbody);
+        uint8_t flags = 0;
+        if( bNewBody || bodyStamp.structureRevision != pbody->GetStructureRevision() ) {
+            // the info also carries the state and the grabbed bodies
+            flags = DBF_Info;
+        }
+        else {
+            if( bodyStamp.updateStamp != pbody->GetUpdateStamp() ) {
+                flags |= DBF_State;
+            }
+            if( bodyStamp.grabbedHash != grabbedHash ) {
+                flags |= DBF_Grabbed;
+            }
+        }
+        bodyStamp.pbody = pbody;
+        bodyStamp.updateStamp = pbody->GetUpdateStamp();
+        bodyStamp.structureRevision = pbody->GetStructureRevision();
+        bodyStamp.grabbedHash = grabbedHash;
+        if( flags == 0 ) {
+            continue;
+        }
+
+        ++numBodies;
+        _WriteDeltaString(ssbodies, bodyId);
+        _WriteDeltaValue<uint8_t>(ssbodies, flags);
+        if( flags & DBF_Info ) {
+            rapidjson::Document rBodyInfo;
+            if( pbody->IsRobot() ) {
+                RobotBase::RobotBaseInfo robotInfo;
+                RaveInterfaceCast<RobotBase>(pbody)->ExtractInfo(robotInfo, EIO_Everything);
+                robotInfo.SerializeJSON(rBodyInfo, rBodyInfo.GetAllocator(), 1.0);
             }
             else {
-                // not a robot
-                if (itExistingBodyInfo == _vBodyInfos.end()) {
-                    // in case no such id
-                    if (!isDeleted) {
-                        KinBody::KinBodyInfoPtr pKinBodyInfo(new KinBody::KinBodyInfo());
-                        pKinBodyInfo->DeserializeJSON(rKinBodyInfo, fUnitScale, options);
-                        if (!pKinBodyInfo->_name.empty()) {
-                            pKinBodyInfo->_id = id;
-                            _vBodyInfos.push_back(pKinBodyInfo);
-                            RAVELOG_VERBOSE_FORMAT("created new body id='%s'", id);
-                        } else {
-                            RAVELOG_WARN_FORMAT("new body id='%s' does not have a name, so skip creating", id);
-                        }
-                    }
-                    continue;
-                }
-                // in case same id exists before
-                if (isDeleted) {
-                    RAVELOG_VERBOSE_FORMAT("deleted body id='%s'", id);
-                    _vBodyInfos.erase(itExistingBodyInfo);
-                    continue;
-                }
-                KinBody::KinBodyInfoPtr pKinBodyInfo = *itExistingBodyInfo;
-                RobotBase::RobotBaseInfoPtr pRobotBaseInfo = OPENRAVE_DYNAMIC_POINTER_CAST<RobotBase::RobotBaseInfo>(pKinBodyInfo);
-                if (!!pRobotBaseInfo) {
-                    // previous body was a robot
-                    // need to replace with a new KinBodyInfo
-                    pKinBodyInfo.reset(new KinBody::KinBodyInfo());
-                    *itExistingBodyInfo = pKinBodyInfo;
-                    *pKinBodyInfo = *((KinBody::KinBodyInfo*)pRobotBaseInfo.get());
-                    RAVELOG_VERBOSE_FORMAT("replaced robot as a body id='%s'", id);
-                }
-                pKinBodyInfo->DeserializeJSON(rKinBodyInfo, fUnitScale, options);
-                pKinBodyInfo->_id = id;
+                KinBody::KinBodyInfo bodyInfo;
+                pbody->ExtractInfo(bodyInfo, EIO_Everything);
+                bodyInfo.SerializeJSON(rBodyInfo, rBodyInfo.GetAllocator(), 1.0);
+            }
+            _WriteDeltaMsgPack(ssbodies, rBodyInfo);
+        }
+        if( flags & DBF_State ) {
+            const Transform t = pbody->GetTransform();
+            const double ftransform[7] = {t.rot.x, t.rot.y, t.rot.z, t.rot.w, t.trans.x, t.trans.y, t.trans.z};
+            _WriteDeltaValue(ssbodies, ftransform, sizeof(ftransform));
+            pbody->GetDOFValues(vDOFValues);
+            _WriteDeltaValue<uint32_t>(ssbodies, vDOFValues.size());
+            FOREACHC(itvalue, vDOFValues) {
+                _WriteDeltaValue<double>(ssbodies, *itvalue);
+            }
+            pbody->GetLinkEnableStates(vLinkEnableStates);
+            _WriteDeltaValue<uint32_t>(ssbodies, vLinkEnableStates.size());
+            _WriteDeltaValue(ssbodies, vLinkEnableStates.data(), vLinkEnableStates.size());
+        }
+        if( flags & DBF_Grabbed ) {
+            std::vector<KinBody::GrabbedInfoPtr> vGrabbedInfos;
+            pbody->GetGrabbedInfo(vGrabbedInfos);
+            rapidjson::Document rGrabbedInfos;
+            rGrabbedInfos.SetArray();
+            FOREACHC(itGrabbedInfo, vGrabbedInfos) {
+                rapidjson::Value rGrabbedInfo;
+                (*itGrabbedInfo)->SerializeJSON(rGrabbedInfo, rGrabbedInfos.GetAllocator(), 1.0);
+                rGrabbedInfos.PushBack(rGrabbedInfo, rGrabbedInfos.GetAllocator());
+            }
+            _WriteDeltaMsgPack(ssbodies, rGrabbedInfos);
+        }
+    }
+
+    std::vector<std::string> vRemovedIds;
+    std::map<std::string, DeltaStamp::BodyStamp>::iterator itBodyStamp = stamp._mapBodyStamps.begin();
+    while( itBodyStamp != stamp._mapBodyStamps.end() ) {
+        if( setCurrentIds.count(itBodyStamp->first) == 0 ) {
+            vRemovedIds.push_back(itBodyStamp->first);
+            itBodyStamp = stamp._mapBodyStamps.erase(itBodyStamp);
+        }
+        else {
+            ++itBodyStamp;
+        }
+    }
+
+    _WriteDeltaValue<uint32_t>(odelta, s_nDeltaMagic);
+    _WriteDeltaValue<uint16_t>(odelta, s_nDeltaVersion);
+    _WriteDeltaValue<uint32_t>(odelta, vRemovedIds.size());
+    FOREACHC(itRemovedId, vRemovedIds) {
+        _WriteDeltaString(odelta, *itRemovedId);
+    }
+    _WriteDeltaValue<uint32_t>(odelta, numBodies);
+    if( numBodies > 0 ) {
+        // streaming an empty buffer would set the failbit of odelta
+        odelta << ssbodies.rdbuf();
+    }
+}
+
+bool EnvironmentBase::ApplyDelta(std::istream& idelta)
+{
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    if( !_ReadDeltaValue(idelta, magic) || magic != s_nDeltaMagic || !_ReadDeltaValue(idelta, version) || version != s_nDeltaVersion ) {
+        RAVELOG_WARN_FORMAT("env=%s, delta does not start with a supported header", GetNameId());
+        return false;
+    }
+
+    EnvironmentLock lock(GetMutex());
+    uint32_t numRemoved = 0;
+    if( !_ReadDeltaValue(idelta, numRemoved) ) {
+        return false;
+    }
+    std::string bodyId;
+    for(uint32_t iremoved = 0; iremoved < numRemoved; ++iremoved) {
+        if( !_ReadDeltaString(idelta, bodyId) ) {
+            return false;
+        }
+        KinBodyPtr pbody = GetKinBodyById(bodyId);
+        if( !!pbody ) {
+            Remove(pbody);
+        }
+    }
+
+    // the infos are applied together first so that the states and grabbed infos can refer to new bodies
+    struct BodyStateDelta
+    {
+        std::string bodyId;
+        Transform transform;
+        std::vector<dReal> vDOFValues;
+        std::vector<uint8_t> vLinkEnableStates;
+    };
+    std::vector<BodyStateDelta> vStateDeltas;
+    std::vector< std::pair<std::string, std::vector<KinBody::GrabbedInfoConstPtr> > > vGrabbedDeltas;
+    EnvironmentBaseInfo envInfo;
+    uint32_t numBodies = 0;
+    if( !_ReadDeltaValue(idelta, numBodies) ) {
+        return false;
+    }
+    std::string buffer;
+    for(uint32_t ibody = 0; ibody < numBodies; ++ibody) {
+        uint8_t flags = 0;
+        if( !_ReadDeltaString(idelta, bodyId) || !_ReadDeltaValue(idelta, flags) ) {
+            return false;
+        }
+        if( flags & DBF_Info ) {
+            rapidjson::Document rBodyInfo;
+            if( !_ReadDeltaMsgPack(idelta, rBodyInfo, buffer) ) {
+                return false;
+            }
+            KinBody::KinBodyInfoPtr pBodyInfo;
+            if( orjson::GetJsonValueByKey<bool>(rBodyInfo, "isRobot", false) ) {
+                pBodyInfo.reset(new RobotBase::RobotBaseInfo());
+            }
+            else {
+                pBodyInfo.reset(new KinBody::KinBodyInfo());
             }
+            pBodyInfo->DeserializeJSON(rBodyInfo, 1.0, 0);
+            envInfo._vBodyInfos.push_back(pBodyInfo);
         }
+        if( flags & DBF_State ) {
+            BodyStateDelta stateDelta;
+            stateDelta.bodyId = bodyId;
+            double ftransform[7];
+            uint32_t numValues = 0;
+            if( !_ReadDeltaValue(idelta, ftransform) || !_ReadDeltaValue(idelta, numValues) || !_ReadDeltaBytes(idelta, numValues*sizeof(double), buffer) ) {
+                return false;
+            }
+            stateDelta.transform.rot = Vector(ftransform[0], ftransform[1], ftransform[2], ftransform[3]);
+            stateDelta.transform.trans = Vector(ftransform[4], ftransform[5], ftransform[6]);
+            stateDelta.vDOFValues.resize(numValues);
+            for(uint32_t ivalue = 0; ivalue < numValues; ++ivalue) {
+                double fvalue = 0;
+                memcpy(&fvalue, buffer.data() + ivalue*sizeof(double), sizeof(double));
+                stateDelta.vDOFValues[ivalue] = fvalue;
+            }
+            if( !_ReadDeltaValue(idelta, numValues) || !_ReadDeltaBytes(idelta, numValues, stateDelta.vLinkEnableStates) ) {
+                return false;
+            }
+            vStateDeltas.push_back(stateDelta);
+        }
+        if( flags & DBF_Grabbed ) {
+            rapidjson::Document rGrabbedInfos;
+            if( !_ReadDeltaMsgPack(idelta, rGrabbedInfos, buffer) || !rGrabbedInfos.IsArray() ) {
+                return false;
+            }
+            vGrabbedDeltas.push_back(std::make_pair(bodyId, std::vector<KinBody::GrabbedInfoConstPtr>()));
+            for(rapidjson::Value::ConstValueIterator itGrabbedInfo = rGrabbedInfos.Begin(); itGrabbedInfo != rGrabbedInfos.End(); ++itGrabbedInfo) {
+                KinBody::GrabbedInfoPtr pGrabbedInfo(new KinBody::GrabbedInfo());
+                pGrabbedInfo->DeserializeJSON(*itGrabbedInfo, 1.0, 0);
+                vGrabbedDeltas.back().second.push_back(pGrabbedInfo);
+            }
+        }
+    }
+
+    if( envInfo._vBodyInfos.size() > 0 ) {
+        std::vector<KinBodyPtr> vCreatedBodies, vModifiedBodies, vRemovedBodies;
+        UpdateFromInfo(envInfo, vCreatedBodies, vModifiedBodies, vRemovedBodies, UFIM_OnlySpecifiedBodiesExact);
+    }
+
+    std::vector<uint8_t> vLinkEnableStates;
+    FOREACHC(itStateDelta, vStateDeltas) {
+        KinBodyPtr pbody = GetKinBodyById(itStateDelta->bodyId);
+        if( !pbody ) {
+            RAVELOG_WARN_FORMAT("env=%s, delta has state of body id='%s' that does not exist", GetNameId()%itStateDelta->bodyId);
+            continue;
+        }
+        if( (int)itStateDelta->vDOFValues.size() != pbody->GetDOF() ) {
+            RAVELOG_WARN_FORMAT("env=%s, delta has %d dof values for body id='%s' with %d dofs", GetNameId()%itStateDelta->vDOFValues.size()%itStateDelta->bodyId%pbody->GetDOF());
+            continue;
+        }
+        pbody->SetDOFValues(itStateDelta->vDOFValues, itStateDelta->transform, KinBody::CLA_Nothing);
+        pbody->GetLinkEnableStates(vLinkEnableStates);
+        if( vLinkEnableStates != itStateDelta->vLinkEnableStates && itStateDelta->vLinkEnableStates.size() == pbody->GetLinks().size() ) {
+            pbody->SetLinkEnableStates(itStateDelta->vLinkEnableStates);
+        }
+    }
+
+    FOREACHC(itGrabbedDelta, vGrabbedDeltas) {
+        KinBodyPtr pbody = GetKinBodyById(itGrabbedDelta->first);
+        if( !pbody ) {
+            RAVELOG_WARN_FORMAT("env=%s, delta has grabbed bodies of body id='%s' that does not exist", GetNameId()%itGrabbedDelta->first);
+            continue;
+        }
+        pbody->ResetGrabbed(itGrabbedDelta->second);
+    }
+    return true;
+}
+
+namespace {
+
+static thread_local std::vector<const EnvironmentStateMutex*> s_vExclusiveStateMutexes; ///< state mutexes locked exclusively by the current thread
+static thread_local std::vector<const EnvironmentStateMutex*> s_vSharedStateMutexes; ///< state mutexes locked shared by the current thread
+
+inline bool _IsStateMutexHeld(const std::vector<const EnvironmentStateMutex*>& vmutexes, const EnvironmentStateMutex& mutex)
+{
+    return std::find(vmutexes.begin(), vmutexes.end(), &mutex) != vmutexes.end();
+}
+
+inline void _EraseStateMutex(std::vector<const EnvironmentStateMutex*>& vmutexes, const EnvironmentStateMutex& mutex)
+{
+    std::vector<const EnvironmentStateMutex*>::iterator it = std::find(vmutexes.begin(), vmutexes.end(), &mutex);
+    if( it != vmutexes.end() ) {
+        vmutexes.erase(it);
+    }
+}
+
+} // end namespace
+
+EnvironmentStateExclusiveLock::EnvironmentStateExclusiveLock(const EnvironmentBase& env, bool bAlways) : _env(env), _bAlways(bAlways), _bLocked(false)
+{
+    lock();
+}
+
+EnvironmentStateExclusiveLock::~EnvironmentStateExclusiveLock()
+{
+    unlock();
+}
+
+void EnvironmentStateExclusiveLock::lock()
+{
+    if( _bLocked || (!_bAlways && !_env.IsConcurrentCollisionQueryEnabled()) ) {
+        return;
+    }
+    EnvironmentStateMutex& mutex = _env.GetStateMutex();
+    if( _IsStateMutexHeld(s_vExclusiveStateMutexes, mutex) ) {
+        return;
+    }
+    if( _IsStateMutexHeld(s_vSharedStateMutexes, mutex) ) {
+        throw OPENRAVE_EXCEPTION_FORMAT(_("env=%s, cannot change the state of the environment from inside a concurrent collision query"), _env.GetNameId(), ORE_InvalidState);
+    }
+    mutex.lock();
+    s_vExclusiveStateMutexes.push_back(&mutex);
+    _bLocked = true;
+}
+
+void EnvironmentStateExclusiveLock::unlock()
+{
+    if( !_bLocked ) {
+        return;
+    }
+    EnvironmentStateMutex& mutex = _env.GetStateMutex();
+    _EraseStateMutex(s_vExclusiveStateMutexes, mutex);
+    mutex.unlock();
+    _bLocked = false;
+}
+
+EnvironmentStateSharedLock::EnvironmentStateSharedLock(EnvironmentStateMutex& mutex, defer_lock_t) : _mutex(mutex), _bLocked(false)
+{
+}
+
+EnvironmentStateSharedLock::~EnvironmentStateSharedLock()
+{
+    unlock();
+}
+
+void EnvironmentStateSharedLock::lock()
+{
+    if( _bLocked || _IsStateMutexHeld(s_vExclusiveStateMutexes, _mutex) || _IsStateMutexHeld(s_vSharedStateMutexes, _mutex) ) {
+        return;
+    }
+    _mutex.lock_shared();
+    s_vSharedStateMutexes.push_back(&_mutex);
+    _bLocked = true;
+}
+
+void EnvironmentStateSharedLock::unlock()
+{
+    if( !_bLocked ) {
+        return;
     }
+    _EraseStateMutex(s_vSharedStateMutexes, _mutex);
+    _mutex.unlock_shared();
+    _bLocked = false;
 }
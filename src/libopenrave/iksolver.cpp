@@ -164,6 +164,48 @@ bool IkSolverBase::SolveAll(const IkParameterization& param, const std::vector<d
     return vsolutions.size() > 0;
 }
 
+int IkSolverBase::SolveBatch(const std::vector<IkParameterization>& vparams, const std::vector<dReal>& q0, int filteroptions, std::vector<IkReturnPtr>& vikreturns)
+{
+    vikreturns.resize(vparams.size());
+    int numsolved = 0;
+    for(size_t iparam = 0; iparam < vparams.size(); ++iparam) {
+        if( !vikreturns[iparam] ) {
+            vikreturns[iparam].reset(new IkReturn(IKRA_Reject));
+        }
+        if( Solve(vparams[iparam], q0, filteroptions, vikreturns[iparam]) ) {
+            ++numsolved;
+        }
+    }
+    return numsolved;
+}
+
+int IkSolverBase::SolveAllBatch(const std::vector<IkParameterization>& vparams, int filteroptions, std::vector< std::vector<IkReturnPtr> >& vvikreturns)
+{
+    vvikreturns.resize(vparams.size());
+    int numsolved = 0;
+    for(size_t iparam = 0; iparam < vparams.size(); ++iparam) {
+        if( SolveAll(vparams[iparam], filteroptions, vvikreturns[iparam]) ) {
+            ++numsolved;
+        }
+    }
+    return numsolved;
+}
+
+bool IkSolverBase::HasRegisteredCallbacks() const
+{
+    FOREACHC(it, __listRegisteredFilters) {
+        if( !!it->lock() ) {
+            return true;
+        }
+    }
+    FOREACHC(it, __listRegisteredFinishCallbacks) {
+        if( !!it->lock() ) {
+            return true;
+        }
+    }
+    return false;
+}
+
 UserDataPtr IkSolverBase::RegisterCustomFilter(int32_t priority, const IkSolverBase::IkFilterCallbackFn &filterfn)
 {
     CustomIkSolverFilterDataPtr pdata(new CustomIkSolverFilterData(priority,filterfn,shared_iksolver()));
@@ -439,6 +439,8 @@ KinBody::KinBody(InterfaceType type, EnvironmentBasePtr penv) : InterfaceBase(ty
     _environmentBodyIndex = 0;
     _nNonAdjacentLinkCache = 0x80000000;
     _nUpdateStampId = 0;
+    _nChangedLinksUpdateStamp = -1;
+    _nChangedLinksBaseUpdateStamp = -1;
     _bAreAllJoints1DOFAndNonCircular = false;
     _lastModifiedAtUS = 0;
     _revisionId = 0;
@@ -1432,6 +1434,7 @@ void KinBody::SetTransform(const Transform& bodyTransform)
     if( _veclinks.size() == 0 ) {
         return;
     }
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     Transform baseLinkTransform = bodyTransform * _baseLinkInBodyTransform;
     Transform tbaseinv = _veclinks.front()->GetTransform().inverse();
     Transform tapply = baseLinkTransform * tbaseinv;
@@ -2066,6 +2069,7 @@ Vector KinBody::GetCenterOfMass() const
 
 void KinBody::SetLinkTransformations(const std::vector<Transform>& vbodies)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     if( RaveGetDebugLevel() & Level_VerifyPlans ) {
         RAVELOG_WARN("SetLinkTransformations should be called with doflastsetvalues, re-setting all values\n");
     }
@@ -2089,6 +2093,7 @@ void KinBody::SetLinkTransformations(const std::vector<Transform>& vbodies)
 
 void KinBody::SetLinkTransformations(const std::vector<Transform>& transforms, const std::vector<dReal>& doflastsetvalues)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     OPENRAVE_ASSERT_OP_FORMAT(transforms.size(), >=, _veclinks.size(), "env=%s, not enough links %d<%d", GetEnv()->GetNameId()%transforms.size()%_veclinks.size(),ORE_InvalidArguments);
     vector<Transform>::const_iterator it;
     vector<LinkPtr>::iterator itlink;
@@ -2106,12 +2111,14 @@ void KinBody::SetLinkTransformations(const std::vector<Transform>& transforms, c
 
 void KinBody::SetLinkVelocities(const std::vector<std::pair<Vector,Vector> >& velocities)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     GetEnv()->GetPhysicsEngine()->SetLinkVelocities(shared_kinbody(),velocities);
     _UpdateGrabbedBodies();
 }
 
 void KinBody::SetLinkEnableStates(const std::vector<uint8_t>& enablestates)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     OPENRAVE_ASSERT_OP(enablestates.size(),==,_veclinks.size());
     bool bchanged = false;
     for(size_t ilink = 0; ilink < enablestates.size(); ++ilink) {
@@ -2132,6 +2139,7 @@ void KinBody::SetDOFValues(const std::vector<dReal>& vJointValues, const Transfo
     if( _veclinks.size() == 0 ) {
         return;
     }
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     Transform baseLinkTransform = bodyTransform * _baseLinkInBodyTransform;
     Transform tbase = baseLinkTransform*_veclinks.at(0)->GetTransform().inverse();
     _veclinks.at(0)->SetTransform(baseLinkTransform);
@@ -2151,6 +2159,87 @@ void KinBody::SetDOFValues(const std::vector<dReal>& vJointValues, uint32_t chec
     SetDOFValues(&vJointValues[0], vJointValues.size(), checklimits, dofindices);
 }
 
+/// flags of KinBody::_vJointsToUpdateCache
+static const uint8_t s_nJointToUpdateRecompute = 1; ///< the transform of the child link has to be recomputed
+static const uint8_t s_nJointToUpdateNeedsValues = 2; ///< the joint values are needed to recompute the links
+static const uint8_t s_nJointToUpdateDOFsChanged = 4; ///< one of the dofs of the joint is set
+
+void KinBody::_ClampJointValuesToLimits(const Joint& joint, const dReal* p, dReal* ptempjoints, uint32_t checklimits) const
+{
+    if( checklimits == CLA_Nothing ) {
+        // limits should not be checked, so just copy
+        for(int i = 0; i < joint.GetDOF(); ++i) {
+            *ptempjoints++ = p[i];
+        }
+        return;
+    }
+    if( joint.GetType() == JointSpherical ) {
+        dReal fcurang = fmod(RaveSqrt(p[0]*p[0]+p[1]*p[1]+p[2]*p[2]),2*PI);
+        dReal lowerlimit = joint.GetLowerLimit(0);
+        dReal upperlimit = joint.GetUpperLimit(0);
+
+        if( fcurang < lowerlimit ) {
+            if( fcurang < 1e-10 ) {
+                *ptempjoints++ = lowerlimit; *ptempjoints++ = 0; *ptempjoints++ = 0;
+            }
+            else {
+                dReal fmult = lowerlimit/fcurang;
+                *ptempjoints++ = p[0]*fmult; *ptempjoints++ = p[1]*fmult; *ptempjoints++ = p[2]*fmult;
+            }
+        }
+        else if( fcurang > upperlimit ) {
+            if( fcurang < 1e-10 ) {
+                *ptempjoints++ = upperlimit; *ptempjoints++ = 0; *ptempjoints++ = 0;
+            }
+            else {
+                dReal fmult = upperlimit/fcurang;
+                *ptempjoints++ = p[0]*fmult; *ptempjoints++ = p[1]*fmult; *ptempjoints++ = p[2]*fmult;
+            }
+        }
+        else {
+            *ptempjoints++ = p[0]; *ptempjoints++ = p[1]; *ptempjoints++ = p[2];
+        }
+    }
+    else {
+        for(int i = 0; i < joint.GetDOF(); ++i) {
+            if( joint.IsCircular(i) ) {
+                // don't normalize since user is expecting the values he sets are exactly returned via GetDOFValues
+                *ptempjoints++ = p[i]; //utils::NormalizeCircularAngle(p[i],(*it)->_vcircularlowerlimit[i],(*it)->_vcircularupperlimit[i]);
+            }
+            else {
+                dReal lowerlimit = joint.GetLowerLimit(0);
+                dReal upperlimit = joint.GetUpperLimit(0);
+
+                if( p[i] < lowerlimit ) {
+                    if( p[i] < lowerlimit-g_fEpsilonEvalJointLimit ) {
+                        if( checklimits == CLA_CheckLimits ) {
+                            RAVELOG_WARN(str(boost::format("env=%d, dof %d value %e is smaller than the lower limit %e")%GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%lowerlimit));
+                        }
+                        else if( checklimits == CLA_CheckLimitsThrow ) {
+                            throw OPENRAVE_EXCEPTION_FORMAT(_("env=%d, dof %d value %e is smaller than the lower limit %e"), GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%lowerlimit, ORE_InvalidArguments);
+                        }
+                    }
+                    *ptempjoints++ = lowerlimit;
+                }
+                else if( p[i] > upperlimit ) {
+                    if( p[i] > upperlimit+g_fEpsilonEvalJointLimit ) {
+                        if( checklimits == CLA_CheckLimits ) {
+                            RAVELOG_WARN_FORMAT("env=%d, dof %d value %.16e is greater than the upper limit %.16e", GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%upperlimit);
+                        }
+                        else if( checklimits == CLA_CheckLimitsThrow ) {
+                            throw OPENRAVE_EXCEPTION_FORMAT(_("env=%d, dof %d value %.16e is greater than the upper limit %.16e"), GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%upperlimit, ORE_InvalidArguments);
+                        }
+                    }
+                    *ptempjoints++ = upperlimit;
+                }
+                else {
+                    *ptempjoints++ = p[i];
+                }
+            }
+        }
+    }
+}
+
 void KinBody::SetDOFValues(const dReal* pJointValues, int dof, uint32_t checklimits, const std::vector<int>& dofindices)
 {
     CHECK_INTERNAL_COMPUTATION;
@@ -2159,8 +2248,37 @@ void KinBody::SetDOFValues(const dReal* pJointValues, int dof, uint32_t checklim
     }
     int expecteddof = dofindices.size() > 0 ? (int)dofindices.size() : GetDOF();
     OPENRAVE_ASSERT_OP_FORMAT((int)dof,>=,expecteddof, "env=%s, not enough values %d<%d", GetEnv()->GetNameId()%dof%GetDOF(),ORE_InvalidArguments);
+    EnvironmentStateExclusiveLock lockstate(*GetEnv()); // concurrent collision queries have to wait until the state is consistent
 
-    if(checklimits == CLA_Nothing && dofindices.empty()) {
+    // when only a subset of the dofs is set, only the links downstream of them have to be recomputed
+    const bool bIncremental = dofindices.size() > 0 && (int)dofindices.size() < GetDOF() && !_pCurrentKinematicsFunctions && _vClosedLoops.empty() && _ComputeJointsToUpdate(dofindices);
+    const int nBaseUpdateStamp = _nUpdateStampId; // Link::SetTransform increments the stamp for every recomputed link
+    if( bIncremental ) {
+        // only get the values of the joints that are recomputed instead of all the dofs
+        _vTempJoints.resize(GetDOF());
+        boost::array<dReal,3> vjointvalues;
+        for(const JointPtr& pjoint : _vecjoints) {
+            const Joint& joint = *pjoint;
+            if( _vJointsToUpdateCache[joint.GetJointIndex()] & s_nJointToUpdateNeedsValues ) {
+                joint.GetValues(vjointvalues);
+                std::copy(vjointvalues.begin(), vjointvalues.begin()+joint.GetDOF(), _vTempJoints.begin()+joint.GetDOFIndex());
+            }
+        }
+        for(size_t i = 0; i < dofindices.size(); ++i) {
+            _vTempJoints.at(dofindices[i]) = pJointValues[i];
+        }
+        if( checklimits != CLA_Nothing ) {
+            for(const JointPtr& pjoint : _vecjoints) {
+                const Joint& joint = *pjoint;
+                if( _vJointsToUpdateCache[joint.GetJointIndex()] & s_nJointToUpdateDOFsChanged ) {
+                    dReal* pjointvalues = &_vTempJoints[joint.GetDOFIndex()];
+                    _ClampJointValuesToLimits(joint, pjointvalues, pjointvalues, checklimits);
+                }
+            }
+        }
+        pJointValues = &_vTempJoints[0];
+    }
+    else if(checklimits == CLA_Nothing && dofindices.empty()) {
         _vTempJoints.assign(pJointValues, pJointValues + dof);
     }
     else {
@@ -2179,80 +2297,8 @@ void KinBody::SetDOFValues(const dReal* pJointValues, int dof, uint32_t checklim
         // check the limits
         for(const JointPtr& pjoint : _vecjoints) {
             const Joint& joint = *pjoint;
-
-            const dReal* p = pJointValues+joint.GetDOFIndex();
-            if( checklimits == CLA_Nothing ) {
-                // limits should not be checked, so just copy
-                for(int i = 0; i < joint.GetDOF(); ++i) {
-                    *ptempjoints++ = p[i];
-                }
-                continue;
-            }
-            if( joint.GetType() == JointSpherical ) {
-                dReal fcurang = fmod(RaveSqrt(p[0]*p[0]+p[1]*p[1]+p[2]*p[2]),2*PI);
-                dReal lowerlimit = joint.GetLowerLimit(0);
-                dReal upperlimit = joint.GetUpperLimit(0);
-
-                if( fcurang < lowerlimit ) {
-                    if( fcurang < 1e-10 ) {
-                        *ptempjoints++ = lowerlimit; *ptempjoints++ = 0; *ptempjoints++ = 0;
-                    }
-                    else {
-                        dReal fmult = lowerlimit/fcurang;
-                        *ptempjoints++ = p[0]*fmult; *ptempjoints++ = p[1]*fmult; *ptempjoints++ = p[2]*fmult;
-                    }
-                }
-                else if( fcurang > upperlimit ) {
-                    if( fcurang < 1e-10 ) {
-                        *ptempjoints++ = upperlimit; *ptempjoints++ = 0; *ptempjoints++ = 0;
-                    }
-                    else {
-                        dReal fmult = upperlimit/fcurang;
-                        *ptempjoints++ = p[0]*fmult; *ptempjoints++ = p[1]*fmult; *ptempjoints++ = p[2]*fmult;
-                    }
-                }
-                else {
-                    *ptempjoints++ = p[0]; *ptempjoints++ = p[1]; *ptempjoints++ = p[2];
-                }
-            }
-            else {
-                for(int i = 0; i < joint.GetDOF(); ++i) {
-                    if( joint.IsCircular(i) ) {
-                        // don't normalize since user is expecting the values he sets are exactly returned via GetDOFValues
-                        *ptempjoints++ = p[i]; //utils::NormalizeCircularAngle(p[i],(*it)->_vcircularlowerlimit[i],(*it)->_vcircularupperlimit[i]);
-                    }
-                    else {
-                        dReal lowerlimit = joint.GetLowerLimit(0);
-                        dReal upperlimit = joint.GetUpperLimit(0);
-
-                        if( p[i] < lowerlimit ) {
-                            if( p[i] < lowerlimit-g_fEpsilonEvalJointLimit ) {
-                                if( checklimits == CLA_CheckLimits ) {
-                                    RAVELOG_WARN(str(boost::format("env=%d, dof %d value %e is smaller than the lower limit %e")%GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%lowerlimit));
-                                }
-                                else if( checklimits == CLA_CheckLimitsThrow ) {
-                                    throw OPENRAVE_EXCEPTION_FORMAT(_("env=%d, dof %d value %e is smaller than the lower limit %e"), GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%lowerlimit, ORE_InvalidArguments);
-                                }
-                            }
-                            *ptempjoints++ = lowerlimit;
-                        }
-                        else if( p[i] > upperlimit ) {
-                            if( p[i] > upperlimit+g_fEpsilonEvalJointLimit ) {
-                                if( checklimits == CLA_CheckLimits ) {
-                                    RAVELOG_WARN_FORMAT("env=%d, dof %d value %.16e is greater than the upper limit %.16e", GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%upperlimit);
-                                }
-                                else if( checklimits == CLA_CheckLimitsThrow ) {
-                                    throw OPENRAVE_EXCEPTION_FORMAT(_("env=%d, dof %d value %.16e is greater than the upper limit %.16e"), GetEnv()->GetId()%(joint.GetDOFIndex()+i)%p[i]%upperlimit, ORE_InvalidArguments);
-                                }
-                            }
-                            *ptempjoints++ = upperlimit;
-                        }
-                        else {
-                            *ptempjoints++ = p[i];
-                        }
-                    }
-                }
-            }
+            _ClampJointValuesToLimits(joint, pJointValues+joint.GetDOFIndex(), ptempjoints, checklimits);
+            ptempjoints += joint.GetDOF();
         }
         pJointValues = &_vTempJoints[0];
     }
@@ -2318,6 +2364,9 @@ void KinBody::SetDOFValues(const dReal* pJointValues, int dof, uint32_t checklim
     std::vector<dReal>& veval = _vTempMimicValues2;
 
     for(size_t ijoint = 0; ijoint < _vTopologicallySortedJointsAll.size(); ++ijoint) {
+        if( bIncremental && !(_vJointsToUpdateCache[_vTopologicallySortedJointIndicesAll[ijoint]] & s_nJointToUpdateRecompute) ) {
+            continue; // not downstream of the changed dofs, so child link stays
+        }
         const JointPtr& pjoint = _vTopologicallySortedJointsAll[ijoint];
         KinBody::Joint& joint = *pjoint;
         const LinkPtr& parentlink = joint._attachedbodies[0];
@@ -2515,9 +2564,85 @@ void KinBody::SetDOFValues(const dReal* pJointValues, int dof, uint32_t checklim
     }
 
     _UpdateGrabbedBodies();
+    if( bIncremental ) {
+        // besides the base link, vlinkscomputed only has the links that were recomputed
+        InitializeLinkStateBitMasks(_vChangedLinksMasks, _veclinks.size());
+        for(size_t ilink = 1; ilink < vlinkscomputed.size(); ++ilink) {
+            if( vlinkscomputed[ilink] ) {
+                EnableLinkStateBit(_vChangedLinksMasks, ilink);
+            }
+        }
+        _nChangedLinksBaseUpdateStamp = nBaseUpdateStamp;
+        _nChangedLinksUpdateStamp = _nUpdateStampId + 1; // _PostprocessChangedParameters increments the stamp once
+    }
     _PostprocessChangedParameters(Prop_LinkTransforms);
 }
 
+bool KinBody::_ComputeJointsToUpdate(const std::vector<int>& dofindices)
+{
+    const int nActiveJoints = _vecjoints.size();
+    std::vector<uint8_t>& vjointstoupdate = _vJointsToUpdateCache;
+    vjointstoupdate.resize(nActiveJoints + _vPassiveJoints.size());
+    std::fill(vjointstoupdate.begin(), vjointstoupdate.end(), 0);
+    std::vector<uint8_t>& vlinksmoved = _vLinksMovedCache;
+    vlinksmoved.resize(_veclinks.size());
+    std::fill(vlinksmoved.begin(), vlinksmoved.end(), 0);
+    for(int dofindex : dofindices) {
+        vjointstoupdate.at(_vDOFIndices.at(dofindex)) |= s_nJointToUpdateDOFsChanged;
+    }
+
+    // joints are sorted so that parent links and mimic dependencies come first
+    for(size_t ijoint = 0; ijoint < _vTopologicallySortedJointsAll.size(); ++ijoint) {
+        const Joint& joint = *_vTopologicallySortedJointsAll[ijoint];
+        const int jointindex = _vTopologicallySortedJointIndicesAll[ijoint];
+        const LinkPtr& parentlink = joint._attachedbodies[0];
+        const bool bMimic = !joint.IsStatic() && joint.IsMimic();
+        bool bRecompute = !!parentlink && vlinksmoved[parentlink->GetIndex()];
+        if( !joint.IsStatic() ) {
+            bRecompute |= !!(vjointstoupdate[jointindex] & s_nJointToUpdateDOFsChanged);
+        }
+        if( bMimic && !bRecompute ) {
+            for(int iaxis = 0; iaxis < joint.GetDOF() && !bRecompute; ++iaxis) {
+                if( !joint.IsMimic(iaxis) ) {
+                    continue;
+                }
+                for(const Mimic::DOFFormat& dofformat : joint._vmimic[iaxis]->_vdofformat) {
+                    if( dofformat.dofindex >= 0 ) {
+                        bRecompute |= !!(vjointstoupdate[_vDOFIndices.at(dofformat.dofindex)] & s_nJointToUpdateDOFsChanged);
+                    }
+                    else {
+                        // values of non-mimic passive joints do not change, mimic ones only change when they are recomputed
+                        bRecompute |= _vPassiveJoints.at(dofformat.jointindex-nActiveJoints)->IsMimic() && !!(vjointstoupdate[dofformat.jointindex] & s_nJointToUpdateRecompute);
+                    }
+                }
+            }
+        }
+        if( !bRecompute ) {
+            continue;
+        }
+
+        vjointstoupdate[jointindex] |= s_nJointToUpdateRecompute|s_nJointToUpdateNeedsValues;
+        vlinksmoved[joint._attachedbodies[1]->GetIndex()] = 1;
+        if( bMimic ) {
+            for(int iaxis = 0; iaxis < joint.GetDOF(); ++iaxis) {
+                if( !joint.IsMimic(iaxis) ) {
+                    continue;
+                }
+                for(const Mimic::DOFFormat& dofformat : joint._vmimic[iaxis]->_vdofformat) {
+                    if( dofformat.dofindex >= 0 ) {
+                        vjointstoupdate[_vDOFIndices.at(dofformat.dofindex)] |= s_nJointToUpdateNeedsValues;
+                    }
+                    else if( _vPassiveJoints.at(dofformat.jointindex-nActiveJoints)->IsMimic() && !(vjointstoupdate[dofformat.jointindex] & s_nJointToUpdateRecompute) ) {
+                        // the value of a passive mimic joint is only known when it is recomputed, so have to update everything
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
 bool KinBody::IsDOFRevolute(int dofindex) const
 {
     int jointindex = _vDOFIndices.at(dofindex);
@@ -5346,6 +5471,7 @@ bool KinBody::_RemoveAttachedBody(KinBody &body)
 
 void KinBody::Enable(bool bEnable)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     bool bchanged = false;
     for (const LinkPtr& plink : _veclinks) {
         Link& link = *plink;
@@ -5378,6 +5504,19 @@ bool KinBody::IsEnabled() const
     return false;
 }
 
+bool KinBody::IsStatic() const
+{
+    if( _veclinks.size() == 0 ) {
+        return false;
+    }
+    for (const LinkPtr& plink : _veclinks) {
+        if( !plink->IsStatic() ) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool KinBody::SetVisible(bool visible)
 {
     bool bchanged = false;
@@ -5615,7 +5754,8 @@ void KinBody::Clone(InterfaceBaseConstPtr preference, int cloningoptions)
             }
             newlink._vGeometries = vnewgeometries;
         }
-        {
+        // when sharing geometries, the map copied above already has its own group lists pointing to the shared infos
+        if( !(cloningoptions & Clone_ShareGeometries) ) {
             // deep copy extra geometries as well, otherwise changing value of map in original map affects value of cloned map
             std::map< std::string, std::vector<GeometryInfoPtr> > newMapExtraGeometries;
             for (const std::pair<const std::string, std::vector<GeometryInfoPtr> >& keyValue : newlink._info._mapExtraGeometries) {
@@ -5816,6 +5956,9 @@ void KinBody::Clone(InterfaceBaseConstPtr preference, int cloningoptions)
 void KinBody::_PostprocessChangedParameters(uint32_t parameters)
 {
     _nUpdateStampId++;
+    if( !!(parameters & ~(Prop_LinkTransforms|Prop_LinkEnable|Prop_RobotGrabbed|Prop_RobotActiveDOFs|Prop_BodyAttached|Prop_BodyRemoved)) ) {
+        ++_nStructureRevision;
+    }
     if( _nHierarchyComputed == 1 ) {
         _nParametersChanged |= parameters;
         return;
@@ -5830,6 +5973,8 @@ void KinBody::_PostprocessChangedParameters(uint32_t parameters)
     // do not change hash if geometry changed!
     if( !!(parameters & (Prop_LinkDynamics|Prop_LinkGeometry|Prop_JointMimic)) ) {
         __hashKinematicsGeometryDynamics.resize(0);
+        // the hash rounds the geometry, so it might not change
+        _pLinkSphereTreeCache.reset();
     }
 
     if( (parameters&Prop_LinkEnable) == Prop_LinkEnable ) {
@@ -16,6 +16,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "libopenrave.h"
 
+#include <boost/algorithm/string/predicate.hpp>
+
 namespace OpenRAVE {
 
 bool KinBody::CheckSelfCollision(CollisionReportPtr report, CollisionCheckerBasePtr collisionchecker) const
@@ -42,8 +44,40 @@ bool KinBody::CheckSelfCollision(CollisionReportPtr report, CollisionCheckerBase
         report->nKeepPrevious = 1; // have to keep the previous since aggregating results
     }
 
+    // the spheres approximate the current geometries of the links, so can only be used if the checker does not use another geometry group for this body.
+    // GenericCollisionChecker never reports collisions, so it cannot be short-circuited either.
+    int precheck = 0;
+    const int checkeroptions = collisionchecker->GetCollisionOptions();
+    if( !(checkeroptions & CO_Distance) && _veclinks.size() > 1 && !boost::iequals(collisionchecker->GetXMLId(), "GenericCollisionChecker") ) {
+        bool bUseSpheres = false;
+        try {
+            bUseSpheres = collisionchecker->GetGeometryGroup().size() == 0 && collisionchecker->GetBodyGeometryGroup(shared_kinbody_const()).size() == 0;
+        }
+        catch(const openrave_exception&) {
+            // checker does not keep geometry groups per body
+        }
+        if( bUseSpheres ) {
+            int adjacentoptions = AO_Enabled;
+            if( (checkeroptions & CO_ActiveDOFs) && IsRobot() ) {
+                adjacentoptions |= AO_ActiveDOFs;
+            }
+            // a clearly colliding pair can only be reported if nothing has to be written to the report and no callback can ignore the collision
+            const bool bAllowColliding = !report && !bAllLinkCollisions && ((checkeroptions & CO_IgnoreCallbacks) || !GetEnv()->HasRegisteredCollisionCallbacks());
+            precheck = _PrecheckSelfCollisionWithSpheres(adjacentoptions, bAllowColliding);
+        }
+    }
+    if( precheck < 0 ) {
+        return true;
+    }
+
     bool bCollision = false;
-    if( collisionchecker->CheckStandaloneSelfCollision(shared_kinbody_const(), report) ) {
+    if( precheck > 0 ) {
+        // all the link pairs are clearly free, so the checker would only reset the report
+        if( !!report ) {
+            report->Reset(checkeroptions);
+        }
+    }
+    else if( collisionchecker->CheckStandaloneSelfCollision(shared_kinbody_const(), report) ) {
         if( !!report ) {
             if( IS_DEBUGLEVEL(Level_Verbose) ) {
                 std::vector<OpenRAVE::dReal> colvalues;
@@ -224,6 +224,7 @@ bool KinBody::Grab(KinBodyPtr pGrabbedBody, LinkPtr pGrabbingLink, const std::se
     OPENRAVE_ASSERT_FORMAT(!!pGrabbingLink, "env=%s, pGrabbingLink of body '%s' for grabbing body '%s' is invalid", GetEnv()->GetNameId()%GetName()%pGrabbedBody->GetName(), ORE_InvalidArguments);
     OPENRAVE_ASSERT_FORMAT(pGrabbingLink->GetParent().get() == this, "env=%s, pGrabbingLink name='%s' for grabbing '%s' is not part of body '%s'", GetEnv()->GetNameId()%pGrabbingLink->GetName()%pGrabbedBody->GetName()%GetName(), ORE_InvalidArguments);
     OPENRAVE_ASSERT_FORMAT(pGrabbedBody.get() != this, "env=%s, body '%s' cannot grab itself", GetEnv()->GetNameId()%pGrabbedBody->GetName(), ORE_InvalidArguments);
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
 
     // If pGrabbedBody has previously been grabbed, check if the grabbing condition is the same
     GrabbedPtr pPreviouslyGrabbed;
@@ -325,6 +326,7 @@ bool KinBody::Grab(KinBodyPtr pGrabbedBody, LinkPtr pGrabbingLink, const std::se
 
 void KinBody::Release(KinBody &body)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     FOREACH(itgrabbed, _vGrabbedBodies) {
         GrabbedPtr pgrabbed = *itgrabbed;
         KinBodyConstPtr pgrabbedbody = pgrabbed->_pGrabbedBody.lock();
@@ -359,6 +361,7 @@ void KinBody::Release(KinBody &body)
 void KinBody::ReleaseAllGrabbed()
 {
     if( _vGrabbedBodies.size() > 0 ) {
+        EnvironmentStateExclusiveLock lockstate(*GetEnv());
         for (const GrabbedPtr& pgrabbed : _vGrabbedBodies) {
             KinBodyPtr pbody = pgrabbed->_pGrabbedBody.lock();
             if( !!pbody ) {
@@ -374,6 +377,7 @@ void KinBody::ReleaseAllGrabbedWithLink(const KinBody::Link& bodyLinkToReleaseWi
 {
     OPENRAVE_ASSERT_FORMAT(bodyLinkToReleaseWith.GetParent().get() == this, "body %s invalid grab arguments",GetName(), ORE_InvalidArguments);
 
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     if( _vGrabbedBodies.size() > 0 ) {
         bool bReleased = false;
         int nCheckIndex = (int)_vGrabbedBodies.size()-1;
@@ -765,6 +769,7 @@ std::string KinBody::GrabbedInfo::GetGrabbedInfoHash() const
 
 void KinBody::ResetGrabbed(const std::vector<KinBody::GrabbedInfoConstPtr>& vGrabbedInfos)
 {
+    EnvironmentStateExclusiveLock lockstate(*GetEnv());
     ReleaseAllGrabbed();
     if( vGrabbedInfos.size() > 0 ) {
         CollisionCheckerBasePtr collisionchecker = !!_selfcollisionchecker ? _selfcollisionchecker : GetEnv()->GetCollisionChecker();
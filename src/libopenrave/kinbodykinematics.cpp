@@ -0,0 +1,245 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2006-2019 Rosen Diankov (rosen.diankov@gmail.com)
+//
+// This file is part of OpenRAVE.
+// OpenRAVE is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "libopenrave.h"
+
+#include <mutex>
+
+namespace OpenRAVE {
+
+namespace {
+
+/// \brief computes the transform of one child link from its parent link
+struct UnrolledKinematicsStep
+{
+    enum StepType
+    {
+        ST_Static = 0, ///< child = parent * tLeft
+        ST_Revolute = 1, ///< child = parent * (tLeft * rotation(vaxis, value) * tRight)
+        ST_Prismatic = 2, ///< child = parent * (tLeft * translation(vaxis * value) * tRight)
+    };
+
+    Transform tLeft, tRight;
+    Vector vaxis; ///< for revolute joints the axis is normalized
+    int parentlinkindex = 0;
+    int childlinkindex = 0;
+    int dofindex = -1;
+    StepType type = ST_Static;
+    bool bRightIdentity = false; ///< if true, then can skip multiplying by tRight
+};
+
+/// \brief the straight-line forward kinematics of a body, shared between all bodies with exactly the same steps
+struct UnrolledKinematicsProgram
+{
+    std::vector<UnrolledKinematicsStep> vsteps; ///< in the order of KinBody::GetDependencyOrderedJointsAll
+    size_t numlinks = 0;
+};
+
+typedef boost::shared_ptr<UnrolledKinematicsProgram const> UnrolledKinematicsProgramConstPtr;
+
+class UnrolledKinematicsFunctions : public KinematicsFunctions
+{
+public:
+    UnrolledKinematicsFunctions(UnrolledKinematicsProgramConstPtr program) : _program(program) {
+    }
+
+    bool SetLinkTransforms(const dReal* pJointValues, const std::vector<Transform*>& vLinkTransformPointers) override
+    {
+        const UnrolledKinematicsProgram& program = *_program;
+        if( vLinkTransformPointers.size() != program.numlinks ) {
+            return false;
+        }
+
+        Transform* const* ptransforms = vLinkTransformPointers.data();
+        Transform tlocal;
+        for(const UnrolledKinematicsStep& step : program.vsteps) {
+            const Transform& tparent = *ptransforms[step.parentlinkindex];
+            Transform& tchild = *ptransforms[step.childlinkindex];
+            switch(step.type) {
+            case UnrolledKinematicsStep::ST_Static:
+                tchild = tparent * step.tLeft;
+                continue;
+            case UnrolledKinematicsStep::ST_Revolute: {
+                const dReal fhalfangle = dReal(0.5)*pJointValues[step.dofindex];
+                const dReal fsin = RaveSin(fhalfangle);
+                tlocal.rot = quatMultiply(step.tLeft.rot, Vector(RaveCos(fhalfangle), step.vaxis.x*fsin, step.vaxis.y*fsin, step.vaxis.z*fsin));
+                tlocal.trans = step.tLeft.trans;
+                break;
+            }
+            case UnrolledKinematicsStep::ST_Prismatic:
+                tlocal.rot = step.tLeft.rot;
+                tlocal.trans = step.tLeft.trans + step.tLeft.rotate(step.vaxis*pJointValues[step.dofindex]);
+                break;
+            }
+            if( step.bRightIdentity ) {
+                tchild = tparent * tlocal;
+            }
+            else {
+                tchild = tparent * (tlocal * step.tRight);
+            }
+        }
+        return true;
+    }
+
+private:
+    UnrolledKinematicsProgramConstPtr _program;
+};
+
+/// \brief returns an empty pointer if the body has joints that the unrolled kinematics does not support
+UnrolledKinematicsProgramConstPtr _CompileUnrolledKinematics(const KinBody& body)
+{
+    if( body.GetClosedLoops().size() > 0 ) {
+        return UnrolledKinematicsProgramConstPtr();
+    }
+
+    boost::shared_ptr<UnrolledKinematicsProgram> program(new UnrolledKinematicsProgram());
+    program->numlinks = body.GetLinks().size();
+    const std::vector<KinBody::JointPtr>& vjoints = body.GetDependencyOrderedJointsAll();
+    program->vsteps.reserve(vjoints.size());
+    for(const KinBody::JointPtr& pjoint : vjoints) {
+        const KinBody::Joint& joint = *pjoint;
+        const KinBody::LinkPtr parentlink = joint.GetHierarchyParentLink();
+        const KinBody::LinkPtr childlink = joint.GetHierarchyChildLink();
+        if( !childlink ) {
+            return UnrolledKinematicsProgramConstPtr();
+        }
+
+        UnrolledKinematicsStep step;
+        step.parentlinkindex = !!parentlink ? parentlink->GetIndex() : 0;
+        step.childlinkindex = childlink->GetIndex();
+        step.tLeft = joint.GetInternalHierarchyLeftTransform();
+        if( !joint.IsStatic() ) {
+            // values of passive joints and mimic joints are not part of the dof values
+            if( joint.GetDOFIndex() < 0 || joint.IsMimic() || joint.GetDOF() != 1 ) {
+                return UnrolledKinematicsProgramConstPtr();
+            }
+            if( joint.GetType() == KinBody::JointRevolute ) {
+                const dReal faxislength = RaveSqrt(joint.GetInternalHierarchyAxis(0).lengthsqr3());
+                if( faxislength <= 0 ) {
+                    return UnrolledKinematicsProgramConstPtr();
+                }
+                step.type = UnrolledKinematicsStep::ST_Revolute;
+                step.vaxis = joint.GetInternalHierarchyAxis(0)*(1/faxislength);
+            }
+            else if( joint.GetType() == KinBody::JointPrismatic ) {
+                step.type = UnrolledKinematicsStep::ST_Prismatic;
+                step.vaxis = joint.GetInternalHierarchyAxis(0);
+            }
+            else {
+                return UnrolledKinematicsProgramConstPtr();
+            }
+            step.dofindex = joint.GetDOFIndex();
+            step.tRight = joint.GetInternalHierarchyRightTransform();
+            step.bRightIdentity = step.tRight == Transform();
+        }
+        program->vsteps.push_back(step);
+    }
+    return program;
+}
+
+/// \brief appends the exact values of all the steps of the program to key, two programs with the same key compute the same transforms
+void _GetUnrolledKinematicsKey(const UnrolledKinematicsProgram& program, std::string& key)
+{
+    key.resize(0);
+    const auto appendvalues = [&key](const dReal* pvalues, size_t num) {
+        key.append(reinterpret_cast<const char*>(pvalues), num*sizeof(dReal));
+    };
+    const auto appendint = [&key](int32_t value) {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    appendint(program.numlinks);
+    for(const UnrolledKinematicsStep& step : program.vsteps) {
+        appendint(step.type);
+        appendint(step.parentlinkindex);
+        appendint(step.childlinkindex);
+        appendint(step.dofindex);
+        appendvalues(&step.tLeft.rot.x, 4);
+        appendvalues(&step.tLeft.trans.x, 3);
+        if( step.type != UnrolledKinematicsStep::ST_Static ) {
+            appendvalues(&step.vaxis.x, 3);
+            appendvalues(&step.tRight.rot.x, 4);
+            appendvalues(&step.tRight.trans.x, 3);
+        }
+    }
+}
+
+class UnrolledKinematicsGenerator : public KinematicsGenerator
+{
+public:
+    UnrolledKinematicsGenerator() : _nLastPurgeSize(64) {
+    }
+
+    KinematicsFunctionsPtr GenerateKinematicsFunctions(const KinBody& body) override
+    {
+        // compiling only reads the joints, so always compile and share the programs with exactly the same steps.
+        // GetKinematicsGeometryHash is rounded, so bodies with slightly different joints can have the same hash.
+        UnrolledKinematicsProgramConstPtr newprogram = _CompileUnrolledKinematics(body);
+        if( !newprogram ) {
+            return KinematicsFunctionsPtr();
+        }
+        std::string key;
+        _GetUnrolledKinematicsKey(*newprogram, key);
+
+        UnrolledKinematicsProgramConstPtr program;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ProgramMap::iterator itprogram = _mapPrograms.find(key);
+            if( itprogram != _mapPrograms.end() ) {
+                program = itprogram->second.lock();
+            }
+            if( !program ) {
+                if( _mapPrograms.size() >= 2*_nLastPurgeSize ) {
+                    _PurgeExpired();
+                }
+                _mapPrograms[key] = newprogram;
+                program = newprogram;
+            }
+        }
+        return KinematicsFunctionsPtr(new UnrolledKinematicsFunctions(program));
+    }
+
+private:
+    /// \brief has to be called with _mutex locked
+    void _PurgeExpired()
+    {
+        ProgramMap::iterator itprogram = _mapPrograms.begin();
+        while( itprogram != _mapPrograms.end() ) {
+            if( itprogram->second.expired() ) {
+                itprogram = _mapPrograms.erase(itprogram);
+            }
+            else {
+                ++itprogram;
+            }
+        }
+        _nLastPurgeSize = std::max(_mapPrograms.size(), (size_t)64);
+    }
+
+    typedef std::map<std::string, boost::weak_ptr<UnrolledKinematicsProgram const> > ProgramMap;
+
+    std::mutex _mutex;
+    ProgramMap _mapPrograms; ///< indexed by _GetUnrolledKinematicsKey, the programs are held by the functions of the bodies
+    size_t _nLastPurgeSize; ///< size of _mapPrograms after the last purge of the expired programs
+};
+
+} // end namespace
+
+KinematicsGeneratorPtr GetUnrolledKinematicsGenerator()
+{
+    static KinematicsGeneratorPtr s_generator(new UnrolledKinematicsGenerator());
+    return s_generator;
+}
+
+} // end namespace OpenRAVE
@@ -117,15 +117,27 @@ int KinBody::LinkInfo::Compare(const LinkInfo& rhs, int linkCompareOptions, dRea
     return 0;
 }
 
-void KinBody::LinkInfo::ConvertUnitScale(dReal fUnitScale)
+/// \brief replaces the infos with scaled copies since they can be shared with other links (see Clone_ShareGeometries)
+///
+/// \param mapScaledInfos the copies made so far, so that an info in several lists is only scaled once
+static void _ConvertGeometryInfosUnitScale(std::vector<KinBody::GeometryInfoPtr>& vgeometryinfos, std::map<KinBody::GeometryInfoPtr, KinBody::GeometryInfoPtr>& mapScaledInfos, dReal fUnitScale)
 {
-    FOREACH(itgeometry, _vgeometryinfos) {
-        (*itgeometry)->ConvertUnitScale(fUnitScale);
+    FOREACH(itgeometry, vgeometryinfos) {
+        KinBody::GeometryInfoPtr& pscaledinfo = mapScaledInfos[*itgeometry];
+        if( !pscaledinfo ) {
+            pscaledinfo.reset(new KinBody::GeometryInfo(**itgeometry));
+            pscaledinfo->ConvertUnitScale(fUnitScale);
+        }
+        *itgeometry = pscaledinfo;
     }
+}
+
+void KinBody::LinkInfo::ConvertUnitScale(dReal fUnitScale)
+{
+    std::map<GeometryInfoPtr, GeometryInfoPtr> mapScaledInfos;
+    _ConvertGeometryInfosUnitScale(_vgeometryinfos, mapScaledInfos, fUnitScale);
     FOREACH(itextra, _mapExtraGeometries) {
-        FOREACH(itgeometry, itextra->second) {
-            (*itgeometry)->ConvertUnitScale(fUnitScale);
-        }
+        _ConvertGeometryInfosUnitScale(itextra->second, mapScaledInfos, fUnitScale);
     }
 
     _tMassFrame.trans *= fUnitScale;
@@ -413,6 +425,7 @@ void KinBody::Link::Enable(bool bEnable)
 {
     if( _info._bIsEnabled != bEnable ) {
         KinBodyPtr parent = GetParent();
+        EnvironmentStateExclusiveLock lockstate(*parent->GetEnv());
         parent->_nNonAdjacentLinkCache &= ~AO_Enabled;
         _Enable(bEnable);
         GetParent()->_PostprocessChangedParameters(Prop_LinkEnable);
@@ -0,0 +1,405 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2006-2019 Rosen Diankov (rosen.diankov@gmail.com)
+//
+// This file is part of OpenRAVE.
+// OpenRAVE is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "libopenrave.h"
+
+#include <mutex>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace OpenRAVE {
+
+namespace {
+
+static const int s_nMaxSpheresPerAxis = 8; ///< maximum number of spheres along one axis of a geometry
+
+/// \brief adds spheres of radius fradius whose centers are evenly spaced on the segment [-fhalflength+fradius, fhalflength-fradius] of axis iaxis of the geometry frame
+void _AddInnerSpheresAlongAxis(const Transform& tgeom, int iaxis, dReal fhalflength, dReal fradius, std::vector<Vector>& vspheres)
+{
+    if( fradius <= 0 ) {
+        return;
+    }
+    const dReal fspan = std::max(dReal(0), fhalflength - fradius);
+    const int numspheres = fspan > 0 ? std::max(2, std::min(s_nMaxSpheresPerAxis, (int)RaveCeil(fhalflength/fradius))) : 1;
+    for(int isphere = 0; isphere < numspheres; ++isphere) {
+        Vector vlocal;
+        if( numspheres > 1 ) {
+            vlocal[iaxis] = -fspan + 2*fspan*isphere/(numspheres-1);
+        }
+        Vector vsphere = tgeom*vlocal;
+        vsphere.w = fradius;
+        vspheres.push_back(vsphere);
+    }
+}
+
+/// \brief the values of a geometry that its spheres are built from
+struct GeometrySphereInput
+{
+    GeometryType type;
+    Transform tgeom;
+    AABB ab; ///< in the link frame
+    Vector vextents; ///< box extents, sphere radius in x, cylinder radius and height in x and y
+};
+
+void _GetGeometrySphereInputs(const KinBody& body, std::vector< std::vector<GeometrySphereInput> >& vlinkinputs)
+{
+    vlinkinputs.resize(body.GetLinks().size());
+    for (const KinBody::LinkPtr& plink : body.GetLinks()) {
+        std::vector<GeometrySphereInput>& vinputs = vlinkinputs.at(plink->GetIndex());
+        vinputs.resize(0);
+        for (const KinBody::Link::GeometryPtr& pgeom : plink->GetGeometries()) {
+            GeometrySphereInput input;
+            input.type = pgeom->GetType();
+            input.tgeom = pgeom->GetTransform();
+            input.ab = pgeom->ComputeAABB(Transform());
+            switch(input.type) {
+            case GT_Box:
+                input.vextents = pgeom->GetBoxExtents();
+                break;
+            case GT_Sphere:
+                input.vextents.x = pgeom->GetSphereRadius();
+                break;
+            case GT_Cylinder:
+                input.vextents.x = pgeom->GetCylinderRadius();
+                input.vextents.y = pgeom->GetCylinderHeight();
+                break;
+            default:
+                break;
+            }
+            vinputs.push_back(input);
+        }
+    }
+}
+
+/// \brief writes the exact bits of all the values the tree is built from into key
+///
+/// KinBody::GetKinematicsGeometryHash rounds the values, so it cannot tell apart geometries that differ by less than the rounding and the spheres would not cover them.
+void _GetLinkSphereTreeKey(const std::vector< std::vector<GeometrySphereInput> >& vlinkinputs, std::string& key)
+{
+    key.resize(0);
+    const auto appendvalues = [&key](const dReal* pvalues, size_t num) {
+        key.append(reinterpret_cast<const char*>(pvalues), num*sizeof(dReal));
+    };
+    for (const std::vector<GeometrySphereInput>& vinputs : vlinkinputs) {
+        const uint32_t numgeometries = vinputs.size();
+        key.append(reinterpret_cast<const char*>(&numgeometries), sizeof(numgeometries));
+        for (const GeometrySphereInput& input : vinputs) {
+            const uint32_t type = input.type;
+            key.append(reinterpret_cast<const char*>(&type), sizeof(type));
+            appendvalues(&input.tgeom.rot.x, 4);
+            appendvalues(&input.tgeom.trans.x, 3);
+            appendvalues(&input.ab.pos.x, 3);
+            appendvalues(&input.ab.extents.x, 3);
+            appendvalues(&input.vextents.x, 3);
+        }
+    }
+}
+
+LinkSphereTreeConstPtr _BuildLinkSphereTree(const std::vector< std::vector<GeometrySphereInput> >& vlinkinputs, const std::string& kinematicsGeometryHash)
+{
+    boost::shared_ptr<LinkSphereTree> tree(new LinkSphereTree());
+    tree->kinematicsGeometryHash = kinematicsGeometryHash;
+    tree->vlinks.resize(vlinkinputs.size());
+    for(size_t ilink = 0; ilink < vlinkinputs.size(); ++ilink) {
+        LinkSphereTree::LinkSpheres& linkspheres = tree->vlinks[ilink];
+        for (const GeometrySphereInput& input : vlinkinputs[ilink]) {
+            // cover the box of the geometry with a grid of spheres whose cells are close to cubes
+            const AABB& ab = input.ab;
+            const dReal fmaxextent = std::max(ab.extents.x, std::max(ab.extents.y, ab.extents.z));
+            if( fmaxextent <= 0 ) {
+                continue;
+            }
+            const dReal fminextent = std::min(ab.extents.x, std::min(ab.extents.y, ab.extents.z));
+            const dReal fcellextent = std::max(fminextent, fmaxextent/s_nMaxSpheresPerAxis);
+            int numcells[3];
+            Vector vcellextents;
+            for(int iaxis = 0; iaxis < 3; ++iaxis) {
+                numcells[iaxis] = std::max(1, std::min(s_nMaxSpheresPerAxis, (int)RaveCeil(ab.extents[iaxis]/fcellextent)));
+                vcellextents[iaxis] = ab.extents[iaxis]/numcells[iaxis];
+            }
+            const dReal fradius = RaveSqrt(vcellextents.lengthsqr3());
+            for(int iz = 0; iz < numcells[2]; ++iz) {
+                for(int iy = 0; iy < numcells[1]; ++iy) {
+                    for(int ix = 0; ix < numcells[0]; ++ix) {
+                        Vector vsphere = ab.pos - ab.extents + Vector(vcellextents.x*(2*ix+1), vcellextents.y*(2*iy+1), vcellextents.z*(2*iz+1));
+                        vsphere.w = fradius;
+                        linkspheres.vouter.push_back(vsphere);
+                    }
+                }
+            }
+
+            // only solid primitives have an interior that is known to be occupied
+            const Transform& tgeom = input.tgeom;
+            const Vector& vextents = input.vextents;
+            switch(input.type) {
+            case GT_Box: {
+                int ilongestaxis = 0;
+                for(int iaxis = 1; iaxis < 3; ++iaxis) {
+                    if( vextents[iaxis] > vextents[ilongestaxis] ) {
+                        ilongestaxis = iaxis;
+                    }
+                }
+                _AddInnerSpheresAlongAxis(tgeom, ilongestaxis, vextents[ilongestaxis], std::min(vextents.x, std::min(vextents.y, vextents.z)), linkspheres.vinner);
+                break;
+            }
+            case GT_Sphere:
+                _AddInnerSpheresAlongAxis(tgeom, 2, vextents.x, vextents.x, linkspheres.vinner);
+                break;
+            case GT_Cylinder: {
+                const dReal fhalfheight = 0.5*vextents.y;
+                _AddInnerSpheresAlongAxis(tgeom, 2, fhalfheight, std::min(vextents.x, fhalfheight), linkspheres.vinner);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        if( linkspheres.vouter.size() == 0 ) {
+            linkspheres.vroot = Vector(0,0,0,-1);
+            continue;
+        }
+        Vector vmin = linkspheres.vouter.at(0), vmax = vmin;
+        for (const Vector& vsphere : linkspheres.vouter) {
+            for(int iaxis = 0; iaxis < 3; ++iaxis) {
+                vmin[iaxis] = std::min(vmin[iaxis], vsphere[iaxis] - vsphere.w);
+                vmax[iaxis] = std::max(vmax[iaxis], vsphere[iaxis] + vsphere.w);
+            }
+        }
+        Vector vroot = (vmin + vmax)*dReal(0.5);
+        vroot.w = 0;
+        for (const Vector& vsphere : linkspheres.vouter) {
+            vroot.w = std::max(vroot.w, RaveSqrt((vsphere - vroot).lengthsqr3()) + vsphere.w);
+        }
+        linkspheres.vroot = vroot;
+    }
+    return tree;
+}
+
+/// \brief process-wide cache of the sphere trees indexed by the exact geometries of the links
+///
+/// The cache only holds weak references, so trees are freed when the last body using them releases them.
+class LinkSphereTreeCache
+{
+public:
+    LinkSphereTreeCache() : _nLastPurgeSize(64) {
+    }
+
+    LinkSphereTreeConstPtr GetTree(const KinBody& body)
+    {
+        std::vector< std::vector<GeometrySphereInput> > vlinkinputs;
+        _GetGeometrySphereInputs(body, vlinkinputs);
+        std::string key;
+        _GetLinkSphereTreeKey(vlinkinputs, key);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            LinkSphereTreeConstPtr tree = _Find(key);
+            if( !!tree ) {
+                return tree;
+            }
+        }
+
+        LinkSphereTreeConstPtr newtree = _BuildLinkSphereTree(vlinkinputs, body.GetKinematicsGeometryHash());
+        std::lock_guard<std::mutex> lock(_mutex);
+        LinkSphereTreeConstPtr tree = _Find(key);
+        if( !!tree ) {
+            return tree;
+        }
+        if( _mapTrees.size() >= 2*_nLastPurgeSize ) {
+            _PurgeExpired();
+        }
+        _mapTrees[key] = newtree;
+        return newtree;
+    }
+
+private:
+    /// \brief has to be called with _mutex locked
+    LinkSphereTreeConstPtr _Find(const std::string& key)
+    {
+        TreeMap::iterator ittree = _mapTrees.find(key);
+        if( ittree == _mapTrees.end() ) {
+            return LinkSphereTreeConstPtr();
+        }
+        LinkSphereTreeConstPtr tree = ittree->second.lock();
+        if( !tree ) {
+            _mapTrees.erase(ittree);
+        }
+        return tree;
+    }
+
+    /// \brief has to be called with _mutex locked
+    void _PurgeExpired()
+    {
+        TreeMap::iterator ittree = _mapTrees.begin();
+        while( ittree != _mapTrees.end() ) {
+            if( ittree->second.expired() ) {
+                ittree = _mapTrees.erase(ittree);
+            }
+            else {
+                ++ittree;
+            }
+        }
+        _nLastPurgeSize = std::max(_mapTrees.size(), (size_t)64);
+    }
+
+    typedef std::map<std::string, boost::weak_ptr<LinkSphereTree const> > TreeMap;
+
+    std::mutex _mutex;
+    TreeMap _mapTrees; ///< indexed by _GetLinkSphereTreeKey
+    size_t _nLastPurgeSize; ///< size of _mapTrees after the last purge of the expired trees
+};
+
+/// \brief returns true if the sphere overlaps or touches one of the num spheres given as arrays of their centers and radii
+inline bool _IsAnySphereOverlapping(const dReal* px, const dReal* py, const dReal* pz, const dReal* pradius, size_t num, const Vector& vsphere)
+{
+    size_t index = 0;
+#if defined(__AVX__) && OPENRAVE_PRECISION
+    const __m256d vx = _mm256_set1_pd(vsphere.x), vy = _mm256_set1_pd(vsphere.y), vz = _mm256_set1_pd(vsphere.z), vradius = _mm256_set1_pd(vsphere.w);
+    for(; index + 4 <= num; index += 4) {
+        const __m256d vdx = _mm256_sub_pd(_mm256_loadu_pd(px + index), vx);
+        const __m256d vdy = _mm256_sub_pd(_mm256_loadu_pd(py + index), vy);
+        const __m256d vdz = _mm256_sub_pd(_mm256_loadu_pd(pz + index), vz);
+        const __m256d vdist2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vdx, vdx), _mm256_mul_pd(vdy, vdy)), _mm256_mul_pd(vdz, vdz));
+        const __m256d vsumradius = _mm256_add_pd(_mm256_loadu_pd(pradius + index), vradius);
+        if( _mm256_movemask_pd(_mm256_cmp_pd(vdist2, _mm256_mul_pd(vsumradius, vsumradius), _CMP_LE_OQ)) != 0 ) {
+            return true;
+        }
+    }
+#endif
+    for(; index < num; ++index) {
+        const dReal fdx = px[index] - vsphere.x, fdy = py[index] - vsphere.y, fdz = pz[index] - vsphere.z;
+        const dReal fsumradius = pradius[index] + vsphere.w;
+        if( fdx*fdx + fdy*fdy + fdz*fdz <= fsumradius*fsumradius ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// \brief returns true if a sphere of the first set strictly overlaps a sphere of the second set
+bool _IsAnyInnerSphereOverlapping(const std::vector<Vector>& vspheres0, const Transform& t0, const std::vector<Vector>& vspheres1, const Transform& t1)
+{
+    for (const Vector& vlocal0 : vspheres0) {
+        const Vector vsphere0 = t0*vlocal0;
+        for (const Vector& vlocal1 : vspheres1) {
+            const dReal fsumradius = vlocal0.w + vlocal1.w;
+            if( (t1*vlocal1 - vsphere0).lengthsqr3() < fsumradius*fsumradius ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // end namespace
+
+LinkSphereTreeConstPtr GetLinkSphereTree(const KinBody& body)
+{
+    static LinkSphereTreeCache s_cache;
+    return s_cache.GetTree(body);
+}
+
+int KinBody::_PrecheckSelfCollisionWithSpheres(int adjacentoptions, bool bAllowColliding) const
+{
+    const std::vector<int>& nonadjacent = GetNonAdjacentLinks(adjacentoptions);
+    if( nonadjacent.size() == 0 ) {
+        return 1;
+    }
+
+    if( !_pLinkSphereTreeCache || _pLinkSphereTreeCache->kinematicsGeometryHash != GetKinematicsGeometryHash() ) {
+        _pLinkSphereTreeCache = GetLinkSphereTree(*this);
+        _vLinkSpheresWorldOffsetsCache.resize(_pLinkSphereTreeCache->vlinks.size());
+        size_t offset = 0;
+        for(size_t ilink = 0; ilink < _pLinkSphereTreeCache->vlinks.size(); ++ilink) {
+            _vLinkSpheresWorldOffsetsCache[ilink] = offset;
+            offset += 4*_pLinkSphereTreeCache->vlinks[ilink].vouter.size();
+        }
+        _vLinkSpheresWorldCache.resize(offset);
+    }
+    const LinkSphereTree& tree = *_pLinkSphereTreeCache;
+    if( tree.vlinks.size() != _veclinks.size() ) {
+        return 0;
+    }
+    _vLinkSpheresWorldComputedCache.resize(0);
+    _vLinkSpheresWorldComputedCache.resize(_veclinks.size(), 0);
+
+    int result = 1;
+    for (int linkpair : nonadjacent) {
+        const size_t index0 = linkpair&0xffff, index1 = linkpair>>16;
+        const Link& link0 = *_veclinks[index0];
+        const Link& link1 = *_veclinks[index1];
+        if( link0.IsSelfCollisionIgnored() || link1.IsSelfCollisionIgnored() ) {
+            continue;
+        }
+        const LinkSphereTree::LinkSpheres& spheres0 = tree.vlinks[index0];
+        const LinkSphereTree::LinkSpheres& spheres1 = tree.vlinks[index1];
+        if( spheres0.vroot.w < 0 || spheres1.vroot.w < 0 ) {
+            continue;
+        }
+        const Transform& t0 = link0.GetTransform();
+        const Transform& t1 = link1.GetTransform();
+        const dReal frootradius = spheres0.vroot.w + spheres1.vroot.w;
+        if( (t0*spheres0.vroot - t1*spheres1.vroot).lengthsqr3() > frootradius*frootradius ) {
+            continue;
+        }
+
+        if( result != 0 ) {
+            // transform the outer spheres of both links to world coordinates once per call
+            for(size_t index : {index0, index1}) {
+                if( !_vLinkSpheresWorldComputedCache[index] ) {
+                    const std::vector<Vector>& vouter = tree.vlinks[index].vouter;
+                    const Transform& tlink = _veclinks[index]->GetTransform();
+                    dReal* pworld = &_vLinkSpheresWorldCache[_vLinkSpheresWorldOffsetsCache[index]];
+                    const size_t num = vouter.size();
+                    for(size_t isphere = 0; isphere < num; ++isphere) {
+                        const Vector v = tlink*vouter[isphere];
+                        pworld[isphere] = v.x;
+                        pworld[num + isphere] = v.y;
+                        pworld[2*num + isphere] = v.z;
+                        pworld[3*num + isphere] = vouter[isphere].w;
+                    }
+                    _vLinkSpheresWorldComputedCache[index] = 1;
+                }
+            }
+
+            const dReal* pworld0 = &_vLinkSpheresWorldCache[_vLinkSpheresWorldOffsetsCache[index0]];
+            const dReal* pworld1 = &_vLinkSpheresWorldCache[_vLinkSpheresWorldOffsetsCache[index1]];
+            const size_t num0 = spheres0.vouter.size(), num1 = spheres1.vouter.size();
+            bool bOverlapping = false;
+            for(size_t isphere = 0; isphere < num0 && !bOverlapping; ++isphere) {
+                const Vector vsphere(pworld0[isphere], pworld0[num0 + isphere], pworld0[2*num0 + isphere], pworld0[3*num0 + isphere]);
+                bOverlapping = _IsAnySphereOverlapping(pworld1, pworld1 + num1, pworld1 + 2*num1, pworld1 + 3*num1, num1, vsphere);
+            }
+            if( !bOverlapping ) {
+                continue;
+            }
+            if( !bAllowColliding ) {
+                return 0;
+            }
+            result = 0;
+        }
+
+        // the outer spheres overlap, so the links might be colliding
+        if( _IsAnyInnerSphereOverlapping(spheres0.vinner, t0, spheres1.vinner, t1) ) {
+            return -1;
+        }
+    }
+    return result;
+}
+
+} // end namespace OpenRAVE
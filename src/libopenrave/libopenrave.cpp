@@ -19,6 +19,7 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/utility.hpp>
 
+#include <atomic>
 #include <mutex>
 #include <streambuf>
 
@@ -30,6 +31,7 @@
 
 #include <locale>
 #include <set>
+#include <thread>
 
 #include "plugindatabase_virtual.h"
 #include "plugindatabase.h"
@@ -2716,6 +2718,145 @@ CollisionOptionsStateSaver::~CollisionOptionsStateSaver()
     _p->SetCollisionOptions(_oldoptions);
 }
 
+int CollisionCheckerBase::CheckCollisionBatch(KinBodyConstPtr pbody, const dReal* pconfigs, int numconfigs, const std::vector<int>& dofindices, std::vector<uint8_t>& vresults, int checkflags, CollisionReportPtr report)
+{
+    vresults.resize(0);
+    vresults.resize(std::max(0, numconfigs), 0);
+    if( !!report ) {
+        report->Reset(GetCollisionOptions());
+    }
+    if( numconfigs <= 0 ) {
+        return 0;
+    }
+
+    // the body is only moved temporarily, its state is restored before returning
+    KinBodyPtr pmutablebody = boost::const_pointer_cast<KinBody>(pbody);
+    KinBody::KinBodyStateSaver saver(pmutablebody, KinBody::Save_LinkTransformation);
+    const int dof = dofindices.size() > 0 ? (int)dofindices.size() : pbody->GetDOF();
+    CollisionReportPtr reportfirst = report; // reset once the first collision is recorded
+    int numcolliding = 0;
+    for(int iconfig = 0; iconfig < numconfigs; ++iconfig) {
+        pmutablebody->SetDOFValues(pconfigs + iconfig*dof, dof, KinBody::CLA_Nothing, dofindices);
+        uint8_t result = 0;
+        if( (checkflags & CBF_Env) && CheckCollision(pbody, reportfirst) ) {
+            result |= CBF_Env;
+            reportfirst.reset();
+        }
+        if( (checkflags & CBF_Self) && CheckStandaloneSelfCollision(pbody, reportfirst) ) {
+            result |= CBF_Self;
+            reportfirst.reset();
+        }
+        vresults[iconfig] = result;
+        if( result != 0 ) {
+            ++numcolliding;
+        }
+    }
+    return numcolliding;
+}
+
+bool CollisionCheckerBase::CheckContinuousCollision(KinBodyConstPtr pbody, const std::vector<dReal>& q0, const std::vector<dReal>& q1, const std::vector<int>& dofindices, int checkflags, dReal* pfContactTime, CollisionReportPtr report)
+{
+    const int dof = dofindices.size() > 0 ? (int)dofindices.size() : pbody->GetDOF();
+    OPENRAVE_ASSERT_OP((int)q0.size(), ==, dof);
+    OPENRAVE_ASSERT_OP((int)q1.size(), ==, dof);
+    if( !!report ) {
+        report->Reset(GetCollisionOptions());
+    }
+
+    std::vector<dReal> vresolutions;
+    pbody->GetDOFResolutions(vresolutions, dofindices);
+    int numsteps = 1;
+    for(int idof = 0; idof < dof; ++idof) {
+        if( vresolutions.at(idof) > 0 ) {
+            numsteps = std::max(numsteps, (int)RaveCeil(RaveFabs(q1[idof] - q0[idof])/vresolutions[idof]));
+        }
+    }
+
+    // the body is only moved temporarily, its state is restored before returning
+    KinBodyPtr pmutablebody = boost::const_pointer_cast<KinBody>(pbody);
+    KinBody::KinBodyStateSaver saver(pmutablebody, KinBody::Save_LinkTransformation);
+    std::vector<dReal> vconfig(dof);
+    for(int istep = 0; istep <= numsteps; ++istep) {
+        const dReal ftime = dReal(istep)/dReal(numsteps);
+        for(int idof = 0; idof < dof; ++idof) {
+            vconfig[idof] = q0[idof] + ftime*(q1[idof] - q0[idof]);
+        }
+        pmutablebody->SetDOFValues(vconfig, KinBody::CLA_Nothing, dofindices);
+        if( ((checkflags & CBF_Env) && CheckCollision(pbody, report)) || ((checkflags & CBF_Self) && CheckStandaloneSelfCollision(pbody, report)) ) {
+            if( !!pfContactTime ) {
+                *pfContactTime = ftime;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+int CollisionCheckerBase::CheckCollisionRays(const std::vector<RAY>& vrays, KinBodyConstPtr pbody, std::vector<RayCollisionResult>& vresults)
+{
+    static const int s_nMinRaysPerThread = 256;
+    vresults.resize(0);
+    vresults.resize(vrays.size());
+    std::atomic<int> numhits(0);
+    std::atomic<size_t> nextray(0);
+    auto checkfn = [&]() {
+        CollisionReport report;
+        CollisionReportPtr preport(&report, utils::null_deleter());
+        for(size_t iray = nextray++; iray < vrays.size(); iray = nextray++) {
+            const RAY& ray = vrays[iray];
+            const bool bCollision = !pbody ? CheckCollision(ray, preport) : CheckCollision(ray, pbody, preport);
+            KinBody::LinkConstPtr plink = !!report.plink1 ? report.plink1 : report.plink2;
+            if( !bCollision || !plink ) {
+                continue;
+            }
+            RayCollisionResult& result = vresults[iray];
+            result.plink = plink;
+            result.fDistance = report.minDistance;
+            if( report.contacts.size() > 0 ) {
+                result.pos = report.contacts[0].pos;
+                result.norm = report.contacts[0].norm;
+            }
+            else {
+                const dReal flength = RaveSqrt(ray.dir.lengthsqr3());
+                result.pos = ray.pos + ray.dir*(flength > 0 ? report.minDistance/flength : dReal(0));
+            }
+            ++numhits;
+        }
+    };
+
+    // the rays can only be split if the checker allows concurrent queries
+    const int numthreads = IsReentrant() ? std::min(std::max(1, (int)std::thread::hardware_concurrency()), (int)(vrays.size()/s_nMinRaysPerThread)) : 1;
+    std::vector<std::thread> vthreads;
+    for(int ithread = 1; ithread < numthreads; ++ithread) {
+        vthreads.emplace_back(checkfn);
+    }
+    checkfn();
+    for (std::thread& thread : vthreads) {
+        thread.join();
+    }
+    return numhits;
+}
+
+dReal CollisionCheckerBase::ComputeStaticClearance(KinBodyConstPtr pbody)
+{
+    CollisionCheckerBasePtr pchecker = boost::static_pointer_cast<CollisionCheckerBase>(shared_from_this());
+    CollisionOptionsStateSaver optionsaver(pchecker, GetCollisionOptions()|CO_Distance);
+    CollisionReportPtr report(new CollisionReport());
+    std::vector<KinBodyPtr> vbodies;
+    GetEnv()->GetBodies(vbodies);
+    dReal fclearance = 1e20;
+    for (const KinBodyPtr& pstaticbody : vbodies) {
+        if( pstaticbody == pbody || pstaticbody->IsRobot() || !pstaticbody->IsStatic() || pbody->IsAttached(*pstaticbody) ) {
+            continue;
+        }
+        if( CheckCollision(pbody, KinBodyConstPtr(pstaticbody), report) ) {
+            return 0;
+        }
+        fclearance = std::min(fclearance, report->minDistance);
+    }
+    return fclearance;
+}
+
 void RaveInitRandomGeneration(uint32_t seed)
 {
     RaveGlobal::instance()->GetDefaultSampler()->SetSeed(seed);
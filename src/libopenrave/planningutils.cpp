@@ -33,6 +33,7 @@ namespace planningutils {
 static const dReal g_fEpsilonQuadratic = RavePow(g_fEpsilon,0.55); // should be 0.6...perhaps this is related to parabolic smoother epsilons?
 static const dReal g_fEpsilonCubic = RavePow(g_fEpsilon,0.55);
 static const dReal g_fEpsilonQuintic = RavePow(g_fEpsilon,0.55);
+static const int g_nMaxQueuedStates = 64; ///< when checking in CFO_CheckInBisectionOrder, the queued states are checked once there are this many so that long segments can return early
 
 int JitterActiveDOF(RobotBasePtr robot,int nMaxIterations,dReal fRand,const PlannerBase::PlannerParameters::NeighStateFn& neighstatefn)
 {
@@ -2331,6 +2332,80 @@ int DynamicsCollisionConstraint::_SetAndCheckState(PlannerBase::PlannerParameter
     return 0;
 }
 
+int DynamicsCollisionConstraint::_SetAndQueueState(PlannerBase::PlannerParametersConstPtr params, const std::vector<dReal>& vdofvalues, const std::vector<dReal>& vdofvelocities, dReal fTime, int numfilled, ConstraintFilterReturnPtr filterreturn)
+{
+    // have to set the state since _neighstatefn and _getstatefn expect it
+    if( params->SetStateValues(vdofvalues, 0) != 0 ) {
+        return CFO_StateSettingError;
+    }
+    _vqueuedconfigs.insert(_vqueuedconfigs.end(), vdofvalues.begin(), vdofvalues.end());
+    _vqueuedvelconfigs.insert(_vqueuedvelconfigs.end(), vdofvelocities.begin(), vdofvelocities.end());
+    QueuedState queuedstate;
+    queuedstate.fTime = fTime;
+    queuedstate.numFilledConfigurations = (!!filterreturn ? filterreturn->_configurationtimes.size() : 0) + numfilled;
+    _vqueuedstates.push_back(queuedstate);
+    return 0;
+}
+
+int DynamicsCollisionConstraint::_CheckQueuedStates(PlannerBase::PlannerParametersConstPtr params, const std::vector<dReal>& vdofaccels, int options, ConstraintFilterReturnPtr filterreturn)
+{
+    const int numstates = _vqueuedstates.size();
+    if( numstates == 0 ) {
+        return 0;
+    }
+    const size_t ndof = _vqueuedconfigs.size()/numstates, nveldof = _vqueuedvelconfigs.size()/numstates;
+
+    // go through the ranges in breadth-first order so that the checked states are spread out over the whole segment
+    int nstateret = 0;
+    _vbisectionranges.resize(0);
+    _vbisectionranges.push_back(std::make_pair(0, numstates));
+    for(size_t irange = 0; irange < _vbisectionranges.size(); ++irange) {
+        const std::pair<int, int> range = _vbisectionranges[irange];
+        const int imid = (range.first + range.second)/2;
+        _vstepconfig.assign(_vqueuedconfigs.begin() + imid*ndof, _vqueuedconfigs.begin() + (imid+1)*ndof);
+        _vdiffvelconfig.assign(_vqueuedvelconfigs.begin() + imid*nveldof, _vqueuedvelconfigs.begin() + (imid+1)*nveldof);
+        nstateret = _SetAndCheckState(params, _vstepconfig, _vdiffvelconfig, vdofaccels, options, filterreturn);
+        if( nstateret != 0 ) {
+            if( !!filterreturn ) {
+                // the states before imid are not checked, so imid is not necessarily the earliest invalid state
+                filterreturn->_returncode = nstateret;
+                filterreturn->_invalidvalues = _vstepconfig;
+                filterreturn->_invalidvelocities = _vdiffvelconfig;
+                filterreturn->_fTimeWhenInvalid = _vqueuedstates[imid].fTime;
+                // keep the configurations up to the invalid state
+                const size_t numfilled = _vqueuedstates[imid].numFilledConfigurations;
+                if( filterreturn->_configurationtimes.size() > numfilled ) {
+                    filterreturn->_configurations.resize(numfilled*ndof);
+                    filterreturn->_configurationtimes.resize(numfilled);
+                }
+            }
+            break;
+        }
+        if( range.first < imid ) {
+            _vbisectionranges.push_back(std::make_pair(range.first, imid));
+        }
+        if( imid+1 < range.second ) {
+            _vbisectionranges.push_back(std::make_pair(imid+1, range.second));
+        }
+    }
+
+    if( nstateret == 0 && _vbisectionranges.size() > 1 ) {
+        // the last checked state is not the last queued one, so set it back since the caller continues interpolating from it
+        _vstepconfig.assign(_vqueuedconfigs.end() - ndof, _vqueuedconfigs.end());
+        if( params->SetStateValues(_vstepconfig, 0) != 0 ) {
+            nstateret = CFO_StateSettingError;
+            if( !!filterreturn ) {
+                filterreturn->_returncode = nstateret;
+            }
+        }
+    }
+
+    _vqueuedconfigs.resize(0);
+    _vqueuedvelconfigs.resize(0);
+    _vqueuedstates.resize(0);
+    return nstateret;
+}
+
 int DynamicsCollisionConstraint::_CheckState(const std::vector<dReal>& vdofvelocities, const std::vector<dReal>& vdofaccels, int options, ConstraintFilterReturnPtr filterreturn)
 {
     options &= _filtermask;
@@ -2806,6 +2881,13 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
         _vtempvelconfig = dq0;
     }
 
+    // when checking in bisection order, the configurations are first computed in order from start to end since _neighstatefn depends on the previous configuration, and are checked in blocks of g_nMaxQueuedStates
+    const bool bBisectionOrder = !!(options & CFO_CheckInBisectionOrder);
+    const int numfilledperstate = (!!filterreturn && (options & CFO_FillCheckedConfiguration)) ? 1 : 0;
+    _vqueuedconfigs.resize(0);
+    _vqueuedvelconfigs.resize(0);
+    _vqueuedstates.resize(0);
+
     if( maskinterpolation == IT_Default && (timeelapsed > 0 && dq0.size() == _vtempconfig.size() && dq1.size() == _vtempconfig.size()) ) {
         // just in case, have to set the current values to _vtempconfig since neighstatefn expects the state to be set.
         if( params->SetStateValues(_vtempconfig, 0) != 0 ) {
@@ -2855,7 +2937,7 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
         while(istep < numSteps && prevtimestep < timeelapsed) {
             int nstateret = 0;
             if( istep >= start ) {
-                nstateret = _SetAndCheckState(params, _vtempconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
+                nstateret = bBisectionOrder ? _SetAndQueueState(params, _vtempconfig, _vtempvelconfig, timestep, numfilledperstate, filterreturn) : _SetAndCheckState(params, _vtempconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
                 if( !!params->_getstatefn ) {
                     params->_getstatefn(_vtempconfig);     // query again in order to get normalizations/joint limits
                 }
@@ -2863,9 +2945,19 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                     filterreturn->_configurations.insert(filterreturn->_configurations.end(), _vtempconfig.begin(), _vtempconfig.end());
                     filterreturn->_configurationtimes.push_back(timestep);
                 }
+                if( nstateret == 0 && bBisectionOrder && (int)_vqueuedstates.size() >= g_nMaxQueuedStates ) {
+                    nstateret = _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn);
+                    if( nstateret != 0 ) {
+                        return nstateret;
+                    }
+                }
                 bHasNewTempConfigToAdd = false;
             }
             if( nstateret != 0 ) {
+                const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                if( nqueuedret != 0 ) {
+                    return nqueuedret;
+                }
                 if( !!filterreturn ) {
                     filterreturn->_returncode = nstateret;
                 }
@@ -2930,6 +3022,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                 }
                 if( !bfound ) {
                     RAVELOG_WARN("cannot take root for quadratic interpolation\n");
+                    const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                    if( nqueuedret != 0 ) {
+                        return nqueuedret;
+                    }
                     if( !!filterreturn ) {
                         filterreturn->_returncode = CFO_StateSettingError;
                     }
@@ -3010,6 +3106,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                     RaveSerializeValues(ss, dq1);
                     ss << "]; deltatime=" << timeelapsed;
                     RAVELOG_WARN_FORMAT("got very small dqscale %f, so returning failure %s", dqscale%ss.str());
+                    const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                    if( nqueuedret != 0 ) {
+                        return nqueuedret;
+                    }
                     if( !!filterreturn ) {
                         filterreturn->_returncode = CFO_StateSettingError;
                     }
@@ -3027,6 +3127,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                     RaveSerializeValues(ss, dq1);
                     ss << "]; deltatime=" << timeelapsed;
                     RAVELOG_WARN_FORMAT("num repeating is %d/%d, dqscale=%f, iScaledIndex=%d, nLargestStepIndex=%d, timestep=%f, fBestNewStep=%f, fLargestStep=%f, so returning failure %s", numRepeating%(numSteps*2)%dqscale%iScaledIndex%nLargestStepIndex%timestep%fBestNewStep%fLargestStep%ss.str());
+                    const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                    if( nqueuedret != 0 ) {
+                        return nqueuedret;
+                    }
                     if( !!filterreturn ) {
                         filterreturn->_returncode = CFO_StateSettingError;
                     }
@@ -3073,6 +3177,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                         RAVELOG_WARN_FORMAT("timestep %.15e > total time of ramp %.15e, step %d/%d %s", timestep%timeelapsed%istep%numSteps%ss.str());
                     }
 
+                    const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                    if( nqueuedret != 0 ) {
+                        return nqueuedret;
+                    }
                     if( !!filterreturn ) {
                         filterreturn->_returncode = CFO_StateSettingError;
                     }
@@ -3085,6 +3193,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
 
             int neighstatus = params->_neighstatefn(_vtempconfig, dQ, neighstateoptions);
             if( neighstatus == NSS_Failed ) {
+                const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                if( nqueuedret != 0 ) {
+                    return nqueuedret;
+                }
                 if( !!filterreturn ) {
                     filterreturn->_returncode = CFO_StateSettingError;
                 }
@@ -3131,7 +3243,7 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                             _vprevtempvelconfig[i] += vpostddq[i]; // probably not right with the way interpolation works out, but it is a reasonable approximation
                         }
 
-                        nstateret = _SetAndCheckState(params, _vprevtempconfig, _vprevtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
+                        nstateret = bBisectionOrder ? _SetAndQueueState(params, _vprevtempconfig, _vprevtempvelconfig, timestep, 0, filterreturn) : _SetAndCheckState(params, _vprevtempconfig, _vprevtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
 //                        if( !!params->_getstatefn ) {
 //                            params->_getstatefn(_vprevtempconfig);     // query again in order to get normalizations/joint limits
 //                        }
@@ -3141,6 +3253,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
 //                            filterreturn->_configurationtimes.push_back(timestep);
 //                        }
                         if( nstateret != 0 ) {
+                            const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                            if( nqueuedret != 0 ) {
+                                return nqueuedret;
+                            }
                             if( !!filterreturn ) {
                                 filterreturn->_returncode = nstateret;
                             }
@@ -3162,6 +3278,12 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
             }
             prevtimestep = timestep; // have to always update since it serves as the basis for the next timestep chosen
         }
+        if( bBisectionOrder ) {
+            int nstateret = _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn);
+            if( nstateret != 0 ) {
+                return nstateret;
+            }
+        }
         if( RaveFabs(fStep-fLargestStep) > RaveFabs(fLargestStepDelta) ) {
             RAVELOG_WARN_FORMAT("fStep (%.15e) did not reach fLargestStep (%.15e). %.15e > %.15e", fStep%fLargestStep%RaveFabs(fStep-fLargestStep)%fLargestStepDelta);
             if( !!filterreturn ) {
@@ -3337,7 +3459,7 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                         if( s == (maxnumsteps - 1) ) {
                             break;
                         }
-                        int ret = _SetAndCheckState(params, _vstepconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
+                        int ret = bBisectionOrder ? _SetAndQueueState(params, _vstepconfig, _vtempvelconfig, (s * imaxnumsteps)*fisteps, 0, filterreturn) : _SetAndCheckState(params, _vstepconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
                         if( !!params->_getstatefn ) {
                             params->_getstatefn(_vstepconfig); // query again in order to get normalizations/joint limits
                         }
@@ -3346,6 +3468,11 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                         //  filterreturn->_configurationtimes.push_back((s * imaxnumsteps)*fisteps);
                         // }
                         if( ret != 0 ) {
+                            // checking in order would have stopped at an invalid state before this one, so check the queued states first
+                            const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                            if( nqueuedret != 0 ) {
+                                return nqueuedret;
+                            }
                             if( !!filterreturn ) {
                                 filterreturn->_returncode = ret;
                                 filterreturn->_invalidvalues = _vstepconfig;
@@ -3362,7 +3489,7 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
 
         _vprevtempconfig.resize(dQ.size());
         for (int f = start; f < numSteps; f++) {
-            int nstateret = _SetAndCheckState(params, _vtempconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
+            int nstateret = bBisectionOrder ? _SetAndQueueState(params, _vtempconfig, _vtempvelconfig, f*fisteps, numfilledperstate, filterreturn) : _SetAndCheckState(params, _vtempconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
             if( !!params->_getstatefn ) {
                 params->_getstatefn(_vtempconfig);     // query again in order to get normalizations/joint limits
             }
@@ -3370,7 +3497,17 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                 filterreturn->_configurations.insert(filterreturn->_configurations.end(), _vtempconfig.begin(), _vtempconfig.end());
                 filterreturn->_configurationtimes.push_back(f*fisteps);
             }
+            if( nstateret == 0 && bBisectionOrder && (int)_vqueuedstates.size() >= g_nMaxQueuedStates ) {
+                nstateret = _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn);
+                if( nstateret != 0 ) {
+                    return nstateret;
+                }
+            }
             if( nstateret != 0 ) {
+                const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                if( nqueuedret != 0 ) {
+                    return nqueuedret;
+                }
                 if( !!filterreturn ) {
                     filterreturn->_returncode = nstateret;
                     filterreturn->_invalidvalues = _vtempconfig;
@@ -3399,6 +3536,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
             _vtempconfig2 = _vtempconfig; // keep record of the original _vtempconfig before being modified by _neighstatefn
             // Make sure that the state is set before calling _neighstatefn
             if( params->SetStateValues(_vtempconfig, 0) != 0 ) {
+                const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                if( nqueuedret != 0 ) {
+                    return nqueuedret;
+                }
                 if( !!filterreturn ) {
                     filterreturn->_returncode = CFO_StateSettingError;
                 }
@@ -3406,6 +3547,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
             }
             int neighstatus = params->_neighstatefn(_vtempconfig, _vprevtempconfig, neighstateoptions);
             if( neighstatus == NSS_Failed ) {
+                const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                if( nqueuedret != 0 ) {
+                    return nqueuedret;
+                }
                 if( !!filterreturn ) {
                     filterreturn->_returncode = CFO_StateSettingError;
                 }
@@ -3456,7 +3601,7 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                         if( s == (maxnumsteps - 1) ) {
                             break;
                         }
-                        int ret = _SetAndCheckState(params, _vstepconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
+                        int ret = bBisectionOrder ? _SetAndQueueState(params, _vstepconfig, _vtempvelconfig, (f + (s * imaxnumsteps))*fisteps, 0, filterreturn) : _SetAndCheckState(params, _vstepconfig, _vtempvelconfig, _vtempaccelconfig, maskoptions, filterreturn);
                         if( !!params->_getstatefn ) {
                             params->_getstatefn(_vstepconfig); // query again in order to get normalizations/joint limits
                         }
@@ -3465,6 +3610,10 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
                         //  filterreturn->_configurationtimes.push_back((s * imaxnumsteps)*fisteps);
                         // }
                         if( ret != 0 ) {
+                            const int nqueuedret = bBisectionOrder ? _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn) : 0;
+                            if( nqueuedret != 0 ) {
+                                return nqueuedret;
+                            }
                             if( !!filterreturn ) {
                                 filterreturn->_returncode = ret;
                                 filterreturn->_invalidvalues = _vstepconfig;
@@ -3478,6 +3627,13 @@ int DynamicsCollisionConstraint::Check(const std::vector<dReal>& q0, const std::
             }
         }
 
+        if( bBisectionOrder ) {
+            int nstateret = _CheckQueuedStates(params, _vtempaccelconfig, maskoptions, filterreturn);
+            if( nstateret != 0 ) {
+                return nstateret;
+            }
+        }
+
         // check if _vtempconfig is close to q1!
         {
             // the neighbor function could be a constraint function and might move _vtempconfig by more than the specified dQ! so double check the straight light distance between them justin case?
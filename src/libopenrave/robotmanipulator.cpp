@@ -15,6 +15,12 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "libopenrave.h"
+
+#include <exception>
+#include <functional>
+#include <numeric>
+#include <thread>
+
 namespace OpenRAVE {
 
 void RobotBase::ManipulatorInfo::Reset()
@@ -460,6 +466,118 @@ bool RobotBase::Manipulator::FindIKSolutions(const IkParameterization& goal, con
     return vFreeParameters.size() == 0 ? pIkSolver->SolveAll(localgoal,filteroptions,vikreturns) : pIkSolver->SolveAll(localgoal,vFreeParameters,filteroptions,vikreturns);
 }
 
+/// \brief transforms the goals into the base frame of the manipulator and solves them, either on the calling thread or split across the manipulators of cloned environments
+///
+/// \param fn solves the local goals with the ik solver and writes their outputs starting at index start. Returns the number of goals that have a solution.
+static int _FindIKSolutionBatch(const RobotBase::Manipulator& manip, const std::vector<IkParameterization>& vgoals, int numthreads, const std::function<int(IkSolverBasePtr, const std::vector<IkParameterization>&, size_t)>& fn)
+{
+    static const int s_nMinGoalsPerThread = 64; // cloning the environment is not worth it for less
+    IkSolverBasePtr pIkSolver = manip.GetIkSolver();
+    RobotBasePtr probot = manip.GetRobot();
+    OPENRAVE_ASSERT_FORMAT(!!pIkSolver, "manipulator %s:%s does not have an IK solver set",probot->GetName()%manip.GetName(),ORE_Failed);
+    std::vector<IkParameterization> vlocalgoals(vgoals.size());
+    if( !!manip.GetBase() ) {
+        const Transform tbaseinv = manip.GetBase()->GetTransform().inverse();
+        for(size_t igoal = 0; igoal < vgoals.size(); ++igoal) {
+            vlocalgoals[igoal] = tbaseinv*vgoals[igoal];
+        }
+    }
+    else {
+        vlocalgoals = vgoals;
+    }
+
+    if( numthreads <= 0 ) {
+        numthreads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    numthreads = std::min(numthreads, (int)vgoals.size()/s_nMinGoalsPerThread);
+    if( numthreads <= 1 || pIkSolver->HasRegisteredCallbacks() ) {
+        return fn(pIkSolver, vlocalgoals, 0);
+    }
+
+    // every other thread solves with the manipulator of its own clone, they are all in the same state as the robot
+    std::vector<EnvironmentBasePtr> vcloneenvs;
+    boost::shared_ptr<void> onexit((void*) 0, [&vcloneenvs](void*) {
+        for (const EnvironmentBasePtr& pcloneenv : vcloneenvs) {
+            pcloneenv->Destroy();
+        }
+    });
+    std::vector<IkSolverBasePtr> vsolvers(1, pIkSolver);
+    for(int ithread = 1; ithread < numthreads; ++ithread) {
+        EnvironmentBasePtr pcloneenv = probot->GetEnv()->CloneSelf(Clone_Bodies);
+        vcloneenvs.push_back(pcloneenv);
+        RobotBasePtr pclonerobot = pcloneenv->GetRobot(probot->GetName());
+        RobotBase::ManipulatorPtr pclonemanip = !!pclonerobot ? pclonerobot->GetManipulator(manip.GetName()) : RobotBase::ManipulatorPtr();
+        OPENRAVE_ASSERT_FORMAT(!!pclonemanip, "env=%s, manipulator %s:%s is not in the cloned environment",pcloneenv->GetNameId()%probot->GetName()%manip.GetName(),ORE_Failed);
+        // clone the solver to keep its free increments and thresholds
+        IkSolverBasePtr pclonesolver = RaveCreateIkSolver(pcloneenv, pIkSolver->GetXMLId());
+        OPENRAVE_ASSERT_FORMAT(!!pclonesolver, "env=%s, failed to create ik solver %s",pcloneenv->GetNameId()%pIkSolver->GetXMLId(),ORE_Failed);
+        pclonesolver->Clone(pIkSolver, 0);
+        pclonemanip->SetIkSolver(pclonesolver);
+        vsolvers.push_back(pclonemanip->GetIkSolver());
+    }
+
+    const size_t numgoalsperthread = (vgoals.size() + numthreads - 1)/numthreads;
+    std::vector<int> vnumsolved(numthreads, 0);
+    std::vector<std::exception_ptr> vexceptions(numthreads);
+    auto solverangefn = [&](int ithread) {
+        const size_t start = std::min(vgoals.size(), ithread*numgoalsperthread);
+        const size_t end = std::min(vgoals.size(), start+numgoalsperthread);
+        std::vector<IkParameterization> vrangegoals(vlocalgoals.begin()+start, vlocalgoals.begin()+end);
+        try {
+            if( ithread > 0 ) {
+                EnvironmentLock lockclone(vsolvers[ithread]->GetEnv()->GetMutex());
+                vnumsolved[ithread] = fn(vsolvers[ithread], vrangegoals, start);
+            }
+            else {
+                vnumsolved[ithread] = fn(vsolvers[ithread], vrangegoals, start);
+            }
+        }
+        catch(...) {
+            vexceptions[ithread] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> vthreads;
+    for(int ithread = 1; ithread < numthreads; ++ithread) {
+        vthreads.emplace_back(solverangefn, ithread);
+    }
+    solverangefn(0);
+    for (std::thread& thread : vthreads) {
+        thread.join();
+    }
+    for (const std::exception_ptr& exception : vexceptions) {
+        if( !!exception ) {
+            std::rethrow_exception(exception);
+        }
+    }
+    return std::accumulate(vnumsolved.begin(), vnumsolved.end(), 0);
+}
+
+int RobotBase::Manipulator::FindIKSolutionBatch(const std::vector<IkParameterization>& vgoals, int filteroptions, std::vector<IkReturnPtr>& vikreturns, int numthreads) const
+{
+    std::vector<dReal> q0;
+    GetArmDOFValues(q0);
+    vikreturns.resize(vgoals.size());
+    return _FindIKSolutionBatch(*this, vgoals, numthreads, [&q0, filteroptions, &vikreturns](IkSolverBasePtr pIkSolver, const std::vector<IkParameterization>& vlocalgoals, size_t start) {
+        std::vector<IkReturnPtr> vrangeikreturns;
+        const int numsolved = pIkSolver->SolveBatch(vlocalgoals, q0, filteroptions, vrangeikreturns);
+        std::copy(vrangeikreturns.begin(), vrangeikreturns.end(), vikreturns.begin()+start);
+        return numsolved;
+    });
+}
+
+int RobotBase::Manipulator::FindIKSolutionsBatch(const std::vector<IkParameterization>& vgoals, int filteroptions, std::vector< std::vector<IkReturnPtr> >& vvikreturns, int numthreads) const
+{
+    vvikreturns.resize(vgoals.size());
+    return _FindIKSolutionBatch(*this, vgoals, numthreads, [filteroptions, &vvikreturns](IkSolverBasePtr pIkSolver, const std::vector<IkParameterization>& vlocalgoals, size_t start) {
+        std::vector< std::vector<IkReturnPtr> > vvrangeikreturns;
+        const int numsolved = pIkSolver->SolveAllBatch(vlocalgoals, filteroptions, vvrangeikreturns);
+        for(size_t igoal = 0; igoal < vvrangeikreturns.size(); ++igoal) {
+            vvikreturns[start+igoal].swap(vvrangeikreturns[igoal]);
+        }
+        return numsolved;
+    });
+}
+
 IkParameterization RobotBase::Manipulator::GetIkParameterization(IkParameterizationType iktype, bool inworld) const
 {
     IkParameterization ikp;
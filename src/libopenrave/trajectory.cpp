@@ -125,6 +125,16 @@ void TrajectoryBase::SamplePoints(std::vector<dReal>& data, const std::vector<dR
     }
 }
 
+void TrajectoryBase::SamplePoints(dReal* pdata, const dReal* ptimes, size_t numtimes) const
+{
+    std::vector<dReal> tempdata;
+    const int dof = GetConfigurationSpecification().GetDOF();
+    for(size_t i = 0; i < numtimes; ++i, pdata += dof) {
+        Sample(tempdata, ptimes[i]);
+        std::copy(tempdata.begin(), tempdata.end(), pdata);
+    }
+}
+
 void TrajectoryBase::SamplePointsSameDeltaTime(std::vector<dReal>& data, dReal deltatime, bool ensureLastPoint) const
 {
     const dReal duration = GetDuration();
@@ -107,3 +107,36 @@ class TestBinaryTrajectory(EnvironmentSetup):
 		trajBinary1 = trajectory1.serialize()
 		trajectory1Copy.deserialize(trajBinary1)
 		assert(trajectory1Copy.GetDescription()=='test')
+
+	def test_aligned_binary_traj(self):
+		import tempfile, os
+		env = Environment()
+		spec = ConfigurationSpecification()
+		spec.AddGroup('joint_values robot 0 1', 2, 'linear')
+		spec.AddDeltaTimeGroup()
+		trajectory = RaveCreateTrajectory(env, '')
+		trajectory.Init(spec)
+		trajectory.Insert(0, [0, 0, 0, 1, 2, 0.5, 2, 4, 1.5])
+
+		# aligned layout can be read back by the regular deserialize
+		trajectoryCopy = RaveCreateTrajectory(env, '')
+		trajectoryCopy.deserialize(trajectory.serialize(0x4000))
+		assert trajectory.GetConfigurationSpecification() == trajectoryCopy.GetConfigurationSpecification()
+		assert list(trajectory.GetWaypoints(0, trajectory.GetNumWaypoints())) == list(trajectoryCopy.GetWaypoints(0, trajectoryCopy.GetNumWaypoints()))
+
+		fd, filename = tempfile.mkstemp(suffix='.traj')
+		os.close(fd)
+		try:
+			trajectory.SaveToFile(filename, 0x4000)
+			trajectoryMapped = RaveCreateTrajectory(env, '')
+			trajectoryMapped.SendCommand('MapFile %s'%filename)
+			assert trajectoryMapped.GetNumWaypoints() == 3
+			assert abs(trajectoryMapped.GetDuration() - trajectory.GetDuration()) <= 1e-10
+			assert transdist(trajectoryMapped.Sample(1.0), trajectory.Sample(1.0)) <= 1e-10
+
+			# modifying copies the data out of the mapped file
+			trajectoryMapped.Insert(3, [3, 6, 1])
+			assert trajectoryMapped.GetNumWaypoints() == 4
+			assert abs(trajectoryMapped.GetDuration() - 3) <= 1e-10
+		finally:
+			os.remove(filename)
@@ -12,6 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 from common_test_openrave import *
+import threading
 
 class RunCollision(EnvironmentSetup):
     def __init__(self,collisioncheckername):
@@ -82,6 +83,109 @@ class RunCollision(EnvironmentSetup):
             assert(not target1.CheckSelfCollision())
             assert(self.env.CheckCollision(target1,report))
 
+    def test_selfcollisionspheres(self):
+        # KinBody.CheckSelfCollision first tests the link sphere trees, the checker itself does not
+        env=self.env
+        for robotfile in g_robotfiles:
+            env.Reset()
+            robot=self.LoadRobot(robotfile)
+            with env:
+                collisionchecker = env.GetCollisionChecker()
+                lower,upper = robot.GetDOFLimits()
+                for i in range(50):
+                    robot.SetDOFValues(lower+random.rand(len(lower))*(upper-lower))
+                    assert(robot.CheckSelfCollision() == collisionchecker.CheckSelfCollision(robot))
+                    assert(robot.CheckSelfCollision(CollisionReport()) == collisionchecker.CheckSelfCollision(robot))
+
+        # geometries that differ less than the rounding of the kinematics geometry hash cannot share spheres
+        with env:
+            env.Reset()
+            bodies = []
+            for i, fextent in enumerate([0.1, 0.10001]):
+                body = env.ReadKinBodyData("""<KinBody name="arm%d">
+  <Body name="base"><Geom type="box"><extents>%f 0.02 0.02</extents></Geom></Body>
+  <Body name="middle"><offsetfrom>base</offsetfrom><translation>0.2 0 0</translation><Geom type="box"><extents>0.02 0.02 0.02</extents></Geom></Body>
+  <Body name="tip"><offsetfrom>middle</offsetfrom><translation>0.2 0 0</translation><Geom type="box"><extents>0.1 0.02 0.02</extents></Geom></Body>
+  <Joint name="j0" type="hinge"><Body>base</Body><Body>middle</Body><offsetfrom>middle</offsetfrom><axis>0 0 1</axis><limitsdeg>-180 180</limitsdeg></Joint>
+  <Joint name="j1" type="hinge"><Body>middle</Body><Body>tip</Body><offsetfrom>middle</offsetfrom><axis>0 0 1</axis><limitsdeg>-180 180</limitsdeg></Joint>
+</KinBody>"""%(i, fextent))
+                env.Add(body)
+                bodies.append(body)
+            collisionchecker = env.GetCollisionChecker()
+            for body in bodies:
+                lower,upper = body.GetDOFLimits()
+                for i in range(50):
+                    body.SetDOFValues(lower+random.rand(len(lower))*(upper-lower))
+                    assert(body.CheckSelfCollision() == collisionchecker.CheckSelfCollision(body))
+
+    def test_collisionbatch(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot = env.GetRobots()[0]
+            collisionchecker = env.GetCollisionChecker()
+            dofindices = robot.GetActiveManipulator().GetArmIndices()
+            lower,upper = robot.GetDOFLimits(dofindices)
+            configs = array([lower+random.rand(len(lower))*(upper-lower) for i in range(100)])
+            initialvalues = robot.GetDOFValues()
+            for checkflags in [CollisionBatchFlags.Env, CollisionBatchFlags.Self, CollisionBatchFlags.Env|CollisionBatchFlags.Self]:
+                results = collisionchecker.CheckCollisionBatch(robot, configs, dofindices, checkflags)
+                assert(len(results) == len(configs))
+                # the state of the body is restored
+                assert(transdist(robot.GetDOFValues(), initialvalues) <= g_epsilon)
+                with robot:
+                    for config, result in zip(configs, results):
+                        robot.SetDOFValues(config, dofindices)
+                        expected = 0
+                        if (checkflags & CollisionBatchFlags.Env) and collisionchecker.CheckCollision(robot):
+                            expected |= CollisionBatchFlags.Env
+                        if (checkflags & CollisionBatchFlags.Self) and collisionchecker.CheckSelfCollision(robot):
+                            expected |= CollisionBatchFlags.Self
+                        assert(result == expected)
+
+    def test_continuouscollision(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot = env.GetRobots()[0]
+            collisionchecker = env.GetCollisionChecker()
+            dofindices = robot.GetActiveManipulator().GetArmIndices()
+            lower,upper = robot.GetDOFLimits(dofindices)
+            resolutions = robot.GetDOFResolutions(dofindices)
+            initialvalues = robot.GetDOFValues()
+            checkflags = CollisionBatchFlags.Env|CollisionBatchFlags.Self
+            numcollisions = 0
+            for i in range(50):
+                q0 = lower+random.rand(len(lower))*(upper-lower)
+                q1 = minimum(upper,maximum(lower,q0+0.4*(random.rand(len(lower))-0.5)))
+                collision, contacttime = collisionchecker.CheckContinuousCollision(robot, q0, q1, dofindices, checkflags)
+                # the state of the body is restored
+                assert(transdist(robot.GetDOFValues(), initialvalues) <= g_epsilon)
+                # discretize 4 times finer than the dof resolutions, this contains all the configurations the default implementation checks
+                numsteps = 4*max(1,int(ceil(max(abs(q1-q0)/resolutions))))
+                firstcollisiontime = None
+                with robot:
+                    for istep in range(numsteps+1):
+                        t = float(istep)/numsteps
+                        robot.SetDOFValues(q0+t*(q1-q0), dofindices)
+                        if collisionchecker.CheckCollision(robot) or collisionchecker.CheckSelfCollision(robot):
+                            firstcollisiontime = t
+                            break
+                    if collision:
+                        assert(contacttime >= 0 and contacttime <= 1)
+                        # the returned time has to be in collision
+                        robot.SetDOFValues(q0+contacttime*(q1-q0), dofindices)
+                        assert(collisionchecker.CheckCollision(robot) or collisionchecker.CheckSelfCollision(robot))
+                    else:
+                        assert(contacttime == -1)
+                if firstcollisiontime is not None:
+                    numcollisions += 1
+                    assert(collision)
+                    # discretized checkers can only find the collision at their next sample
+                    assert(contacttime <= firstcollisiontime+4.0/numsteps+g_epsilon)
+            # need both free and colliding segments
+            assert(numcollisions > 0 and numcollisions < 50)
+
     def test_attachedbodiescollision(self):
         with self.env:
             self.LoadEnv('data/lab1.env.xml')
@@ -268,6 +372,220 @@ class RunCollision(EnvironmentSetup):
         manip.CheckEndEffectorCollision(report)
         assert(len(report.vLinkColliding)==4)
 
+class TestFCLCollision(EnvironmentSetup):
+    """tests the features that only the fcl checker implements
+    """
+    def setup(self):
+        EnvironmentSetup.setup(self)
+        self.env.SetCollisionChecker(RaveCreateCollisionChecker(self.env,'fcl_'))
+
+    def _AddBox(self,name,extents,pos,static=False):
+        body=RaveCreateKinBody(self.env,'')
+        body.InitFromBoxes(array([[0,0,0]+list(extents)]),True)
+        body.SetName(name)
+        self.env.Add(body,True)
+        body.SetTransform(matrixFromPose([1,0,0,0]+list(pos)))
+        for link in body.GetLinks():
+            link.SetStatic(static)
+        return body
+
+    def test_staticclearance(self):
+        self.log.info('the distance field has to stay a lower bound of the exact clearance when bodies become static')
+        env=self.env
+        with env:
+            checker=env.GetCollisionChecker()
+            exactchecker=RaveCreateCollisionChecker(env,'fcl_')
+            exactchecker.InitEnvironment()
+            self._AddBox('obstacle0',[0.2,0.2,0.2],[1,0,0],static=True)
+            obstacle1=self._AddBox('obstacle1',[0.2,0.2,0.2],[-1,0,0],static=False)
+            probe=self._AddBox('probe',[0.05,0.05,0.05],[0,0,0])
+            assert(checker.SendCommand('SetStaticDistanceField 0.01 0.5') is not None)
+            for static in [False,True,False]:
+                for link in obstacle1.GetLinks():
+                    link.SetStatic(static)
+                for x in arange(-0.7,0.71,0.1):
+                    probe.SetTransform(matrixFromPose([1,0,0,0,x,0.05,0]))
+                    fieldclearance=checker.ComputeStaticClearance(probe)
+                    exactclearance=exactchecker.ComputeStaticClearance(probe)
+                    assert(fieldclearance <= exactclearance+g_epsilon), 'static=%d x=%f field=%f exact=%f'%(static,x,fieldclearance,exactclearance)
+                    # the field is conservative, but has to stay within a few voxels
+                    assert(fieldclearance >= exactclearance-0.15)
+
+    def test_raygeometries(self):
+        self.log.info('single rays and ray batches hit boxes, spheres, cylinders and meshes at the analytic distances')
+        env=self.env
+        with env:
+            checker=env.GetCollisionChecker()
+            self._AddBox('box',[0.1,0.2,0.3],[0,0,0])
+            sphere=RaveCreateKinBody(env,'')
+            sphere.InitFromSpheres(array([[0,2,0,0.2]]),True)
+            sphere.SetName('sphere')
+            env.Add(sphere,True)
+            infocylinder=KinBody.Link.GeometryInfo()
+            infocylinder._type=KinBody.Link.GeomType.Cylinder
+            infocylinder._vGeomData=[0.15,0.4]
+            infocylinder._t[1,3]=4
+            cylinder=RaveCreateKinBody(env,'')
+            cylinder.InitFromGeometries([infocylinder])
+            cylinder.SetName('cylinder')
+            env.Add(cylinder,True)
+            mesh=RaveCreateKinBody(env,'')
+            mesh.InitFromTrimesh(TriMesh(*misc.ComputeBoxMesh([0.1,0.2,0.3])),True)
+            mesh.SetName('mesh')
+            env.Add(mesh,True)
+            mesh.SetTransform(matrixFromPose([1,0,0,0,0,6,0]))
+
+            # rays along -x, with their expected hit distance or None
+            rays=[([1,0,0],[-2,0,0],0.9), ([1,0,0],[-0.5,0,0],None), ([1,2,0],[-2,0,0],0.8), ([1,2.1,0],[-2,0,0],1-sqrt(0.2**2-0.1**2)),
+                  ([1,4,0],[-2,0,0],0.85), ([1,6,0],[-2,0,0],0.9), ([1,6.1,0.1],[-2,0,0],0.9), ([1,8,0],[-2,0,0],None)]
+            hits,hitposnorms,distances=checker.CheckCollisionRaysBatch(array([pos+dir for pos,dir,distance in rays]),None)
+            report=CollisionReport()
+            for iray,(pos,dir,distance) in enumerate(rays):
+                bCollision=checker.CheckCollision(Ray(pos,dir),report)
+                assert(bCollision == (distance is not None)), 'ray %d'%iray
+                assert(hits[iray] == (distance is not None)), 'ray %d'%iray
+                if distance is None:
+                    continue
+                assert(abs(report.minDistance-distance) <= 1e-6), 'ray %d: %f != %f'%(iray,report.minDistance,distance)
+                assert(abs(distances[iray]-distance) <= 1e-6), 'ray %d: %f != %f'%(iray,distances[iray],distance)
+                expectedpos=array(pos)+array(dir)*distance/linalg.norm(dir)
+                assert(transdist(report.contacts[0].pos,expectedpos) <= 1e-6)
+                assert(transdist(hitposnorms[iray][0:3],expectedpos) <= 1e-6)
+                # the surfaces face the rays
+                assert(dot(report.contacts[0].norm,dir) < 0)
+                assert(transdist(report.contacts[0].norm,hitposnorms[iray][3:6]) <= 1e-6)
+
+    def test_sharedmeshbvh(self):
+        self.log.info('bodies with the same meshes share their BVH models and still report their own geometries')
+        env=self.env
+        with env:
+            checker=env.GetCollisionChecker()
+            def CreateMeshBody(name,extents,pos):
+                infos=[]
+                for igeom in range(2):
+                    info=KinBody.Link.GeometryInfo()
+                    info._type=KinBody.Link.GeomType.Trimesh
+                    info._meshcollision=TriMesh(*misc.ComputeBoxMesh(extents))
+                    info._t[2,3]=igeom
+                    info._name='%s_geom%d'%(name,igeom)
+                    infos.append(info)
+                body=RaveCreateKinBody(env,'')
+                body.InitFromGeometries(infos)
+                body.SetName(name)
+                env.Add(body,True)
+                body.SetTransform(matrixFromPose([1,0,0,0]+pos))
+                return body
+
+            numcached=int(checker.SendCommand('PurgeSharedMeshBVHCache'))
+            bodies=[CreateMeshBody('mesh0',[0.1,0.2,0.3],[0,0,0]), CreateMeshBody('mesh1',[0.1,0.2,0.3],[2,0,0]), CreateMeshBody('othermesh',[0.1,0.1,0.3],[4,0,0])]
+            clone=RaveCreateKinBody(env,'')
+            clone.Clone(bodies[0],0)
+            clone.SetName('mesh0clone')
+            env.Add(clone,True)
+            clone.SetTransform(matrixFromPose([1,0,0,0,6,0,0]))
+            bodies.append(clone)
+            ids=[checker.SendCommand('GetGeometryBVHIds %s'%body.GetName()).split() for body in bodies]
+            self.log.info('BVH ids %r', ids)
+            assert(len(ids[0]) == 2 and ids[0][0] == ids[0][1])
+            assert(ids[1] == ids[0] and ids[3] == ids[0])
+            assert(len(ids[2]) == 2 and ids[2][0] != ids[0][0])
+            assert(int(checker.SendCommand('PurgeSharedMeshBVHCache')) == numcached+2)
+
+            # every body collides with its own geometries even though the models are shared
+            probe=self._AddBox('probe',[0.05,0.05,0.05],[10,0,0])
+            report=CollisionReport()
+            for body in bodies:
+                T=body.GetTransform()
+                for igeom in range(2):
+                    probe.SetTransform(matrixFromPose([1,0,0,0,T[0,3],T[1,3],igeom]))
+                    assert(env.CheckCollision(probe,report=report))
+                    assert(report.plink1.GetParent() == body or report.plink2.GetParent() == body)
+                    geomnames=[geom.GetName() for geom in [report.pgeom1,report.pgeom2] if geom is not None]
+                    assert('%s_geom%d'%(body.GetName(),igeom) in geomnames), '%s %d %r'%(body.GetName(),igeom,geomnames)
+                    assert(env.CheckCollision(probe,body))
+                    assert(not any(env.CheckCollision(probe,otherbody) for otherbody in bodies if otherbody != body))
+                probe.SetTransform(matrixFromPose([1,0,0,0,T[0,3],T[1,3],0.5]))
+                assert(not env.CheckCollision(probe))
+
+            # the models are freed once the last body using them is removed
+            for body in [bodies[0],bodies[1]]:
+                env.Remove(body)
+            assert(int(checker.SendCommand('PurgeSharedMeshBVHCache')) == numcached+2)
+            env.Remove(bodies[3])
+            assert(int(checker.SendCommand('PurgeSharedMeshBVHCache')) == numcached+1)
+            env.Remove(bodies[2])
+            assert(int(checker.SendCommand('PurgeSharedMeshBVHCache')) == numcached)
+
+    def test_concurrentqueries(self):
+        self.log.info('queries from several threads at once see either state of a body that another thread keeps moving')
+        env=self.env
+        with env:
+            bodies=[self._AddBox('box%d'%i,[0.1,0.1,0.1],[0.15*i,0.02*(i%2),0]) for i in range(6)]
+            pairs=[(body1,body2) for body1 in bodies for body2 in bodies if body1 != body2]
+            movingbody=bodies[0]
+            Tinitial=movingbody.GetTransform()
+            Tfar=array(Tinitial)
+            Tfar[2,3]+=1.0
+            expectedstates=[]
+            for T in [Tinitial,Tfar]:
+                movingbody.SetTransform(T)
+                expected=[env.CheckCollision(body1,body2) for body1,body2 in pairs]
+                expected+=[env.CheckCollision(body) for body in bodies]
+                expectedstates.append(expected)
+            movingbody.SetTransform(Tinitial)
+            assert(any(expectedstates[0]) and not all(expectedstates[0]))
+            assert(expectedstates[0] != expectedstates[1])
+
+        results={}
+        stopmoving=threading.Event()
+        def mover():
+            try:
+                imove=0
+                while not stopmoving.is_set():
+                    with env:
+                        movingbody.SetTransform([Tinitial,Tfar][imove%2])
+                    imove+=1
+                results['mover']=True
+            except Exception as e:
+                results['mover']=e
+
+        def worker(index):
+            try:
+                for iter in range(20):
+                    result=[env.CheckCollision(body1,body2) for body1,body2 in pairs]
+                    result+=[env.CheckCollision(body) for body in bodies]
+                    for i in range(len(result)):
+                        if result[i] != expectedstates[0][i] and result[i] != expectedstates[1][i]:
+                            results[index]=result
+                            return
+                    # the pairs without the moving body do not depend on its state
+                    for i,(body1,body2) in enumerate(pairs):
+                        if movingbody not in (body1,body2) and result[i] != expectedstates[0][i]:
+                            results[index]=result
+                            return
+                results[index]=True
+            except Exception as e:
+                results[index]=e
+
+        moverthread=threading.Thread(target=mover)
+        moverthread.start()
+        threads=[threading.Thread(target=worker,args=(ithread,)) for ithread in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join(60)
+        stopmoving.set()
+        moverthread.join(60)
+        assert(not moverthread.is_alive() and not any(t.is_alive() for t in threads))
+        assert(results['mover'] is True), 'mover: %r'%(results['mover'],)
+        for ithread in range(4):
+            assert(results[ithread] is True), 'thread %d: %r'%(ithread,results[ithread])
+        with env:
+            movingbody.SetTransform(Tinitial)
+            result=[env.CheckCollision(body1,body2) for body1,body2 in pairs]
+            result+=[env.CheckCollision(body) for body in bodies]
+            assert(result == expectedstates[0])
+
 #generate_classes(RunCollision, globals(), [('ode','ode'),('bullet','bullet')])
 
 class test_ode(RunCollision):
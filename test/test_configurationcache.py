@@ -135,6 +135,14 @@ class TestConfigurationCache(EnvironmentSetup):
             self.log.info('writing cache to file...')
             cachechecker.SendCommand('SaveCache')
 
+            # warm start from the saved cache
+            cachechecker.SendCommand('ResetSelfCache')
+            loadedsize = cachechecker.SendCommand('LoadCache')
+            assert(loadedsize is not None and int(loadedsize) == int(selfcachesize))
+            selfcachedcollisions, selfcachedcollisionhits, selfcachedfreehits, selfcachesize2 = cachechecker.SendCommand('GetSelfCacheStatistics').split()
+            assert(int(selfcachesize2) == int(selfcachesize))
+            assert(cachechecker.SendCommand('ValidateSelfCache').strip() == '1')
+
     def test_find_insert(self):
 
         self.LoadEnv('data/lab1.env.xml')
@@ -310,3 +318,96 @@ class TestConfigurationCache(EnvironmentSetup):
                 cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = cachechecker.SendCommand('GetSelfCacheStatistics').split()
                 assert(int(cachesize)==0)
                 self.log.info('self cache reset test passed')
+
+    def test_sharedselfcache(self):
+        env = self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot = env.GetRobots()[0]
+            cachechecker = RaveCreateCollisionChecker(env,'CacheChecker')
+            assert(cachechecker.SendCommand('TrackRobotState %s'%robot.GetName()) is not None)
+            env.SetCollisionChecker(cachechecker)
+            # publish every configuration right away
+            assert(cachechecker.SendCommand('ShareSelfCache 1 0') is not None)
+            sampler = RaveCreateSpaceSampler(env, u'RobotConfiguration %s'%robot.GetName())
+
+        env2 = env.CloneSelf(CloningOptions.Bodies)
+        try:
+            robot2 = env2.GetRobot(robot.GetName())
+            cachechecker2 = env2.GetCollisionChecker()
+            assert(cachechecker2.SendCommand('GetSharedSelfCacheStatistics') is not None)
+
+            def CheckSharedResults(numsamples):
+                confs = []
+                results = []
+                report = CollisionReport()
+                with env:
+                    for iter in range(numsamples):
+                        robot.SetActiveDOFValues(sampler.SampleSequence(SampleDataType.Real,1))
+                        confs.append(robot.GetDOFValues())
+                        results.append(cachechecker.CheckSelfCollision(robot, report=report))
+                sharedhits = int(cachechecker2.SendCommand('GetSharedSelfCacheStatistics').split()[0])
+                with env2:
+                    for conf, result in zip(confs, results):
+                        robot2.SetDOFValues(conf)
+                        assert(cachechecker2.CheckSelfCollision(robot2, report=report) == result)
+                        if result and report.plink1 is not None:
+                            # links have to be mapped to the bodies of the querying environment
+                            assert(report.plink1.GetParent() == robot2)
+                            if report.plink2 is not None:
+                                assert(env2.GetKinBody(report.plink2.GetParent().GetName()) == report.plink2.GetParent())
+                # every configuration is known from the other environment
+                assert(int(cachechecker2.SendCommand('GetSharedSelfCacheStatistics').split()[0]) == sharedhits+numsamples)
+
+            CheckSharedResults(100)
+
+            # removing bodies that are not attached to the robot does not change the self collision results
+            with env:
+                env.Remove([body for body in env.GetBodies() if body != robot][0])
+            CheckSharedResults(100)
+
+            # grabbing changes the self collision results of the robot, so the clone stops using the shared cache
+            with env2:
+                box = RaveCreateKinBody(env2,'')
+                box.SetName('sharedcachebox')
+                box.InitFromBoxes(array([[0,0,0,0.02,0.02,0.02]]),True)
+                env2.Add(box)
+                box.SetTransform(robot2.GetActiveManipulator().GetTransform())
+                robot2.Grab(box)
+            assert(cachechecker2.SendCommand('GetSharedSelfCacheStatistics') is None)
+            assert(cachechecker.SendCommand('GetSharedSelfCacheStatistics') is not None)
+        finally:
+            env2.Destroy()
+
+    def test_sharedselfcachepublishdelay(self):
+        env = self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot = env.GetRobots()[0]
+            cachechecker = RaveCreateCollisionChecker(env,'CacheChecker')
+            assert(cachechecker.SendCommand('TrackRobotState %s'%robot.GetName()) is not None)
+            env.SetCollisionChecker(cachechecker)
+            # the batch never fills, so configurations are only published by the delay
+            assert(cachechecker.SendCommand('ShareSelfCache 1000 0.5') is not None)
+
+        env2 = env.CloneSelf(CloningOptions.Bodies)
+        try:
+            robot2 = env2.GetRobot(robot.GetName())
+            cachechecker2 = env2.GetCollisionChecker()
+            with env:
+                values = robot.GetDOFValues()
+                values[1] += 0.5
+                robot.SetDOFValues(values)
+                result = cachechecker.CheckSelfCollision(robot)
+            sharedhits, sharednodes, numpending = [int(x) for x in cachechecker.SendCommand('GetSharedSelfCacheStatistics').split()]
+            assert(numpending == 1)
+
+            # once the delay passed, the next query of any clone publishes the queued configuration
+            time.sleep(0.6)
+            with env2:
+                robot2.SetDOFValues(values)
+                assert(cachechecker2.CheckSelfCollision(robot2) == result)
+            sharedhits2, sharednodes2, numpending2 = [int(x) for x in cachechecker2.SendCommand('GetSharedSelfCacheStatistics').split()]
+            assert(sharedhits2 == 1 and numpending2 == 0 and sharednodes2 == sharednodes+1)
+        finally:
+            env2.Destroy()
@@ -12,9 +12,14 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 from common_test_openrave import *
-from subprocess import Popen, PIPE
+from subprocess import Popen, PIPE, STDOUT
 import shutil
+import tempfile
+import sys
+import re
+import json
 import threading
+import struct
 
 class TestEnvironment(EnvironmentSetup):
     def test_load(self):
@@ -141,6 +146,48 @@ class TestEnvironment(EnvironmentSetup):
                 env2.StepSimulation(0.01)
             env2.Destroy()
 
+    def test_delta(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        env2=Environment()
+        try:
+            stamp = DeltaStamp()
+            with env:
+                delta = env.ExtractDelta(stamp)
+            assert(env2.ApplyDelta(delta))
+            misc.CompareEnvironments(env,env2,epsilon=g_epsilon)
+
+            # only the changed state is sent
+            with env:
+                robot = env.GetRobots()[0]
+                lower,upper = robot.GetDOFLimits()
+                robot.SetDOFValues(lower+random.rand(len(lower))*(upper-lower))
+                robot.Grab(env.GetKinBody('mug1'))
+                deltastate = env.ExtractDelta(stamp)
+            assert(len(deltastate) < len(delta))
+            assert(env2.ApplyDelta(deltastate))
+            misc.CompareEnvironments(env,env2,epsilon=g_epsilon)
+            assert(len(env2.GetRobot(robot.GetName()).GetGrabbed()) == 1)
+
+            with env:
+                env.Remove(env.GetKinBody('mug2'))
+                deltaremove = env.ExtractDelta(stamp)
+            assert(env2.ApplyDelta(deltaremove))
+            misc.CompareEnvironments(env,env2,epsilon=g_epsilon)
+
+            # nothing changed
+            with env:
+                assert(env2.ApplyDelta(env.ExtractDelta(stamp)))
+            misc.CompareEnvironments(env,env2,epsilon=g_epsilon)
+
+            # malformed deltas are rejected
+            assert(not env2.ApplyDelta(delta[:len(delta)//2]))
+            assert(not env2.ApplyDelta(b'openrave'))
+            # the header followed by one removed body id whose length is far larger than the delta
+            assert(not env2.ApplyDelta(delta[:6] + struct.pack('<II', 1, 0xffffffff)))
+        finally:
+            env2.Destroy()
+
     def test_clone_basic(self):
         env=self.env
         self.LoadEnv('data/pr2test1.env.xml')
@@ -191,6 +238,184 @@ class TestEnvironment(EnvironmentSetup):
             assert(endtime <= 0.05)
             misc.CompareEnvironments(env,clonedenv,epsilon=g_epsilon)
             
+    def test_clonesharegeometries(self):
+        self.log.info('geometry groups of cloned bodies stay isolated with and without sharing the geometry infos')
+        env=self.env
+        with env:
+            body=RaveCreateKinBody(env,'')
+            body.SetName('box')
+            body.InitFromBoxes(array([[0,0,0,0.1,0.2,0.3]]),True)
+            env.Add(body)
+            link=body.GetLinks()[0]
+            groupinfos = []
+            for i in range(2):
+                info=KinBody.GeometryInfo()
+                info._type=GeometryType.Box
+                info._name='groupbox%d'%i
+                info._vGeomData=[0.05*(i+1),0.05,0.05]
+                groupinfos.append(info)
+            link.SetGroupGeometries('test',groupinfos)
+            numgeometries = len(link.GetGeometries())
+
+            for options in [CloningOptions.Bodies, CloningOptions.Bodies|CloningOptions.ShareGeometries]:
+                clonedenv=env.CloneSelf(options)
+                try:
+                    with clonedenv:
+                        clonedlink=clonedenv.GetKinBody('box').GetLinks()[0]
+                        clonedinfos=clonedlink.GetGeometriesFromGroup('test')
+                        assert(len(clonedinfos) == 2)
+                        for info,clonedinfo in zip(link.GetGeometriesFromGroup('test'),clonedinfos):
+                            assert(info._name == clonedinfo._name)
+                            assert(sum(abs(array(info._vGeomData)-array(clonedinfo._vGeomData))) <= g_epsilon)
+
+                        # changing the groups of the clone does not change the source
+                        newinfo=KinBody.GeometryInfo()
+                        newinfo._type=GeometryType.Box
+                        newinfo._name='groupbox2'
+                        newinfo._vGeomData=[0.2,0.2,0.2]
+                        clonedlink.AddGeometryToGroup(newinfo,'test')
+                        clonedlink.RemoveGeometryByName('groupbox0',True)
+                        assert([info._name for info in clonedlink.GetGeometriesFromGroup('test')] == ['groupbox1','groupbox2'])
+                        assert([info._name for info in link.GetGeometriesFromGroup('test')] == ['groupbox0','groupbox1'])
+                        clonedlink.SetGeometriesFromGroup('test')
+                        assert(len(clonedlink.GetGeometries()) == 2)
+                        assert(len(link.GetGeometries()) == numgeometries)
+
+                        # changing the groups of the source does not change the clone
+                        link.SetGroupGeometries('test',groupinfos[:1])
+                        assert([info._name for info in clonedlink.GetGeometriesFromGroup('test')] == ['groupbox1','groupbox2'])
+                        link.SetGroupGeometries('test',groupinfos)
+                finally:
+                    clonedenv.Destroy()
+
+    def test_jsondocumentcache(self):
+        self.log.info('the process-wide cache of json documents reuses, invalidates and evicts documents')
+        # the cache budget is read once per process, so run the loads in separate processes and look at their verbose log
+        script = """
+import sys
+from openravepy import *
+RaveSetDebugLevel(DebugLevel.Verbose)
+env = Environment()
+names = []
+try:
+    for step in sys.argv[2:]:
+        command, filename = step.split(':', 1)
+        if command == 'load':
+            env.Reset()
+            assert(env.Load(filename))
+            names.append(env.GetBodies()[0].GetName())
+        elif command == 'rename':
+            # rewrite with the same size right away, so the modification time does not change on most file systems
+            with open(filename) as f:
+                content = f.read()
+            with open(filename, 'w') as f:
+                f.write(content.replace('boxa', 'boxb'))
+    # write the names to a file since the log of the process is not synchronized with python's output
+    with open(sys.argv[1], 'w') as f:
+        f.write(' '.join(names))
+finally:
+    env.Destroy()
+    RaveDestroy()
+"""
+        content = '{"bodies": [{"id": "%s", "name": "%s", "links": [{"id": "base", "name": "base", "geometries": [{"id": "geom", "type": "box", "halfExtents": [0.1, 0.1, 0.1]}]}]}]}'
+        tempdir = os.path.realpath(tempfile.mkdtemp())
+        try:
+            scriptfilename = os.path.join(tempdir, 'loadjson.py')
+            with open(scriptfilename, 'w') as f:
+                f.write(script)
+            filenamea = os.path.join(tempdir, 'a.json')
+            filenameb = os.path.join(tempdir, 'b.json')
+            namesfilename = os.path.join(tempdir, 'names.txt')
+
+            def run(cachesize, steps):
+                for filename, name in [(filenamea, 'boxa'), (filenameb, 'boxc')]:
+                    with open(filename, 'w') as f:
+                        f.write(content % (name, name))
+                processenv = dict(os.environ)
+                if cachesize is not None:
+                    processenv['OPENRAVE_JSON_DOCUMENT_CACHE_SIZE'] = str(cachesize)
+                process = Popen([sys.executable, scriptfilename, namesfilename] + steps, stdout=PIPE, stderr=STDOUT, env=processenv)
+                output = process.communicate()[0].decode('utf-8', 'replace')
+                assert process.returncode == 0, output
+                with open(namesfilename) as f:
+                    names = f.read().split()
+                return output, names
+
+            # hit and invalidation after a rewrite of the same size
+            output, names = run(None, ['load:' + filenamea, 'load:' + filenamea, 'rename:' + filenamea, 'load:' + filenamea])
+            assert(names == ['boxa', 'boxa', 'boxb'])
+            assert(output.count("reusing cached document '%s'" % filenamea) == 1)
+            assert(output.count("cached document '%s' changed on disk" % filenamea) == 1)
+            documentsize = int(re.search("caching document '%s' of (\\d+) bytes" % re.escape(filenamea), output).group(1))
+            assert(documentsize > 0)
+
+            # a budget of one and a half documents only keeps the most recently used one
+            output, names = run(documentsize + documentsize//2, ['load:' + filenamea, 'load:' + filenameb, 'load:' + filenamea, 'load:' + filenamea])
+            assert(names == ['boxa', 'boxc', 'boxa', 'boxa'])
+            assert(output.count("evicting cached document '%s'" % filenamea) == 1)
+            assert(output.count("evicting cached document '%s'" % filenameb) == 1)
+            assert(output.count("reusing cached document '%s'" % filenamea) == 1)
+
+            # 0 disables the cache
+            output, names = run(0, ['load:' + filenamea, 'load:' + filenamea])
+            assert(names == ['boxa', 'boxa'])
+            assert(output.count('caching document') == 0)
+            assert(output.count('reusing cached document') == 0)
+        finally:
+            shutil.rmtree(tempdir)
+
+    def test_loadjsonthreads(self):
+        self.log.info('loading a json scene with several load threads gives the same bodies and errors as with one')
+        env=self.env
+
+        def getbodyjson(ibody, geomtype):
+            geometry = {'id': 'geom', 'type': geomtype, 'transform': [1, 0, 0, 0, 0, 0, 0.01*ibody]}
+            if geomtype == 'cylinder':
+                geometry['radius'] = 0.05 + 0.01*ibody
+                geometry['height'] = 0.2
+            else:
+                geometry['halfExtents'] = [0.1, 0.02*(ibody+1), 0.05]
+            links = [{'id': 'base', 'name': 'base', 'transform': [1, 0, 0, 0, 0.5*ibody, 0, 0], 'geometries': [geometry]}]
+            return {'id': 'body%d' % ibody, 'name': 'body%d' % ibody, 'links': links}
+
+        def writescene(filename, geomtypes):
+            with open(filename, 'w') as f:
+                f.write(json.dumps({'bodies': [getbodyjson(ibody, geomtype) for ibody, geomtype in enumerate(geomtypes)]}))
+
+        tempdir = tempfile.mkdtemp()
+        try:
+            filename = os.path.join(tempdir, 'scene.json')
+            writescene(filename, ['box' if ibody % 2 == 0 else 'cylinder' for ibody in range(12)])
+            bodystates = []
+            for numloadthreads in [1, 4]:
+                with env:
+                    env.Reset()
+                    assert(env.Load(filename, {'numloadthreads': str(numloadthreads)}))
+                    bodystate = []
+                    for body in sorted(env.GetBodies(), key=lambda body: body.GetName()):
+                        geometries = [(geom.GetType(), geom.GetBoxExtents().tolist(), geom.GetCylinderRadius(), geom.GetTransform().tolist()) for geom in body.GetLinks()[0].GetGeometries()]
+                        bodystate.append((body.GetName(), body.GetKinematicsGeometryHash(), body.GetTransform().tolist(), geometries))
+                    bodystates.append(bodystate)
+            assert(len(bodystates[0]) == 12)
+            assert(bodystates[0] == bodystates[1])
+
+            # bodies 3 and 7 fail to decode, always report body 3 like when decoding one body at a time
+            writescene(filename, ['unsupportedtype%d' % ibody if ibody in (3, 7) else 'box' for ibody in range(12)])
+            errors = []
+            for numloadthreads in [1, 4]:
+                with env:
+                    env.Reset()
+                    try:
+                        env.Load(filename, {'numloadthreads': str(numloadthreads)})
+                        errors.append(None)
+                    except openrave_exception as e:
+                        errors.append(str(e))
+                    assert(len(env.GetBodies()) == 0)
+            assert(errors[0] is not None and 'unsupportedtype3' in errors[0])
+            assert(errors[0] == errors[1])
+        finally:
+            shutil.rmtree(tempdir)
+
     def test_multithread(self):
         self.log.info('test multiple threads accessing same resource')
         def mythread(env,threadid):
@@ -209,6 +434,49 @@ class TestEnvironment(EnvironmentSetup):
         for t in threads:
             t.join()
 
+    def test_parallelsensors(self):
+        self.log.info('read-only sensors stepped on several threads produce the same data as stepped serially')
+        env=self.env
+        # fcl is reentrant, so the sensors are stepped concurrently
+        env.SetCollisionChecker(RaveCreateCollisionChecker(env,'fcl_'))
+        self.LoadEnv('data/lab1.env.xml')
+        lasersxml = """<Robot name="lasers">
+  <KinBody>
+    <Body name="base"><Geom type="box"><extents>0.05 0.05 0.05</extents></Geom></Body>
+  </KinBody>
+  <AttachedSensor name="laser0">
+    <link>base</link>
+    <translation>0 0 0.8</translation>
+    <sensor type="BaseLaser2D"><minangle>-135</minangle><maxangle>135</maxangle><resolution>0.35</resolution><maxrange>5</maxrange><scantime>0.1</scantime></sensor>
+  </AttachedSensor>
+  <AttachedSensor name="laser1">
+    <link>base</link>
+    <translation>0 0 0.6</translation>
+    <rotationaxis>1 0 0 20</rotationaxis>
+    <sensor type="BaseLaser2D"><minangle>-90</minangle><maxangle>90</maxangle><resolution>0.5</resolution><maxrange>5</maxrange><scantime>0.1</scantime></sensor>
+  </AttachedSensor>
+</Robot>"""
+        with env:
+            robot = env.ReadRobotData(lasersxml)
+            env.Add(robot)
+            robot.SetTransform(matrixFromPose([1,0,0,0,0.5,-0.5,0]))
+            sensors = [attachedsensor.GetSensor() for attachedsensor in robot.GetAttachedSensors()]
+            for sensor in sensors:
+                sensor.Configure(Sensor.ConfigureCommand.PowerOn)
+
+        alldata = []
+        for numthreads in [1, 4]:
+            env.SetSimulationSensorThreads(numthreads)
+            assert(env.GetSimulationSensorThreads() == numthreads)
+            with env:
+                env.StepSimulation(0.1)
+            alldata.append([sensor.GetSensorData() for sensor in sensors])
+        for data0, data1 in zip(alldata[0], alldata[1]):
+            assert(len(data0.ranges) > 0 and len(data0.ranges) == len(data1.ranges))
+            assert(sum(abs(data0.ranges-data1.ranges)) <= g_epsilon)
+            assert(sum(abs(data0.positions-data1.positions)) <= g_epsilon)
+            assert(sum(abs(data0.intensity-data1.intensity)) <= g_epsilon)
+
     def test_dataccess(self):
         RaveDestroy()
         OPENRAVE_DATA = os.environ.get('OPENRAVE_DATA','')
@@ -545,3 +545,36 @@ class TestIkSolver(EnvironmentSetup):
         
         sol = r.GetActiveManipulator().FindIKSolution(Tee, 0)
         assert( sol is None)
+
+    def test_findiksolutionbatch(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        ikmodel = databases.inversekinematics.InverseKinematicsModel(robot,IkParameterization.Type.Transform6D)
+        if not ikmodel.load():
+            ikmodel.autogenerate()
+
+        with env:
+            manip = ikmodel.manip
+            lower,upper = robot.GetDOFLimits(manip.GetArmIndices())
+            orgvalues = robot.GetDOFValues()
+            # every thread solves at least 64 goals, so need enough of them to split
+            ikparams = []
+            with robot:
+                for i in range(200):
+                    robot.SetDOFValues(lower+random.rand(len(lower))*(upper-lower),manip.GetArmIndices())
+                    ikparams.append(manip.GetIkParameterization(IkParameterizationType.Transform6D))
+            filteroptions = IkFilterOptions.CheckEnvCollisions
+            expectedsolutions = [manip.FindIKSolution(ikparam,filteroptions) for ikparam in ikparams]
+            numsolved = len([sol for sol in expectedsolutions if sol is not None])
+            # need both goals with and without a solution
+            assert(numsolved > 0 and numsolved < len(ikparams))
+            for numthreads in [1, 3]:
+                solutions = manip.FindIKSolutionBatch(ikparams,filteroptions,numthreads)
+                assert(len(solutions) == len(ikparams))
+                assert(transdist(robot.GetDOFValues(),orgvalues) <= g_epsilon)
+                for sol, expectedsol in zip(solutions, expectedsolutions):
+                    if expectedsol is None:
+                        assert(sol is None)
+                    else:
+                        assert(sol is not None and transdist(sol,expectedsol) <= g_epsilon)
@@ -874,6 +874,118 @@ class TestKinematics(EnvironmentSetup):
         assert(J0a.GetMimicDOFIndices() == [0])
         assert(J0b.GetMimicDOFIndices() == [0])
 
+    def test_partialsetdofvalues(self):
+        self.log.info('check that setting a subset of the dofs gives the same link transforms as setting all of them')
+        env=self.env
+        xml="""
+<kinbody name="b">
+  <body name="L0">
+  </body>
+  <body name="L1">
+  </body>
+  <body name="L2">
+  </body>
+  <body name="L3">
+  </body>
+  <body name="L4">
+  </body>
+  <joint name="J0" type="hinge">
+    <body>L0</body>
+    <body>L1</body>
+    <axis>1 0 0</axis>
+    <anchor>0 0 0.1</anchor>
+  </joint>
+  <joint name="J1" type="hinge">
+    <body>L1</body>
+    <body>L2</body>
+    <axis>0 1 0</axis>
+    <anchor>0 0 0.2</anchor>
+  </joint>
+  <joint name="J1a" type="hinge" mimic_pos="2*J1+J0" mimic_vel="|J1 2 |J0 1" mimic_accel="|J1 0 |J0 0">
+    <body>L2</body>
+    <body>L3</body>
+    <axis>0 0 1</axis>
+    <anchor>0.1 0 0.3</anchor>
+  </joint>
+  <joint name="J0a" type="hinge" mimic_pos="-J0" mimic_vel="|J0 -1" mimic_accel="|J0 0">
+    <body>L0</body>
+    <body>L4</body>
+    <axis>0 1 0</axis>
+    <anchor>0 0.1 0</anchor>
+  </joint>
+</kinbody>
+"""
+        with env:
+            body = env.ReadKinBodyData(xml)
+            env.Add(body)
+            for robotfile in g_robotfiles:
+                env.Add(env.ReadRobotURI(robotfile))
+            for body in env.GetBodies():
+                if body.GetDOF() < 2:
+                    continue
+                lower,upper = body.GetDOFLimits()
+                for iter in range(20):
+                    values = randlimits(numpy.maximum(lower,-3),numpy.minimum(upper,3))
+                    body.SetDOFValues(values)
+                    # change a random subset of the dofs starting from values
+                    dofindices = [i for i in range(body.GetDOF()) if random.rand() < 0.5]
+                    if len(dofindices) == 0 or len(dofindices) == body.GetDOF():
+                        dofindices = [random.randint(body.GetDOF())]
+                    newvalues = randlimits(numpy.maximum(lower,-3),numpy.minimum(upper,3))
+                    body.SetDOFValues(newvalues[dofindices],dofindices)
+                    partialtransforms = body.GetLinkTransformations()
+                    partialvalues = body.GetDOFValues()
+                    passivevalues = [joint.GetValues() for joint in body.GetPassiveJoints()]
+                    allvalues = array(values)
+                    allvalues[dofindices] = newvalues[dofindices]
+                    body.SetDOFValues(allvalues)
+                    assert(transdist(body.GetDOFValues(),partialvalues) <= g_epsilon)
+                    for joint,jointvalues in zip(body.GetPassiveJoints(),passivevalues):
+                        assert(transdist(joint.GetValues(),jointvalues) <= g_epsilon)
+                    for link,T in zip(body.GetLinks(),partialtransforms):
+                        assert(transdist(link.GetTransform(),T) <= g_epsilon), 'body %s link %s differs when setting dofs %r'%(body.GetName(),link.GetName(),dofindices)
+
+    def test_unrolledkinematics(self):
+        self.log.info('check that the unrolled forward kinematics give the same link transforms as the generic forward kinematics')
+        env=self.env
+        # the kinematics geometry hash is rounded, so both arms have the same hash with different anchors
+        armxml="""<kinbody name="arm%d">
+  <body name="L0"><geom type="box"><extents>0.02 0.02 0.02</extents></geom></body>
+  <body name="L1"><geom type="box"><extents>0.02 0.02 0.02</extents></geom></body>
+  <body name="L2"><geom type="box"><extents>0.02 0.02 0.02</extents></geom></body>
+  <joint name="J0" type="hinge"><body>L0</body><body>L1</body><axis>1 0 0</axis><anchor>0 0 %f</anchor></joint>
+  <joint name="J1" type="slider"><body>L1</body><body>L2</body><axis>0 1 1</axis><anchor>0 0 0.2</anchor><limits>-0.5 0.5</limits></joint>
+</kinbody>"""
+        with env:
+            arms = []
+            for i, fanchor in enumerate([0.1, 0.10001]):
+                arm = env.ReadKinBodyData(armxml%(i, fanchor))
+                env.Add(arm)
+                arms.append(arm)
+            assert(arms[0].GetKinematicsGeometryHash() == arms[1].GetKinematicsGeometryHash())
+            for robotfile in g_robotfiles:
+                env.Add(env.ReadRobotURI(robotfile))
+            vbodytests = []
+            for body in env.GetBodies():
+                lower,upper = body.GetDOFLimits()
+                vvalues = [randlimits(numpy.maximum(lower,-3),numpy.minimum(upper,3)) for iter in range(20)]
+                vtransforms = []
+                for values in vvalues:
+                    body.SetDOFValues(values)
+                    vtransforms.append(body.GetLinkTransformations())
+                vbodytests.append((body,vvalues,vtransforms))
+            # enable all of them first, so that the arms would share a program if it were cached by the hash
+            unrolledbodies = [body for body in env.GetBodies() if body.SetUnrolledKinematicsGenerator(True)]
+            # mimic joints and closed loops are not supported
+            assert(all(arm in unrolledbodies for arm in arms) and len(unrolledbodies) > len(arms))
+            for body,vvalues,vtransforms in vbodytests:
+                for values,transforms in zip(vvalues,vtransforms):
+                    body.SetDOFValues(values)
+                    for link,T in zip(body.GetLinks(),transforms):
+                        assert(transdist(link.GetTransform(),T) <= g_epsilon), 'body %s link %s differs'%(body.GetName(),link.GetName())
+            for body in unrolledbodies:
+                assert(not body.SetUnrolledKinematicsGenerator(False))
+
     def test_specification(self):
         env=self.env
         self.LoadEnv('data/lab1.env.xml')
@@ -607,6 +607,251 @@ class RunPlanning(EnvironmentSetup):
             self.RunTrajectory(robot,traj1)
             self.RunTrajectory(robot,traj2)
 
+    def test_bisectionordercheck(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            manip=robot.GetActiveManipulator()
+            robot.SetActiveDOFs(manip.GetArmIndices())
+            params=Planner.PlannerParameters()
+            params.SetRobotActiveJoints(robot)
+            constraints=planningutils.DynamicsCollisionConstraint(params,[robot])
+            # count the checked states with a user constraint that always passes
+            numchecks = [0]
+            def usercheck():
+                numchecks[0] += 1
+                return True
+            constraints.SetUserCheckFunction(usercheck)
+            options = ConstraintFilterOptions.CheckEnvCollisions|ConstraintFilterOptions.CheckSelfCollisions|ConstraintFilterOptions.CheckUserConstraints|ConstraintFilterOptions.FillCheckedConfiguration
+            lower,upper=robot.GetActiveDOFLimits()
+            numinvalid = 0
+            numinvalidchecks = 0
+            numinvalidchecksbisection = 0
+            for i in range(100):
+                q0 = lower+random.rand(len(lower))*(upper-lower)
+                q1 = lower+random.rand(len(lower))*(upper-lower)
+                # check both linear segments and ramps, which start at rest and accelerate constantly to q1
+                if i % 2 == 0:
+                    dq0 = []
+                    dq1 = []
+                    timeelapsed = 0
+                else:
+                    timeelapsed = 2.0
+                    dq0 = zeros(len(q0))
+                    dq1 = 2*(q1-q0)/timeelapsed
+                numchecks[0] = 0
+                with robot:
+                    ret = constraints.Check(q0,q1,dq0,dq1,timeelapsed,Interval.Closed,options,True)
+                numchecksinorder = numchecks[0]
+                numchecks[0] = 0
+                with robot:
+                    retbisection = constraints.Check(q0,q1,dq0,dq1,timeelapsed,Interval.Closed,options|ConstraintFilterOptions.CheckInBisectionOrder,True)
+                numchecksbisection = numchecks[0]
+                assert((ret['returncode'] == 0) == (retbisection['returncode'] == 0))
+                if ret['returncode'] == 0:
+                    # every state has to be checked, only in a different order
+                    assert(numchecksinorder == numchecksbisection)
+                    for name in ['configurations', 'configurationtimes']:
+                        assert(len(ret[name]) == len(retbisection[name]))
+                        assert(sum(abs(ret[name]-retbisection[name])) <= g_epsilon)
+                else:
+                    numinvalid += 1
+                    numinvalidchecks += numchecksinorder
+                    numinvalidchecksbisection += numchecksbisection
+                    # the invalid state found in bisection order is not necessarily the earliest one
+                    assert(retbisection['fTimeWhenInvalid'] >= ret['fTimeWhenInvalid']-g_epsilon)
+                    invalidvalues = retbisection['invalidvalues']
+                    assert(len(invalidvalues) == len(q0))
+                    with robot:
+                        assert(constraints.Check(invalidvalues,invalidvalues,[],[],0,Interval.Closed,options) != 0)
+                    # the configurations are cut at the invalid state, so both are the start of the same interpolation
+                    configurations = ret['configurations']
+                    configurationsbisection = retbisection['configurations']
+                    numcommon = min(len(configurations),len(configurationsbisection))
+                    assert(sum(abs(configurations[:numcommon]-configurationsbisection[:numcommon])) <= g_epsilon)
+            # need both valid and invalid segments
+            assert(numinvalid > 0 and numinvalid < 100)
+            # the invalid segments are rejected with fewer checks
+            self.log.info('invalid segments checked %d states in order and %d in bisection order', numinvalidchecks, numinvalidchecksbisection)
+            assert(numinvalidchecksbisection < numinvalidchecks)
+            constraints.SetUserCheckFunction(None)
+
+    def test_parallelbirrt(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            manip=robot.GetActiveManipulator()
+            robot.SetActiveDOFs(manip.GetArmIndices())
+            start=robot.GetActiveDOFValues()
+            goal=array(start)
+            goal[0] = -0.5
+            goal[3] = -1.6
+            with robot:
+                robot.SetActiveDOFValues(goal)
+                assert(not env.CheckCollision(robot) and not robot.CheckSelfCollision())
+
+            planner=RaveCreatePlanner(env,'ParallelBiRRT')
+            planner.SendCommand('SetNumSearches 3')
+            params=Planner.PlannerParameters()
+            params.SetRobotActiveJoints(robot)
+            params.SetGoalConfig(goal)
+            params.SetExtraParameters('<_nmaxiterations>5000</_nmaxiterations>')
+            # plan twice to check that the cloned environments are correctly re-synchronized
+            for iplan in range(2):
+                assert(planner.InitPlan(robot,params))
+                traj=RaveCreateTrajectory(env,'')
+                assert(planner.PlanPath(traj)==PlannerStatusCode.HasSolution)
+                assert(traj.GetNumWaypoints() >= 2)
+                spec=robot.GetActiveConfigurationSpecification()
+                assert(sum(abs(traj.GetWaypoint(0,spec)-start)) <= g_epsilon)
+                assert(sum(abs(traj.GetWaypoint(-1,spec)-goal)) <= g_epsilon)
+                # the robot in the source environment is never moved by the searches
+                assert(sum(abs(robot.GetActiveDOFValues()-start)) <= g_epsilon)
+                assert(planningutils.RetimeActiveDOFTrajectory(traj,robot,False)==PlannerStatusCode.HasSolution)
+                with robot:
+                    planningutils.VerifyTrajectory(params,traj,samplingstep=0.002)
+
+    def test_rrtnearestneighbortype(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            manip=robot.GetActiveManipulator()
+            robot.SetActiveDOFs(manip.GetArmIndices())
+            start=robot.GetActiveDOFValues()
+            goal=array(start)
+            goal[0] = -0.5
+            goal[3] = -1.6
+            lower,upper = robot.GetActiveDOFLimits()
+            weights2 = robot.GetActiveDOFWeights()**2
+            sampler = RaveCreateSpaceSampler(env, u'MT19937')
+            sampler.SetSpaceDOF(robot.GetActiveDOF())
+            for plannername in ['BiRRT','BasicRRT']:
+                for nearestneighbortype in [0,1]:
+                    planner=RaveCreatePlanner(env,plannername)
+                    params=Planner.PlannerParameters()
+                    params.SetRobotActiveJoints(robot)
+                    params.SetGoalConfig(goal)
+                    params.SetExtraParameters('<_nmaxiterations>5000</_nmaxiterations><nearestneighbortype>%d</nearestneighbortype>'%nearestneighbortype)
+                    assert(planner.InitPlan(robot,params))
+                    assert(int(planner.SendCommand('GetNearestNeighborType')) == nearestneighbortype)
+                    traj=RaveCreateTrajectory(env,'')
+                    assert(planner.PlanPath(traj)==PlannerStatusCode.HasSolution)
+                    spec=robot.GetActiveConfigurationSpecification()
+                    assert(sum(abs(traj.GetWaypoint(0,spec)-start)) <= g_epsilon)
+                    assert(sum(abs(traj.GetWaypoint(-1,spec)-goal)) <= g_epsilon)
+                    with robot:
+                        planningutils.VerifyTrajectory(params,traj,samplingstep=0.002)
+
+                    if nearestneighbortype == 1:
+                        # the flat index has to find the same neighbor as the cover tree on the nodes of the search
+                        for iquery in range(200):
+                            q = lower + (upper-lower)*sampler.SampleSequence(SampleDataType.Real,1)
+                            querystring = ' '.join(repr(x) for x in q)
+                            nnflat = [float(x) for x in planner.SendCommand('FindNearestNode 0 '+querystring).split()]
+                            nncovertree = [float(x) for x in planner.SendCommand('FindNearestNode 1 '+querystring).split()]
+                            assert(abs(nnflat[0]-sqrt(sum(weights2*(array(nnflat[1:])-q)**2))) <= g_epsilon)
+                            # nodes can tie, so compare the distances of the returned configurations
+                            assert(abs(nnflat[0]-nncovertree[0]) <= g_epsilon)
+                            assert(abs(nnflat[0]-sqrt(sum(weights2*(array(nncovertree[1:])-q)**2))) <= g_epsilon)
+
+    def test_graspthreadedpool(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        target=env.GetKinBody('mug1')
+        gmodel = databases.grasping.GraspingModel(robot=robot,target=target)
+        grasper = interfaces.Grasper(robot,friction=0.3)
+        with env:
+            manip=robot.GetActiveManipulator()
+            approachrays = gmodel.computeBoxApproachRays(delta=0.04)[::4]
+            approachrays[:,3:6] = -approachrays[:,3:6]
+            # move the target away from the rest of the scene so that only the target can be touched
+            Ttarget = eye(4)
+            Ttarget[2,3] = 10
+            target.SetTransform(Ttarget)
+            robot.SetTransform(eye(4))
+            robot.SetActiveDOFs(manip.GetGripperIndices(),DOFAffine.X|DOFAffine.Y|DOFAffine.Z)
+            preshapes = array([robot.GetDOFValues(manip.GetGripperIndices())])
+            rolls = array([0,pi/2])
+            standoffs = array([0,0.025])
+            manipulatordirections = array([manip.GetLocalToolDirection()])
+            numgrasps = len(approachrays)*len(rolls)*len(standoffs)*len(preshapes)*len(manipulatordirections)
+            graspargs = dict(approachrays=approachrays,standoffs=standoffs,preshapes=preshapes,rolls=rolls,manipulatordirections=manipulatordirections,target=target)
+
+            def GetGraspKey(grasp):
+                return tuple(round(f,6) for f in r_[grasp[0],grasp[1],grasp[2],grasp[3]])
+            def GetGraspDict(grasps):
+                graspdict = dict((GetGraspKey(grasp),grasp) for grasp in grasps)
+                assert(len(graspdict) == len(grasps))
+                return graspdict
+            def CheckSameGrasps(grasps,refgrasps,offset=zeros(3),epsilon=g_epsilon):
+                graspdict = GetGraspDict(grasps)
+                assert(sorted(graspdict.keys()) == sorted(refgrasps.keys()))
+                for key,grasp in graspdict.items():
+                    refgrasp = refgrasps[key]
+                    assert(transdist(grasp[8][0:3,0:3],refgrasp[8][0:3,0:3]) <= epsilon)
+                    assert(transdist(grasp[8][0:3,3],refgrasp[8][0:3,3]+offset) <= epsilon)
+                    assert(transdist(grasp[9],refgrasp[9]) <= epsilon)
+
+            self.log.info('workers kept between the jobs have to return the same grasps as workers destroyed after the job')
+            nextid,grasps = grasper.GraspThreaded(numthreads=2,keepworkers=0,**graspargs)
+            assert(nextid == numgrasps)
+            assert(len(grasps) > 2)
+            refgrasps = GetGraspDict(grasps)
+            for ijob in range(2):
+                nextid,grasps = grasper.GraspThreaded(numthreads=2,**graspargs)
+                assert(nextid == numgrasps)
+                CheckSameGrasps(grasps,refgrasps)
+
+            self.log.info('maxgrasps stops the job at the first grasp, resuming from nextid has to find the remaining grasps')
+            grasps = []
+            nextid = 0
+            while nextid < numgrasps:
+                newnextid,newgrasps = grasper.GraspThreaded(numthreads=1,startindex=nextid,maxgrasps=1,**graspargs)
+                assert(newnextid > nextid)
+                assert(len(newgrasps) <= 1)
+                if newnextid < numgrasps:
+                    # stopped early
+                    assert(len(newgrasps) == 1)
+                nextid = newnextid
+                grasps += newgrasps
+            CheckSameGrasps(grasps,refgrasps)
+
+            self.log.info('streaming the grasps has to return the same grasps')
+            assert(grasper.StartGraspThreaded(numthreads=2,**graspargs) == numgrasps)
+            grasps = []
+            isfinished = False
+            while not isfinished:
+                nextid,isfinished,newgrasps = grasper.GetGraspThreadedResults(wait=True)
+                grasps += newgrasps
+            assert(nextid == numgrasps)
+            assert(grasper.StopGraspThreaded() == numgrasps)
+            CheckSameGrasps(grasps,refgrasps)
+
+            self.log.info('stopping a streamed job and resuming from the returned id')
+            grasper.StartGraspThreaded(numthreads=2,**graspargs)
+            nextid,isfinished,grasps = grasper.GetGraspThreadedResults(wait=True)
+            nextid = grasper.StopGraspThreaded()
+            stoppednextid,isfinished,newgrasps = grasper.GetGraspThreadedResults()
+            assert(isfinished and stoppednextid == nextid)
+            grasps += newgrasps
+            if nextid < numgrasps:
+                newnextid,newgrasps = grasper.GraspThreaded(numthreads=2,startindex=nextid,**graspargs)
+                assert(newnextid == numgrasps)
+                grasps += newgrasps
+            CheckSameGrasps(grasps,refgrasps)
+
+            self.log.info('the workers have to see the bodies that changed between the jobs')
+            offset = array([1.0,0,0])
+            Ttarget[0:3,3] += offset
+            target.SetTransform(Ttarget)
+            nextid,grasps = grasper.GraspThreaded(numthreads=2,**graspargs)
+            assert(nextid == numgrasps)
+            CheckSameGrasps(grasps,refgrasps,offset=offset,epsilon=1e-3)
+
     def test_jittertransform(self):
         env=self.env
         self.LoadEnv('data/lab1.env.xml')
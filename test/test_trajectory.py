@@ -752,6 +752,45 @@ class TestTrajectory(EnvironmentSetup):
         sampledata=traj.Sample(1.5,velspec)
         assert(transdist(sampledata, array([-1. ,  0. ,  0. ,  0. ,  0. , -0.5,  0. ])) <= g_epsilon)
 
+    def test_speculativeshortcutting(self):
+        self.log.info('speculative shortcutting has to terminate and give the same result with one and many workers')
+        env = self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            robot.SetActiveDOFs(robot.GetActiveManipulator().GetArmIndices())
+            lower,upper = robot.GetActiveDOFLimits()
+            random.seed(0)
+            traj = RaveCreateTrajectory(env,'')
+            traj.Init(robot.GetActiveConfigurationSpecification('linear'))
+            traj.Insert(0,robot.GetActiveDOFValues())
+            with robot:
+                # a zig-zag of collision-free waypoints leaves a lot to shortcut
+                basevalues = robot.GetActiveDOFValues()
+                while traj.GetNumWaypoints() < 6:
+                    values = basevalues + 0.3*(random.rand(robot.GetActiveDOF())-0.5)
+                    values = numpy.minimum(numpy.maximum(values,lower),upper)
+                    robot.SetActiveDOFValues(values)
+                    if not env.CheckCollision(robot) and not robot.CheckSelfCollision():
+                        traj.Insert(traj.GetNumWaypoints(),values)
+            results = []
+            for numworkers in [1,4]:
+                planner = RaveCreatePlanner(env,'parabolicsmoother2')
+                assert(planner.SendCommand('SetNumShortcutCandidates 8 %d'%numworkers) is not None)
+                params = Planner.PlannerParameters()
+                params.SetRobotActiveJoints(robot)
+                params.SetRandomGeneratorSeed(1234)
+                params.SetMaxIterations(100)
+                assert(planner.InitPlan(robot,params))
+                smoothedtraj = RaveClone(traj,0)
+                assert(planner.PlanPath(smoothedtraj)==PlannerStatusCode.HasSolution)
+                results.append(smoothedtraj)
+            assert(results[0].GetNumWaypoints() == results[1].GetNumWaypoints())
+            assert(abs(results[0].GetDuration()-results[1].GetDuration()) <= g_epsilon)
+            for i in range(results[0].GetNumWaypoints()):
+                assert(transdist(results[0].GetWaypoint(i),results[1].GetWaypoint(i)) <= g_epsilon)
+            self.RunTrajectory(robot,results[1])
+
     def test_insertionsmoothing(self):
         env=self.env
         env.Load('robots/kawada-hironx.zae')
@@ -866,3 +905,27 @@ class TestTrajectory(EnvironmentSetup):
         planningutils.SegmentTrajectory(traj, startoffset, duration)
         assert( abs(traj.GetDuration() - (duration-startoffset)) <= g_epsilon )
 
+
+    def test_samplepointsbatch(self):
+        env=self.env
+        trajstr = '''<trajectory>
+<configuration>
+<group name="deltatime" offset="12" dof="1" interpolation=""/>
+<group name="joint_velocities muratecpicker0 0 1 2 3 4 5" offset="6" dof="6" interpolation="linear"/>
+<group name="joint_values muratecpicker0 0 1 2 3 4 5" offset="0" dof="6" interpolation="quadratic"/>
+<group name="iswaypoint" offset="13" dof="1" interpolation="next"/>
+</configuration>
+<data count="3">
+0.6117269650558744 0.9266602002674107 0.8438166789174414 0 1.371115774404944 -0.9590693617390226 0 0 0 0 0 0 0 1 1.17529158313744 0.189183598445679 1.49708779104353 -0.001910739864792349 1.446569660068643 0.1559566101894805 2.196724161297836 -2.874617422095069 2.546392001631284 -0.00744789202919198 0.294112455578719 4.346270887885016 0.5130954791780579 0 1.738856201219005 -0.5482930033760525 2.150358903169619 -0.003821479729584697 1.522023545732342 1.270982582117983 0 0 0 0 0 0 0.5130954791780579 1 </data>
+</trajectory>
+        '''
+        traj=RaveCreateTrajectory(env, '')
+        traj.deserialize(trajstr)
+        times = arange(0, traj.GetDuration(), 0.001)
+        # batch sampling has to give the same results as sampling one time at a time, also when times go backwards
+        for sampletimes in [times, r_[times, times[::-1]]]:
+            batchdata = traj.SamplePoints2D(sampletimes)
+            for i, t in enumerate(sampletimes):
+                assert( transdist(batchdata[i], traj.Sample(t)) <= g_epsilon )
+        deltatimedata = traj.SamplePointsSameDeltaTime2D(0.001, True)
+        assert( transdist(deltatimedata[-1], traj.GetWaypoint(-1)) <= g_epsilon )